@@ -32,6 +32,7 @@
 #include "rOperators.h"
 #include "symsecs.h"
 #include "network.h"
+#include "qnhash.h"
 
 struct newtooldmatvec {
         int oldsb;
@@ -77,6 +78,8 @@ struct Heffdata {
         struct symsecs symarr[STEPSPECS_MSITES][3];
         /// The @ref symsecs for the MPO bonds.
         struct symsecs MPOsymsec;
+        /// The irrep arithmetic and prefactors for the symmetries.
+        const struct symmetryKernels * kern;
 
         /** The site for each @ref rOperators where it should be attached.
          *
@@ -114,6 +117,13 @@ struct Heffdata {
          * <tt>@ref siteObject.{@link siteTensor.qnumbers qnumbers}[@ref siteObject.{@link siteTensor.nrsites nrsites} * i + @ref posB]</tt> 
          * for all @p i */
         QN_TYPE * qnB_arr;
+        /// Index on @ref qnB_arr.
+        struct qnhash qnB_hash;
+        /** Index on the qnumbers of every MPO symsec of @ref Operators.
+         *
+         * See @ref init_qnhash_rOperators. NULL for the unused 
+         * <tt>Operators[2]</tt> of DMRG. */
+        struct qnhash * Operators_hash[3];
         /** For every qnB' in @ref qnB_arr, gives number of elements in @ref qnBtoqnB_arr.
          *
          * For \f[\Psi' = H_{eff}\Psi\f] 
@@ -26,6 +26,7 @@
  * mutual information out of it. */
 
 #include "siteTensor.h"
+#include "hamiltonian.h"
 
 /// Maximal RDM that can be calculated is the #MAX_RDM-body RDM.
 #define MAX_RDM 2
@@ -43,7 +44,10 @@ struct RedDM {
          * with<br>
          * \f$Γ(iσ)(jτ);(kσ)(lτ) = 〈a^†_{iσ}a^†_{jτ}a_{lτ}a_{kσ}〉\f$
          *
-         * **NOTE: This is not implemented yet.**
+         * Both are stored in full as \f$Γ(ij;kl)\f$ at 
+         * <tt>chemRDM[·][((i L + j) L + k) L + l]</tt> with \f$L\f$ the number
+         * of orbitals, or NULL if not calculated. Only for the states supported
+         * by @ref check_opstrings_support.
          */
         T3NS_EL_TYPE * chemRDM[2];
 
@@ -71,17 +75,106 @@ struct RedDM {
 /**
  * @brief Calculates the RDMs of the current T3NS.
  *
- * @param T3NS [in] The current Tree Tensor Network
+ * The environments of all bonds are made in one traversal of the network, so
+ * no orthogonality center is needed and the T3NS is left untouched.
+ *
+ * @param T3NS [in] The current Tree Tensor Network, it should be normed.
  * @param rdm [out] The resulting RedDM structure
  * @param mrdm [in] The maximal RDM to be calculated.
  * This can not be larger than #MAX_RDM.
  * @param chemRDM [in] 0 if @ref RedDM @p rdm->chemRDM should not be calculated, 
- * 1 if they should.
+ * 1 if they should. For states with SU(2) symmetry an error is returned, see
+ * @ref check_opstrings_support.
  * @return 0 if successful, 1 if error occured.
  */
-int get_RedDMs(struct siteTensor * T3NS, struct RedDM * rdm, 
+int get_RedDMs(const struct siteTensor * T3NS, struct RedDM * rdm, 
                int mrdm, int chemRDM);
 
+/**
+ * @brief Calculates the spin-summed 1- and 2-RDM and writes them to a file.
+ *
+ * \f$Γ_{ijkl} = Σ_{στ}〈a^†_{iσ}a^†_{jτ}a_{lτ}a_{kσ}〉\f$ and
+ * \f$γ_{ik} = Σ_σ〈a^†_{iσ}a_{kσ}〉\f$ in the orbital order of the 
+ * Hamiltonian. The elements are evaluated by inserting their operators in the
+ * environments of @ref get_RedDMs. For every \f$ij\f$ the environments with
+ * \f$a^†_{iσ}a^†_{jτ}\f$ are made once, and for every \f$l\f$ the ones
+ * with \f$a_{lτ}\f$ added, so every element only needs the contraction of
+ * the site of \f$k\f$. The slices \f$Γ_{ij\cdot\cdot}\f$ are divided 
+ * over the threads and written as soon as they are made, so the full 2-RDM is
+ * never stored in memory.
+ *
+ * The renormalized operators of the optimization are not used, they fold the
+ * integrals in complementary operators and do not give separate elements.
+ *
+ * Only implemented for the quantum chemistry Hamiltonian with U(1) × U(1)
+ * symmetry. For states with SU(2) symmetry an error is returned before
+ * anything is calculated (see @ref check_opstrings_support), optimize them
+ * with U(1) for the spin projection instead.
+ *
+ * @param T3NS [in] The current Tree Tensor Network, it should be normed.
+ * @param filename [in] The HDF5-file to write to, see @ref open_2RDM_stream.
+ * @return 0 if successful, 1 if error occured.
+ */
+int write_2RDM(const struct siteTensor * T3NS, const char * filename);
+
+/**
+ * @brief Checks if @ref write_2RDM, @ref get_2RDM and 
+ * @ref get_mutualInformation support a state, before anything is calculated.
+ *
+ * The operator strings are evaluated in the U(1) × U(1) symmetry sectors of
+ * the quantum chemistry Hamiltonian, other states are rejected with an error.
+ *
+ * @param [in] hamtype The Hamiltonian of the state.
+ * @param [in] nrSyms The number of symmetries of the state.
+ * @param [in] sgs The symmetries of the state.
+ * @param [in] what What is calculated, for the error message.
+ * @return 0 if supported, 1 if not.
+ */
+int check_opstrings_support(enum hamtypes hamtype, int nrSyms,
+                            const enum symmetrygroup * sgs, const char * what);
+
+/**
+ * @brief Calculates the spin-summed 1- and 2-RDM in memory.
+ *
+ * Same elements as @ref write_2RDM, but written in arrays of the caller, e.g.
+ * the buffers of NumPy arrays, so no copy is needed to hand them over.
+ * \f$γ_{ik}\f$ is at <tt>onerdm[i L + k]</tt> and \f$Γ_{ijkl}\f$ at 
+ * <tt>twordm[((i L + j) L + k) L + l]</tt>. The full 2-RDM is stored, so
+ * for large \f$L\f$ @ref write_2RDM is preferred.
+ *
+ * @param T3NS [in] The current Tree Tensor Network, it should be normed.
+ * @param onerdm [out] The \f$L^2\f$ elements of the 1-RDM, already allocated.
+ * @param twordm [out] The \f$L^4\f$ elements of the 2-RDM, already allocated.
+ * If `NULL`, only the 1-RDM is calculated.
+ * @return 0 if successful, 1 if error occured.
+ */
+int get_2RDM(const struct siteTensor * T3NS, T3NS_EL_TYPE * onerdm,
+             T3NS_EL_TYPE * twordm);
+
+/**
+ * @brief Calculates the orbital entropies and the mutual information.
+ *
+ * The orbital entropy \f$S_i\f$ and the two-orbital entropy \f$S_{ij}\f$
+ * follow from the eigenvalues of the one- and two-orbital RDMs. These RDMs
+ * are made by evaluating transition operators in the environments of 
+ * @ref get_RedDMs. The pairs of orbitals are divided over the threads.
+ *
+ * The mutual information is 
+ * \f$I_{ij} = \frac{1}{2}(S_i + S_j - S_{ij})(1 - δ_{ij})\f$. 
+ * Both are in the orbital order of the Hamiltonian.
+ *
+ * Only implemented for the quantum chemistry Hamiltonian with U(1) × U(1)
+ * symmetry, see @ref write_2RDM.
+ *
+ * @param T3NS [in] The current Tree Tensor Network, it should be normed.
+ * @param entropy [out] The \f$L\f$ orbital entropies, already allocated.
+ * @param Iij [out] The \f$L^2\f$ elements of the mutual information, 
+ * already allocated.
+ * @return 0 if successful, 1 if error occured.
+ */
+int get_mutualInformation(const struct siteTensor * T3NS, double * entropy,
+                          double * Iij);
+
 /**
  * @brief Destroys a RedDM structure.
  *
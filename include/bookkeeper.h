@@ -18,6 +18,7 @@
 
 #include "symmetries.h"
 #include "symsecs.h"
+#include "context.h"
 
 /**
  * @file bookkeeper.h
@@ -48,10 +49,40 @@ struct bookkeeper {
         int psites;
         /// List of the symsecs of each physical bond.
         struct symsecs * p_symsecs;
+        /** The irrep arithmetic and prefactors for @ref sgs, resolved once by
+         * @ref set_symmetry_kernels. */
+        const struct symmetryKernels * kernels;
 };
 
-/// The global bookkeeper
-extern struct bookkeeper bookie;
+/// The bookkeeper, in the current context (see context.h).
+#define bookie (*CONTEXT_STATE(struct bookkeeper, CONTEXT_BOOKKEEPER))
+
+/**
+ * @brief Sets a thread-private replacement for the global bookie.
+ *
+ * Until it is reset with NULL, the calling thread uses the given bookkeeper
+ * (e.g. made by @ref deep_copy_bookkeeper) instead of bookie in 
+ * @ref get_symsecs, @ref get_symsecs_arr and @ref get_bookie.
+ * Other threads are not affected.
+ *
+ * @param [in] keeper The bookkeeper to use or NULL.
+ */
+void set_bookie_view(struct bookkeeper * keeper);
+
+/// Returns the bookkeeper used by the calling thread.
+struct bookkeeper * get_bookie(void);
+
+/**
+ * @brief Resolves the kernels of the symmetries in the bookkeeper.
+ *
+ * Called by @ref preparebookkeeper and when reading the bookkeeper from
+ * disk, so the block loops use the resolved function pointers without
+ * looking them up again. Call it again if the symmetries change
+ * afterwards.
+ *
+ * @param [in,out] keeper The bookkeeper.
+ */
+void set_symmetry_kernels(struct bookkeeper * keeper);
 
 /**
  * \brief Frees the memory allocated to the global bookie variable.
@@ -151,6 +182,23 @@ int translate_DOCI_to_qchem(struct bookkeeper * keeper,
 
 struct bookkeeper shallow_copy_bookkeeper(struct bookkeeper * tocopy);
 
+/**
+ * @brief Prepares the bookkeeper for a new calculation or for the
+ * continuation of a previous one.
+ *
+ * When continuing with minimal occupied states, the sectors are only
+ * replaced if one of the bonds changes. If all sectors are still populated,
+ * the previous symsecs are kept and @p changedSS stays 0. This is also
+ * done between the regimes of @ref execute_optScheme with a different bond
+ * dimension.
+ *
+ * @param [in] prevbookie The bookkeeper of the previous calculation or NULL.
+ * @param [in] max_dim The maximal dimension of the bonds.
+ * @param [in] interm_scale Scale for the dimension of the branching bonds.
+ * @param [in] minocc The minimal dimension of every symmetry sector.
+ * @param [out] changedSS Set to 1 if the symsecs differ from prevbookie.
+ * @return 0 on success, 1 on failure.
+ */
 int preparebookkeeper(struct bookkeeper * prevbookie, int max_dim,
                       int interm_scale, int minocc, int * changedSS);
 
@@ -0,0 +1,166 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <stddef.h>
+
+/**
+ * @file context.h
+ *
+ * The calculation context, i.e. everything of a calculation that used to be
+ * a global of the library.
+ *
+ * The network (@ref netw), the bookkeeper (@ref bookie), the Hamiltonian and
+ * the statics of the modules that build the operators and instructions all
+ * live in a @ref t3ns_context. Every thread works in one context, by default
+ * the context of the process, which is what the executables use.
+ *
+ * To run several calculations concurrently in one process, every calculation
+ * creates its own context with @ref create_context and passes it to the entry
+ * points of the optimizer (optimize_network.h) and of the decompositions
+ * (@ref decompose_siteTensor, @ref qr_step and @ref expand_step). These select
+ * the context in the calling thread for the duration of the call, NULL selects
+ * the default context of the process. Other functions work in the context
+ * selected with @ref use_context. The threads of the parallel regions of the
+ * library inherit the context of the thread that starts the region (through
+ * `copyin(t3ns_ctx)`), so within a calculation everything is shared exactly
+ * as it was with the globals.
+ *
+ * The state of a module is allocated and zero-initialized the first time it is
+ * used in a context, which corresponds with the zero-initialization of the
+ * former globals.
+ */
+
+/// The slots for the state of the different modules in a context.
+enum context_slot {
+        CONTEXT_NETWORK,        ///< @ref netw
+        CONTEXT_SWEEP,          ///< The position in the sweep of the network.
+        CONTEXT_BOOKKEEPER,     ///< @ref bookie
+        CONTEXT_HAMTYPE,        ///< The type of the Hamiltonian.
+        CONTEXT_HAMILTONIAN,    ///< The interaction string of the Hamiltonian.
+        CONTEXT_QC,             ///< The quantum chemistry Hamiltonian.
+        CONTEXT_DOCI,           ///< The DOCI Hamiltonian.
+        CONTEXT_NN_HUBBARD,     ///< The nearest neighbour Hubbard Hamiltonian.
+        CONTEXT_OPTYPE,         ///< The operator types of the bonds.
+        CONTEXT_OPTYPE_QC,      ///< The operator types of the qchem ones.
+        CONTEXT_INSTRUCTIONS,   ///< The stored instructions.
+        CONTEXT_BUPDATE,        ///< The helper of the branching updates.
+        CONTEXT_MULTISITE,      ///< The helper for the multi-site tensors.
+        CONTEXT_PERMUTE,        ///< The helper for the permutations.
+        CONTEXT_OPTIMIZE,       ///< The snapshot and progress callback.
+        NR_CONTEXT_SLOTS
+};
+
+/** The locks of a context, for the helpers that are shared by the threads of
+ * one calculation (e.g. the branches of a parallel sweep). Calculations in
+ * other contexts do not wait for them. */
+enum context_lock {
+        CONTEXT_LOCK_BUPDATE,           ///< The helper of the branching updates.
+        CONTEXT_LOCK_MULTISITE,         ///< The multi-site and permute helpers.
+        CONTEXT_LOCK_INSTRUCTIONS,      ///< Filling the stored instructions.
+        CONTEXT_LOCK_PROGRESS,          ///< The calls of the progress callback.
+        NR_CONTEXT_LOCKS
+};
+
+/// A calculation context.
+struct t3ns_context {
+        /// The states of the modules, NULL if not used yet.
+        void * state[NR_CONTEXT_SLOTS];
+        /// The locks of the context, NULL if not used yet.
+        void * locks;
+};
+
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__INTEL_COMPILER)
+/* The context is looked up for every access to the state, the static TLS
+ * model avoids a call to __tls_get_addr in the shared library for each. */
+#define CONTEXT_TLS _Thread_local __attribute__((tls_model("initial-exec")))
+#else
+#define CONTEXT_TLS
+#endif
+
+/// The context of the calling thread.
+extern CONTEXT_TLS struct t3ns_context * t3ns_ctx;
+#pragma omp threadprivate(t3ns_ctx)
+
+/**
+ * @brief Allocates the state of a slot of a context.
+ *
+ * Use @ref context_state instead.
+ */
+void * context_allocate(struct t3ns_context * ctx, enum context_slot slot,
+                        size_t size);
+
+/**
+ * @brief Returns the state of a slot in a context.
+ *
+ * @param [in] ctx The context.
+ * @param [in] slot The slot.
+ * @param [in] size The size of the state, only used the first time.
+ * @return The state, zero-initialized at its first use.
+ */
+static inline void * context_state(struct t3ns_context * ctx,
+                                   enum context_slot slot, size_t size)
+{
+        /* A plain read, such that the compiler can reuse it within a function.
+         * A slot is only set once, a thread that still sees NULL rechecks it
+         * in the critical section of context_allocate. */
+        void * state = ctx->state[slot];
+        return state != NULL ? state : context_allocate(ctx, slot, size);
+}
+
+/// The state of @p type in @p slot of the context @p ctx.
+#define CONTEXT_STATE_OF(ctx, type, slot) \
+        ((type *) context_state((ctx), (slot), sizeof(type)))
+
+/// The state of @p type in @p slot of the current context.
+#define CONTEXT_STATE(type, slot) CONTEXT_STATE_OF(t3ns_ctx, type, slot)
+
+/**
+ * @brief Takes a lock of the current context.
+ *
+ * Used instead of a named critical section, which would also wait for the
+ * calculations in other contexts. The lock is not recursive.
+ *
+ * @param [in] lock The lock.
+ */
+void context_lock(enum context_lock lock);
+
+/// Releases a lock of the current context taken by @ref context_lock.
+void context_unlock(enum context_lock lock);
+
+/// Creates a new and empty context.
+struct t3ns_context * create_context(void);
+
+/**
+ * @brief Destroys a context.
+ *
+ * The network, bookkeeper, Hamiltonian and instructions of the context are
+ * destroyed. The context should not be in use by any thread.
+ *
+ * @param [in] ctx The context.
+ */
+void destroy_context(struct t3ns_context * ctx);
+
+/// @p ctx, or the default context of the process if it is NULL.
+struct t3ns_context * context_or_default(struct t3ns_context * ctx);
+
+/**
+ * @brief Selects the context of the calling thread.
+ *
+ * @param [in] ctx The context, NULL for the default context of the process.
+ * @return The previous context of the calling thread, to restore it later.
+ */
+struct t3ns_context * use_context(struct t3ns_context * ctx);
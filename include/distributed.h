@@ -0,0 +1,74 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <stdbool.h>
+
+/** 
+ * @file distributed.h
+ *
+ * Helpers for running a calculation over several MPI processes.
+ *
+ * Every process keeps a full copy of the wave function and the renormalized
+ * operators and runs the same Davidson iterations. Only the loops over the
+ * symmetry blocks of the matrix-vector product of the effective Hamiltonian
+ * and of the updates of the renormalized operators are divided over the
+ * processes, the partial results are summed afterwards. This spreads the
+ * compute, but not the memory: the operators are not partitioned.
+ *
+ * Without MPI support (`T3NS_WITH_MPI` not defined) or if MPI is not
+ * initialized, everything behaves as a single process.
+ */
+
+/**
+ * @brief Initializes MPI if compiled with MPI support.
+ *
+ * Only the root process keeps writing to stdout.
+ *
+ * @param [in,out] argc Pointer to the number of arguments of main.
+ * @param [in,out] argv Pointer to the arguments of main.
+ */
+void init_distributed(int * argc, char *** argv);
+
+/// Finalizes MPI if it was initialized by @ref init_distributed.
+void finalize_distributed(void);
+
+/// Returns the rank of this process, 0 without MPI.
+int get_rank(void);
+
+/// Returns the number of processes, 1 without MPI.
+int get_nr_ranks(void);
+
+/// Returns true if the work item @p i is assigned to this process.
+bool is_my_work(long i);
+
+/**
+ * @brief Sums an array elementwise over all processes.
+ *
+ * All processes should call this with the same @p n. The result is
+ * available on all processes.
+ */
+void sum_over_ranks(double * arr, long n);
+
+/// Overwrites @p arr on every process with the one of the root process.
+void broadcast_from_root(double * arr, long n);
+
+/**
+ * @brief Returns a seed for the random number generator.
+ *
+ * It is the same on all processes, so they make the same random choices.
+ */
+unsigned int common_seed(void);
@@ -19,6 +19,7 @@
 
 #include "bookkeeper.h"
 #include "symmetries.h"
+#include "context.h"
 
 /**
  * \file hamiltonian.h
@@ -27,7 +28,14 @@
  * At this moment only the quantum chemistry hamiltonian.
  */
 
-extern enum hamtypes {INVALID_HAM, QC, NN_HUBBARD, DOCI} ham;
+/// The implemented hamiltonians.
+enum hamtypes {INVALID_HAM, QC, NN_HUBBARD, DOCI};
+
+/// The hamiltonian, in the current context (see context.h).
+#define ham (*CONTEXT_STATE(enum hamtypes, CONTEXT_HAMTYPE))
+
+/// Returns the hamiltonian of the current context, for the bindings.
+enum hamtypes * get_ham(void);
 
 void destroy_hamiltonian(void);
 
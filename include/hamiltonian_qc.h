@@ -75,7 +75,16 @@ void QC_reinit_hamiltonian(void);
 /**
  * Makes the QC hamiltonian from the integrals passed by pyscf.
  *
- * Both h1e and eri need to be full.
+ * h1e needs to be full, eri can be full or packed as in pyscf, see
+ * @ref read_integrals. The arrays are only read, the caller keeps ownership.
  */
-void QC_ham_from_integrals(int norb, int * irrep, double * h1e, double * eri,
-                           double enuc, int ps, int su2, int has_seniority);
+void QC_ham_from_integrals(int norb, int * irrep, const double * h1e,
+                           const double * eri, int packed, double enuc, int ps,
+                           int su2, int has_seniority);
+
+/**
+ * Gives a block of the integrals of the current hamiltonian without copying.
+ *
+ * See @ref qcH_block. The block is valid until the hamiltonian is destroyed.
+ */
+int QC_integral_block(char kind, int nr, double ** block);
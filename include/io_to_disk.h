@@ -19,6 +19,8 @@
 
 #include "siteTensor.h"
 #include "rOperators.h"
+#include "Heff.h"
+#include "hamiltonian.h"
 
 #define H5_DEFAULT_LOCATION "./"
 
@@ -30,6 +32,127 @@ void write_to_disk(const char * hdf5_loc, const struct siteTensor * const T3NS,
 int read_from_disk(const char filename[], struct siteTensor ** const T3NS, 
                    struct rOperators ** const ops, bool init);
 
+/**
+ * @brief Reads the Hamiltonian and the symmetries of a wave function written
+ * by @ref write_to_disk, without reading the wave function itself.
+ *
+ * @param [in] filename The file.
+ * @param [out] hamtype The Hamiltonian.
+ * @param [out] nrSyms The number of symmetries.
+ * @param [out] sgs The symmetries, room for #MAX_SYMMETRIES is needed.
+ * @return 0 on success, 1 on failure.
+ */
+int read_symmetries_from_disk(const char filename[], enum hamtypes * hamtype,
+                              int * nrSyms, enum symmetrygroup * sgs);
+
+/**
+ * @brief Writes everything needed to rebuild an effective Hamiltonian to a
+ * file.
+ *
+ * Next to the site object, the renormalized operators and the start vector,
+ * also the network, the bookkeeper and the Hamiltonian are stored. The
+ * remainder of the @ref Heffdata (the symmetry sectors of the bonds and the
+ * instructions) is made from these by @ref init_Heffdata.
+ *
+ * Only the root process writes.
+ *
+ * @param [in] filename The file, is overwritten.
+ * @param [in] data The effective Hamiltonian.
+ * @param [in] vec The start vector for the eigensolver.
+ * @return 0 on success, 1 on failure.
+ */
+int write_Heff_snapshot(const char * filename, const struct Heffdata * data,
+                        const T3NS_EL_TYPE * vec);
+
+/**
+ * @brief Reads a file written by @ref write_Heff_snapshot.
+ *
+ * The network, the bookkeeper and the Hamiltonian are read into the globals.
+ *
+ * @param [in] filename The file.
+ * @param [out] siteObject The site object.
+ * @param [out] Operators The renormalized operators. For a DMRG-like
+ * effective Hamiltonian the third one is a null @ref rOperators.
+ * @param [out] vec The start vector.
+ * @return 0 on success, 1 on failure.
+ */
+int read_Heff_snapshot(const char * filename, struct siteTensor * siteObject,
+                       struct rOperators * Operators, T3NS_EL_TYPE ** vec);
+
+/// An HDF5 file in which the spin-summed 2-RDM is written slice by slice.
+struct RDM_stream {
+        /// The file.
+        hid_t file_id;
+        /// The dataset of the 2-RDM.
+        hid_t dataset_id;
+        /// The number of orbitals.
+        int orbitals;
+};
+
+/**
+ * @brief Creates a file for the spin-summed RDMs.
+ *
+ * The file gets a dataset 'two_rdm' of \f$L^4\f$ elements, ordered as
+ * \f$Γ_{ijkl}\f$ with \f$l\f$ the fastest index. It is filled by 
+ * @ref write_2RDM_slice.
+ *
+ * @param [out] stream The opened file.
+ * @param [in] filename The file.
+ * @param [in] orbitals The number of orbitals \f$L\f$.
+ * @return 0 on success, 1 on failure.
+ */
+int open_2RDM_stream(struct RDM_stream * stream, const char * filename,
+                     int orbitals);
+
+/**
+ * @brief Writes the elements \f$Γ_{ij\cdot\cdot}\f$ of the 2-RDM.
+ *
+ * Not thread-safe, calls should be serialized.
+ *
+ * @param [in] stream The file.
+ * @param [in] i The first orbital.
+ * @param [in] j The second orbital.
+ * @param [in] slice The \f$L^2\f$ elements, \f$l\f$ the fastest index.
+ */
+void write_2RDM_slice(const struct RDM_stream * stream, int i, int j,
+                      const T3NS_EL_TYPE * slice);
+
+/**
+ * @brief Writes the 1-RDM as dataset 'one_rdm' and closes the file.
+ *
+ * @param [in,out] stream The file.
+ * @param [in] onerdm The \f$L^2\f$ elements of the 1-RDM, NULL to only close
+ * the file.
+ */
+void close_2RDM_stream(struct RDM_stream * stream, const T3NS_EL_TYPE * onerdm);
+
+/**
+ * @brief Writes the orbital entropies and the mutual information to a file.
+ *
+ * The file gets the datasets 'entropy' and 'mutual_information' 
+ * (\f$L \times L\f$) and the attribute 'orbitals'.
+ *
+ * @param [in] filename The file.
+ * @param [in] orbitals The number of orbitals \f$L\f$.
+ * @param [in] entropy The orbital entropies.
+ * @param [in] Iij The mutual information.
+ * @return 0 on success, 1 on failure.
+ */
+int write_mutualInformation(const char * filename, int orbitals, 
+                            const double * entropy, const double * Iij);
+
+/**
+ * @brief Reads the mutual information written by 
+ * @ref write_mutualInformation.
+ *
+ * @param [in] filename The file.
+ * @param [in] orbitals The expected number of orbitals \f$L\f$.
+ * @param [out] Iij The \f$L^2\f$ elements of the mutual information, 
+ * already allocated.
+ * @return 0 on success, 1 on failure.
+ */
+int read_mutualInformation(const char * filename, int orbitals, double * Iij);
+
 void write_dataset(hid_t id, const char datname[], const void * dat, 
                    hsize_t size, enum hdf5type kind);
 
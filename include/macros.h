@@ -30,6 +30,7 @@
 
 #define safe_malloc(t, s) t = safe_malloc_helper((s), sizeof *(t), #t, __FILE__, __LINE__, __func__)
 #define safe_calloc(t, s) t = safe_calloc_helper((s), sizeof *(t), #t, __FILE__, __LINE__, __func__)
+#define safe_realloc(t, s) t = safe_realloc_helper((t), (s), sizeof *(t), #t, __FILE__, __LINE__, __func__)
 #define safe_free(ptr) \
   do { \
     free(ptr); \
@@ -41,3 +42,6 @@ void * safe_malloc_helper(long long s, size_t t, const char *typ,
 
 void * safe_calloc_helper(long long s, size_t t, const char *typ, 
                           const char *file, int line, const char *func);
+
+void * safe_realloc_helper(void * ptr, long long s, size_t t, const char *typ, 
+                           const char *file, int line, const char *func);
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include "context.h"
 
 /**
  * @file network.h
@@ -76,8 +77,26 @@ struct stepSpecs {
         int nCenter;
 };
 
-/// The network of the T3NS
-extern struct network netw;
+/// The network of the T3NS, in the current context (see context.h).
+#define netw (*CONTEXT_STATE(struct network, CONTEXT_NETWORK))
+
+/**
+ * @brief Sets a thread-private replacement for netw.sitetoorb.
+ *
+ * Until it is reset with NULL, the calling thread uses the given array as
+ * mapping of sites to orbitals (see @ref get_sitetoorb). Other threads are
+ * not affected. This allows to try out several orderings of the orbitals
+ * concurrently.
+ *
+ * @param [in] sitetoorb Array of length netw.sites or NULL.
+ */
+void set_sitetoorb_view(int * sitetoorb);
+
+/// Returns the site to orbital mapping used by the calling thread.
+int * get_sitetoorb(void);
+
+/// Returns the network of the current context, for the bindings.
+struct network * get_netw(void);
 
 /**
  * @brief Searches a definition of a network file in the inputfile and reads 
@@ -89,6 +108,16 @@ void read_network(const char * inputfile, const char * relpath);
 
 void make_network(const char * netwfile);
 
+/**
+ * @brief Writes the network to a network file that can be read by 
+ * @ref make_network.
+ *
+ * @param [in] net The network.
+ * @param [in] netwfile The path of the file.
+ * @return 0 on success, 1 on failure.
+ */
+int write_network(const struct network * net, const char * netwfile);
+
 /**
  * @brief Destroys the network object.
  */
@@ -157,6 +186,27 @@ void get_string_of_bond(char * buffer, int bond);
  */
 int next_opt_step(int maxsites, struct stepSpecs * specs);
 
+/**
+ * @brief Returns the information for the next optimization step of a given
+ * sweep.
+ *
+ * Same as @ref next_opt_step, but for an arbitrary closed sweep and with the
+ * state passed explicitly. This way different sweeps can be walked through
+ * concurrently.
+ *
+ * @param [in] sweep The sites to walk through, consecutive sites should be
+ * neighbours, also the last and the first one.
+ * @param [in] swlength The length of @p sweep.
+ * @param [in] maxsites The maximal number of sites updated this step.
+ * @param [out] specs The specifications of the step.
+ * @param [in,out] state The state in the sweep, should be 0 at the start. 
+ * It is reset to 0 at the end of the sweep.
+ *
+ * @return Returns 1 if sweep is not finished yet, 0 if sweep is finished.
+ */
+int next_opt_step_in(const int * sweep, int swlength, int maxsites,
+                     struct stepSpecs * specs, int * state);
+
 /**
  * @brief Gives the common bond between the two sites.
  *
@@ -195,5 +245,32 @@ int  make_simplesweep(bool inclborder, int ** sweep, int * swlength);
 
 int get_outgoing_bond(void);
 
+/**
+ * @brief Gives the path between two sites in the network.
+ *
+ * @param [in] start The first site of the path.
+ * @param [in] end The last site of the path.
+ * @param [out] path Array of at least network.sites elements. The sites of
+ * the path are stored here, from @p start to @p end.
+ * @return The number of sites in the path, or 0 if no path is found.
+ */
+int get_path(int start, int end, int * path);
+
+/**
+ * @brief Makes the sweep for the branch of the network hanging at a bond.
+ *
+ * The branch consists of @p site and all sites connected to it without
+ * passing @p bond. The sweep is network.sweep restricted to this branch and 
+ * starts at @p site.
+ *
+ * @param [in] bond The bond where the branch is cut off.
+ * @param [in] site The site of the branch next to @p bond.
+ * @param [out] sweep The sweep array for the branch.
+ * @param [out] swlength The length of the sweep array.
+ * @return 0 if successful, 1 if not. Fails if the restricted sweep is not a
+ * closed walk over neighbouring sites.
+ */
+int make_branch_sweep(int bond, int site, int ** sweep, int * swlength);
+
 void fillin_network(int nr_bonds, int psites, int sites, int (*bonds)[2],
                     int * sitetoorb, int sweeplength, int * sweep);
@@ -0,0 +1,122 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+/**
+ * @file network_placement.h
+ *
+ * Optimization of the placement of the orbitals on the physical sites of the
+ * network.
+ *
+ * Strongly entangled orbitals should be close in the network. The placement
+ * minimizes the cost \f$C = Σ_{i ≠ j} I_{ij} d_{ij}^η\f$, with \f$I_{ij}\f$
+ * the mutual information (or any other measure of correlation) and
+ * \f$d_{ij}\f$ the number of bonds between the sites of orbital \f$i\f$ and
+ * \f$j\f$. This is the same cost as the one of <tt>netw.py</tt>.
+ *
+ * The minimization is a Monte Carlo simulation with swaps of two orbitals,
+ * for which the change of the cost is calculated in \f$O(L)\f$. Several
+ * replicas at different temperatures are simulated concurrently and
+ * exchanged between temperatures (parallel tempering).
+ */
+
+/// The default exponent of the distance in the cost.
+#define DEFAULT_PLACEMENT_ETA 2
+/// The default number of sweeps.
+#define DEFAULT_PLACEMENT_SWEEPS 1000
+/** The default number of replicas.
+ *
+ * Fixed, such that the default result does not depend on the number of
+ * threads. */
+#define DEFAULT_PLACEMENT_REPLICAS 8
+/// The default lowest inverse temperature.
+#define DEFAULT_PLACEMENT_BETA_MIN 0.1
+/// The default highest inverse temperature.
+#define DEFAULT_PLACEMENT_BETA_MAX 10
+
+/// The settings for the optimization of the placement.
+struct placementScheme {
+        /// The exponent \f$η\f$ of the distance in the cost.
+        double eta;
+        /** The number of sweeps.
+         *
+         * In every sweep, every replica tries \f$L\f$ swaps of two orbitals,
+         * after which replicas at neighbouring temperatures are exchanged. */
+        int sweeps;
+        /** The number of replicas.
+         *
+         * Their inverse temperatures are geometrically spaced between
+         * @ref beta_min and @ref beta_max. */
+        int replicas;
+        /** The lowest inverse temperature.
+         *
+         * The inverse temperatures are in units of the inverse of the mean
+         * absolute change of the cost for a swap in the initial placement.
+         * A replica at \f$β = 0.1\f$ accepts almost every swap, one at
+         * \f$β = 10\f$ almost only the improving ones. */
+        double beta_min;
+        /// The highest inverse temperature.
+        double beta_max;
+        /// The seed of the random number generators.
+        unsigned int seed;
+};
+
+/// Returns the default @ref placementScheme.
+struct placementScheme default_placementScheme(void);
+
+/**
+ * @brief Returns the cost of the current placement of the orbitals in
+ * @ref netw.
+ *
+ * @param [in] Iij The \f$L^2\f$ elements of the correlation between the
+ * orbitals, in the orbital order of the Hamiltonian.
+ * @param [in] eta The exponent of the distance.
+ * @return The cost.
+ */
+double placement_cost(const double * Iij, double eta);
+
+/**
+ * @brief Returns the change of the cost of the current placement when
+ * swapping two orbitals.
+ *
+ * This is the update the Monte Carlo simulation does for every proposed swap.
+ *
+ * @param [in] Iij The \f$L^2\f$ elements of the correlation between the
+ * orbitals, in the orbital order of the Hamiltonian.
+ * @param [in] eta The exponent of the distance.
+ * @param [in] k The first physical site, as the index in the physical sites
+ * of @ref netw.
+ * @param [in] l The second physical site.
+ * @return The change of the cost.
+ */
+double placement_swap_cost(const double * Iij, double eta, int k, int l);
+
+/**
+ * @brief Optimizes the placement of the orbitals in @ref netw.
+ *
+ * The best placement found by any of the replicas is stored in
+ * <tt>netw.sitetoorb</tt>, the current placement is the starting point.
+ * The bonds and the sweep of the network are unchanged.
+ *
+ * @param [in] Iij The \f$L^2\f$ elements of the correlation between the
+ * orbitals, in the orbital order of the Hamiltonian.
+ * @param [in] scheme The settings of the optimization.
+ * @param [in] verbosity 0 for no output, 1 for the progress of the best cost.
+ * @return The cost of the resulting placement.
+ */
+double optimize_placement(const double * Iij,
+                          const struct placementScheme * scheme, int verbosity);
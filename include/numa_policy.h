@@ -0,0 +1,97 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <stddef.h>
+
+/**
+ * @file numa_policy.h
+ *
+ * Placement of the large element arrays over the NUMA nodes.
+ *
+ * The operating system places a page on the NUMA node of the thread that
+ * writes it first. The helpers in this file make sure that these first writes
+ * are done by the threads that will work on the data afterwards.
+ *
+ * For the best results the threads should be bound to their cores (e.g.
+ * `OMP_PROC_BIND=spread`). Memory that was already touched before (e.g.
+ * small arrays reused by the allocator) can not be moved by these helpers.
+ */
+
+/// The possible placement policies.
+enum numa_policy {
+        /// Arrays are first touched by the thread that allocates them.
+        NUMA_SERIAL,
+        /** Arrays are first touched in parallel, following the
+         * block-to-thread mapping of the loops that fill them. */
+        NUMA_FIRST_TOUCH,
+        /** As @ref NUMA_FIRST_TOUCH, but read-only data that is shared by all
+         * threads (e.g. the packed renormalized operators) is interleaved
+         * page by page over the threads. */
+        NUMA_INTERLEAVE
+};
+
+/// Returns the current placement policy, @ref NUMA_FIRST_TOUCH by default.
+enum numa_policy get_numa_policy(void);
+
+/**
+ * @brief Sets the placement policy.
+ *
+ * @param [in] policy The name of the policy, `serial`, `first touch` or
+ * `interleave`.
+ * @return 0 on success, 1 if the policy is not known.
+ */
+int set_numa_policy(const char * policy);
+
+/// Returns the name of the current placement policy.
+const char * get_numa_policy_string(void);
+
+/**
+ * @brief Gives the blocks that the calling thread touches first.
+ *
+ * The @p N blocks are divided in contiguous chunks over the threads of the
+ * current parallel region. Outside a parallel region all blocks are given.
+ * The loops that fill the blocks use the same split, such that every block is
+ * filled by the thread that placed it.
+ *
+ * @param [in] N The total number of blocks.
+ * @param [out] first The first block of this thread.
+ * @param [out] last One past the last block of this thread.
+ */
+void thread_block_range(int N, int * first, int * last);
+
+/**
+ * @brief Touches every page of a fresh allocation from the threads in a
+ * round-robin manner, such that the pages are interleaved over the NUMA nodes.
+ *
+ * The contents of the memory should be considered undefined afterwards.
+ *
+ * @param [in] mem The memory.
+ * @param [in] size The size of the memory in bytes.
+ */
+void interleave_pages(void * mem, size_t size);
+
+/// Remembers the current NUMA counters of the system, if available.
+void init_numa_stats(void);
+
+/**
+ * @brief Prints the NUMA placement of this process and the fraction of
+ * remote page allocations since @ref init_numa_stats.
+ *
+ * Only prints something if the system exposes these counters and has more
+ * than one NUMA node.
+ */
+void print_numa_stats(void);
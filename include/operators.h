@@ -22,15 +22,26 @@
  *
  * The header file for the calculation of preprogrammed operators.
  *
- * At this moment only the weight of the different seniority sectors of a wave
- * function are calculated.
+ * At this moment the weight of the different seniority sectors of a wave
+ * function, the spin-summed 2-RDM and the orbital mutual information are 
+ * calculated.
  */
 
+/// True if @p operator is one of the operators of @ref calculate_operator.
+bool is_valid_operator(const char * operator);
+
 /**
  * @brief Calculates the expectation value of a given operator and prints it.
  *
+ * The operator is checked first. For '2rdm' and 'mutual' also the
+ * symmetries of the state in @p h5file are checked before the wave function
+ * is read, states with SU(2) symmetry are rejected.
+ *
  * @param [in] operator Name of the operator to calculate.
- * At this moment, only 'seniority' is allowed.
+ * At this moment, 'seniority', '2rdm' and 'mutual' are allowed. For '2rdm' the
+ * RDMs are written to '2rdm.h5', or to FILE with '2rdm=FILE'. For 'mutual' 
+ * the orbital entropies and mutual information are written to 'mutual.h5', 
+ * or to FILE with 'mutual=FILE'.
  *
  * @param [in] h5file The location of the HDF5-file with the wave function.
  *
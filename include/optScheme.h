@@ -42,6 +42,20 @@ struct regime {
         double energy_conv;
         /// Level of noise to add after every optimization step.
         double noise;
+        /** Optimize the branches around a branching tensor concurrently.
+         * Falls back to a normal sweep if the network has no suitable
+         * branching tensor. */
+        int par_sweep;
+        /** Subspace expansion for one-site optimizations.
+         *
+         * If nonzero, after optimizing a site the bond to the next site is
+         * enlarged with the perturbation -expansion (H|psi> - E|psi>) of the
+         * optimized site, made with the one-site effective Hamiltonian. The
+         * next site is zero padded, so the wave function is not changed,
+         * and the enlarged bond is truncated again. The perturbation
+         * vanishes with the residual, so it dies out as the sweeps
+         * converge. 0 disables the expansion. */
+        double expansion;
 };
 
 /// Struct with the optimization scheme stored in it.
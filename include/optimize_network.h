@@ -19,28 +19,40 @@
 #include "rOperators.h"
 #include "optScheme.h"
 #include "bookkeeper.h"
+#include "context.h"
 
 /** 
  * @file optimize_network.h
  *
  * The header file for some routines for the optimization of the network.
+ *
+ * Every routine works in the context that is passed, it is selected in the
+ * calling thread for the duration of the call (see context.h).
  */
 
 /**
  * @brief Initializes the T3NS randomly and prepares the calculation.
  *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
  * @param [out] T3NS Pointer to the siteTensor array representing the T3NS.
  * @param [out] rops Pointer to the rOperators array representing the 
  * renormalized operators.
  * @param [in] option initialization option for the tensors.
  */
-void init_calculation(struct siteTensor ** T3NS, 
+void init_calculation(struct t3ns_context * ctx, struct siteTensor ** T3NS, 
                       struct rOperators ** rOps, 
                       char option);
 
 /**
  * @brief Executes the optimization scheme for the tensor network.
  *
+ * When the maximal bond dimension changes from one regime to the next, the
+ * symmetry sectors are checked again as in @ref preparebookkeeper. Sectors
+ * that were truncated away are filled with noise again, and the renormalized
+ * operators are rebuilt. If all sectors are still populated, the wave
+ * function and the operators are kept as they are.
+ *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
  * @param [in, out] T3NS Pointer to the siteTensor array representing the T3NS.
  * @param [in, out] rops Pointer to the rOperators array representing the 
  * renormalized operators.
@@ -48,12 +60,90 @@ void init_calculation(struct siteTensor ** T3NS,
  * @param [in] saveloc The location where to save the hdf5 files.
  * @return The lowest found energy during the scheme.
  */
-double execute_optScheme(struct siteTensor * const T3NS,
+double execute_optScheme(struct t3ns_context * ctx,
+                         struct siteTensor * const T3NS,
                          struct rOperators * const rops, 
                          const struct optScheme * const  scheme,
                          const char * saveloc, int lowD, int * lowDb,
                          const int verbosity);
 
+/**
+ * @brief Writes the effective Hamiltonian of one optimization step of the next
+ * @ref execute_optScheme to a file (see @ref write_Heff_snapshot).
+ *
+ * The step is identified as in the records of @ref write_timers_record.
+ * Only the first step that matches is written. If no step matches, a warning
+ * is printed at the end of @ref execute_optScheme.
+ *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
+ * @param [in] filename The file, NULL for no snapshot.
+ * @param [in] regime The regime, starting from 1.
+ * @param [in] sweep The sweep in the regime, starting from 1.
+ * @param [in] step The step in the sweep, starting from 0.
+ * @return 0 on success, 1 if the step does not exist.
+ */
+int set_Heff_snapshot(struct t3ns_context * ctx, const char * filename,
+                      int regime, int sweep, int step);
+
+/// What a @ref progress_info reports on.
+enum progress_kind {
+        /// The end of an optimization step.
+        PROGRESS_STEP,
+        /// The end of a sweep.
+        PROGRESS_SWEEP
+};
+
+/// The progress of the optimization, passed to the callback set by
+/// @ref set_progress_callback.
+struct progress_info {
+        /// A @ref progress_kind.
+        int kind;
+        /// The regime, starting from 1.
+        int regime;
+        /// The sweep in the regime, starting from 1.
+        int sweep;
+        /** For a step, the step in the sweep starting from 0. For a sweep,
+         * the number of steps done. */
+        int step;
+        /// The branch in a parallel sweep, -1 if not in a branch.
+        int branch;
+        /// The energy of the step, or the minimal energy of the sweep.
+        double energy;
+        /// The truncation error of the step, or the maximal one of the sweep.
+        double trunc_err;
+        /// The bond dimension of the step, or the maximal one of the sweep.
+        int maxdim;
+        /// The wall time of the step or sweep in seconds.
+        double seconds;
+        /// The number of timers.
+        int nr_timers;
+        /// The names of the timers.
+        const char ** timer_names;
+        /// The seconds of every timer in the step or sweep.
+        const double * timer_seconds;
+};
+
+/**
+ * @brief Sets a callback that is called with the progress of the next
+ * @ref execute_optScheme calls.
+ *
+ * The callback is called at the end of every optimization step and every 
+ * sweep, on the root process only. In a parallel sweep the calls of the 
+ * branches are serialized, but they come from different threads. The 
+ * @p info is only valid during the call.
+ *
+ * If the callback returns nonzero at the end of a sweep, the optimization
+ * stops after that sweep, as if the scheme converged. The return value at
+ * the end of a step is ignored.
+ *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
+ * @param [in] callback The callback, NULL for no callback.
+ * @param [in] data Passed to the callback as is.
+ */
+void set_progress_callback(struct t3ns_context * ctx,
+                           int (*callback)(const struct progress_info * info,
+                                           void * data), void * data);
+
 /**
  * @brief Prints the weights of the different sectors in the target state.
  *
@@ -61,22 +151,25 @@ double execute_optScheme(struct siteTensor * const T3NS,
  * If \f$|Ψ〉= Σ c_i |Ψ_i〉\f$ with \f$|Ψ_i〉\f$ having distinct quantum 
  * numbers, it will print out \f$|c_i|^2\f$ for every \f$|Ψ_i〉\f$.
  *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
  * @param [in] T3NS The wave function.
  */
-void print_target_state_coeff(const struct siteTensor * T3NS);
+void print_target_state_coeff(struct t3ns_context * ctx,
+                              const struct siteTensor * T3NS);
 
 /**
  * @brief Initializes the renormalized operators. 
  *
  * Is skipped if @ref rOps is already populated.
  *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
  * @param [in,out] rOps The calculated renormalized operators.
  * @param [in] T3NS The wave function.
  * @param [in] tilltheend True for calculation of operators (contraction till the end)
  * @return 0 on success, 1 on failure.
  */
-int init_operators(struct rOperators ** rOps, const struct siteTensor * T3NS,
-                   bool tilltheend);
+int init_operators(struct t3ns_context * ctx, struct rOperators ** rOps,
+                   const struct siteTensor * T3NS, bool tilltheend);
 
 /*
  * @brief Initializes the wave function.
@@ -89,7 +182,10 @@ int init_operators(struct rOperators ** rOps, const struct siteTensor * T3NS,
  *
  * If previously discarded symmetry sectors are again populated, then
  * the T3NS will populate these symmetry sectors with small random values.
+ * Only the site tensors with a changed bond are remade and get noise, the
+ * others are copied.
  *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
  * @param [in,out] T3NS The wave function.
  * @param [in] changedSS The symmetry sectors in the bookkeeper were changed
  * in comparison with the previous calculation.
@@ -97,8 +193,9 @@ int init_operators(struct rOperators ** rOps, const struct siteTensor * T3NS,
  * @param [in] option How to fill the new T3NS.
  * @return 0 on success, 1 on failure.
  */
-int init_wave_function(struct siteTensor ** T3NS, int changedSS, 
-                       struct bookkeeper * prevbookie, char option);
+int init_wave_function(struct t3ns_context * ctx, struct siteTensor ** T3NS,
+                       int changedSS, struct bookkeeper * prevbookie,
+                       char option);
 
 /// A structure for specifying the scheme for disentangling the wave function.
 struct disentScheme {
@@ -118,21 +215,23 @@ struct disentScheme {
  * @brief Disentangles the wave function by permuting the orbitals on the
  * network.
  *
- * The network.sitetoorb from the global @ref netw and the bookkeeper.v_symsecs 
- * from the global @ref bookie are also changed by this procedure.
+ * The network.sitetoorb of @ref netw and the bookkeeper.v_symsecs of
+ * @ref bookie in the context are also changed by this procedure.
  *
  * **Note:** You should keep in mind, that after executing this function, the
  * Hamiltonian and the rOperators should be reinitialized.
  * 
+ * @param [in] ctx The context of the calculation, NULL for the default one.
  * @param [in,out] T3NS The wave function, the orbitals are permuted by this
  * function and possibly an extra truncation error is introduced.
  * @param [in] scheme The disentangling scheme to be used.
  * @param [in] verbosity Level of verbosity for the printed statements.
  * @return The total entanglement in the disentangled state.
  */
-double disentangle_state(struct siteTensor * T3NS,
+double disentangle_state(struct t3ns_context * ctx, struct siteTensor * T3NS,
                          const struct disentScheme * scheme,
                          int verbosity);
 
 /// Prints for every bond in the network the singular values of the wave func.
-int print_singular_values_wav(struct siteTensor * T3NS);
+int print_singular_values_wav(struct t3ns_context * ctx,
+                              struct siteTensor * T3NS);
@@ -25,4 +25,8 @@
 # define DEFAULT_SOLVER_MAX_ITS 100
 # define DEFAULT_SWEEPS 4
 # define DEFAULT_E_CONV 1e-6
-# define DEFAULT_NOISE 0
+# define DEFAULT_NOISE 0.0
+# define DEFAULT_PAR_SWEEP 0
+# define DEFAULT_RAND_SVD 0
+# define DEFAULT_GRAM_SVD 1
+# define DEFAULT_EXPANSION 0.0
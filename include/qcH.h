@@ -164,8 +164,37 @@ void read_qcH_from_disk(const hid_t id, struct qcH * H);
 /**
  * Reads the integrals and stores them in the qcH structure.
  *
- * The integrals should be passed in a flattened form of the compressed arrays,
- * i.e.
+ * The integrals are read in place, no copy of the passed arrays is made.
+ *
+ * @param [out] H The structure to store the integrals in.
+ * @param [in] norb The number of orbitals.
+ * @param [in] irreps The irreps of the orbitals, or `NULL` if no point group
+ * symmetry is used.
+ * @param [in] h1e The full \f$L^2\f$ one-body integrals.
+ * @param [in] eri The two-body integrals. If @p packed, these are the
+ * fourfold compressed integrals of pyscf, i.e. a C-ordered 
+ * \f$[L(L+1)/2, L(L+1)/2]\f$ array. Otherwise the full \f$L^4\f$ 
+ * integrals with \f$[ij|kl]\f$ at \f$i + Lj + L^2k + L^3l\f$.
+ * @param [in] packed Whether @p eri is packed.
+ * @param [in] enuc The core energy.
+ * @param [in] ps The permutation symmetry, only @ref EIGHTFOLD is supported.
+ * @return 0 if successful, 1 if an error occured.
+ */
+int read_integrals(struct qcH * H, int norb, int * irreps, const double * h1e,
+                   const double * eri, bool packed, double enuc,
+                   enum permsym ps);
+
+/**
+ * Gives the @p nr -th block of the compressed one-body (@p kind = 'T') or
+ * two-body (@p kind = 'V') integrals.
+ *
+ * The blocks are ordered as in the HDF5 file. The block is not copied, it is
+ * owned by @p H and valid until @ref destroy_qcH.
+ *
+ * @param [in] H The qcH structure.
+ * @param [in] kind 'T' or 'V'.
+ * @param [in] nr The number of the block.
+ * @param [out] block Pointer to the block, `NULL` if there is no such block.
+ * @return The number of elements in the block, -1 if there is no such block.
  */
-int read_integrals(struct qcH * H, int norb, int * irreps, double * h1e,
-                   double * eri, double enuc, enum permsym ps);
+int qcH_block(const struct qcH * H, char kind, int nr, double ** block);
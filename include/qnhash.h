@@ -0,0 +1,103 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "macros.h"
+#include "rOperators.h"
+
+/**
+ * @file qnhash.h
+ *
+ * Hash index for looking up sparse blocks by their quantum numbers.
+ *
+ * The quantum numbers of the blocks of a @ref siteTensor or @ref rOperators
+ * are sorted, so a block can be found with @ref binSearch in O(log n).
+ * The index in this file does the same lookup in O(1) through an
+ * open-addressing (linear probing) hash table.
+ *
+ * The index does not own nor copy the quantum numbers, it should be rebuilt
+ * (or destroyed) whenever the indexed array changes.
+ */
+
+/**
+ * The minimal number of elements for which an actual hash table is built.
+ *
+ * For smaller arrays @ref search_qnhash just does a binary search.
+ */
+#ifndef QNHASH_MIN_SIZE
+#define QNHASH_MIN_SIZE 32
+#endif
+
+/// Hash index on an array of (tuples of) quantum numbers.
+struct qnhash {
+        /// The indexed array of quantum numbers.
+        const QN_TYPE * qn;
+        /// The number of elements in @ref qn.
+        int n;
+        /// The number of @p QN_TYPE's per element (1 to 4).
+        int stride;
+        /** The number of slots in the table, a power of two.
+         *
+         * 0 if no table is built and binary search is used. */
+        int size;
+        /// For every slot the index of the element in @ref qn, -1 if empty.
+        int * slots;
+};
+
+/// Returns a null-initialized @ref qnhash.
+struct qnhash null_qnhash(void);
+
+/**
+ * @brief Builds the index for an array of quantum numbers.
+ *
+ * @param [out] hash The resulting index.
+ * @param [in] qn The array with the quantum numbers, should be sorted as
+ * needed for @ref binSearch. The array should outlive the index.
+ * @param [in] n The number of elements in the array.
+ * @param [in] stride The number of @p QN_TYPE's per element.
+ */
+void init_qnhash(struct qnhash * hash, const QN_TYPE * qn, int n, int stride);
+
+/// Destroys a @ref qnhash and sets it to a null-initialized one.
+void destroy_qnhash(struct qnhash * hash);
+
+/**
+ * @brief Builds an index for the blocks of every MPO symmetry sector of a
+ * @ref rOperators.
+ *
+ * @param [in] ops The rOperators.
+ * @return Array of @ref rOperators.nrhss indexes, see
+ * @ref rOperators_give_qnumbers_for_hss.
+ */
+struct qnhash * init_qnhash_rOperators(const struct rOperators * ops);
+
+/**
+ * @brief Destroys an array of indexes made by @ref init_qnhash_rOperators.
+ *
+ * @param [in,out] hash The array to destroy, set to NULL afterwards.
+ * @param [in] ops The rOperators for which the index was built.
+ */
+void destroy_qnhash_rOperators(struct qnhash ** hash,
+                               const struct rOperators * ops);
+
+/**
+ * @brief Searches an element in the index.
+ *
+ * @param [in] key Pointer to the @ref qnhash.stride quantum numbers to search.
+ * @param [in] hash The index.
+ * @return The index of the found element in the array, if not found -1.
+ */
+int search_qnhash(const QN_TYPE * key, const struct qnhash * hash);
@@ -120,6 +120,11 @@ struct rOperators {
         int * hss_of_ops;
         /// The renormalized operators.
         struct sparseblocks * operators;
+        /** If not NULL, @ref operators and all their @p beginblock and @p tel
+         * arrays are stored in this single allocation.
+         *
+         * See @ref alloc_operators_rOperators. */
+        void * slab;
 };
 
 /*************************** Init & Destroy **********************************/
@@ -129,6 +134,54 @@ struct rOperators null_rOperators(void);
 /// Destroys a rOperators and sets it to a null initialized rOperators.
 void destroy_rOperators(struct rOperators* rops);
 
+/**
+ * @brief Sets the elements of freshly malloc'ed operators to zero in parallel.
+ *
+ * The blocks of the rOperators (numbered as in @ref rOperators.qnumbers) are
+ * divided over the threads as in the update loops (see 
+ * @ref thread_block_range). Every thread zeroes its blocks in all operators,
+ * so that the memory ends up on the NUMA node of the thread that fills it.
+ * Is done serially for the @ref NUMA_SERIAL policy.
+ *
+ * @param [in,out] rops The rOperators.
+ */
+void first_touch_rOperators(struct rOperators * rops);
+
+/**
+ * @brief Allocates the operators of a rOperators.
+ *
+ * Operator @p i gets a copy of the beginblock array @p bb[i], or no blocks at
+ * all if it is NULL. @ref rOperators.nrops, @ref rOperators.hss_of_ops and 
+ * @ref rOperators.begin_blocks_of_hss should be set. The elements are not
+ * initialized (see @ref first_touch_rOperators).
+ *
+ * If compiled with @p T3NS_SLAB, the operators and all their @p beginblock 
+ * and @p tel arrays are laid out in one allocation, @ref rOperators.slab. 
+ * Every operator starts on a @ref T3NS_SLAB_ALIGN byte boundary, and so does 
+ * every block if the block sizes in @p bb are padded with 
+ * @ref slab_block_size (as done by @ref init_rOperators). Access through 
+ * @ref get_tel_block and @ref get_size_block is unchanged and destroying is a
+ * single free. The pages are interleaved over the threads for the
+ * @ref NUMA_INTERLEAVE policy.
+ *
+ * @param [in,out] rops The rOperators.
+ * @param [in] bb The beginblock array of every operator.
+ */
+void alloc_operators_rOperators(struct rOperators * rops,
+                                const T3NS_BB_TYPE * const * bb);
+
+/**
+ * @brief Kicks the zero blocks out of all operators.
+ *
+ * Operators in a slab are squeezed in place (see @ref squeeze_zero_blocks), 
+ * the gaps between the operators are closed and the slab is shrunk, without
+ * a second copy of the operators. Other operators are reallocated with 
+ * @ref kick_zero_blocks.
+ *
+ * @param [in,out] rops The rOperators to pack.
+ */
+void pack_rOperators(struct rOperators * rops);
+
 /// Initializes a vacuum rOperators at the given bond
 struct rOperators vacuum_rOperators(int bond, int is_left);
 
@@ -201,6 +254,16 @@ int rOperators_give_nr_blocks_for_hss(const struct rOperators * const rops, cons
  */
 int nblocks_in_operator(const struct rOperators * rops, int op);
 
+/**
+ * @brief Sums the elements of all operators over the MPI processes.
+ *
+ * Used after an update where every process only calculated part of the
+ * blocks. Does nothing when running as a single process.
+ *
+ * @param [in,out] rops The rOperators structure.
+ */
+void sum_rOperators_over_ranks(struct rOperators * rops);
+
 /**
  * @brief Gives pointer to the qnumbers array for an operator belonging to a certain rOperators 
  * struct and a certain hamiltonian symmetry sector.
@@ -92,6 +92,11 @@ struct siteTensor {
         QN_TYPE *qnumbers;
         /// Structure that contains the sparse blocks of the siteTensor.
         struct sparseblocks blocks;
+        /** If true, @ref qnumbers, the @p beginblock and the @p tel array of
+         * @ref blocks are stored in one allocation starting at @ref qnumbers.
+         *
+         * See @ref siteTensor_alloc_meta. */
+        bool slab;
 };
 
 /* =================================== INIT & DESTROY ========================================== */
@@ -138,6 +143,36 @@ int makesiteTensor(struct siteTensor * tens, const struct siteTensor * T3NS,
  */
 void destroy_siteTensor(struct siteTensor * const tens);
 
+/**
+ * \brief Allocates the quantum numbers and the beginblock array of a
+ * siteTensor.
+ *
+ * @ref siteTensor.nrsites and @ref siteTensor.nrblocks should be set. The
+ * beginblock array is set to zero and there are no elements yet, see
+ * @ref siteTensor_alloc_tel.
+ *
+ * If compiled with @p T3NS_SLAB, everything is stored in one allocation
+ * (@ref siteTensor.slab) that is grown for the elements, and destroying is a
+ * single free.
+ *
+ * \param [in,out] tens The siteTensor.
+ */
+void siteTensor_alloc_meta(struct siteTensor * tens);
+
+/**
+ * \brief Allocates the elements of a siteTensor after 
+ * @ref siteTensor_alloc_meta.
+ *
+ * In a slab, the elements start on a @ref T3NS_SLAB_ALIGN byte boundary. 
+ * The blocks themselves are not padded, the elements form one vector (e.g.
+ * for the eigenvalue solver).
+ *
+ * \param [in,out] tens The siteTensor, with its beginblock array filled in.
+ * \param [in] o 'c' to set the elements to zero, 'm' to leave them
+ * uninitialized.
+ */
+void siteTensor_alloc_tel(struct siteTensor * tens, char o);
+
 /**
  * \brief Makes a deep copy of a siteTensor.
  *
@@ -348,6 +383,43 @@ int multiplyR(struct siteTensor * A, const int bondA,
               struct Rmatrix * R, const int bondR, 
               struct siteTensor * B);
 
+/**
+ * @brief Makes the matrix that changes the basis of a bond from the one of an
+ * old R matrix to the one of a new R matrix.
+ *
+ * i.e. \f$P = R_{old}^+ R_{new}^T\f$ for every sector, with \f$^+\f$ the
+ * pseudo-inverse. Singular values of @p Rold smaller than @p cutoff times the
+ * largest one are discarded.
+ *
+ * If a tensor \f$A = Q R_{old}\f$ and afterwards \f$R_{old}\f$ is
+ * replaced by \f$R_{new}\f$ through an independent update, multiplying @p P
+ * with @p A (multiplyR with bondR = 0) gives the updated tensor.
+ *
+ * @param Rold [in] The old R matrix with dimensions (m, n) for every sector.
+ * @param Rnew [in] The new R matrix with dimensions (k, m) for every sector.
+ * @param cutoff [in] The relative cutoff for the pseudo-inverse.
+ * @param P [out] The resulting matrix with dimensions (n, k).
+ * @return 0 for success, 1 for failure
+ */
+int R_transition(const struct Rmatrix * Rold, const struct Rmatrix * Rnew,
+                 double cutoff, struct Rmatrix * P);
+
+/**
+ * @brief Kicks the symmetry sectors without states out of the bond between
+ * the one-site tensors @p A and @p B.
+ *
+ * The sectors of dimension zero in the bookkeeper are removed from the bond
+ * and the blocks of @p A and @p B are renumbered accordingly. The
+ * rOperators of the bond should be made again afterwards.
+ *
+ * @param A [in,out] The first tensor.
+ * @param bondA [in] The bond of @p A connected to @p B. Should be 0,1 or 2.
+ * @param B [in,out] The second tensor.
+ * @param bondB [in] The bond of @p B connected to @p A. Should be 0,1 or 2.
+ */
+void kick_empties_of_bond(struct siteTensor * A, int bondA,
+                          struct siteTensor * B, int bondB);
+
 /**
  * @brief qr decomposition on a one-site tensor.
  *
@@ -418,6 +490,27 @@ struct SvalSelect {
         int maxD;
         /// The asked truncation error on the cost function.
         double truncerr;
+        /** If nonzero, large symmetry sectors are decomposed with a randomized
+         * SVD which only calculates about @ref maxD singular values.
+         * Falls back to the full SVD if the result can not be trusted. */
+        int randomized;
+        /** If nonzero, symmetry sectors of which one dimension is much larger
+         * than the other are decomposed through the eigendecomposition of
+         * their Gram matrix. Falls back to the full SVD if the kept singular
+         * values of the sector are badly conditioned. */
+        int gram;
+};
+
+/// The ways a symmetry sector can be decomposed in @ref split_of_site.
+enum svd_method {
+        /// Full SVD through dgesdd.
+        SVD_DGESDD,
+        /// Randomized SVD (see @ref SvalSelect.randomized).
+        SVD_RANDOMIZED,
+        /// Eigendecomposition of the Gram matrix (see @ref SvalSelect.gram).
+        SVD_GRAM,
+        /// The number of methods.
+        SVD_METHODS
 };
 
 /** A structure which stores several properties of the singular values and the 
@@ -425,6 +518,8 @@ struct SvalSelect {
 struct SelectRes {
         /// Errorcode for the SVD.
         int erflag;
+        /// The number of symmetry sectors decomposed by each @ref svd_method.
+        int methods[SVD_METHODS];
         /// Norm of the wavefunction before and after truncation.
         double norm[2];
         /// Renyi Entropy at α=0.25 before and after truncation
@@ -489,6 +584,9 @@ struct decompose_info {
         double ls_sigma[3];
         /// The smallest singular value in each bond.
         double s_sigma[3];
+        /** The number of symmetry sectors decomposed by each
+         * @ref svd_method in each cut. Only filled for HOSVD. */
+        int cut_methods[3][SVD_METHODS];
 };
 
 /**
@@ -528,6 +626,7 @@ struct decompose_info HOSVD(struct siteTensor * A, int nCenter,
  * @brief Executes one QR decomposition for orthocenter and contracts the 
  * resulting R in ortho, making this the new orthocenter.
  *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
  * @param [in] A The tensor to decompose.
  * @param [in] nCenter The next orthogonality center. This is needed to know
  * how to QR and where to absorb the singular values.
@@ -538,8 +637,33 @@ struct decompose_info HOSVD(struct siteTensor * A, int nCenter,
  * calculated through the R matrix end info stored in the return value.
  * @return Information on the performed decomposition.
  */
-struct decompose_info qr_step(struct siteTensor * A, int nCenter, 
-                              struct siteTensor * T3NS, bool calc_ent);
+struct decompose_info qr_step(struct t3ns_context * ctx, struct siteTensor * A,
+                              int nCenter, struct siteTensor * T3NS,
+                              bool calc_ent);
+
+/**
+ * @brief Executes a one-site step with subspace expansion of the bond to
+ * the next orthogonality center.
+ *
+ * The bond is enlarged as \f$A' = [A\ P]\f$ and \f$B' = [B\ 0]^T\f$ with
+ * \f$B\f$ the tensor of @p nCenter, so that \f$A' B' = A B\f$ and the wave
+ * function is not changed. \f$A'\f$ is decomposed by a QR and a truncated
+ * SVD of the R matrix, the singular values and right singular vectors are
+ * absorbed in \f$B'\f$, which becomes the new orthogonality center.
+ *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
+ * @param [in] A The one-site tensor to decompose. It is destroyed.
+ * @param [in] P The perturbation, with the same block structure as @p A.
+ * @param [in] nCenter The next orthogonality center.
+ * @param [in,out] T3NS Array with all the siteTensors of the wave function.
+ * @param [in] sel Selection criterion for the truncation of the bond.
+ * @return Information on the performed decomposition.
+ */
+struct decompose_info expand_step(struct t3ns_context * ctx,
+                                  struct siteTensor * A,
+                                  const T3NS_EL_TYPE * P, int nCenter,
+                                  struct siteTensor * T3NS,
+                                  const struct SvalSelect * sel);
 
 /**
  * @brief Either a QR decomposition or a truncated HOSVD of tensor @ref A.
@@ -552,6 +676,7 @@ struct decompose_info qr_step(struct siteTensor * A, int nCenter,
  * In both cases the entanglement in the applicable bonds is stored in the
  * returned decompose_info.
  *
+ * @param [in] ctx The context of the calculation, NULL for the default one.
  * @param [in, out] A The tensor to decompose. It is destroyed.
  * @param [in] nCenter The next orthogonality center. This is needed to know
  * how to QR and where to absorb the singular values.
@@ -561,7 +686,8 @@ struct decompose_info qr_step(struct siteTensor * A, int nCenter,
  * @param [in] sel Selection criterion for the truncation for HOSVD.
  * @return Information on the performed decomposition.
  */
-struct decompose_info decompose_siteTensor(struct siteTensor * A, int nCenter,
+struct decompose_info decompose_siteTensor(struct t3ns_context * ctx,
+                                           struct siteTensor * A, int nCenter,
                                            struct siteTensor * T3NS, 
                                            const struct SvalSelect * sel);
 
@@ -16,6 +16,7 @@
 */
 #pragma once
 #include <inttypes.h>
+#include <stdbool.h>
 
 #ifdef T3NS_MKL
 #include "mkl.h"
@@ -37,6 +38,8 @@
 #define T3NS_EL_TYPE double
 /// Type of the elements of the tensors for HDF5
 #define T3NS_EL_TYPE_H5 H5T_IEEE_F64LE
+/// Alignment in bytes of the blocks in a slab.
+#define T3NS_SLAB_ALIGN 64
 
 /**
  * The structure for the sparse blocks of the tensors. 
@@ -87,6 +90,21 @@ void init_sparseblocks(struct sparseblocks * blocks,
 void deep_copy_sparseblocks(struct sparseblocks * copy, 
                             const struct sparseblocks * tocopy, int nrblocks);
 
+/**
+ * @brief Sets the elements of a fresh malloc'ed sparseblocks to zero in 
+ * parallel.
+ *
+ * The blocks are divided over the threads as in a 
+ * <tt>schedule(static)</tt> loop over the blocks (see 
+ * @ref thread_block_range), so that the memory ends up on the NUMA nodes of
+ * the threads that fill it afterwards. Is done serially for the 
+ * @ref NUMA_SERIAL policy.
+ *
+ * @param [in,out] blocks The sparseblocks.
+ * @param [in] nr_blocks The number of blocks in the sparseblocks object.
+ */
+void first_touch_sparseblocks(struct sparseblocks * blocks, int nr_blocks);
+
 /**
  * @brief Destroys a sparseblocks struct.
  *
@@ -102,6 +120,33 @@ void destroy_sparseblocks(struct sparseblocks * blocks);
  */
 void kick_zero_blocks(struct sparseblocks * blocks, int nr_blocks);
 
+/**
+ * @brief Kicks the zero-element blocks out like @ref kick_zero_blocks, but
+ * does not reallocate @ref sparseblocks.tel.
+ *
+ * The kept blocks are moved to the front, in the order they were. If every
+ * block started on a @ref T3NS_SLAB_ALIGN boundary, they still do afterwards.
+ *
+ * @param [in,out] blocks The sparseblocks structure to kick zero-elements out of.
+ * @param [in] nr_blocks The number of blocks in the sparseblocks object.
+ */
+void squeeze_zero_blocks(struct sparseblocks * blocks, int nr_blocks);
+
+/**
+ * @brief Returns the space a block of @p N elements takes in a slab.
+ *
+ * If compiled with @p T3NS_SLAB, @p N is rounded up to a multiple of
+ * @ref T3NS_SLAB_ALIGN bytes, so that the next block starts aligned too. The
+ * padding is kept at zero. Otherwise, this is just @p N.
+ */
+T3NS_BB_TYPE slab_block_size(T3NS_BB_TYPE N);
+
+/**
+ * @brief Returns if the given block holds @p N elements, with or without the
+ * padding of @ref slab_block_size.
+ */
+bool block_has_size(const struct sparseblocks * blocks, int id, T3NS_BB_TYPE N);
+
 /**
  * @brief Returns the size of the given block.
  *
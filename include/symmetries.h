@@ -65,6 +65,24 @@ int get_max_irrep(int (*prop1)[MAX_SYMMETRIES], int nr1,
 void tensprod_irrep(int *min_irrep, int *nr_irreps, int *step, int irrep1, 
                     int irrep2, int sign, enum symmetrygroup sg);
 
+/**
+ * @brief Does @ref tensprod_irrep for all the symmetries at once.
+ *
+ * @param [out] min_irrep The lowest label of resulting irrep for every 
+ * symmetry.
+ * @param [out] nr_irreps Number of resulting irreps for every symmetry.
+ * @param [out] step Step with which the labels are separated for every 
+ * symmetry.
+ * @param [in] irrep1 The irreps of the first symmetry sector.
+ * @param [in] irrep2 The irreps of the second symmetry sector.
+ * @param [in] sign -1 if the inverse of irrep2 should be taken, +1 otherwise.
+ * @param [in] sgs The symmetrygroups.
+ * @param [in] nrsy The number of symmetrygroups.
+ */
+void tensprod_irreps(int * min_irrep, int * nr_irreps, int * step, 
+                     const int * irrep1, const int * irrep2, int sign,
+                     const enum symmetrygroup * sgs, int nrsy);
+
 /**
  * @brief Returns the string of the symmetrygroup.
  *
@@ -266,6 +284,64 @@ int need_multiplicity(int nrSyms, const enum symmetrygroup * sgs);
 
 int multiplicity(int nrSyms, const enum symmetrygroup * sgs, const int * irreps);
 
+/**
+ * @brief The irrep arithmetic and the prefactors for a combination of
+ * symmetries.
+ *
+ * Every member has the arguments of the function with the same name. The
+ * kernels specialized for a combination of symmetries ignore the passed
+ * symmetrygroups, the symmetries are fixed at compile time.
+ *
+ * They are resolved once for the bookkeeper (see @ref set_symmetry_kernels),
+ * the block loops take them from bookkeeper.kernels.
+ */
+struct symmetryKernels {
+        /// The combination of symmetries, "generic" for the fallback.
+        const char * name;
+        /// The number of symmetries, 0 for the generic kernels.
+        int nrSyms;
+        /// The symmetries, a point group matches every point group.
+        const enum symmetrygroup * sgs;
+
+        void (*tensprod_irreps)(int * min_irrep, int * nr_irreps, int * step, 
+                                const int * irrep1, const int * irrep2, 
+                                int sign, const enum symmetrygroup * sgs, 
+                                int nrsy);
+        double (*prefactor_pAppend)(const int * (*irrep_arr)[3], int is_left,
+                                    const enum symmetrygroup * sgs, int nrsy);
+        double (*prefactor_adjoint)(const int ** irreps, char c, 
+                                    const enum symmetrygroup * sgs, int nrsy);
+        double (*prefactor_pUpdate)(const int * (*irrep_arr)[3], int is_left,
+                                    const enum symmetrygroup * sgs, int nrsy);
+        double (*prefactor_bUpdate)(int * (*irrep_arr)[3], int updateCase,
+                                    const enum symmetrygroup * sgs, int nrsy);
+        double (*prefactor_add_P_operator)(int * const (*irreps)[3], int isleft,
+                                           const enum symmetrygroup * sgs, 
+                                           int nrsy);
+        double (*prefactor_combine_MPOs)(int * const (*irreps)[3], 
+                                         int * const *irrMPO, 
+                                         const enum symmetrygroup * sgs, 
+                                         int nrsy, int isdmrg, int extradinge);
+        double (*prefactor_permutation)(int * irreps[5][3], int permuteType,
+                                        const enum symmetrygroup * sgs, 
+                                        int nrsy);
+        int (*multiplicity)(int nrSyms, const enum symmetrygroup * sgs, 
+                            const int * irreps);
+};
+
+/**
+ * @brief Returns the kernels for the given symmetries.
+ *
+ * Specialized kernels exist for Z2 U1 SU2 and Z2 U1 U1, with or without a 
+ * point group. For other combinations, the generic kernels are returned.
+ *
+ * @param [in] nrSyms The number of symmetries.
+ * @param [in] sgs The symmetrygroups.
+ * @return Pointer to the kernels.
+ */
+const struct symmetryKernels * get_symmetry_kernels(int nrSyms, 
+                                                    const enum symmetrygroup * sgs);
+
 /**
  * @brief returns a buffer of the different symmetry groups inputted.
  *
@@ -125,6 +125,17 @@ void kick_empty_symsecs(struct symsecs * sectors, char o);
  */
 void deep_copy_symsecs(struct symsecs * copy, const struct symsecs * tocopy);
 
+/**
+ * \brief Checks if two symsecs have the same sectors with the same dimensions.
+ *
+ * Both should be for the current symmetries of the bookkeeper.
+ *
+ * \param [in] a The first symsecs.
+ * \param [in] b The second symsecs.
+ * \return true if they are equal.
+ */
+bool same_symsecs(const struct symsecs * a, const struct symsecs * b);
+
 int full_dimension(const struct symsecs * const sym);
 
 /**
@@ -134,6 +145,153 @@ int full_dimension(const struct symsecs * const sym);
  */
 void print_symsecinfo(struct symsecs * ss);
 
+/** @name Quantum numbers
+ *
+ * A quantum number (@p QN_TYPE) combines the indices of the symmetry sectors
+ * of three bonds, with @p dims the number of sectors in each bond.
+ *
+ * If no bond has more than @ref QN_MAXSECS sectors, the indices are packed
+ * in fields of @ref QN_BITS bits:
+ * <tt>ids[0] | ids[1] << QN_BITS | ids[2] << 2 * QN_BITS</tt>.
+ * Otherwise it falls back to column major:
+ * <tt>ids[0] + ids[1] * dims[0] + ids[2] * dims[0] * dims[1]</tt>.
+ *
+ * Both orders are the same: first on ids[2], then ids[1] and then ids[0].
+ * On disk, quantum numbers are always stored column major.
+ */
+///@{
+/// The number of bits for every index in a packed quantum number.
+#define QN_BITS 21
+/// The maximal number of sectors in a bond for packed quantum numbers.
+#define QN_MAXSECS (1 << QN_BITS)
+/// Mask for one index in a packed quantum number.
+#define QN_MASK (((QN_TYPE) 1 << QN_BITS) - 1)
+
+/// Returns true if the quantum numbers for these bonds are packed.
+inline bool qn_packed(const int * dims)
+{
+        return dims[0] <= QN_MAXSECS && dims[1] <= QN_MAXSECS && 
+                dims[2] <= QN_MAXSECS;
+}
+
+/**
+ * @brief Returns the quantum number of three indices.
+ *
+ * @param [in] ids The indices.
+ * @param [in] dims The number of sectors of the three bonds.
+ * @return The quantum number.
+ */
+inline QN_TYPE qn_combine(const int * ids, const int * dims)
+{
+        assert(ids[0] < dims[0] && ids[1] < dims[1] && ids[2] < dims[2]);
+        if (qn_packed(dims)) {
+                return ids[0] | (QN_TYPE) ids[1] << QN_BITS | 
+                        (QN_TYPE) ids[2] << 2 * QN_BITS;
+        }
+        return ids[0] + ids[1] * (QN_TYPE) dims[0] + 
+                ids[2] * (QN_TYPE) dims[0] * dims[1];
+}
+
+/**
+ * @brief Splits a quantum number in its three indices.
+ *
+ * @param [out] ids The indices.
+ * @param [in] qn The quantum number.
+ * @param [in] dims The number of sectors of the three bonds.
+ */
+inline void qn_split(int * ids, QN_TYPE qn, const int * dims)
+{
+        if (qn_packed(dims)) {
+                ids[0] = qn & QN_MASK;
+                ids[1] = (qn >> QN_BITS) & QN_MASK;
+                ids[2] = qn >> 2 * QN_BITS;
+        } else {
+                ids[0] = qn % dims[0];
+                qn /= dims[0];
+                ids[1] = qn % dims[1];
+                ids[2] = qn / dims[1];
+        }
+        assert(ids[2] < dims[2]);
+}
+
+/// Returns index @p i of a quantum number.
+inline int qn_index(QN_TYPE qn, int i, const int * dims)
+{
+        if (qn_packed(dims)) { return (qn >> i * QN_BITS) & QN_MASK; }
+        for (int j = 0; j < i; ++j) { qn /= dims[j]; }
+        return i == 2 ? qn : qn % dims[i];
+}
+
+/**
+ * @brief Returns the part of a quantum number with only the first @p n 
+ * indices.
+ *
+ * This is the same as the quantum number with the other indices zero.
+ */
+inline QN_TYPE qn_head(QN_TYPE qn, int n, const int * dims)
+{
+        if (qn_packed(dims)) { 
+                return qn & (((QN_TYPE) 1 << n * QN_BITS) - 1);
+        }
+        QN_TYPE mod = 1;
+        for (int j = 0; j < n; ++j) { mod *= dims[j]; }
+        return qn % mod;
+}
+
+/// Returns the part of a quantum number without the first @p n indices.
+inline QN_TYPE qn_tail(QN_TYPE qn, int n, const int * dims)
+{
+        if (qn_packed(dims)) { return qn >> n * QN_BITS; }
+        QN_TYPE div = 1;
+        for (int j = 0; j < n; ++j) { div *= dims[j]; }
+        return qn / div;
+}
+
+/**
+ * @brief Inverse of @ref qn_head and @ref qn_tail.
+ *
+ * @param [in] head The part with the first @p n indices.
+ * @param [in] tail The part without the first @p n indices.
+ * @param [in] n The number of indices in @p head.
+ * @param [in] dims The number of sectors of the three bonds.
+ * @return The quantum number.
+ */
+inline QN_TYPE qn_join(QN_TYPE head, QN_TYPE tail, int n, const int * dims)
+{
+        if (qn_packed(dims)) { return head | tail << n * QN_BITS; }
+        QN_TYPE mul = 1;
+        for (int j = 0; j < n; ++j) { mul *= dims[j]; }
+        return head + tail * mul;
+}
+
+/**
+ * @brief Translates a quantum number between the two formats.
+ *
+ * @param [in] qn The quantum number.
+ * @param [in] dims The number of sectors of the three bonds.
+ * @param [in] tocolumnmajor True if @p qn is in the format of 
+ * @ref qn_combine and should be transformed to column major, false for the
+ * other direction.
+ * @return The translated quantum number.
+ */
+inline QN_TYPE qn_columnmajor(QN_TYPE qn, const int * dims, bool tocolumnmajor)
+{
+        if (!qn_packed(dims)) { return qn; }
+        int ids[3];
+        if (tocolumnmajor) {
+                qn_split(ids, qn, dims);
+                return ids[0] + ids[1] * (QN_TYPE) dims[0] + 
+                        ids[2] * (QN_TYPE) dims[0] * dims[1];
+        } else {
+                ids[0] = qn % dims[0];
+                qn /= dims[0];
+                ids[1] = qn % dims[1];
+                ids[2] = qn / dims[1];
+                return qn_combine(ids, dims);
+        }
+}
+///@}
+
 /**
  * @brief Changes a single quantumnumber @ref qn to its appropriate indices.
  *
@@ -144,15 +302,12 @@ void print_symsecinfo(struct symsecs * ss);
  */
 inline void indexize(int * ids, QN_TYPE qn, const struct symsecs * ss)
 {
-        ids[0] = qn % ss[0].nrSecs;
-        qn /= ss[0].nrSecs;
-        ids[1] = qn % ss[1].nrSecs;
-        ids[2] = qn / ss[1].nrSecs;
-        assert(ids[2] < ss[2].nrSecs);
+        const int dims[3] = {ss[0].nrSecs, ss[1].nrSecs, ss[2].nrSecs};
+        qn_split(ids, qn, dims);
 }
 
 /**
- * @brief Changes 3 indexes to its appopriate quantum number (column major).
+ * @brief Changes 3 indexes to its appopriate quantum number.
  *
  * @param[in] ids The indexes.
  * @param[in] ss The symmetrysectors associated with each index.
@@ -160,12 +315,8 @@ inline void indexize(int * ids, QN_TYPE qn, const struct symsecs * ss)
  */
 inline QN_TYPE qntypize(const int * ids, const struct symsecs * ss)
 {
-        assert(ids[0] < ss[0].nrSecs);
-        assert(ids[1] < ss[1].nrSecs);
-        assert(ids[2] < ss[2].nrSecs);
-
-        return ids[0] + ids[1] * ss[0].nrSecs + 
-                ids[2] * ss[0].nrSecs * ss[1].nrSecs;
+        const int dims[3] = {ss[0].nrSecs, ss[1].nrSecs, ss[2].nrSecs};
+        return qn_combine(ids, dims);
 }
 
 /**
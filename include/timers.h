@@ -23,8 +23,31 @@
  * @file timers.h
  *
  * The header file for timers.
+ *
+ * Next to the wall time, every timer counts the work done by all threads
+ * between its tic and toc: the GEMM calls and FLOPs done through
+ * @ref do_contract and the bytes allocated through @p safe_malloc and 
+ * @p safe_calloc. Timers can be nested by giving them a parent (see 
+ * @ref set_timer_parent), which is used for printing and for the records
+ * written by @ref write_timers_record.
+ *
+ * The counters are global, so timers that run concurrently (e.g. in the
+ * branches of a parallel sweep) also count each others work.
  */
 
+/// The maximal number of threads that get their own counters.
+#define MAX_COUNTED_THREADS 128
+
+/// Work counted by the threads.
+struct perf_counters {
+        /// The number of GEMM calls.
+        long long gemms;
+        /// The floating point operations done in the GEMM calls.
+        double flops;
+        /// The number of bytes allocated.
+        long long bytes;
+};
+
 /// This structure defines a single timer
 struct timer {
         /// The name of the timer
@@ -35,10 +58,26 @@ struct timer {
         bool ticed;
         /// True if you at least tic-toced it once (or added)
         bool touched;
+        /// True if the tic was written to the trace (see trace.h)
+        bool traced;
         /// The time when ticed
         struct timeval tictime;
         /// The total seconds already tictoc-ed
         double t;
+        /// The key of the parent timer, -1 if it has no parent.
+        int parent;
+        /// The number of tic-tocs.
+        long long calls;
+        /// The counters of all threads summed at the time of the tic.
+        struct perf_counters ticcount;
+        /// The FLOPs of every thread at the time of the tic.
+        double ticflops[MAX_COUNTED_THREADS];
+        /// The work counted in all tic-tocs.
+        struct perf_counters count;
+        /// The sum over the tic-tocs of the FLOPs of the busiest thread.
+        double maxthreadflops;
+        /// The maximal number of threads that did FLOPs in a tic-toc.
+        int threads;
 };
 
 /// A collection of timers
@@ -81,3 +120,48 @@ int add_timers(struct timers * result, const struct timers * toadd);
 
 /// Resets the timers
 void reset_timers(struct timers * tim);
+
+/// Sets the timer with key @p parent as parent of the timer with key @p key.
+int set_timer_parent(struct timers * tim, int key, int parent);
+
+/** Returns a number that identifies the calling thread, unique over all
+ * threads that ever called it. */
+int get_thread_id(void);
+
+/// Counts @p L GEMM calls with the given dimensions for the calling thread.
+void count_gemm(int M, int N, int K, int L);
+
+/// Counts an allocation of @p bytes bytes for the calling thread.
+void count_alloc(long long bytes);
+
+/// Returns the counters summed over all threads.
+struct perf_counters get_perf_counters(void);
+
+/**
+ * @brief Sets the file to which @ref write_timers_record writes.
+ *
+ * If the filename ends on `.csv` a CSV file is written with one row per
+ * timer per record, otherwise every record is written as one line of JSON.
+ *
+ * @param [in] filename The file, is overwritten. NULL closes the file.
+ * @return 0 on success, 1 if the file could not be opened.
+ */
+int set_timers_output(const char * filename);
+
+/**
+ * @brief Writes the touched timers as one record to the file set by 
+ * @ref set_timers_output. Does nothing if no file is set.
+ *
+ * Every timer reports its seconds, number of tic-tocs, GEMM calls, GFLOPs,
+ * allocated bytes and the load balance of the FLOPs over the threads 
+ * (total FLOPs divided by the number of threads times the FLOPs of the 
+ * busiest thread).
+ *
+ * @param [in] tim The timers.
+ * @param [in] labels The names of the integer labels of the record (e.g.
+ * regime, sweep and step).
+ * @param [in] values The values of the labels.
+ * @param [in] n The number of labels.
+ */
+void write_timers_record(const struct timers * tim, const char ** labels, 
+                         const int * values, int n);
@@ -0,0 +1,67 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include <stdbool.h>
+
+/**
+ * @file trace.h
+ *
+ * Event timeline in the Chrome trace-event format.
+ *
+ * The written file can be opened in `chrome://tracing` or
+ * <https://ui.perfetto.dev>. Every @ref tic and @ref toc of a timer gives a
+ * begin and end event, and the OpenMP loops of the heavy kernels add a span
+ * for every thread. The thread ids in the trace are those of
+ * @ref get_thread_id.
+ *
+ * Only the root process writes a trace.
+ */
+
+/**
+ * @brief Starts writing a trace to the given file.
+ *
+ * @param [in] filename The file, is overwritten. NULL closes the current trace.
+ * @return 0 on success, 1 if the file could not be opened.
+ */
+int set_trace_output(const char * filename);
+
+/// Returns true if a trace is being written.
+bool trace_enabled(void);
+
+/// Returns the time in microseconds since the start of the trace.
+double trace_now(void);
+
+/**
+ * @brief Writes the begin of an event for the calling thread.
+ *
+ * @param [in] name The name of the event.
+ * @param [in] cat The category of the event.
+ * @param [in] args The arguments of the event as a JSON object, or NULL.
+ */
+void trace_begin(const char * name, const char * cat, const char * args);
+
+/// Writes the end of the last begun event with name @p name of this thread.
+void trace_end(const char * name, const char * cat);
+
+/**
+ * @brief Writes the span of the calling thread in a parallel loop.
+ *
+ * @param [in] name The name of the loop.
+ * @param [in] start The start of the span, as given by @ref trace_now.
+ * @param [in] items The number of iterations done by this thread.
+ */
+void trace_span(const char * name, double start, int items);
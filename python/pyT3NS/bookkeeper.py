@@ -1,4 +1,4 @@
-from ctypes import cdll, Structure, c_int, POINTER, byref, c_double, c_char_p
+from ctypes import cdll, Structure, c_int, POINTER, byref, c_double, c_char_p, c_void_p
 
 
 libt3ns = cdll.LoadLibrary("libT3NS.so")
@@ -71,7 +71,8 @@ class Bookkeeper(Structure):
         ("nr_bonds", c_int),
         ("v_symsecs", POINTER(Symsecs)),
         ("psites", c_int),
-        ("p_symsecs", POINTER(Symsecs))
+        ("p_symsecs", POINTER(Symsecs)),
+        ("kernels", c_void_p)
     ]
 
     def init_bookkeeper(self, pbookie=None, maxD=500, mstates=2):
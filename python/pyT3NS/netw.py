@@ -1,4 +1,5 @@
-from ctypes import cdll, c_int, POINTER, Structure, c_void_p, byref
+from ctypes import cdll, c_int, c_uint, c_double, POINTER, Structure, \
+    c_void_p, byref
 
 libt3ns = cdll.LoadLibrary("libT3NS.so")
 
@@ -27,6 +28,21 @@ class cNetwork(Structure):
         return f.getvalue()
 
 
+# The network in the context of the calling thread
+libt3ns.get_netw.restype = POINTER(cNetwork)
+
+
+class PlacementScheme(Structure):
+    _fields_ = [
+        ("eta", c_double),
+        ("sweeps", c_int),
+        ("replicas", c_int),
+        ("beta_min", c_double),
+        ("beta_max", c_double),
+        ("seed", c_uint),
+    ]
+
+
 class Site:
     def __init__(self, kind='Vacuum', nr=0):
         if kind != 'Vacuum' and kind != 'B' and kind != 'P':
@@ -63,7 +79,7 @@ class Network:
     def __init__(self, sites=None, layers=0, isMET=True, isDMRG=False,
                  get_global=False):
         if get_global:
-            cnetwork = cNetwork.in_dll(libt3ns, "netw")
+            cnetwork = libt3ns.get_netw().contents
             self.sites = []
             for s in cnetwork.sitetoorb[:cnetwork.sites]:
                 self.sites.append(Site('B' if s == -1 else 'P',
@@ -415,19 +431,75 @@ class Network:
                         distances[j, i] = currsitedist[j] + currsitedist[i]
         return distances
 
-    def optimize(self, Iij, **kwargs):
-        Dij = self.calcDistances()
-        psites = [site.nr for site in self.sites if site.is_physical]
-        Dij = Dij[psites, :][:, psites]
-        assert Iij.shape == Dij.shape
-        assert Dij.size == self.nrP ** 2
-
-        self.sitemap, cost = montecarlo(Iij, Dij, **kwargs)
+    def optimize(self, Iij, η=2, sweeps=1000, replicas=None, β=(0.1, 10),
+                 seed=0, **kwargs):
+        """Optimizes the placement of the orbitals in the network.
+
+        Cost is Σ Iij * d_ij^η with d_ij the distance between the orbitals in
+        the network. It is minimized by the parallel tempering of
+        optimize_placement in the T3NS library. The resulting placement is
+        stored in sitemap and the network is passed to the library.
+
+        The arguments of the former Python Monte Carlo are deprecated:
+            iterations: the number of accepted swaps, mapped on sweeps of
+            nrP swaps each.
+            initstate: the starting placement, use sitemap instead.
+            swapspaces: not supported anymore and ignored.
+        A single β is used for both the lowest and highest inverse
+        temperature.
+        """
+        from numpy import ascontiguousarray, float64
+        from warnings import warn
+        Iij = ascontiguousarray(Iij, dtype=float64)
+        assert Iij.shape == (self.nrP, self.nrP)
+
+        if 'iterations' in kwargs:
+            warn('iterations is deprecated, use sweeps', DeprecationWarning)
+            sweeps = max(1, kwargs.pop('iterations') // max(1, self.nrP))
+        if 'initstate' in kwargs:
+            warn('initstate is deprecated, set sitemap', DeprecationWarning)
+            initstate = kwargs.pop('initstate')
+            if initstate is not None:
+                assert len(initstate) == self.nrP
+                self.sitemap = list(initstate)
+        if 'swapspaces' in kwargs:
+            warn('swapspaces is not supported anymore and is ignored',
+                 DeprecationWarning)
+            kwargs.pop('swapspaces')
+        if kwargs:
+            raise TypeError('Unexpected arguments: {}'.format(
+                ', '.join(kwargs)))
+        if not isinstance(β, (tuple, list)):
+            β = (β, β)
+
+        self.pass_network()
+        default_scheme = libt3ns.default_placementScheme
+        default_scheme.restype = PlacementScheme
+        scheme = default_scheme()
+        scheme.eta = η
+        scheme.sweeps = sweeps
+        if replicas is not None:
+            scheme.replicas = replicas
+        scheme.beta_min, scheme.beta_max = β
+        scheme.seed = seed
+
+        optimize = libt3ns.optimize_placement
+        optimize.argtypes = [POINTER(c_double), POINTER(PlacementScheme),
+                             c_int]
+        optimize.restype = c_double
+        cost = optimize(Iij.ctypes.data_as(POINTER(c_double)), byref(scheme),
+                        0)
+
+        cnetwork = libt3ns.get_netw().contents
+        self.sitemap = [
+            s for s in cnetwork.sitetoorb[:cnetwork.sites] if s != -1
+        ]
         return cost
 
     def pass_network(self):
-        '''Fills in the static global network structure in the T3NS.so library
-        and puts a pointer to that global network in the network structure
+        '''Fills in the network structure of the current context in the
+        T3NS.so library (the one of the process if not called from a T3NS
+        object).
         '''
         bonds = ((c_int * 2) * self.nrbonds)(
             *[(c_int * 2)(*bond) for bond in self.net_bonds]
@@ -511,81 +583,3 @@ def add_one(distances, currsiteid, prevsiteid):
             assert distances[currsiteid, i] == -1
             distances[i, currsiteid] = val + 1
             distances[currsiteid, i] = val + 1
-
-
-def costfunction(state, Iij, Dij, η=2):
-    """The default cost function.
-
-    Cost is Σ Iij * |i - j|^η
-    """
-    from numpy import power, argsort
-    nsites = len(state)
-    if costfunction.Dij_η is None:
-        costfunction.Dij_η = power(Dij, η)
-    if costfunction.Dij_sort_id is None:
-        costfunction.Dij_sort_id = argsort(Dij, axis=1)
-
-    cost = 0
-    for i in range(nsites):
-        for j in range(i + 1, nsites):
-            cost += 2 * Iij[state[i], state[j]] * costfunction.Dij_η[i][j]
-    return cost
-
-
-costfunction.Dij_η = None
-costfunction.Dij_sort_id = None
-
-
-def doswap(nsites, swapspaces=None):
-    from random import sample
-    if swapspaces is None:
-        return sample(range(nsites), 2)
-    else:
-        swap = [sample(range(nsites), 1)[0]] * 2
-        for liss in swapspaces:
-            if swap[0] in liss:
-                if len(liss) == 1:
-                    return doswap(nsites, swapspaces)
-                while swap[0] == swap[1]:
-                    swap[1] = sample(liss, 1)[0]
-                return swap
-
-
-def montecarlo(Iij, Dij, iterations=1000, β=1, initstate=None, **kwargs):
-    from random import sample, random
-    from math import exp
-    assert Iij.shape == Dij.shape and Iij.shape[0] == Iij.shape[1]
-
-    nsites = Iij.shape[0]
-    if initstate is None:
-        initstate = sample(range(nsites), nsites)
-    else:
-        assert len(initstate) == nsites
-
-    currstate = [el for el in initstate]
-    beststate = [el for el in initstate]
-    costfunction.Dij_η = None
-    costfunction.Dij_sort_id = None
-    oldcost = costfunction(currstate, Iij, Dij, **kwargs)
-    bestcost = oldcost
-
-    for it in range(iterations):
-        while True:
-            swapper = doswap(nsites, **kwargs)
-            # swap them
-            currstate[swapper[0]], currstate[swapper[1]] = \
-                currstate[swapper[1]], currstate[swapper[0]]
-            newcost = costfunction(currstate, Iij, Dij, **kwargs)
-
-            if newcost < oldcost or random() < exp(-β * (newcost - oldcost)):
-                # swap is accepted
-                oldcost = newcost
-                # new best state
-                if bestcost > oldcost:
-                    beststate = [i for i in currstate]
-                    bestcost = oldcost
-                break
-            # swap is not accepted, redo swap
-            currstate[swapper[0]], currstate[swapper[1]] = \
-                currstate[swapper[1]], currstate[swapper[0]]
-    return beststate, bestcost
@@ -2,21 +2,50 @@ import pyscf
 import numpy
 from pyT3NS import netw, bookkeeper, tensors
 from ctypes import c_int, cdll, POINTER, c_double, c_char, byref, c_void_p, \
-    cast, Structure, c_char_p, c_bool
+    cast, Structure, c_char_p, c_bool, CFUNCTYPE
+from functools import wraps
+from threading import RLock
 
 libt3ns = cdll.LoadLibrary("libT3NS.so")
 
 supported_pgs = ['D2h', 'C2v', 'C2h', 'D2', 'Cs', 'C2', 'Ci', 'C1']
 
+# The C library keeps the network, bookkeeper and Hamiltonian of a calculation
+# in a context, every T3NS object has its own.
+libt3ns.create_context.restype = c_void_p
+libt3ns.destroy_context.argtypes = [c_void_p]
+libt3ns.use_context.argtypes = [c_void_p]
+libt3ns.use_context.restype = c_void_p
+libt3ns.get_bookie.restype = POINTER(bookkeeper.Bookkeeper)
+libt3ns.get_ham.restype = POINTER(c_int)
+
+
+def _in_context(method):
+    '''Runs the method in the context of the calculation, one call of the
+    object at a time.'''
+    @wraps(method)
+    def wrapper(self, *args, **kwargs):
+        with self._lock:
+            prev = libt3ns.use_context(self._context)
+            try:
+                return method(self, *args, **kwargs)
+            finally:
+                libt3ns.use_context(prev)
+    return wrapper
+
 
 class SvalSelect(Structure):
     _fields_ = [
         ("minD", c_int),
         ("maxD", c_int),
         ("truncerr", c_double),
+        ("randomized", c_int),
+        ("gram", c_int),
     ]
 
-    def __init__(self, D):
+    def __init__(self, D, randomized=False, gram=True):
+        self.randomized = randomized
+        self.gram = gram
         if isinstance(D, tuple):
             self.minD = D[0]
             self.maxD = D[1]
@@ -61,18 +90,23 @@ class Regime(Structure):
         ("davidson_max_its", c_int),
         ("max_sweeps", c_int),
         ("energy_conv", c_double),
-        ("noise", c_double)
+        ("noise", c_double),
+        ("par_sweep", c_int),
+        ("expansion", c_double)
     ]
 
     def __init__(self, D, sitesize=2, davidson_rtl=1e-5, davidson_max_its=100,
-                 max_sweeps=20, energy_conv=1e-6, noise=0):
-        self.svd_sel = SvalSelect(D)
+                 max_sweeps=20, energy_conv=1e-6, noise=0, par_sweep=False,
+                 rand_svd=False, gram_svd=True, expansion=0):
+        self.svd_sel = SvalSelect(D, rand_svd, gram_svd)
         self.sitesize = sitesize
         self.davidson_rtl = davidson_rtl
         self.davidson_max_its = davidson_max_its
         self.max_sweeps = max_sweeps
         self.energy_conv = energy_conv
         self.noise = noise
+        self.par_sweep = par_sweep
+        self.expansion = expansion
 
     def __str__(self):
         one_two_three = {1: 'one', 2: 'two', 3: 'three', 4: 'four'}
@@ -82,7 +116,9 @@ class Regime(Structure):
             f"its: {self.davidson_max_its})\n" + \
             f"Maximal sweeps: {self.max_sweeps}\n" + \
             f"Energy convergence: {self.energy_conv}\n" + \
-            f"Added noise: {self.noise}\n"
+            f"Added noise: {self.noise}\n" + \
+            f"Parallel sweep: {bool(self.par_sweep)}\n" + \
+            f"Subspace expansion: {self.expansion}\n"
 
 
 class OptScheme(Structure):
@@ -115,6 +151,47 @@ class OptScheme(Structure):
         return result
 
 
+class ProgressInfo(Structure):
+    _fields_ = [
+        ("kind", c_int),
+        ("regime", c_int),
+        ("sweep", c_int),
+        ("step", c_int),
+        ("branch", c_int),
+        ("energy", c_double),
+        ("trunc_err", c_double),
+        ("maxdim", c_int),
+        ("seconds", c_double),
+        ("nr_timers", c_int),
+        ("timer_names", POINTER(c_char_p)),
+        ("timer_seconds", POINTER(c_double))
+    ]
+
+    def as_dict(self):
+        """Copies the progress in a dictionary.
+
+        The structure itself is only valid during the callback.
+        """
+        return {
+            'kind': 'sweep' if self.kind == 1 else 'step',
+            'regime': self.regime,
+            'sweep': self.sweep,
+            'step': self.step,
+            'branch': self.branch,
+            'energy': self.energy,
+            'trunc_err': self.trunc_err,
+            'maxdim': self.maxdim,
+            'seconds': self.seconds,
+            'timers': {
+                self.timer_names[i].decode('utf8'): self.timer_seconds[i]
+                for i in range(self.nr_timers)
+            }
+        }
+
+
+PROGRESS_CALLBACK = CFUNCTYPE(c_int, POINTER(ProgressInfo), c_void_p)
+
+
 class T3NS:
     '''Class for the optimization of the three-legged tree tensor network
     state.
@@ -134,6 +211,22 @@ class T3NS:
         _pg_irrep:
         _lastD:
         verbose: The verbosity
+
+    Memory shared with the C library:
+        The integrals are passed in place, the C library only reads them
+        while building the Hamiltonian. Views on the site tensors
+        (tensors.SiteTensor.block) and on the stored integrals
+        (integral_blocks) are owned by the C library and do not keep it
+        alive, they are invalidated by the next kernel or disentangle. RDMs
+        and the mutual information are filled in NumPy arrays owned by
+        Python.
+
+    Concurrent calculations:
+        Every object has its own context in the C library for its network,
+        bookkeeper and Hamiltonian, so several calculations can run
+        concurrently in one process (see kernel_async). Each one uses a team
+        of OMP_NUM_THREADS threads. The calls on one object are executed one
+        at a time.
     '''
     def __init__(self, mol_or_hdf5, c=None, network=None, verbose=None):
         '''Initializing the T3NS calculation.
@@ -154,6 +247,8 @@ class T3NS:
             Default is 'T3NS' if Mole instance was passed, else None.
         '''
         from pyscf import symm
+        self._lock = RLock()
+        self._context = libt3ns.create_context()
         if isinstance(mol_or_hdf5, pyscf.gto.Mole):
             # Initialize with RHF
             mol = mol_or_hdf5
@@ -219,7 +314,7 @@ class T3NS:
                 self._netw.readnetworkfile(network)
             else:
                 raise ValueError(f'{network} is invalid for network')
-            self._netw.pass_network()
+            self._pass_network()
 
         elif isinstance(mol_or_hdf5, str):
             # h5path = mol_or_hdf5
@@ -236,15 +331,20 @@ class T3NS:
                 'Expects a Mole instance or a path to a hdf5 file'
             )
 
+    @_in_context
+    def _pass_network(self):
+        self._netw.pass_network()
+
     def __del__(self):
-        libt3ns.destroy_hamiltonian()
-        libt3ns.clear_instructions()
-        for rops in self._rOps:
+        if getattr(self, '_context', None) is None:
+            return
+        for rops in getattr(self, '_rOps', None) or []:
             rops.delete()
-        bookie = bookkeeper.Bookkeeper.in_dll(libt3ns, "bookie")
-        libt3ns.destroy_bookkeeper.argtypes = [POINTER(bookkeeper.Bookkeeper)]
-        libt3ns.destroy_bookkeeper(byref(bookie))
+        # Destroys the Hamiltonian, instructions, bookkeeper and network
+        libt3ns.destroy_context(self._context)
+        self._context = None
 
+    @_in_context
     def kernel(self, D=500, mstates=None, doci=False, **kwargs):
         '''Optimization of the tensor network.
 
@@ -286,16 +386,30 @@ class T3NS:
             noise: The amount of noise to add after each optimization.
             The level of noise is scaled as
             0.5 * noise * (discarded weight last sweep)
+
+            par_sweep: Sweep the branches around a branching tensor
+            concurrently.
+
+        For the monitoring:
+            progress: A function called with a dictionary of the progress
+            (see ProgressInfo.as_dict) at the end of every optimization step
+            and sweep. If it returns True at the end of a sweep, the
+            optimization stops after that sweep. It is called from the
+            threads of the C library.
+
+        The GIL is released while the C library optimizes, see kernel_async
+        to run the optimization in the background.
         '''
-        pbookie = self._bookkeeper if hasattr(self, '_bookkeeper') else None
+        pbookie = self._bookkeeper if hasattr(self, '_bookkeeper') \
+            else None
         if mstates is None:
             mstates = 2 if pbookie is None else 0
 
-        # Passes the network to the static global in the C library
+        # Passes the network to the context in the C library
         self._netw.pass_network()
 
-        # Get global bookkeeper
-        self._bookkeeper = bookkeeper.Bookkeeper.in_dll(libt3ns, "bookie")
+        # Get the bookkeeper of the context
+        self._bookkeeper = libt3ns.get_bookie().contents
         # fillin symmetries and target state
         if doci:
             symmetries = ['U1']
@@ -329,9 +443,36 @@ class T3NS:
         self.energy = self.execute_optimization(D, **kwargs)
         return self.energy
 
+    def kernel_async(self, *args, **kwargs):
+        '''Runs kernel in a background thread.
+
+        Accepts the same arguments as kernel and returns a
+        concurrent.futures.Future with the energy. The GIL is released while
+        the C library optimizes, so the interpreter stays responsive and the
+        progress callback can be used to monitor the calculation. Calculations
+        of different objects run concurrently, each in its own context of the
+        C library. Calls on the same object wait in their thread.
+        '''
+        from concurrent.futures import Future
+        from threading import Thread
+
+        future = Future()
+
+        def run():
+            if not future.set_running_or_notify_cancel():
+                return
+            try:
+                future.set_result(self.kernel(*args, **kwargs))
+            except BaseException as e:
+                future.set_exception(e)
+
+        Thread(target=run, daemon=True).start()
+        return future
+
+    @_in_context
     def init_hamiltonian(self, doci):
         from pyT3NS.bookkeeper import translate_irrep
-        ham = c_int.in_dll(libt3ns, 'ham')
+        ham = libt3ns.get_ham().contents
 
         # only qchem or doci allowed atm. DOCI == 3, qchem == 1
         nham = 1 + doci * 2
@@ -349,22 +490,21 @@ class T3NS:
         if not hasattr(self, '_h1e'):
             self._h1e = self._c.T @ pyscf.scf.hf.get_hcore(self._mol) @ self._c
 
-        h1e = self._h1e.astype(numpy.float64).reshape(self._h1e.shape,
-                                                      order='F')
-        assert h1e.ctypes.data % 16 == 0  # Check alignment
-        h1e = h1e.ctypes.data_as(POINTER(c_double))
+        # The integrals are passed in place. h1e is symmetric and the full
+        # eri have eightfold symmetry, so C and Fortran order are the same.
+        self._h1e = numpy.require(self._h1e, numpy.float64, ['C', 'A'])
+        h1e = self._h1e.ctypes.data_as(POINTER(c_double))
 
         norb = self._c.shape[1]
-        if self._eri.size == norb ** 4 or doci:
-            fulleri = self._eri
+        npair = norb * (norb + 1) // 2
+        if self._eri.size in (norb ** 4, npair ** 2) or doci:
+            eri = self._eri
         else:
-            fulleri = pyscf.ao2mo.restore(1, self._eri, norb)
-
-        if not doci:
-            fulleri = fulleri.astype(numpy.float64).reshape(fulleri.shape,
-                                                            order='F')
-        assert fulleri.ctypes.data % 16 == 0  # Check alignment
-        fulleri = fulleri.ctypes.data_as(POINTER(c_double))
+            # Unpacking the eightfold packed integrals to fourfold ones
+            eri = pyscf.ao2mo.restore(4, self._eri, norb)
+        eri = numpy.require(eri, numpy.float64, ['C', 'A'])
+        packed = eri.size != norb ** 4
+        fulleri = eri.ctypes.data_as(POINTER(c_double))
 
         if doci:
             libt3ns.DOCI_ham_from_integrals.argtypes = \
@@ -373,7 +513,7 @@ class T3NS:
         else:
             libt3ns.QC_ham_from_integrals.argtypes = \
                 [c_int, POINTER(c_int), POINTER(c_double), POINTER(c_double),
-                 c_double, c_int, c_int, c_int]
+                 c_int, c_double, c_int, c_int, c_int]
             irrep = None
             if self._pg_irrep is not None:
                 for s in self.symmetries:
@@ -387,15 +527,17 @@ class T3NS:
                 irrep,
                 h1e,
                 fulleri,
+                packed,
                 self._nuc,
                 3,
                 int('SU2' in self.symmetries),
                 int('SENIORITY' in self.symmetries),
             )
 
+    @_in_context
     def init_wave_function(self, pbookie=None):
         initwav = libt3ns.init_wave_function
-        initwav.argtypes = [POINTER(c_void_p), c_int,
+        initwav.argtypes = [c_void_p, POINTER(c_void_p), c_int,
                             POINTER(bookkeeper.Bookkeeper), c_char]
 
         ppbookie = None if pbookie is None else byref(pbookie)
@@ -403,27 +545,31 @@ class T3NS:
         if not hasattr(self, '_T3NS'):
             self._T3NS = c_void_p(None)
 
-        initwav(cast(byref(self._T3NS), POINTER(c_void_p)), 0, ppbookie,
-                'r'.encode('utf8'))
+        initwav(self._context, cast(byref(self._T3NS), POINTER(c_void_p)), 0,
+                ppbookie, 'r'.encode('utf8'))
         self._T3NS = \
             cast(self._T3NS, POINTER(tensors.SiteTensor))[:self._netw.nrsites]
         self._T3NS = (tensors.SiteTensor * len(self._T3NS))(*self._T3NS)
 
+    @_in_context
     def init_operators(self):
         initop = libt3ns.init_operators
-        initop.argtypes = [POINTER(c_void_p), POINTER(tensors.SiteTensor), c_bool]
+        initop.argtypes = [c_void_p, POINTER(c_void_p),
+                           POINTER(tensors.SiteTensor), c_bool]
 
         if not hasattr(self, '_rOps') or self._rOps is None:
             self._rOps = c_void_p(None)
         else:
             self._rOps = cast(self._rOps, c_void_p)
 
-        initop(byref(self._rOps), self._T3NS, False)
+        initop(self._context, byref(self._rOps), self._T3NS, False)
         self._rOps = \
             cast(self._rOps, POINTER(tensors.ROperators))[:self._netw.nrbonds]
         self._rOps = (tensors.ROperators * len(self._rOps))(*self._rOps)
 
-    def execute_optimization(self, D, saveloc=None, verbosity=1, **kwargs):
+    @_in_context
+    def execute_optimization(self, D, saveloc=None, verbosity=1,
+                             progress=None, **kwargs):
         from sys import stdout
         import ctypes
 
@@ -432,6 +578,7 @@ class T3NS:
 
         execute = libt3ns.execute_optScheme
         execute.argtypes = [
+            c_void_p,
             POINTER(tensors.SiteTensor),
             POINTER(tensors.ROperators),
             POINTER(OptScheme),
@@ -445,14 +592,38 @@ class T3NS:
         # Flushing python
         stdout.flush()
 
-        energy = execute(self._T3NS, self._rOps, byref(scheme), saveloc, 0,
-                         POINTER(c_int)(), verbosity)
+        # Exceptions can not pass through the C library. They stop the
+        # optimization and are raised afterwards.
+        errors = []
+
+        def c_progress(info, data):
+            try:
+                return int(bool(progress(info.contents.as_dict())))
+            except BaseException as e:
+                errors.append(e)
+                return 1
+
+        set_progress = libt3ns.set_progress_callback
+        set_progress.argtypes = [c_void_p, PROGRESS_CALLBACK, c_void_p]
+        callback = PROGRESS_CALLBACK() if progress is None else \
+            PROGRESS_CALLBACK(c_progress)
+        set_progress(self._context, callback, None)
+        try:
+            # ctypes releases the GIL during the call
+            energy = execute(self._context, self._T3NS, self._rOps,
+                             byref(scheme), saveloc, 0, POINTER(c_int)(),
+                             verbosity)
+        finally:
+            set_progress(self._context, PROGRESS_CALLBACK(), None)
         libc = ctypes.CDLL(None)
         c_stdout = ctypes.c_void_p.in_dll(libc, 'stdout')
         # Flushing C
         libc.fflush(c_stdout)
+        if errors:
+            raise errors[0]
         return energy
 
+    @_in_context
     def disentangle(self, D=None, verbosity=0, **kwargs):
         """Disentangles the network.
         """
@@ -463,16 +634,18 @@ class T3NS:
 
         disent = libt3ns.disentangle_state
         disent.argtypes = [
+            c_void_p,
             POINTER(tensors.SiteTensor),
             POINTER(DisentScheme),
             c_int
         ]
         disent.restype = c_double
 
-        entanglement = disent(self._T3NS, byref(scheme), verbosity)
+        entanglement = disent(self._context, self._T3NS, byref(scheme),
+                              verbosity)
         stdout.flush()
         self._netw = netw.Network(get_global=True)
-        self._bookkeeper = bookkeeper.Bookkeeper.in_dll(libt3ns, "bookie")
+        self._bookkeeper = libt3ns.get_bookie().contents
         for rops in self._rOps:
             rops.delete()
         self._rOps = None
@@ -482,17 +655,111 @@ class T3NS:
 
         return entanglement
 
+    def _check_opstrings(self, what):
+        '''Raises a ValueError if the RDMs can not be calculated for the
+        symmetries of the state, before anything is allocated.'''
+        check = libt3ns.check_opstrings_support
+        check.argtypes = [c_int, c_int, POINTER(c_int), c_char_p]
+        bk = self._bookkeeper
+        if check(libt3ns.get_ham().contents.value, bk.nrSyms, bk.sgs,
+                 what.encode('utf8')) != 0:
+            raise ValueError('The {} needs U1 U1 instead of SU2 symmetry'
+                             .format(what))
+
+    @_in_context
+    def mutual_information(self):
+        """Returns the orbital entropies and the mutual information matrix.
+
+        Both are in the orbital order of the Hamiltonian. The mutual
+        information can be passed to netw.Network.optimize.
+        """
+        self._check_opstrings('mutual information')
+        norb = self._netw.nrP
+        entropy = numpy.zeros(norb)
+        Iij = numpy.zeros((norb, norb))
+
+        get_mi = libt3ns.get_mutualInformation
+        get_mi.argtypes = [POINTER(tensors.SiteTensor), POINTER(c_double),
+                           POINTER(c_double)]
+        if get_mi(self._T3NS, entropy.ctypes.data_as(POINTER(c_double)),
+                  Iij.ctypes.data_as(POINTER(c_double))) != 0:
+            raise RuntimeError('Failed to calculate the mutual information')
+        return entropy, Iij
+
+    @_in_context
+    def rdms(self, twordm=True):
+        """Returns the spin-summed 1-RDM and 2-RDM.
+
+        gamma[i, k] = sum_s <a+_is a_ks> and
+        Gamma[i, j, k, l] = sum_st <a+_is a+_jt a_lt a_ks>, in the orbital
+        order of the Hamiltonian. The arrays are allocated here and filled in
+        place by the C library, they are owned by Python. Only states with
+        U1 U1 symmetry are supported, SU2 states raise a ValueError.
+
+        Args:
+            twordm: If False, only the 1-RDM is calculated and None is
+            returned for the 2-RDM.
+        """
+        self._check_opstrings('2-RDM')
+        norb = self._netw.nrP
+        gamma = numpy.zeros((norb, norb))
+        Gamma = numpy.zeros((norb,) * 4) if twordm else None
+
+        get_2rdm = libt3ns.get_2RDM
+        get_2rdm.argtypes = [POINTER(tensors.SiteTensor), POINTER(c_double),
+                             POINTER(c_double)]
+        pGamma = None if Gamma is None else \
+            Gamma.ctypes.data_as(POINTER(c_double))
+        if get_2rdm(self._T3NS, gamma.ctypes.data_as(POINTER(c_double)),
+                    pGamma) != 0:
+            raise RuntimeError('Failed to calculate the RDMs')
+        return gamma, Gamma
+
+    @_in_context
+    def integral_blocks(self, kind='V'):
+        """Returns the blocks of the stored integrals as NumPy views.
+
+        The integrals are stored compressed by permutation and point group
+        symmetry, in blocks as written to the HDF5 file. The views share
+        their memory with the C library, which keeps the ownership. They are
+        only valid until the Hamiltonian is rebuilt or destroyed, i.e. until
+        the next kernel with a different doci, disentangle or deletion of this
+        object.
+
+        Args:
+            kind: 'T' for the one-body and 'V' for the two-body integrals.
+        """
+        from numpy.ctypeslib import as_array
+        if libt3ns.get_ham().contents.value != 1:
+            raise ValueError('Integral blocks only for the qchem Hamiltonian')
+        if kind not in ('T', 'V'):
+            raise ValueError(f'{kind} is invalid for kind')
+
+        get_block = libt3ns.QC_integral_block
+        get_block.argtypes = [c_char, c_int, POINTER(POINTER(c_double))]
+        get_block.restype = c_int
+
+        blocks = []
+        block = POINTER(c_double)()
+        size = get_block(kind.encode('utf8'), 0, byref(block))
+        while size >= 0:
+            blocks.append(as_array(block, shape=(size,)) if size > 0
+                          else numpy.empty(0))
+            size = get_block(kind.encode('utf8'), len(blocks), byref(block))
+        return blocks
+
+    @_in_context
     def singular_values(self):
         """Returns the singular values for the different bonds in network.
         """
         from pyT3NS.c_stdout_filter import stdout_redirector
         import io
         print_sval = libt3ns.print_singular_values_wav
-        print_sval.argtypes = [POINTER(tensors.SiteTensor)]
+        print_sval.argtypes = [c_void_p, POINTER(tensors.SiteTensor)]
 
         f = io.BytesIO()
         with stdout_redirector(f):
-            print_sval(self._T3NS)
+            print_sval(self._context, self._T3NS)
         outpstring = f.getvalue().decode('utf8')
         svals = [l.split() for l in outpstring.split('\n')[:-1]]
         maxbond = max([len(s) - 1 for s in svals])
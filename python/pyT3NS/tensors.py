@@ -1,4 +1,5 @@
-from ctypes import cdll, Structure, c_int, POINTER, byref, c_double, c_int64
+from ctypes import cdll, Structure, c_int, POINTER, byref, c_double, c_int64, \
+    c_void_p, c_bool
 
 
 libt3ns = cdll.LoadLibrary("libT3NS.so")
@@ -7,10 +8,31 @@ STEPSPECS_MSITES = 4
 
 class SparseBlocks(Structure):
     _fields_ = [
-        ("beginblock", POINTER(c_int)),
+        ("beginblock", POINTER(c_int64)),
         ("tel", POINTER(c_double))
     ]
 
+    def view(self, nrblocks, block=None):
+        '''Returns the elements as a NumPy view, without copying.
+
+        The view shares its memory with the C library, which keeps the
+        ownership. It does not keep that memory alive: it is only valid as long
+        as the parent tensor is not changed or destroyed by the library.
+
+        Args:
+            nrblocks: The number of blocks, stored in the parent structure.
+            block: The block to view. If None, all elements are viewed.
+        '''
+        from numpy import empty
+        from numpy.ctypeslib import as_array
+        if not self.beginblock or not self.tel:
+            return empty(0)
+        start = 0 if block is None else self.beginblock[block]
+        end = self.beginblock[nrblocks if block is None else block + 1]
+        if end == start:
+            return empty(0)
+        return as_array(self.tel, shape=(end,))[start:end]
+
 
 class SiteTensor(Structure):
     _fields_ = [
@@ -18,7 +40,8 @@ class SiteTensor(Structure):
         ("sites", (c_int * STEPSPECS_MSITES)),
         ("nrblocks", c_int),
         ("qnumbers", POINTER(c_int64)),
-        ("blocks", SparseBlocks)
+        ("blocks", SparseBlocks),
+        ("slab", c_bool)
     ]
 
     def __str__(self):
@@ -31,6 +54,23 @@ class SiteTensor(Structure):
             print_siteTensor(None, byref(self))
         return f.getvalue()
 
+    def block(self, nr):
+        '''Returns the elements of block nr as a NumPy view.
+
+        The elements are in column-major order of the indices of the block.
+        See SparseBlocks.view for the lifetime of the view.
+        '''
+        if nr < 0 or nr >= self.nrblocks:
+            raise IndexError(f'Block {nr} out of range')
+        return self.blocks.view(self.nrblocks, nr)
+
+    def elements(self):
+        '''Returns all elements of the tensor as a NumPy view.
+
+        See SparseBlocks.view for the lifetime of the view.
+        '''
+        return self.blocks.view(self.nrblocks)
+
 
 class ROperators(Structure):
     _fields_ = [
@@ -42,7 +82,8 @@ class ROperators(Structure):
         ("qnumbers", POINTER(c_int64)),
         ("nrops", c_int),
         ("hss_of_ops", POINTER(c_int)),
-        ("operators", POINTER(SparseBlocks))
+        ("operators", POINTER(SparseBlocks)),
+        ("slab", c_void_p)
     ]
 
     def __str__(self):
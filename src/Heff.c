@@ -28,6 +28,8 @@
 #include "network.h"
 #include "hamiltonian.h"
 #include "instructions.h"
+#include "distributed.h"
+#include "trace.h"
 #include "sort.h"
 
 #define NEW 0
@@ -105,16 +107,6 @@ static void check_diagonal(struct Heffdata * data, const double * diagonal)
 }
 #endif
 
-static void find_indexes(QN_TYPE qn, const int * maxdims, int * indexes)
-{
-        for (int i = 0; i < 2; ++i) {
-                indexes[i] = qn % maxdims[i];
-                qn /= maxdims[i];
-        }
-        indexes[2] = qn;
-        assert(qn < maxdims[2]);
-}
-
 static void makeqnumbersarr_count_or_store(int **** qnumbersarray, 
                                            const struct rOperators * Operator, 
                                            int internaldim, int count)
@@ -141,6 +133,7 @@ static void makeqnumbersarr_count_or_store(int **** qnumbersarray,
                 }
         }
 
+        const int dims[3] = {internaldim, internaldim, Operator->nrhss};
         QN_TYPE prevqn = -1;
         int currhss = 0;
         for (int i = 0; i < Operator->begin_blocks_of_hss[Operator->nrhss]; ++i) {
@@ -151,11 +144,10 @@ static void makeqnumbersarr_count_or_store(int **** qnumbersarray,
                 }
                 if (prevqn == currqn) { continue; }
 
-                const int braindex = currqn % internaldim;
-                const QN_TYPE temp = currqn / internaldim;
-                const int ketindex = temp % internaldim;
+                const int braindex = qn_index(currqn, 0, dims);
+                const int ketindex = qn_index(currqn, 1, dims);
 
-                assert(temp / internaldim == currhss);
+                assert(qn_index(currqn, 2, dims) == currhss);
                 ++(*qnumbersarray)[braindex][ketindex][0];
                 if (!count) {
                         (*qnumbersarray)[braindex][ketindex]
@@ -248,7 +240,8 @@ static int find_next_old(int n, int * indices_old, const int * internaldims,
                          int * nrMPO, int ** MPO, int hssdim)
 {
         assert(n == 3);
-        QN_TYPE findid = indices_old[0] + indices_old[1] * internaldims[0];
+        int findids[3] = {indices_old[0], indices_old[1], 0};
+        QN_TYPE findid = qn_combine(findids, internaldims);
         int * MPOarr[n];
 
         /* a next last index can be found with the current first two indices? */
@@ -268,7 +261,9 @@ static int find_next_old(int n, int * indices_old, const int * internaldims,
                                 break;
                         }
                 }
-                findid = indices_old[0] + indices_old[1] * internaldims[0];
+                findids[0] = indices_old[0];
+                findids[1] = indices_old[1];
+                findid = qn_combine(findids, internaldims);
         }
 
         /* So a valid new third index is found */
@@ -283,13 +278,13 @@ static int find_next_old(int n, int * indices_old, const int * internaldims,
 }
 
 static QN_TYPE * make_helperarray(const int nr, const QN_TYPE * const array, 
-                                  const QN_TYPE mod, int ** const lastid)
+                                  const int * dims, int ** const lastid)
 {
         QN_TYPE * const safe_malloc(result, nr);
         safe_malloc(*lastid, nr);
         for (int i = 0; i < nr; ++i) {
-                (*lastid)[i] = array[i] / mod;
-                result[i] = array[i] % mod;
+                (*lastid)[i] = qn_tail(array[i], 2, dims);
+                result[i] = qn_head(array[i], 2, dims);
         }
         return result;
 }
@@ -299,23 +294,23 @@ static void make_qnB_arrT3NS(struct Heffdata * const data,
                              int **** const qnumberarray)
 {
         const int hssdim = data->MPOsymsec.nrSecs;
-        const QN_TYPE bigdim = internaldims[0] * internaldims[1];
         int * lastind;
         QN_TYPE * helperarray = make_helperarray(data->nr_qnB, data->qnB_arr,
-                                                 bigdim, &lastind);
+                                                 internaldims, &lastind);
 
         safe_calloc(data->nr_qnBtoqnB, data->nr_qnB);
         safe_malloc(data->qnBtoqnB_arr, data->nr_qnB);
         safe_malloc(data->nrMPOcombos, data->nr_qnB);
         safe_malloc(data->MPOs, data->nr_qnB);
 
-#pragma omp parallel for schedule(dynamic) default(none) shared(lastind, helperarray)
+#pragma omp parallel for schedule(dynamic) default(none) shared(lastind, helperarray) \
+        copyin(t3ns_ctx)
         for (int i = 0; i < data->nr_qnB; ++i) {
                 int indices[3];
                 int indicesold[3] = {-1, -1, -1};
                 int loc = -1;
                 int * cnt = &data->nr_qnBtoqnB[i];
-                find_indexes(data->qnB_arr[i], internaldims, indices);
+                qn_split(indices, data->qnB_arr[i], internaldims);
                 int ** qnumbersar[3] =  {
                         qnumberarray[0][indices[0]],
                         qnumberarray[1][indices[1]],
@@ -347,9 +342,7 @@ static void make_qnB_arrT3NS(struct Heffdata * const data,
 
                         if (data->nrMPOcombos[i][*cnt] != 0) {
                                 data->qnBtoqnB_arr[i][*cnt] = 
-                                        indicesold[0] + 
-                                        indicesold[1] * internaldims[0] + 
-                                        indicesold[2] * bigdim;
+                                        qn_combine(indicesold, internaldims);
                                 ++(*cnt);
                                 assert(*cnt <= data->nr_qnB);
                         }
@@ -374,7 +367,8 @@ static void make_qnB_arrDMRG(struct Heffdata * const data)
         assert(op.P_operator);
         const int N  = op.begin_blocks_of_hss[op.nrhss];
 
-#pragma omp parallel for schedule(dynamic) default(none) shared(stderr)
+#pragma omp parallel for schedule(dynamic) default(none) shared(stderr) \
+        copyin(t3ns_ctx)
         for (int i = 0; i < data->nr_qnB; ++i) {
                 const QN_TYPE * qna = op.qnumbers;
                 safe_malloc(data->qnBtoqnB_arr[i], data->nr_qnB);
@@ -489,9 +483,8 @@ static void make_qnBdatas(struct Heffdata * const data)
 struct indexdata {
         int id[STEPSPECS_MSITES][2][3];       // index of the bonds: id[SITE][NEW/OLD][BOND]
         QN_TYPE qn[STEPSPECS_MSITES][2];      /* the quantum numbers: qn[SITE][NEW/OLD]
-                                * qn[SITE][NEW/OLD] = id[SITE][NEW/OLD][0] + 
-                                *     id[SITE][NEW/OLD][1] * dim0 + 
-                                *     id[SITE][NEW/OLD][2] * dim0 * dim1 
+                                * qn[SITE][NEW/OLD] = 
+                                *     qn_combine(id[SITE][NEW/OLD], dims)
                                 */
         int idMPO[STEPSPECS_MBONDS];          // id of the MPOs.
         int * irreps[STEPSPECS_MSITES][2][3]; // pointers to the irreps for the @p id 's.
@@ -514,15 +507,17 @@ static double calc_prefactor(const struct indexdata * idd,
         for (int i = 0; i < (data->isdmrg ? 2 : 3); ++i) {
                 if (!data->Operators[i].P_operator) { continue; }
 
-                prefactor *= 
+                prefactor *= data->kern->
                         prefactor_add_P_operator(idd->irreps[data->rOperators_on_site[i]], 
                                                  data->Operators[i].is_left, 
                                                  bookie.sgs, bookie.nrSyms);
         }
 
         // HACK
-        prefactor *= prefactor_combine_MPOs(idd->irreps[data->posB], idd->irrMPO, 
-                                            bookie.sgs, bookie.nrSyms, data->isdmrg, 2 * !data->Operators[1].P_operator);
+        prefactor *= data->kern->
+                prefactor_combine_MPOs(idd->irreps[data->posB], idd->irrMPO, 
+                                       bookie.sgs, bookie.nrSyms, data->isdmrg, 
+                                       2 * !data->Operators[1].P_operator);
         return prefactor;
 }
 
@@ -763,26 +758,25 @@ static void fill_MPO_indexes(struct indexdata * idd, int *instr,
 static void find_operator_sb(struct indexdata * idd, 
                              const struct Heffdata * data)
 {
-        const struct rOperators * const Operators = data->Operators;
-
         for (int i = 0; i < (data->isdmrg ? 2 : 3); ++i) {
                 const int site = data->rOperators_on_site[i];
                 const int innerid = data->Operators[i].P_operator ? 2 * data->Operators[i].is_left : (data->isdmrg ? 2 * !data->Operators[i].is_left : i);
                 const int diminner = data->symarr[site][innerid].nrSecs;
-                const QN_TYPE qninner = idd->id[site][NEW][innerid] +
-                        idd->id[site][OLD][innerid] * diminner +
-                        idd->idMPO[i] * diminner * diminner;
+                const int dims[3] = {
+                        diminner, diminner, data->MPOsymsec.nrSecs
+                };
+                const int ids[3] = {
+                        idd->id[site][NEW][innerid], 
+                        idd->id[site][OLD][innerid], 
+                        idd->idMPO[i]
+                };
+                const QN_TYPE qninner = qn_combine(ids, dims);
 
-                const QN_TYPE * const qnarray = 
-                        rOperators_give_qnumbers_for_hss(&Operators[i],
-                                                         idd->idMPO[i]);
-                const int nr_blocks = 
-                        rOperators_give_nr_blocks_for_hss(&Operators[i],
-                                                          idd->idMPO[i]);
+                const struct qnhash * hash = 
+                        &data->Operators_hash[i][idd->idMPO[i]];
 
                 if (!data->Operators[i].P_operator) {
-                        idd->sb_op[i] = binSearch(&qninner, qnarray, nr_blocks,
-                                                  SORT_QN_TYPE, sizeof qninner);
+                        idd->sb_op[i] = search_qnhash(&qninner, hash);
                         assert(idd->sb_op[i] != - 1);
                 } else {
                         const QN_TYPE qn[3] = {
@@ -791,8 +785,7 @@ static void find_operator_sb(struct indexdata * idd,
                                 qninner
                         };
 
-                        idd->sb_op[i] = binSearch(qn, qnarray, nr_blocks,
-                                                  SORT_QN_TYPE3, sizeof qn);
+                        idd->sb_op[i] = search_qnhash(qn, hash);
                         assert(idd->sb_op[i] != -1);
                 }
         }
@@ -862,9 +855,8 @@ static void loop_oldqnBs(struct indexdata * idd, struct Heffdata * data,
         QN_TYPE * oldqnB_arr = data->qnBtoqnB_arr[newqnB_id];
 
         for (int oldqnB_id = 0; oldqnB_id < oldnr_qnB; ++oldqnB_id) {
-                const int qnBtoSid = binSearch(&oldqnB_arr[oldqnB_id],
-                                               data->qnB_arr, data->nr_qnB,
-                                               SORT_QN_TYPE, sizeof(QN_TYPE));
+                const int qnBtoSid = search_qnhash(&oldqnB_arr[oldqnB_id],
+                                                   &data->qnB_hash);
 
                 const int nrMPOcombos = data->nrMPOcombos[newqnB_id][oldqnB_id];
                 int * MPOs = data->MPOs[newqnB_id][oldqnB_id];
@@ -952,8 +944,11 @@ static void exec_secondrun(const double * const vec, double * const result,
         const int n = data->siteObject.nrblocks;
         int first = 0;
         int second = 0;
-#pragma omp parallel default(none) shared(map) reduction(+:first,second)
+#pragma omp parallel default(none) shared(map) reduction(+:first,second) \
+        copyin(t3ns_ctx)
         {
+                const double start = trace_now();
+                int items = 0;
                 T3NS_EL_TYPE * tels[7];
                 safe_malloc(tels[WORK1], data->sr.worksize[0]);
                 safe_malloc(tels[WORK2], data->sr.worksize[1]);
@@ -963,6 +958,9 @@ static void exec_secondrun(const double * const vec, double * const result,
                 for (int ius = 0; ius < n; ++ius) {
                         const int i = data->sr.shufid[ius];
                         int dims[2][3];
+                        // With several processes, each one makes a part of the blocks.
+                        if (!is_my_work(i)) { continue; }
+                        ++items;
 
                         dims[0][0] = data->sr.dimsofsb[i][0];
                         dims[0][1] = data->sr.dimsofsb[i][1];
@@ -997,6 +995,7 @@ static void exec_secondrun(const double * const vec, double * const result,
 
                 safe_free(tels[WORK1]);
                 safe_free(tels[WORK2]);
+                trace_span("Heff: matvec blocks", start, items);
         }
 }
 
@@ -1009,21 +1008,26 @@ static void exec_firstrun(const double * const vec, double * const result,
         safe_malloc(data->sr.ntom, n);
 
         int wsize[2] = {0, 0};
-#pragma omp parallel for schedule(dynamic) default(none) shared(stderr) reduction(max:wsize)
+#pragma omp parallel for schedule(dynamic) default(none) shared(stderr) reduction(max:wsize) \
+        copyin(t3ns_ctx)
         for (int newqnB_id = 0; newqnB_id < data->nr_qnB; ++newqnB_id) {
                 struct indexdata idd;
                 make_map(idd.map, data);
 
                 int * newsb = NULL;
                 while (search_block_with_qn(&newsb, newqnB_id, data)) {
-                        safe_malloc(data->sr.ntom[*newsb], data->siteObject.nrblocks);
-
                         fill_indexes(*newsb, &idd, data, NEW, result);
                         data->sr.dimsofsb[*newsb][0] = idd.dim[NEW][0];
                         data->sr.dimsofsb[*newsb][1] = idd.dim[NEW][1];
                         data->sr.dimsofsb[*newsb][2] = idd.dim[NEW][2];
 
                         data->sr.nr_oldsb[*newsb] = 0;
+                        // Only the blocks of this process are prepared.
+                        if (!is_my_work(*newsb)) {
+                                data->sr.ntom[*newsb] = NULL;
+                                continue;
+                        }
+                        safe_malloc(data->sr.ntom[*newsb], data->siteObject.nrblocks);
                         loop_oldqnBs(&idd, data, newqnB_id, vec, 
                                      data->sr.ntom[*newsb], 
                                      &data->sr.nr_oldsb[*newsb], wsize); 
@@ -1059,6 +1063,7 @@ void matvecT3NS(const double * vec, double * result, void * vdata)
         } else {
                 exec_firstrun(vec, result, data);
         }
+        sum_over_ranks(result, siteTensor_get_size(&data->siteObject));
 }
 
 static void diag_old_to_new_sb(int MPO, struct indexdata * idd,
@@ -1109,7 +1114,8 @@ static void diag_old_to_new_sb(int MPO, struct indexdata * idd,
 
 static void adaptMPOcombos(struct Heffdata * data)
 {
-#pragma omp parallel for schedule(dynamic) default(none) shared(data)
+#pragma omp parallel for schedule(dynamic) default(none) shared(data) \
+        copyin(t3ns_ctx)
         for (int i = 0; i < data->nr_qnB; ++i) {
                 /* If assertion fails it is because i apparently needed what 
                  * was originally here up until:
@@ -1141,10 +1147,12 @@ static void make_sb_with_qnBid(struct Heffdata * const data)
         const int n = data->siteObject.nrblocks;
         const int ns = data->siteObject.nrsites;
 
-#pragma omp parallel for schedule(static) default(none) shared(stderr)
+#pragma omp parallel for schedule(static) default(none) shared(stderr) \
+        copyin(t3ns_ctx)
         for (int i = 0; i < data->nr_qnB; ++i) {
                 int cnt = 0;
-                safe_malloc(data->sb_with_qnid[i], n);
+                // With room for the sentinel.
+                safe_malloc(data->sb_with_qnid[i], n + 1);
                 const QN_TYPE qn = data->qnB_arr[i];
                 const QN_TYPE * pqn = &data->siteObject.qnumbers[data->posB];
 
@@ -1187,6 +1195,7 @@ void init_Heffdata(struct Heffdata * data, const struct rOperators * Operators,
                 get_symsecs_arr(3, data->symarr[i], bonds);
         }
         get_symsecs(&data->MPOsymsec, -1);
+        data->kern = bookie.kernels;
 
         for (int i = 0; i < (data->isdmrg ? 2 : 3); ++i) {
                 const int site = rOperators_site_to_attach(&Operators[i]);
@@ -1217,11 +1226,19 @@ void init_Heffdata(struct Heffdata * data, const struct rOperators * Operators,
         make_sb_with_qnBid(data);
         adaptMPOcombos(data);
 
+        init_qnhash(&data->qnB_hash, data->qnB_arr, data->nr_qnB, 1);
+        for (int i = 0; i < 3; ++i) {
+                data->Operators_hash[i] = i == 2 && data->isdmrg ? NULL :
+                        init_qnhash_rOperators(&data->Operators[i]);
+        }
+
         data->sr.dimsofsb = NULL;
 }
 
 static void destroy_secondrun(struct Heffdata * const data)
 {
+        // Not made if no matrix-vector product was done.
+        if (data->sr.dimsofsb == NULL) { return; }
         const int n = data->siteObject.nrblocks;
 
         safe_free(data->sr.dimsofsb);
@@ -1256,6 +1273,11 @@ void destroy_Heffdata(struct Heffdata * const data)
                 safe_free(data->sb_with_qnid[i]);
         }
         safe_free(data->qnB_arr);
+        destroy_qnhash(&data->qnB_hash);
+        for (int i = 0; i < 3; ++i) {
+                destroy_qnhash_rOperators(&data->Operators_hash[i], 
+                                          &data->Operators[i]);
+        }
         safe_free(data->nr_qnBtoqnB);
         safe_free(data->qnBtoqnB_arr);
         safe_free(data->nrMPOcombos);
@@ -1269,7 +1291,8 @@ T3NS_EL_TYPE * make_diagonal(const struct Heffdata * const data)
 {
         T3NS_EL_TYPE * safe_calloc(result, siteTensor_get_size(&data->siteObject));
 
-#pragma omp parallel for schedule(dynamic) default(none) shared(result)
+#pragma omp parallel for schedule(dynamic) default(none) shared(result) \
+        copyin(t3ns_ctx)
         for (int newqnB_id = 0; newqnB_id < data->nr_qnB; ++newqnB_id) {
                 struct indexdata idd;
                 make_map(idd.map, data);
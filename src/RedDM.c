@@ -26,6 +26,9 @@
 #include <assert.h>
 #include "symmetries.h"
 #include "bookkeeper.h"
+#include "hamiltonian.h"
+#include "qnhash.h"
+#include "io_to_disk.h"
 
 #ifdef T3NS_MKL
 #include "mkl.h"
@@ -35,96 +38,284 @@
 
 //#define T3NS_REDDM_DEBUG
 
-/// A structure for maing a backup for the T3NS and the @ref bookie.
-struct RDMbackup {
-        /// Backup of the coefficients of the @ref siteTensor array.
-        T3NS_EL_TYPE ** tels;
-        /** Backup of the symmetry sectors of the @ref bookie.
-         * 
-         * This is needed since QR decomposition can change the @ref bookie.
+/** A structure for the environments needed for the calculation of the RDMs.
+ *
+ * Every bond cuts the network in two. The environment of a bond at a certain
+ * side is the contraction of the T3NS with itself over all the sites at that
+ * side. It is block diagonal in the symmetry sectors of the bond.
+ *
+ * All environments are made in one traversal of the network, without
+ * changing the T3NS. An environment only depends on the environments of the
+ * other bonds of the site it is made at, so the environments are made level
+ * by level, starting from the outer bonds of the network.
+ */
+struct RDMenv {
+        /** The environments.
+         *
+         * <tt>env[2 * bond + side]</tt> is the environment at the side of
+         * <tt>netw.bonds[bond][side]</tt>.<br>
+         * If there are no sites at that side, @p tel is NULL and the 
+         * environment is the unit matrix.
          */
-        struct symsecs * ss;
+        struct sparseblocks * env;
+        /// The level in the traversal at which every environment is made.
+        int * level;
+        /// The highest level.
+        int maxlevel;
 };
 
-/// A structure for intermediate results needed for the calculation of the RDMs.
-struct RDMinterm {
-        /** Stores intermediate results for the calculation of the RedDM.sRDMs.
-         *
-         * 1RDMs do not need intermediate results, 2RDMs need intermediate
-         * results from 1 site, 3RDMs would need intermediate results of 2
-         * sites and so on...<br>
-         * For #MAX_RDM = 2 this gives thus 
-         * \f$\frac{\mathrm{MAX\_RDM} + 1}{2} = 1\f$.
-         *
-         * <tt>sRDMs[i]</tt> is a struct rOperators array.<br>
-         * For every bond a rOperators structure is given.
-         *
-         * For details on the the structure of these rOperators, see its 
-         * documentation.
-         */
-        struct rOperators * sRDMs[(MAX_RDM + 1) / 2];
+/// A unit of work: one symmetry sector of an environment or a 1-site RDM.
+struct RDMtask {
+        /// The environment (<tt>2 * bond + side</tt>) or the site.
+        int id;
+        /// The symmetry sector of the bond for which the block is made.
+        int sector;
 };
 
-static struct RDMbackup backup(struct siteTensor * T3NS)
+// Returns the environment of the bond connected to the site at leg @p leg.
+// NULL is returned for the unit matrix.
+static const struct sparseblocks * env_of_leg(const struct RDMenv * env, 
+                                              int site, const int * bonds,
+                                              int leg)
 {
-        struct RDMbackup backupv;
-        safe_malloc(backupv.tels, netw.sites);
-        safe_malloc(backupv.ss, netw.nr_bonds);
-        for (int i = 0; i < netw.sites; ++i) {
-                const int N = siteTensor_get_size(&T3NS[i]);
-                safe_malloc(backupv.tels[i], N);
-                for (int j = 0; j < N; ++j) {
-                        backupv.tels[i][j] = T3NS[i].blocks.tel[j];
+        if (is_psite(site) && leg == 1) { return NULL; }
+        const int side = netw.bonds[bonds[leg]][0] == site;
+        const struct sparseblocks * result = &env->env[2 * bonds[leg] + side];
+        return result->tel == NULL ? NULL : result;
+}
+
+static int env_level(struct RDMenv * env, int bond, int side)
+{
+        const int id = 2 * bond + side;
+        if (env->level[id] != -1) { return env->level[id]; }
+
+        const int site = netw.bonds[bond][side];
+        int level = 0;
+        if (site != -1) {
+                int bonds[3];
+                get_bonds_of_site(site, bonds);
+                for (int i = 0; i < 3; ++i) {
+                        if (bonds[i] == bond || (is_psite(site) && i == 1)) {
+                                continue;
+                        }
+                        const int prev = env_level(env, bonds[i], 
+                                                   netw.bonds[bonds[i]][0] == site);
+                        level = prev + 1 > level ? prev + 1 : level;
                 }
+                // The environment of a site with only outer bonds.
+                if (level == 0) { level = 1; }
         }
+        env->level[id] = level;
+        return level;
+}
 
-        for (int i = 0; i < netw.nr_bonds; ++i) {
-                deep_copy_symsecs(&backupv.ss[i], &bookie.v_symsecs[i]);
+// Multiplies the block with the environment block at leg @p leg.
+static void apply_env(const T3NS_EL_TYPE * tel, const int * tdims, int leg,
+                      const T3NS_EL_TYPE * envtel, T3NS_EL_TYPE * result)
+{
+        int L = 1;
+        for (int i = 0; i < leg; ++i) { L *= tdims[i]; }
+        int R = 1;
+        for (int i = leg + 1; i < 3; ++i) { R *= tdims[i]; }
+        const int D = tdims[leg];
+
+        for (int r = 0; r < R; ++r) {
+                cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, 
+                            L, D, D, 1, tel + r * L * D, L, envtel, D, 
+                            0, result + r * L * D, L);
         }
-        return backupv;
 }
 
-static void putback_backup(struct siteTensor * T3NS, struct RDMbackup * backupv)
+/* Contracts the site tensor with itself over all legs except @p leg, with
+ * the environments of the other legs in between. Only the blocks with 
+ * symmetry sector @p sector at @p leg are taken and the @p result block is
+ * overwritten.
+ *
+ * If @p rdm is true, the result is the 1-site RDM and every block is 
+ * weighted with the prefactor to go to a reduced density matrix. */
+static void contract_site(const struct siteTensor * tens, 
+                          const struct RDMenv * env, int leg, int sector,
+                          bool rdm, T3NS_EL_TYPE * result)
 {
-        for (int i = 0; i < netw.sites; ++i) {
-                safe_free(T3NS[i].blocks.tel);
-                T3NS[i].blocks.tel = backupv->tels[i];
+        const int site = tens->sites[0];
+        int bonds[3];
+        get_bonds_of_site(site, bonds);
+        int dims[3];
+        struct symsecs symarr[3];
+        get_symsecs_arr(3, symarr, bonds);
+        get_maxdims_of_bonds(dims, bonds, 3);
+        const struct sparseblocks * envs[3];
+        for (int i = 0; i < 3; ++i) {
+                envs[i] = i == leg ? NULL : env_of_leg(env, site, bonds, i);
         }
-        safe_free(backupv->tels);
 
-        for (int i = 0; i < netw.nr_bonds; ++i) {
-                destroy_symsecs(&bookie.v_symsecs[i]);
-                bookie.v_symsecs[i] = backupv->ss[i];
+        const int D = symarr[leg].dims[sector];
+        for (int i = 0; i < D * D; ++i) { result[i] = 0; }
+
+        T3NS_EL_TYPE * temp[2] = { NULL, NULL };
+        int tempsize = 0;
+        for (int block = 0; block < tens->nrblocks; ++block) {
+                const QN_TYPE qn = tens->qnumbers[block];
+                int ids[3];
+                qn_split(ids, qn, dims);
+                if (ids[leg] != sector) { continue; }
+
+                const int N = get_size_block(&tens->blocks, block);
+                if (N == 0) { continue; }
+                const int tdims[3] = {
+                        symarr[0].dims[ids[0]], 
+                        symarr[1].dims[ids[1]], 
+                        symarr[2].dims[ids[2]]
+                };
+                assert(tdims[0] * tdims[1] * tdims[2] == N);
+                if (N > tempsize) {
+                        tempsize = N;
+                        safe_realloc(temp[0], tempsize);
+                        safe_realloc(temp[1], tempsize);
+                }
+
+                const T3NS_EL_TYPE * tel = get_tel_block(&tens->blocks, block);
+                const T3NS_EL_TYPE * applied = tel;
+                int curr = 0;
+                for (int i = 0; i < 3; ++i) {
+                        if (envs[i] == NULL) { continue; }
+                        apply_env(applied, tdims, i, 
+                                  get_tel_block(envs[i], ids[i]), temp[curr]);
+                        applied = temp[curr];
+                        curr = !curr;
+                }
+
+                double pref = 1;
+                if (rdm) {
+                        int * irreps[3] = {
+                                symarr[0].irreps[ids[0]],
+                                symarr[1].irreps[ids[1]],
+                                symarr[2].irreps[ids[2]]
+                        };
+                        pref = prefactor_1siteRDM(&irreps, bookie.sgs, 
+                                                  bookie.nrSyms);
+                }
+
+                int L = 1;
+                for (int i = 0; i < leg; ++i) { L *= tdims[i]; }
+                int R = 1;
+                for (int i = leg + 1; i < 3; ++i) { R *= tdims[i]; }
+                for (int r = 0; r < R; ++r) {
+                        cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, 
+                                    D, D, L, pref, tel + r * L * D, L, 
+                                    applied + r * L * D, L, 1, result, D);
+                }
         }
-        safe_free(backupv->ss);
+        safe_free(temp[0]);
+        safe_free(temp[1]);
 }
 
-static int check_orthonormality(struct siteTensor * orthocenter,
-                                struct siteTensor * ortho)
+static void init_blockdiagonal(struct sparseblocks * blocks, int bond)
 {
+        struct symsecs symsec;
+        get_symsecs(&symsec, bond);
+        safe_malloc(blocks->beginblock, symsec.nrSecs + 1);
+        blocks->beginblock[0] = 0;
+        for (int i = 0; i < symsec.nrSecs; ++i) {
+                blocks->beginblock[i + 1] = blocks->beginblock[i] + 
+                        symsec.dims[i] * symsec.dims[i];
+        }
+        safe_malloc(blocks->tel, blocks->beginblock[symsec.nrSecs]);
+}
 
-        // Check normality of orthocenter
-        double norm = 0;
-        int i;
-        for (i = 0; i < siteTensor_get_size(orthocenter); ++i) {
-                norm += orthocenter->blocks.tel[i] * orthocenter->blocks.tel[i];
+// Runs the tasks over all threads. Every task writes to its own block.
+static void run_tasks(const struct siteTensor * T3NS, const struct RDMenv * env,
+                      const struct RDMtask * tasks, int nrtasks, bool rdm,
+                      struct siteTensor * rdms)
+{
+#pragma omp parallel for schedule(dynamic) default(none) shared(T3NS,env,tasks,nrtasks,rdm,rdms) \
+        copyin(t3ns_ctx)
+        for (int i = 0; i < nrtasks; ++i) {
+                const struct RDMtask * task = &tasks[i];
+                if (rdm) {
+                        struct siteTensor * crdm = 
+                                &rdms[netw.sitetoorb[task->id]];
+                        contract_site(&T3NS[task->id], env, 1, task->sector,
+                                      true, get_tel_block(&crdm->blocks, 
+                                                          task->sector));
+                } else {
+                        const int bond = task->id / 2;
+                        const int site = netw.bonds[bond][task->id % 2];
+                        int bonds[3];
+                        get_bonds_of_site(site, bonds);
+                        int leg;
+                        for (leg = 0; leg < 3; ++leg) {
+                                if (bonds[leg] == bond) { break; }
+                        }
+                        assert(leg != 3);
+                        struct sparseblocks * cenv = &env->env[task->id];
+                        contract_site(&T3NS[site], env, leg, task->sector,
+                                      false, get_tel_block(cenv, task->sector));
+                }
         }
-        if (fabs(norm - 1) > 1e-9) {
-                fprintf(stderr, "site %d : Orthocenter not normed. (deviation: %e)\n", 
-                        orthocenter->sites[0], fabs(norm - 1));
-                return 1;
+}
+
+static void make_environments(const struct siteTensor * T3NS, 
+                              struct RDMenv * env)
+{
+        const int nrenvs = 2 * netw.nr_bonds;
+        safe_malloc(env->env, nrenvs);
+        safe_malloc(env->level, nrenvs);
+        for (int i = 0; i < nrenvs; ++i) { env->level[i] = -1; }
+        env->maxlevel = 0;
+        for (int i = 0; i < nrenvs; ++i) {
+                const int level = env_level(env, i / 2, i % 2);
+                env->maxlevel = level > env->maxlevel ? level : env->maxlevel;
+                init_null_sparseblocks(&env->env[i]);
         }
-        const int comb = get_common_bond(orthocenter->sites[0], ortho->sites[0]);
-        int bonds[3];
-        get_bonds_of_site(ortho->sites[0], bonds);
-        for (i = 0; i < 3; ++i) { if (bonds[i] == comb) { break; } }
-        assert(i != 3);
 
-        if (!is_orthogonal(ortho, i)) {
-                fprintf(stderr, "site %d : Not orthogonal.\n", ortho->sites[0]);
-                return 1;
+        struct RDMtask * tasks = NULL;
+        for (int level = 1; level <= env->maxlevel; ++level) {
+                int nrtasks = 0;
+                for (int i = 0; i < nrenvs; ++i) {
+                        if (env->level[i] != level) { continue; }
+                        struct symsecs symsec;
+                        get_symsecs(&symsec, i / 2);
+                        init_blockdiagonal(&env->env[i], i / 2);
+                        safe_realloc(tasks, nrtasks + symsec.nrSecs);
+                        for (int j = 0; j < symsec.nrSecs; ++j) {
+                                tasks[nrtasks].id = i;
+                                tasks[nrtasks].sector = j;
+                                ++nrtasks;
+                        }
+                }
+                run_tasks(T3NS, env, tasks, nrtasks, false, NULL);
         }
-        return 0;
+        safe_free(tasks);
+}
+
+static void destroy_environments(struct RDMenv * env)
+{
+        for (int i = 0; i < 2 * netw.nr_bonds; ++i) {
+                destroy_sparseblocks(&env->env[i]);
+        }
+        safe_free(env->env);
+        safe_free(env->level);
+}
+
+// The norm of the state, contracted over the environments of the first bond.
+static double norm_of_state(const struct RDMenv * env)
+{
+        const struct sparseblocks * envs[2] = { &env->env[0], &env->env[1] };
+        struct symsecs symsec;
+        get_symsecs(&symsec, 0);
+        double norm = 0;
+        for (int i = 0; i < symsec.nrSecs; ++i) {
+                const int D = symsec.dims[i];
+                for (int j = 0; j < D * D; ++j) {
+                        const double left = envs[0]->tel == NULL ? 
+                                j % (D + 1) == 0 : envs[0]->tel[envs[0]->beginblock[i] + j];
+                        const double right = envs[1]->tel == NULL ? 
+                                j % (D + 1) == 0 : envs[1]->tel[envs[1]->beginblock[i] + j];
+                        norm += left * right;
+                }
+        }
+        return norm;
 }
 
 // Function to calculate combinatorics: pick N out of L
@@ -163,15 +354,16 @@ static int initialize_rdm(struct RedDM * rdm, int mrdm, int chemRDM)
                 return 1;
         }
 
-        if (chemRDM) {
-                fprintf(stderr, "ChemRDM not supported at the moment.\n");
+        if (chemRDM && check_opstrings_support(ham, bookie.nrSyms, 
+                                               bookie.sgs, "chemical RDM")) {
                 return 1;
         }
         rdm->sites = netw.psites;
 
-        if (!chemRDM) {
-                rdm->chemRDM[0] = NULL;
-                rdm->chemRDM[1] = NULL;
+        const long long L2 = rdm->sites * rdm->sites;
+        for (int i = 0; i < 2; ++i) {
+                rdm->chemRDM[i] = NULL;
+                if (chemRDM) { safe_malloc(rdm->chemRDM[i], L2 * L2); }
         }
 
         for (int i = 0; i < mrdm; ++i) {
@@ -202,190 +394,81 @@ void destroy_RedDM(struct RedDM * rdm)
         } 
 }
 
-// Makes the 1-site RDM
-static int make1siteRDM(struct siteTensor * rdm, struct siteTensor * orthoc)
+// Makes all 1-site RDMs from the environments.
+static int make1siteRDMs(const struct siteTensor * T3NS, 
+                         const struct RDMenv * env, struct siteTensor * rdm)
 {
-        // No making of 1 site RDM for branching tensors.
-        if (!is_psite(orthoc->sites[0])) { return 0; }
-        const int id = get_id(orthoc->sites, 1);
-        if (id == -1) { return 1; }
-
-        struct siteTensor * crdm = &rdm[id];
-        // Already made
-        if (crdm->nrsites != 0) { return 0; }
-        crdm->nrsites = 1;
-        crdm->sites[0] = orthoc->sites[0];
-
-        int bonds[3];
-        get_bonds_of_site(orthoc->sites[0], bonds);
-        int dims[3];
-        struct symsecs symarr[3];
-        // bonds[1] is the physical bond
-        get_symsecs_arr(3, symarr, bonds);
-        get_maxdims_of_bonds(dims, bonds, 3);
+        struct RDMtask * tasks = NULL;
+        int nrtasks = 0;
+        for (int site = 0; site < netw.sites; ++site) {
+                // No making of 1 site RDM for branching tensors.
+                if (!is_psite(site)) { continue; }
+                const int id = get_id(&site, 1);
+                if (id == -1) { 
+                        safe_free(tasks);
+                        return 1; 
+                }
 
-        crdm->nrblocks = symarr[1].nrSecs;
-        safe_malloc(crdm->qnumbers, crdm->nrblocks);
-        safe_malloc(crdm->blocks.beginblock, crdm->nrblocks + 1);
-        crdm->blocks.beginblock[0] = 0;
-        for (int i = 0; i < crdm->nrblocks; ++i) {
-                crdm->qnumbers[i] = i * (crdm->nrblocks + 1);
-                crdm->blocks.beginblock[i + 1] = crdm->blocks.beginblock[i] +
-                        symarr[1].dims[i] * symarr[1].dims[i];
-        }
-        const T3NS_BB_TYPE N = crdm->blocks.beginblock[crdm->nrblocks];
-        safe_calloc(crdm->blocks.tel, N);
+                struct siteTensor * crdm = &rdm[id];
+                crdm->nrsites = 1;
+                crdm->sites[0] = site;
 
-//#pragma omp parallel default(none) shared(crdm,orthoc,symarr,bookie,dims)
-        {
-                T3NS_EL_TYPE * safe_calloc(temptel, N);
-
-//#pragma omp for schedule(static) nowait
-                for (int i = 0; i < orthoc->nrblocks; ++i) {
-                        const QN_TYPE qn = orthoc->qnumbers[i];
-                        int ids[3] = {
-                                qn % dims[0],
-                                (qn / dims[0]) % dims[1],
-                                (qn / dims[0]) / dims[1] 
-                        };
-                        int * irreps[3] = {
-                                symarr[0].irreps[ids[0]],
-                                symarr[1].irreps[ids[1]],
-                                symarr[2].irreps[ids[2]]
-                        };
+                int bonds[3];
+                get_bonds_of_site(site, bonds);
+                // bonds[1] is the physical bond
+                struct symsecs symsec;
+                get_symsecs(&symsec, bonds[1]);
 
-                        const double pref = prefactor_1siteRDM(&irreps, bookie.sgs, 
-                                                               bookie.nrSyms);
-                        T3NS_EL_TYPE * tenstel = get_tel_block(&orthoc->blocks, i);
-                        T3NS_EL_TYPE * const rdmtel = temptel + 
-                                crdm->blocks.beginblock[ids[1]];
-                        const int tdims[3] = {
-                                symarr[0].dims[ids[0]], 
-                                symarr[1].dims[ids[1]], 
-                                symarr[2].dims[ids[2]]
-                        };
-                        assert(tdims[0] * tdims[1] * tdims[2] == 
-                               get_size_block(&orthoc->blocks, i));
-                        assert(tdims[1] * tdims[1] == 
-                               get_size_block(&crdm->blocks, ids[1]));
-
-                        for (int k = 0; k < tdims[2]; ++k) {
-                                cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, 
-                                            tdims[1], tdims[1], tdims[0], pref, 
-                                            tenstel, tdims[0], tenstel, tdims[0], 
-                                            1, rdmtel, tdims[1]);
-                                tenstel += tdims[0] * tdims[1];
-                        }
+                crdm->nrblocks = symsec.nrSecs;
+                const int dims[3] = {symsec.nrSecs, symsec.nrSecs, 1};
+                safe_malloc(crdm->qnumbers, crdm->nrblocks);
+                for (int i = 0; i < crdm->nrblocks; ++i) {
+                        const int ids[3] = {i, i, 0};
+                        crdm->qnumbers[i] = qn_combine(ids, dims);
                 }
+                init_blockdiagonal(&crdm->blocks, bonds[1]);
 
-//#pragma omp critical
-                for (int i = 0; i < N; ++i) {
-                        crdm->blocks.tel[i] += temptel[i];
+                safe_realloc(tasks, nrtasks + symsec.nrSecs);
+                for (int i = 0; i < symsec.nrSecs; ++i) {
+                        tasks[nrtasks].id = site;
+                        tasks[nrtasks].sector = i;
+                        ++nrtasks;
                 }
-                safe_free(temptel);
         }
+        run_tasks(T3NS, env, tasks, nrtasks, true, rdm);
+        safe_free(tasks);
         return 0;
 }
 
-// Make 1-site RDM intermediates.
-static int make1siteRDMinterm(struct siteTensor * ortho, int bond,
-                              struct rOperators * interm)
-{
-        const int bondid = siteTensor_give_bondid(ortho, bond);
-        interm->bond = bond;
-        interm->is_left = bondid != 2;
-        interm->P_operator = 0;         // Always non-P_operator.
-        return 1;
-}
+static void make_chemRDM(const struct siteTensor * T3NS, 
+                         const struct RDMenv * env, T3NS_EL_TYPE ** chemRDM);
 
-// Update siteRDM with a certain site. (for 1 and 2 site RDMs)
-static int u_siteRDM(struct siteTensor * orthoc, int bond,
-                     struct siteTensor * rdm, struct rOperators ** interm, 
-                     int si)
-{
-        assert(si < 2);
-        // End loop.
-        if (rdm == NULL) { return 0; }
-
-        if (si == 0) {
-                // Make 1-site RDMs
-                make1siteRDM(rdm, orthoc);
-        } else if (si == 1) {
-                // Make 2-site RDMs and needed intermediates for those.
-
-                // These intermediates should be made after QR.
-                //make1siteRDMinterm(orthoc, bond, interm[0]);
-                //make2siteRDM(rdm, orthoc, interm[0]);
-        } else {
-                fprintf(stderr, "Making of site-RDMs not implemented for %d sites.\n", si);
-                return 1;
-        }
-        return 0;
-}
-
-static int updateRDMs(struct siteTensor * orthoc, int bond, 
-                      struct RedDM * rdm, struct RDMinterm * interm)
-{
-        for (int i = 0; i < MAX_RDM; ++i) {
-                if (u_siteRDM(orthoc, bond, rdm->sRDMs[i], interm->sRDMs, i)) { 
-                        return 1; 
-                }
-        }
-        return 0;
-}
-
-int get_RedDMs(struct siteTensor * T3NS, struct RedDM * rdm, 
+int get_RedDMs(const struct siteTensor * T3NS, struct RedDM * rdm, 
                int mrdm, int chemRDM)
 {
-        printf(" >> Calculating RDMs\n");
-        struct RDMbackup backupv = backup(T3NS);
-        struct RDMinterm intermediateRes;
-
         if (initialize_rdm(rdm, mrdm, chemRDM)) { return 1; }
-        int exitcode = 0;
+        printf(" >> Calculating RDMs\n");
 
-        int * sweep, swlength;
-        if (make_simplesweep(true, &sweep, &swlength)) { return 1; }
+        struct RDMenv env;
+        make_environments(T3NS, &env);
 
-        // Not orthonormal (it is a hack fix)
-        if (check_orthonormality(&T3NS[sweep[0]], &T3NS[sweep[1]])) {
-                qr_step(&T3NS[sweep[1]], sweep[0], T3NS, false);
+        int exitcode = 0;
+        const double norm = norm_of_state(&env);
+        if (fabs(norm - 1) > 1e-9) {
+                fprintf(stderr, "State not normed. (deviation: %e)\n", 
+                        fabs(norm - 1));
+                exitcode = 1;
         }
 
-        for (int i = 0; i < swlength; ++i) {
-                // So, now going through all the sites in the sweep.
-                // Assume that current site is orthogonality center, 
-                // next site is orthogonal.
-                struct siteTensor * orthocenter = &T3NS[sweep[i]];
-                struct siteTensor * ortho = &T3NS[sweep[(i + 1) % swlength]];
-                assert(orthocenter->nrsites == 1);
-                assert(ortho->nrsites == 1);
-
-#ifdef T3NS_REDDM_DEBUG
-                if (check_orthonormality(orthocenter, ortho)) {
-                        exitcode = 1;
-                        break;
-                }
-#endif
-
-                const int comb = get_common_bond(orthocenter->sites[0], 
-                                                 ortho->sites[0]);
-                if (updateRDMs(orthocenter, comb, rdm, &intermediateRes)) {
-                        exitcode = 1;
-                        break;
-                }
-                struct decompose_info info = 
-                        qr_step(&T3NS[sweep[i]], sweep[(i + 1) % swlength], 
-                                T3NS, false);
-                if (info.erflag) {
-                        exitcode = 1;
-                        break;
-                }
+        // 2-site RDMs are not made yet.
+        if (!exitcode && rdm->sRDMs[0] != NULL) {
+                exitcode = make1siteRDMs(T3NS, &env, rdm->sRDMs[0]);
+        }
+        if (!exitcode && rdm->chemRDM[0] != NULL) {
+                make_chemRDM(T3NS, &env, rdm->chemRDM);
         }
 
-        safe_free(sweep);
-        putback_backup(T3NS, &backupv);
-        //clean_intermediate(&intermediateRes);
+        destroy_environments(&env);
         if (exitcode) { destroy_RedDM(rdm); }
         return exitcode;
 }
@@ -399,7 +482,8 @@ int get_1siteEntanglement(const struct RedDM * rdm, double ** result)
 
         safe_calloc(*result, rdm->sites);
         int flag = 0;
-//#pragma omp parallel for schedule(static) default(none) shared(result, rdm, stderr,flag,bookie)
+#pragma omp parallel for schedule(dynamic) default(none) shared(result,rdm,stderr) \
+        reduction(||:flag) copyin(t3ns_ctx)
         for (int i = 0; i < rdm->sites; ++i) {
                 if (flag) { continue; }
                 const struct siteTensor * crdm = &rdm->sRDMs[0][i];
@@ -457,3 +541,1024 @@ int get_1siteEntanglement(const struct RedDM * rdm, double ** result)
         }
         return flag;
 }
+
+/* ========================================================================== */
+/* ===================== SPIN-SUMMED 2-RDM THROUGH INSERTIONS =============== */
+/* ========================================================================== */
+
+/// The longest string of creators and annihilators that can be evaluated.
+#define MAX_OPSTRING 8
+
+/// A creation or annihilation operator on a site.
+struct RDMop {
+        /// The site of the operator.
+        int site;
+        /// 1 for a creator, 0 for an annihilator.
+        int create;
+        /// 0 for spin up, 1 for spin down.
+        int spin;
+};
+
+/// The data needed for evaluating strings of operators on the T3NS.
+struct RDMops {
+        /// The T3NS.
+        const struct siteTensor * T3NS;
+        /// The environments without operators.
+        const struct RDMenv * env;
+        /// The position of every site in the fermionic order, -1 if branching.
+        int * pos;
+        /** For every bond the first and last position in the fermionic order
+         * of the sites at side 0 of the bond. */
+        int (*range)[2];
+        /// The point group irrep of every site, 0 without point group.
+        int * pg;
+        /// For every site an index on the quantum numbers of its blocks.
+        struct qnhash * hash;
+};
+
+/** An environment of a bond where operators are inserted at its side.
+ *
+ * The operators shift the symmetry sectors, so for every ket sector there is
+ * at most one bra sector. */
+struct opEnv {
+        /// The number of symmetry sectors of the bond.
+        int nrSecs;
+        /// For every ket sector the bra sector, -1 if the block is zero.
+        int * bra;
+        /// For every ket sector a scaling of the block.
+        double * scale;
+        /** For every ket sector the block (bra × ket), NULL for the unit 
+         * matrix. */
+        const T3NS_EL_TYPE ** block;
+        /// Memory of the blocks if owned by the environment.
+        T3NS_EL_TYPE * tel;
+};
+
+/** The environments of a fixed string of operators, made when first needed 
+ * and reused for every string with one operator more.
+ *
+ * At side 0 of a bond without the extra operator, the extra operator only
+ * gives the parity of the bond if it comes later in the fermionic order. So
+ * the environment of the fixed string is stored.<br>
+ * At side 1 of a bond with the extra operator at side 0, the environment is
+ * the same wherever the extra operator is at side 0. So the first one made is
+ * stored. */
+struct opCache {
+        /// The fixed string.
+        struct RDMop ops[MAX_OPSTRING];
+        /// The length of the fixed string.
+        int n;
+        /// The cache of a shorter string that is tried next or NULL.
+        struct opCache * parent;
+        /// The environment at side 0 and 1 of every bond, bra is NULL if not made.
+        struct opEnv * env;
+};
+
+static int fermionic_order(struct RDMops * ctx, int site, int * counter)
+{
+        int bonds[3];
+        get_bonds_of_site(site, bonds);
+        int lo = *counter;
+        for (int i = 0; i < (is_psite(site) ? 1 : 2); ++i) {
+                const int child = netw.bonds[bonds[i]][0];
+                if (child != -1) { fermionic_order(ctx, child, counter); }
+        }
+        if (is_psite(site)) { ctx->pos[site] = (*counter)++; }
+        ctx->range[bonds[2]][0] = lo;
+        ctx->range[bonds[2]][1] = *counter - 1;
+        return 0;
+}
+
+static void init_RDMops(struct RDMops * ctx, const struct siteTensor * T3NS,
+                        const struct RDMenv * env)
+{
+        ctx->T3NS = T3NS;
+        ctx->env = env;
+        safe_malloc(ctx->pos, netw.sites);
+        safe_malloc(ctx->pg, netw.sites);
+        safe_malloc(ctx->range, netw.nr_bonds);
+        safe_malloc(ctx->hash, netw.sites);
+        for (int i = 0; i < netw.nr_bonds; ++i) {
+                // Outer bonds have no sites at side 0.
+                ctx->range[i][0] = 0;
+                ctx->range[i][1] = -1;
+        }
+
+        for (int site = 0; site < netw.sites; ++site) {
+                ctx->pos[site] = -1;
+                ctx->pg[site] = 0;
+                init_qnhash(&ctx->hash[site], T3NS[site].qnumbers, 
+                            T3NS[site].nrblocks, 1);
+                if (is_psite(site) && bookie.nrSyms > 3) {
+                        int bonds[3];
+                        get_bonds_of_site(site, bonds);
+                        struct symsecs ss;
+                        get_symsecs(&ss, bonds[1]);
+                        // The irrep of the singly occupied orbital.
+                        ctx->pg[site] = ss.irreps[1][3];
+                }
+        }
+
+        for (int i = 0; i < netw.nr_bonds; ++i) {
+                if (netw.bonds[i][1] == -1) {
+                        int counter = 0;
+                        fermionic_order(ctx, netw.bonds[i][0], &counter);
+                        assert(counter == netw.psites);
+                }
+        }
+}
+
+static void destroy_RDMops(struct RDMops * ctx)
+{
+        for (int site = 0; site < netw.sites; ++site) {
+                destroy_qnhash(&ctx->hash[site]);
+        }
+        safe_free(ctx->pos);
+        safe_free(ctx->pg);
+        safe_free(ctx->range);
+        safe_free(ctx->hash);
+}
+
+static void init_opEnv(struct opEnv * env, int nrSecs)
+{
+        env->nrSecs = nrSecs;
+        safe_malloc(env->bra, nrSecs);
+        safe_malloc(env->scale, nrSecs);
+        safe_malloc(env->block, nrSecs);
+        env->tel = NULL;
+        for (int i = 0; i < nrSecs; ++i) {
+                env->bra[i] = -1;
+                env->scale[i] = 1;
+                env->block[i] = NULL;
+        }
+}
+
+static void destroy_opEnv(struct opEnv * env)
+{
+        safe_free(env->bra);
+        safe_free(env->scale);
+        safe_free(env->block);
+        safe_free(env->tel);
+}
+
+static void init_opCache(struct opCache * cache, const struct RDMop * ops,
+                         int n, struct opCache * parent)
+{
+        assert(n < MAX_OPSTRING);
+        for (int i = 0; i < n; ++i) { cache->ops[i] = ops[i]; }
+        cache->n = n;
+        cache->parent = parent;
+        safe_malloc(cache->env, 2 * netw.nr_bonds);
+        for (int i = 0; i < 2 * netw.nr_bonds; ++i) {
+                cache->env[i].bra = NULL;
+        }
+}
+
+static void destroy_opCache(struct opCache * cache)
+{
+        for (int i = 0; i < 2 * netw.nr_bonds; ++i) {
+                if (cache->env[i].bra != NULL) {
+                        destroy_opEnv(&cache->env[i]);
+                }
+        }
+        safe_free(cache->env);
+}
+
+/* A copy of an environment that does not own the blocks. If @p parity, the
+ * blocks of odd parity change sign. */
+static void borrow_opEnv(const struct opEnv * orig, bool parity, int bond,
+                         struct opEnv * env)
+{
+        struct symsecs ss;
+        get_symsecs(&ss, bond);
+        init_opEnv(env, orig->nrSecs);
+        for (int i = 0; i < env->nrSecs; ++i) {
+                env->bra[i] = orig->bra[i];
+                env->block[i] = orig->block[i];
+                env->scale[i] = parity && ss.irreps[i][0] ? 
+                        -orig->scale[i] : orig->scale[i];
+        }
+}
+
+/* The index in @p ops of the operator that is not in the string of the cache,
+ * @p n if @p ops is the string of the cache and -1 if it is no such string. */
+static int extra_operator(const struct opCache * cache, 
+                          const struct RDMop * ops, int n)
+{
+        if (n != cache->n && n != cache->n + 1) { return -1; }
+        bool used[MAX_OPSTRING] = { false };
+        for (int i = 0; i < cache->n; ++i) {
+                const struct RDMop * op = &cache->ops[i];
+                int j;
+                for (j = 0; j < n; ++j) {
+                        if (!used[j] && ops[j].site == op->site && 
+                            ops[j].create == op->create && 
+                            ops[j].spin == op->spin) { break; }
+                }
+                if (j == n) { return -1; }
+                used[j] = true;
+        }
+        for (int j = 0; j < n; ++j) { if (!used[j]) { return j; } }
+        return n;
+}
+
+// The number of operators in the string at the given positions.
+static int ops_in_range(const struct RDMops * ctx, const struct RDMop * ops,
+                        int n, int lo, int hi)
+{
+        int result = 0;
+        for (int i = 0; i < n; ++i) {
+                const int pos = ctx->pos[ops[i].site];
+                result += pos >= lo && pos <= hi;
+        }
+        return result;
+}
+
+/* The physical leg of a site with the operators of the string at that site.
+ *
+ * Every operator at a later position in the fermionic order gives a sign
+ * (-1)^n for the occupation of this site. */
+static void physical_opEnv(const struct RDMops * ctx, const struct RDMop * ops,
+                           int n, int site, int physbond, struct opEnv * env)
+{
+        struct symsecs ss;
+        get_symsecs(&ss, physbond);
+        init_opEnv(env, ss.nrSecs);
+        const int later = ops_in_range(ctx, ops, n, ctx->pos[site] + 1, 
+                                       netw.psites);
+
+        for (int ket = 0; ket < ss.nrSecs; ++ket) {
+                // The occupations of spin up and spin down.
+                int occ[2] = { ss.irreps[ket][1], ss.irreps[ket][2] };
+                double scale = (later % 2) && ((occ[0] + occ[1]) % 2) ? -1 : 1;
+
+                // The rightmost operator acts first.
+                int i;
+                for (i = n - 1; i >= 0; --i) {
+                        if (ops[i].site != site) { continue; }
+                        const int s = ops[i].spin;
+                        if (occ[s] == ops[i].create) { break; }
+                        occ[s] = ops[i].create;
+                        if (s == 1 && occ[0]) { scale = -scale; }
+                }
+                if (i >= 0) { continue; }
+
+                for (int bra = 0; bra < ss.nrSecs; ++bra) {
+                        if (ss.irreps[bra][1] == occ[0] && 
+                            ss.irreps[bra][2] == occ[1]) {
+                                env->bra[ket] = bra;
+                        }
+                }
+                env->scale[ket] = scale;
+        }
+}
+
+// Multiplies the block with the environment block (bra × ket) at leg @p leg.
+static void apply_opEnv(const T3NS_EL_TYPE * tel, int * tdims, int leg,
+                        const T3NS_EL_TYPE * envtel, int newdim, 
+                        T3NS_EL_TYPE * result)
+{
+        int L = 1;
+        for (int i = 0; i < leg; ++i) { L *= tdims[i]; }
+        int R = 1;
+        for (int i = leg + 1; i < 3; ++i) { R *= tdims[i]; }
+        const int D = tdims[leg];
+
+        for (int r = 0; r < R; ++r) {
+                cblas_dgemm(CblasColMajor, CblasNoTrans, CblasTrans, 
+                            L, newdim, D, 1, tel + r * L * D, L, envtel, 
+                            newdim, 0, result + r * L * newdim, L);
+        }
+        tdims[leg] = newdim;
+}
+
+static void make_opEnv(const struct RDMops * ctx, struct opCache * cache,
+                       const struct RDMop * ops, int n, int bond, int side, 
+                       struct opEnv * env);
+
+/* Contracts the site tensor with itself over all legs except @p leg, with
+ * the environments of the other legs in between. */
+static void contract_opEnv(const struct RDMops * ctx, struct opCache * cache,
+                           const struct RDMop * ops, int n, int site, int leg, 
+                           struct opEnv * env)
+{
+        const struct siteTensor * tens = &ctx->T3NS[site];
+        int bonds[3];
+        get_bonds_of_site(site, bonds);
+        int dims[3];
+        struct symsecs symarr[3];
+        get_symsecs_arr(3, symarr, bonds);
+        get_maxdims_of_bonds(dims, bonds, 3);
+
+        struct opEnv legs[3];
+        for (int i = 0; i < 3; ++i) {
+                if (i == leg) { continue; }
+                if (is_psite(site) && i == 1) {
+                        physical_opEnv(ctx, ops, n, site, bonds[1], &legs[i]);
+                } else {
+                        make_opEnv(ctx, cache, ops, n, bonds[i], 
+                                   netw.bonds[bonds[i]][0] == site, &legs[i]);
+                }
+        }
+        init_opEnv(env, symarr[leg].nrSecs);
+
+        // First pass: the bra block for every ket block.
+        int * safe_malloc(brablock, tens->nrblocks);
+        for (int block = 0; block < tens->nrblocks; ++block) {
+                brablock[block] = -1;
+                const QN_TYPE qn = tens->qnumbers[block];
+                int ids[3];
+                qn_split(ids, qn, dims);
+                int braids[3];
+                int l;
+                for (l = 0; l < 3; ++l) {
+                        if (l == leg) { continue; }
+                        braids[l] = legs[l].bra[ids[l]];
+                        if (braids[l] == -1) { break; }
+                }
+                if (l != 3) { continue; }
+
+                /* Coupling is (0, 1 → 2), so the bra sector of the open leg
+                 * follows from the others. */
+                const int o[3][2] = { {2, 1}, {2, 0}, {0, 1} };
+                int irreps[MAX_SYMMETRIES];
+                for (int j = 0; j < bookie.nrSyms; ++j) {
+                        int nr, step;
+                        tensprod_irrep(&irreps[j], &nr, &step, 
+                                       symarr[o[leg][0]].irreps[braids[o[leg][0]]][j],
+                                       symarr[o[leg][1]].irreps[braids[o[leg][1]]][j],
+                                       leg == 2 ? 1 : -1, bookie.sgs[j]);
+                        assert(nr == 1);
+                }
+                braids[leg] = search_symsec(irreps, &symarr[leg]);
+                if (braids[leg] == -1) { continue; }
+
+                const QN_TYPE braqn = qn_combine(braids, dims);
+                brablock[block] = search_qnhash(&braqn, &ctx->hash[site]);
+                if (brablock[block] == -1) { continue; }
+                assert(env->bra[ids[leg]] == -1 || 
+                       env->bra[ids[leg]] == braids[leg]);
+                env->bra[ids[leg]] = braids[leg];
+        }
+
+        T3NS_BB_TYPE * safe_malloc(begin, env->nrSecs + 1);
+        begin[0] = 0;
+        for (int i = 0; i < env->nrSecs; ++i) {
+                begin[i + 1] = begin[i] + (env->bra[i] == -1 ? 0 : 
+                        symarr[leg].dims[env->bra[i]] * symarr[leg].dims[i]);
+        }
+        safe_calloc(env->tel, begin[env->nrSecs]);
+        for (int i = 0; i < env->nrSecs; ++i) {
+                if (env->bra[i] != -1) { env->block[i] = env->tel + begin[i]; }
+        }
+
+        // Second pass: the contractions.
+        T3NS_EL_TYPE * temp[2] = { NULL, NULL };
+        int tempsize = 0;
+        for (int block = 0; block < tens->nrblocks; ++block) {
+                if (brablock[block] == -1) { continue; }
+                const QN_TYPE qn = tens->qnumbers[block];
+                int ids[3];
+                qn_split(ids, qn, dims);
+                const int N = get_size_block(&tens->blocks, block);
+                const int M = get_size_block(&tens->blocks, brablock[block]);
+                if (N == 0 || M == 0) { continue; }
+
+                int tdims[3] = {
+                        symarr[0].dims[ids[0]], 
+                        symarr[1].dims[ids[1]], 
+                        symarr[2].dims[ids[2]]
+                };
+                // The largest intermediate when applying the environments.
+                int size = N;
+                for (int l = 0, cdims[3] = {tdims[0], tdims[1], tdims[2]}; 
+                     l < 3; ++l) {
+                        if (l == leg || legs[l].block[ids[l]] == NULL) {
+                                continue;
+                        }
+                        cdims[l] = symarr[l].dims[legs[l].bra[ids[l]]];
+                        const int csize = cdims[0] * cdims[1] * cdims[2];
+                        size = csize > size ? csize : size;
+                }
+                if (size > tempsize) {
+                        tempsize = size;
+                        safe_realloc(temp[0], tempsize);
+                        safe_realloc(temp[1], tempsize);
+                }
+                const T3NS_EL_TYPE * applied = get_tel_block(&tens->blocks, 
+                                                             block);
+                double scale = 1;
+                int curr = 0;
+                for (int l = 0; l < 3; ++l) {
+                        if (l == leg) { continue; }
+                        scale *= legs[l].scale[ids[l]];
+                        if (legs[l].block[ids[l]] == NULL) { continue; }
+                        apply_opEnv(applied, tdims, l, legs[l].block[ids[l]], 
+                                    symarr[l].dims[legs[l].bra[ids[l]]], 
+                                    temp[curr]);
+                        applied = temp[curr];
+                        curr = !curr;
+                }
+
+                const T3NS_EL_TYPE * bratel = get_tel_block(&tens->blocks, 
+                                                            brablock[block]);
+                const int Dket = tdims[leg];
+                const int Dbra = symarr[leg].dims[env->bra[ids[leg]]];
+                int L = 1;
+                for (int i = 0; i < leg; ++i) { L *= tdims[i]; }
+                int R = 1;
+                for (int i = leg + 1; i < 3; ++i) { R *= tdims[i]; }
+                assert(L * Dbra * R == M);
+                T3NS_EL_TYPE * result = env->tel + begin[ids[leg]];
+                for (int r = 0; r < R; ++r) {
+                        cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, 
+                                    Dbra, Dket, L, scale, bratel + r * L * Dbra,
+                                    L, applied + r * L * Dket, L, 1, 
+                                    result, Dbra);
+                }
+        }
+        safe_free(temp[0]);
+        safe_free(temp[1]);
+        safe_free(brablock);
+        safe_free(begin);
+        for (int i = 0; i < 3; ++i) {
+                if (i != leg) { destroy_opEnv(&legs[i]); }
+        }
+}
+
+/* The environment of a bond at side @p side with the operators of the string
+ * at that side inserted, without looking in the cache first. */
+static void build_opEnv(const struct RDMops * ctx, struct opCache * cache,
+                        const struct RDMop * ops, int n, int bond, int side, 
+                        struct opEnv * env)
+{
+        const int * range = ctx->range[bond];
+        const int inside = ops_in_range(ctx, ops, n, range[0], range[1]);
+        const int atside = side == 0 ? inside : n - inside;
+
+        if (atside != 0) {
+                const int site = netw.bonds[bond][side];
+                int bonds[3];
+                get_bonds_of_site(site, bonds);
+                int leg;
+                for (leg = 0; leg < 3; ++leg) {
+                        if (bonds[leg] == bond) { break; }
+                }
+                assert(leg != 3);
+                contract_opEnv(ctx, cache, ops, n, site, leg, env);
+                return;
+        }
+
+        // No operators, the plain environment.
+        struct symsecs ss;
+        get_symsecs(&ss, bond);
+        init_opEnv(env, ss.nrSecs);
+        const struct sparseblocks * plain = &ctx->env->env[2 * bond + side];
+        /* Side 0 is a contiguous part of the fermionic order. If an odd 
+         * number of operators comes later, it gives the parity of the bond. */
+        const bool parity = side == 0 && 
+                ops_in_range(ctx, ops, n, range[1] + 1, netw.psites) % 2;
+        for (int i = 0; i < ss.nrSecs; ++i) {
+                env->bra[i] = i;
+                env->scale[i] = parity && ss.irreps[i][0] ? -1 : 1;
+                if (plain->tel != NULL) {
+                        env->block[i] = get_tel_block(plain, i);
+                }
+        }
+}
+
+// Looks for the environment in the cache and its parents, see @ref opCache.
+static bool cached_opEnv(const struct RDMops * ctx, struct opCache * cache,
+                         const struct RDMop * ops, int n, int bond, int side,
+                         struct opEnv * env)
+{
+        for (; cache != NULL; cache = cache->parent) {
+                const int x = extra_operator(cache, ops, n);
+                if (x == -1) { continue; }
+                const int * range = ctx->range[bond];
+                const int pos = x == n ? -1 : ctx->pos[ops[x].site];
+                const bool inside = pos >= range[0] && pos <= range[1];
+                if (side == 0 ? inside : !inside) { continue; }
+
+                // At side 1 the extra operator is needed for the signs.
+                const struct RDMop * base = side == 0 ? cache->ops : ops;
+                const int nbase = side == 0 ? cache->n : n;
+                struct opEnv * stored = &cache->env[2 * bond + side];
+                if (stored->bra == NULL && 
+                    !cached_opEnv(ctx, cache->parent, base, nbase, bond, 
+                                  side, stored)) {
+                        build_opEnv(ctx, cache, base, nbase, bond, side, 
+                                    stored);
+                }
+                borrow_opEnv(stored, side == 0 && pos > range[1], bond, env);
+                return true;
+        }
+        return false;
+}
+
+/* The environment of a bond at side @p side with the operators of the string
+ * at that side inserted. */
+static void make_opEnv(const struct RDMops * ctx, struct opCache * cache,
+                       const struct RDMop * ops, int n, int bond, int side, 
+                       struct opEnv * env)
+{
+        if (!cached_opEnv(ctx, cache, ops, n, bond, side, env)) {
+                build_opEnv(ctx, cache, ops, n, bond, side, env);
+        }
+}
+
+// Contracts the environments at both sides of a bond.
+static double overlap_opEnv(const struct opEnv * envs, int bond)
+{
+        struct symsecs ss;
+        get_symsecs(&ss, bond);
+        double result = 0;
+        for (int ket = 0; ket < ss.nrSecs; ++ket) {
+                const int bra = envs[0].bra[ket];
+                if (bra == -1 || bra != envs[1].bra[ket]) { continue; }
+                const int N = ss.dims[bra] * ss.dims[ket];
+                const T3NS_EL_TYPE * b[2] = { 
+                        envs[0].block[ket], envs[1].block[ket] 
+                };
+                double sum = 0;
+                if (b[0] == NULL && b[1] == NULL) {
+                        sum = ss.dims[ket];
+                } else if (b[0] == NULL || b[1] == NULL) {
+                        const T3NS_EL_TYPE * m = b[0] == NULL ? b[1] : b[0];
+                        for (int i = 0; i < ss.dims[ket]; ++i) {
+                                sum += m[i * (ss.dims[ket] + 1)];
+                        }
+                } else {
+                        for (int i = 0; i < N; ++i) { sum += b[0][i] * b[1][i]; }
+                }
+                result += envs[0].scale[ket] * envs[1].scale[ket] * sum;
+        }
+        return result;
+}
+
+/* The expectation value of the string of operators, leftmost acts last.
+ *
+ * The environments are contracted over the bond above the site of the last
+ * operator in @p string. Without this operator, the environments at both
+ * sides are in @p cache (if not NULL) and only that site has to be 
+ * contracted. */
+static double expectation_value(const struct RDMops * ctx, 
+                                struct opCache * cache,
+                                const struct RDMop * string, int n)
+{
+        // Bring the operators in the fermionic order.
+        struct RDMop ops[MAX_OPSTRING];
+        assert(n > 0 && n <= MAX_OPSTRING);
+        double sign = 1;
+        for (int i = 0; i < n; ++i) {
+                int j = i;
+                for (; j > 0 && ctx->pos[ops[j - 1].site] > 
+                     ctx->pos[string[i].site]; --j) {
+                        ops[j] = ops[j - 1];
+                        sign = -sign;
+                }
+                ops[j] = string[i];
+        }
+
+        int bonds[3];
+        get_bonds_of_site(string[n - 1].site, bonds);
+        struct opEnv envs[2];
+        make_opEnv(ctx, cache, ops, n, bonds[2], 0, &envs[0]);
+        make_opEnv(ctx, cache, ops, n, bonds[2], 1, &envs[1]);
+        const double result = sign * overlap_opEnv(envs, bonds[2]);
+        destroy_opEnv(&envs[0]);
+        destroy_opEnv(&envs[1]);
+        return result;
+}
+
+/* Makes the elements Γ_ij·· of the spin-summed 2-RDM, 
+ * Γ_ijkl = Σ_στ 〈a^†_iσ a^†_jτ a_lτ a_kσ〉, with i and j orbitals.
+ * If @p bslice is not NULL, the elements of Σ_στ (-1)^(σ - τ) 
+ * 〈a^†_iσ a^†_jτ a_lτ a_kσ〉 are made in it from the same expectation values.
+ *
+ * The environments with a^†_iσ a^†_jτ are made once for every σ and τ. The 
+ * ones with a^†_iσ a^†_jτ a_lτ are made from them for every l, after which
+ * every a_kσ only needs the contraction of its own site. */
+static void make_2RDM_slice(const struct RDMops * ctx, const int * orbtosite,
+                            int i, int j, T3NS_EL_TYPE * slice, 
+                            T3NS_EL_TYPE * bslice)
+{
+        const int L = netw.psites;
+        const int si = orbtosite[i];
+        const int sj = orbtosite[j];
+        for (int kl = 0; kl < L * L; ++kl) { slice[kl] = 0; }
+        if (bslice != NULL) {
+                for (int kl = 0; kl < L * L; ++kl) { bslice[kl] = 0; }
+        }
+
+        for (int s = 0; s < 4; ++s) {
+                const int sigma = s / 2;
+                const int tau = s % 2;
+                if (i == j && sigma == tau) { continue; }
+                struct RDMop string[4] = { 
+                        { si, 1, sigma }, { sj, 1, tau } 
+                };
+                struct opCache pair;
+                init_opCache(&pair, string, 2, NULL);
+
+                for (int l = 0; l < L; ++l) {
+                        string[2] = (struct RDMop) { orbtosite[l], 0, tau };
+                        struct opCache triple;
+                        init_opCache(&triple, string, 3, &pair);
+                        for (int k = 0; k < L; ++k) {
+                                const int sk = orbtosite[k];
+                                if (ctx->pg[si] ^ ctx->pg[sj] ^ ctx->pg[sk] ^
+                                    ctx->pg[string[2].site]) { continue; }
+                                if (k == l && sigma == tau) { continue; }
+
+                                string[3] = (struct RDMop) { sk, 0, sigma };
+                                const double value = expectation_value(
+                                        ctx, &triple, string, 4);
+                                slice[k * L + l] += value;
+                                if (bslice != NULL) {
+                                        bslice[k * L + l] += sigma == tau ? 
+                                                value : -value;
+                                }
+                        }
+                        destroy_opCache(&triple);
+                }
+                destroy_opCache(&pair);
+        }
+}
+
+/* Makes the spin-summed 1-RDM, γ_ik = Σ_σ〈a^†_iσ a_kσ〉, with i and k 
+ * orbitals. */
+static void make_1RDM(const struct RDMops * ctx, const int * orbtosite,
+                      T3NS_EL_TYPE * onerdm)
+{
+        const int L = netw.psites;
+        for (int ik = 0; ik < L * L; ++ik) { onerdm[ik] = 0; }
+        for (int i = 0; i < L; ++i) {
+                for (int sigma = 0; sigma < 2; ++sigma) {
+                        struct RDMop string[2] = { 
+                                { orbtosite[i], 1, sigma } 
+                        };
+                        struct opCache single;
+                        init_opCache(&single, string, 1, NULL);
+                        for (int k = 0; k < L; ++k) {
+                                if (ctx->pg[orbtosite[i]] != 
+                                    ctx->pg[orbtosite[k]]) { continue; }
+                                string[1] = (struct RDMop) { 
+                                        orbtosite[k], 0, sigma 
+                                };
+                                onerdm[i * L + k] += expectation_value(
+                                        ctx, &single, string, 2);
+                        }
+                        destroy_opCache(&single);
+                }
+        }
+}
+
+int check_opstrings_support(enum hamtypes hamtype, int nrSyms,
+                            const enum symmetrygroup * sgs, const char * what)
+{
+        if (hamtype != QC || nrSyms < 3 || sgs[1] != U1 || sgs[2] != U1) {
+                fprintf(stderr, "The %s is only implemented for the quantum chemistry Hamiltonian with U1 U1 symmetry.\n"
+                        "States with SU2 symmetry are not supported, optimize them with U1 for the spin projection instead.\n", what);
+                return 1;
+        }
+        return 0;
+}
+
+// Checks if the operator strings can be evaluated for the current state.
+static int check_opstrings(const char * what)
+{
+        return check_opstrings_support(ham, bookie.nrSyms, bookie.sgs, what);
+}
+
+// Makes the environments and checks the norm of the state.
+static int prepare_environments(const struct siteTensor * T3NS, 
+                                struct RDMenv * env)
+{
+        make_environments(T3NS, env);
+        const double norm = norm_of_state(env);
+        if (fabs(norm - 1) > 1e-9) {
+                fprintf(stderr, "State not normed. (deviation: %e)\n", 
+                        fabs(norm - 1));
+                destroy_environments(env);
+                return 1;
+        }
+        return 0;
+}
+
+// The site of every orbital of the Hamiltonian.
+static int * make_orbtosite(void)
+{
+        int * safe_malloc(orbtosite, netw.psites);
+        for (int site = 0; site < netw.sites; ++site) {
+                if (is_psite(site)) { orbtosite[netw.sitetoorb[site]] = site; }
+        }
+        return orbtosite;
+}
+
+/* Makes the full spin-summed 2-RDM in @p twordm and, if not NULL, the one 
+ * with (-1)^(σ - τ) in @p brdm, see @ref make_2RDM_slice. */
+static void make_2RDM(const struct RDMops * ctx, const int * orbtosite,
+                      T3NS_EL_TYPE * twordm, T3NS_EL_TYPE * brdm)
+{
+        const int L = netw.psites;
+        // Γ_jilk = Γ_ijkl, so only the slices with i <= j are made.
+        const int nrpairs = L * (L + 1) / 2;
+        const long long L2 = L * L;
+#pragma omp parallel for schedule(dynamic) default(none) \
+        shared(ctx,orbtosite,twordm,brdm,nrpairs,L,L2) copyin(t3ns_ctx)
+        for (int pair = 0; pair < nrpairs; ++pair) {
+                int i = 0;
+                int j = pair;
+                while (j >= L - i) { j -= L - i; ++i; }
+                j += i;
+
+                T3NS_EL_TYPE * rdms[2] = { twordm, brdm };
+                T3NS_EL_TYPE * slice[2];
+                for (int r = 0; r < 2; ++r) {
+                        slice[r] = rdms[r] == NULL ? NULL : 
+                                &rdms[r][(i * L + j) * L2];
+                }
+                make_2RDM_slice(ctx, orbtosite, i, j, slice[0], slice[1]);
+                if (i == j) { continue; }
+                for (int r = 0; r < 2; ++r) {
+                        if (rdms[r] == NULL) { continue; }
+                        T3NS_EL_TYPE * transposed = &rdms[r][(j * L + i) * L2];
+                        for (int k = 0; k < L; ++k) {
+                                for (int l = 0; l < L; ++l) {
+                                        transposed[l * L + k] = 
+                                                slice[r][k * L + l];
+                                }
+                        }
+                }
+        }
+}
+
+/* Makes Γ^A and Γ^B of struct RedDM in @p chemRDM, the environments of the
+ * state are already made in @p env. */
+static void make_chemRDM(const struct siteTensor * T3NS, 
+                         const struct RDMenv * env, T3NS_EL_TYPE ** chemRDM)
+{
+        printf(" >> Calculating the chemical 2-RDMs\n");
+        struct RDMops ctx;
+        init_RDMops(&ctx, T3NS, env);
+        int * orbtosite = make_orbtosite();
+        make_2RDM(&ctx, orbtosite, chemRDM[0], chemRDM[1]);
+        safe_free(orbtosite);
+        destroy_RDMops(&ctx);
+}
+
+int write_2RDM(const struct siteTensor * T3NS, const char * filename)
+{
+        if (check_opstrings("2-RDM")) { return 1; }
+        printf(" >> Calculating the spin-summed 2-RDM\n");
+
+        struct RDMenv env;
+        if (prepare_environments(T3NS, &env)) { return 1; }
+
+        struct RDM_stream stream;
+        if (open_2RDM_stream(&stream, filename, netw.psites)) {
+                destroy_environments(&env);
+                return 1;
+        }
+
+        struct RDMops ctx;
+        init_RDMops(&ctx, T3NS, &env);
+        const int L = netw.psites;
+        int * orbtosite = make_orbtosite();
+
+        T3NS_EL_TYPE * safe_malloc(onerdm, L * L);
+        make_1RDM(&ctx, orbtosite, onerdm);
+
+        // Γ_jilk = Γ_ijkl, so only the slices with i <= j are made.
+        const int nrpairs = L * (L + 1) / 2;
+#pragma omp parallel default(none) shared(ctx,orbtosite,stream,nrpairs,L) \
+        copyin(t3ns_ctx)
+        {
+                T3NS_EL_TYPE * safe_malloc(slice, L * L);
+                T3NS_EL_TYPE * safe_malloc(transposed, L * L);
+#pragma omp for schedule(dynamic)
+                for (int pair = 0; pair < nrpairs; ++pair) {
+                        int i = 0;
+                        int j = pair;
+                        while (j >= L - i) { j -= L - i; ++i; }
+                        j += i;
+
+                        make_2RDM_slice(&ctx, orbtosite, i, j, slice, NULL);
+                        for (int k = 0; k < L; ++k) {
+                                for (int l = 0; l < L; ++l) {
+                                        transposed[l * L + k] = slice[k * L + l];
+                                }
+                        }
+#pragma omp critical (rdm_output)
+                        {
+                                write_2RDM_slice(&stream, i, j, slice);
+                                if (i != j) {
+                                        write_2RDM_slice(&stream, j, i, 
+                                                         transposed);
+                                }
+                        }
+                }
+                safe_free(slice);
+                safe_free(transposed);
+        }
+
+        close_2RDM_stream(&stream, onerdm);
+        safe_free(onerdm);
+        safe_free(orbtosite);
+        destroy_RDMops(&ctx);
+        destroy_environments(&env);
+        return 0;
+}
+
+int get_2RDM(const struct siteTensor * T3NS, T3NS_EL_TYPE * onerdm,
+             T3NS_EL_TYPE * twordm)
+{
+        if (check_opstrings("2-RDM")) { return 1; }
+        printf(" >> Calculating the spin-summed %s\n", 
+               twordm == NULL ? "1-RDM" : "1- and 2-RDM");
+
+        struct RDMenv env;
+        if (prepare_environments(T3NS, &env)) { return 1; }
+
+        struct RDMops ctx;
+        init_RDMops(&ctx, T3NS, &env);
+        int * orbtosite = make_orbtosite();
+        make_1RDM(&ctx, orbtosite, onerdm);
+        if (twordm != NULL) { make_2RDM(&ctx, orbtosite, twordm, NULL); }
+
+        safe_free(orbtosite);
+        destroy_RDMops(&ctx);
+        destroy_environments(&env);
+        return 0;
+}
+
+/* ========================================================================== */
+/* ====================== TWO-ORBITAL MUTUAL INFORMATION ==================== */
+/* ========================================================================== */
+
+/* Appends the transition operator |a〉〈c| of the orbital at @p site as a 
+ * string of creators and annihilators. The local states are numbered as
+ * n_up + 2 n_down with |a〉 = (a^†_up)^a_up (a^†_down)^a_down |0〉.
+ *
+ * The string is (-1)^((a_down + c_down) c_up) |a〉〈c|, this sign is 
+ * returned. */
+static double transition_string(int site, int a, int c, struct RDMop * string,
+                                int * n)
+{
+        for (int s = 0; s < 2; ++s) {
+                const int occa = (a >> s) & 1;
+                const int occc = (c >> s) & 1;
+                // n = a^† a and 1 - n = a a^†, the leftmost acts last.
+                string[(*n)++] = (struct RDMop) { site, occa, s };
+                if (occa == occc) {
+                        string[(*n)++] = (struct RDMop) { site, !occa, s };
+                }
+        }
+        return ((a >> 1) ^ (c >> 1)) & c & 1 ? -1 : 1;
+}
+
+static int parity_of_state(int a) { return (a ^ (a >> 1)) & 1; }
+
+/* The element 〈|ab〉〈cd|〉 of the two-orbital RDM of the orbitals at 
+ * @p site[0] and @p site[1], with |ab〉 = |a〉|b〉 in that order. */
+static double pair_element(const struct RDMops * ctx, const int * site, 
+                           int a, int b, int c, int d)
+{
+        // The point group irreps of the transitions should cancel.
+        const int pg[2] = {
+                parity_of_state(a ^ c) ? ctx->pg[site[0]] : 0,
+                parity_of_state(b ^ d) ? ctx->pg[site[1]] : 0
+        };
+        if (pg[0] != pg[1]) { return 0; }
+
+        struct RDMop string[MAX_OPSTRING];
+        int n = 0;
+        double sign = transition_string(site[0], a, c, string, &n);
+        sign *= transition_string(site[1], b, d, string, &n);
+        /* Commuting the transition operator of the second orbital through 
+         * 〈c| of the first one. */
+        if (parity_of_state(c) && parity_of_state(b ^ d)) { sign = -sign; }
+        return sign * expectation_value(ctx, NULL, string, n);
+}
+
+// Adds -Σ ω ln ω of the eigenvalues of a symmetric matrix to @p entropy.
+static int add_entropy(double * mat, int dim, double * entropy)
+{
+        double eigvalues[16];
+        assert(dim <= 16);
+        const int info = LAPACKE_dsyev(LAPACK_COL_MAJOR, 'N', 'U', dim, mat, 
+                                       dim, eigvalues);
+        if (info != 0) {
+                fprintf(stderr, "dsyev ended with %d.\n", info);
+                return 1;
+        }
+        for (int i = 0; i < dim; ++i) {
+                // Prevents log(0) and log of small negative rounding errors.
+                if (eigvalues[i] > 1e-10) {
+                        *entropy -= eigvalues[i] * log(eigvalues[i]);
+                }
+        }
+        return 0;
+}
+
+// The entropy of the one-orbital RDM, which is diagonal.
+static double orbital_entropy(const struct RDMops * ctx, int site)
+{
+        double result = 0;
+        for (int a = 0; a < 4; ++a) {
+                struct RDMop string[MAX_OPSTRING];
+                int n = 0;
+                transition_string(site, a, a, string, &n);
+                const double omega = expectation_value(ctx, NULL, string, n);
+                if (omega > 1e-10) { result -= omega * log(omega); }
+        }
+        return result;
+}
+
+/* The entropy of the two-orbital RDM. This RDM is block diagonal in the 
+ * number of spin-up and spin-down electrons on the pair. */
+static int pair_entropy(const struct RDMops * ctx, const int * site, 
+                        double * entropy)
+{
+        *entropy = 0;
+        for (int nup = 0; nup < 3; ++nup) {
+                for (int ndown = 0; ndown < 3; ++ndown) {
+                        int states[4][2];
+                        int dim = 0;
+                        for (int ab = 0; ab < 16; ++ab) {
+                                const int a = ab % 4;
+                                const int b = ab / 4;
+                                if ((a & 1) + (b & 1) != nup || 
+                                    (a >> 1) + (b >> 1) != ndown) {
+                                        continue;
+                                }
+                                states[dim][0] = a;
+                                states[dim][1] = b;
+                                ++dim;
+                        }
+
+                        double rdm[16];
+                        for (int x = 0; x < dim; ++x) {
+                                for (int y = x; y < dim; ++y) {
+                                        rdm[x + y * dim] = pair_element(
+                                                ctx, site, states[x][0], 
+                                                states[x][1], states[y][0], 
+                                                states[y][1]);
+                                }
+                        }
+                        if (add_entropy(rdm, dim, entropy)) { return 1; }
+                }
+        }
+        return 0;
+}
+
+int get_mutualInformation(const struct siteTensor * T3NS, double * entropy,
+                          double * Iij)
+{
+        if (check_opstrings("mutual information")) { return 1; }
+        printf(" >> Calculating the orbital mutual information\n");
+
+        struct RDMenv env;
+        if (prepare_environments(T3NS, &env)) { return 1; }
+
+        struct RDMops ctx;
+        init_RDMops(&ctx, T3NS, &env);
+        const int L = netw.psites;
+        int * orbtosite = make_orbtosite();
+
+#pragma omp parallel for schedule(dynamic) default(none) shared(ctx,orbtosite,entropy,L) \
+        copyin(t3ns_ctx)
+        for (int i = 0; i < L; ++i) {
+                entropy[i] = orbital_entropy(&ctx, orbtosite[i]);
+        }
+
+        int flag = 0;
+        const int nrpairs = L * (L - 1) / 2;
+        // Every thread skips its remaining pairs after a failure.
+#pragma omp parallel for schedule(dynamic) default(none) shared(ctx,orbtosite,entropy,Iij,L,nrpairs) \
+        reduction(||:flag) copyin(t3ns_ctx)
+        for (int pair = 0; pair < nrpairs; ++pair) {
+                if (flag) { continue; }
+                // The pairs i < j.
+                int i = 0;
+                int j = pair;
+                while (j >= L - 1 - i) { j -= L - 1 - i; ++i; }
+                j += i + 1;
+
+                const int sites[2] = { orbtosite[i], orbtosite[j] };
+                double Sij;
+                if (pair_entropy(&ctx, sites, &Sij)) {
+                        flag = 1;
+                        continue;
+                }
+                Iij[i * L + j] = 0.5 * (entropy[i] + entropy[j] - Sij);
+                Iij[j * L + i] = Iij[i * L + j];
+        }
+        for (int i = 0; i < L; ++i) { Iij[i * L + i] = 0; }
+
+        safe_free(orbtosite);
+        destroy_RDMops(&ctx);
+        destroy_environments(&env);
+        return flag;
+}
@@ -27,7 +27,15 @@
 #include "hamiltonian.h"
 #include "sort.h"
 
-struct bookkeeper bookie;
+static struct bookkeeper * bookie_view = NULL;
+#pragma omp threadprivate(bookie_view)
+
+void set_bookie_view(struct bookkeeper * keeper) { bookie_view = keeper; }
+
+struct bookkeeper * get_bookie(void)
+{
+        return bookie_view == NULL ? &bookie : bookie_view;
+}
 
 static void kick_impossibles(struct symsecs * const sector)
 {
@@ -342,6 +350,11 @@ static void create_v_symsecs(int max_dim, int interm_scale, int minocc)
         }
 }
 
+void set_symmetry_kernels(struct bookkeeper * keeper)
+{
+        keeper->kernels = get_symmetry_kernels(keeper->nrSyms, keeper->sgs);
+}
+
 void destroy_bookkeeper(struct bookkeeper * keeper)
 {
         for (int cnt = 0; cnt < keeper->nr_bonds; ++cnt) {
@@ -587,7 +600,8 @@ struct bookkeeper shallow_copy_bookkeeper(struct bookkeeper * tocopy)
                 .nr_bonds = tocopy->nr_bonds,
                 .v_symsecs = tocopy->v_symsecs,
                 .p_symsecs = tocopy->p_symsecs,
-                .psites = tocopy->psites
+                .psites = tocopy->psites,
+                .kernels = tocopy->kernels
         };
         for (int i = 0; i < tocopy->nrSyms; ++i) {
                 copy.sgs[i] =tocopy->sgs[i];
@@ -782,6 +796,7 @@ int preparebookkeeper(struct bookkeeper * prevbookie, int max_dim,
                       int interm_scale, int minocc, int * changedSS)
 {
         if (changedSS != NULL) { *changedSS = 0; }
+        set_symmetry_kernels(&bookie);
         // Create bookkeeper from scratch
         if (prevbookie == NULL) {
                 create_p_symsecs(&bookie);
@@ -797,34 +812,49 @@ int preparebookkeeper(struct bookkeeper * prevbookie, int max_dim,
 
         // Adding empty symmetry sectors
         if (minocc) {
-                printf(" > Adding previously removed symmetry sectors.\n");
-                printf("   The wave function will be filled with noise in these sectors.\n");
-                // The symmetries itself were not changed, just deepcopy
-                if (!*changedSS) {
-                        *changedSS = 1;
-                        // Copying bookkeeper
-                        safe_malloc(bookie.v_symsecs, bookie.nr_bonds);
-                        for (int i = 0; i < bookie.nr_bonds; ++i) {
-                                deep_copy_symsecs(&bookie.v_symsecs[i], 
-                                                  &prevbookie->v_symsecs[i]);
-                        }
-                        create_p_symsecs(&bookie);
-                }
-
+                /* If the symmetries itself were not changed, the sectors of 
+                 * the previous calculation are still owned by prevbookie. */
                 struct symsecs * lofss = bookie.v_symsecs;
+                const bool owned = *changedSS;
+
                 // create new virtual symsecs with minimal filling
                 create_v_symsecs(max_dim, interm_scale, minocc);
 
                 // Select highest dimension of lofss unless that one is zero
+                int changedbonds = 0;
                 for (int i = 0; i < bookie.nr_bonds; ++i) {
                         select_highest_ss_dim(&lofss[i], 
                                               &bookie.v_symsecs[i]);
+                        changedbonds += !same_symsecs(&lofss[i], 
+                                                      &bookie.v_symsecs[i]);
                 }
-                // Set dimensions of target bond on 1
-                for (int i = 0; i < bookie.nr_bonds; ++i) {
-                        destroy_symsecs(&lofss[i]);
+
+                if (!owned && changedbonds == 0) {
+                        /* All sectors are still populated, e.g. when only the
+                         * bond dimension grows. Keep the previous 
+                         * bookkeeper, so the wave function and the 
+                         * renormalized operators can be reused as they are. */
+                        printf(" > All symmetry sectors are still populated, the wave function is kept.\n");
+                        for (int i = 0; i < bookie.nr_bonds; ++i) {
+                                destroy_symsecs(&bookie.v_symsecs[i]);
+                        }
+                        safe_free(bookie.v_symsecs);
+                        bookie.v_symsecs = lofss;
+                        return 0;
+                }
+
+                printf(" > Adding previously removed symmetry sectors at %d bonds.\n",
+                       changedbonds);
+                printf("   The wave function will be filled with noise in these sectors.\n");
+                if (owned) {
+                        for (int i = 0; i < bookie.nr_bonds; ++i) {
+                                destroy_symsecs(&lofss[i]);
+                        }
+                        safe_free(lofss);
+                } else {
+                        *changedSS = 1;
+                        create_p_symsecs(&bookie);
                 }
-                safe_free(lofss);
         }
         return 0;
 }
@@ -909,4 +939,5 @@ void deep_copy_bookkeeper(struct bookkeeper * copy, const struct bookkeeper * to
         for (int i = 0; i < copy->psites; ++i) {
                 deep_copy_symsecs(&copy->p_symsecs[i], &tocopy->p_symsecs[i]);
         }
+        copy->kernels = tocopy->kernels;
 }
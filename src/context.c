@@ -0,0 +1,124 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <omp.h>
+
+#include "context.h"
+#include "network.h"
+#include "bookkeeper.h"
+#include "hamiltonian.h"
+#include "instructions.h"
+#include "macros.h"
+
+static struct t3ns_context default_context = { .state = { NULL } };
+
+CONTEXT_TLS struct t3ns_context * t3ns_ctx = &default_context;
+
+void * context_allocate(struct t3ns_context * ctx, enum context_slot slot,
+                        size_t size)
+{
+        void * state;
+        /* Two threads of the same calculation can get here at the same time,
+         * only one allocates. */
+#pragma omp critical (context)
+        {
+                state = ctx->state[slot];
+                if (state == NULL) {
+                        state = safe_calloc_helper(1, size, "context state",
+                                                   __FILE__, __LINE__,
+                                                   __func__);
+                        ctx->state[slot] = state;
+                }
+        }
+        return state;
+}
+
+#ifdef _OPENMP
+static omp_lock_t * context_locks(struct t3ns_context * ctx)
+{
+        omp_lock_t * locks = ctx->locks;
+        if (locks != NULL) { return locks; }
+#pragma omp critical (context)
+        {
+                locks = ctx->locks;
+                if (locks == NULL) {
+                        safe_malloc(locks, NR_CONTEXT_LOCKS);
+                        for (int i = 0; i < NR_CONTEXT_LOCKS; ++i) {
+                                omp_init_lock(&locks[i]);
+                        }
+                        ctx->locks = locks;
+                }
+        }
+        return locks;
+}
+
+void context_lock(enum context_lock lock)
+{
+        omp_set_lock(&context_locks(t3ns_ctx)[lock]);
+}
+
+void context_unlock(enum context_lock lock)
+{
+        omp_unset_lock(&context_locks(t3ns_ctx)[lock]);
+}
+#else
+void context_lock(enum context_lock lock) { (void) lock; }
+
+void context_unlock(enum context_lock lock) { (void) lock; }
+#endif
+
+struct t3ns_context * create_context(void)
+{
+        struct t3ns_context * safe_calloc(ctx, 1);
+        return ctx;
+}
+
+void destroy_context(struct t3ns_context * ctx)
+{
+        if (ctx == NULL || ctx == &default_context) { return; }
+
+        struct t3ns_context * prev = use_context(ctx);
+        clear_instructions();
+        destroy_hamiltonian();
+        destroy_bookkeeper(&bookie);
+        destroy_network(&netw);
+        use_context(prev == ctx ? NULL : prev);
+
+        for (int i = 0; i < NR_CONTEXT_SLOTS; ++i) {
+                safe_free(ctx->state[i]);
+        }
+#ifdef _OPENMP
+        omp_lock_t * locks = ctx->locks;
+        for (int i = 0; locks != NULL && i < NR_CONTEXT_LOCKS; ++i) {
+                omp_destroy_lock(&locks[i]);
+        }
+#endif
+        safe_free(ctx->locks);
+        safe_free(ctx);
+}
+
+struct t3ns_context * context_or_default(struct t3ns_context * ctx)
+{
+        return ctx == NULL ? &default_context : ctx;
+}
+
+struct t3ns_context * use_context(struct t3ns_context * ctx)
+{
+        struct t3ns_context * prev = t3ns_ctx;
+        t3ns_ctx = context_or_default(ctx);
+        return prev;
+}
@@ -35,7 +35,8 @@
 
 /* For algorithm see http://people.inf.ethz.ch/arbenz/ewp/Lnotes/chapter12.pdf, algorithm 12.1 */
 
-static struct {
+/* Data of a single Davidson run, kept local so concurrent runs don't clash. */
+struct david_data {
         /* sizes */
         int m;
         int max_vecs;
@@ -51,7 +52,7 @@ static struct {
         double * sub_matrix;
         double * eigv;
         double * eigvalues;
-} david_dat;
+};
 
 static int max_vecs_to_alloc(int max_vectors, int keep_deflate, int size)
 {
@@ -77,35 +78,36 @@ static int max_vecs_to_alloc(int max_vectors, int keep_deflate, int size)
         return new_mvecs;
 }
 
-static void init_david_dat(const double * result, const double * diagonal, 
-                           int size, int max_vecs, int keep_deflate)
+static void init_david_dat(struct david_data * dd, const double * result, 
+                           const double * diagonal, int size, int max_vecs, 
+                           int keep_deflate)
 {
         /* sizes */
-        david_dat.m = 0;
-        david_dat.size = size;
+        dd->m = 0;
+        dd->size = size;
         max_vecs = max_vecs_to_alloc(max_vecs, keep_deflate, size);
-        david_dat.max_vecs = max_vecs;
+        dd->max_vecs = max_vecs;
 
         /* The full problem */
-        safe_malloc(david_dat.V , (long long) size * max_vecs);
-        safe_malloc(david_dat.VA, (long long) size * max_vecs);
-        david_dat.diagonal = diagonal;
+        safe_malloc(dd->V , (long long) size * max_vecs);
+        safe_malloc(dd->VA, (long long) size * max_vecs);
+        dd->diagonal = diagonal;
         /* vec_t and residue vector */
-        safe_malloc(david_dat.vec_t, size);
-        for (int i = 0; i < size; ++i) { david_dat.vec_t[i] = result[i]; }
+        safe_malloc(dd->vec_t, size);
+        for (int i = 0; i < size; ++i) { dd->vec_t[i] = result[i]; }
 
         /* Projected problem */
-        safe_malloc(david_dat.sub_matrix, max_vecs * max_vecs);
-        safe_malloc(david_dat.eigv      , max_vecs * max_vecs);
-        safe_malloc(david_dat.eigvalues , max_vecs);
+        safe_malloc(dd->sub_matrix, max_vecs * max_vecs);
+        safe_malloc(dd->eigv      , max_vecs * max_vecs);
+        safe_malloc(dd->eigvalues , max_vecs);
 }
 
 #ifndef NDEBUG
-static void check_ortho(void)
+static void check_ortho(const struct david_data * dd)
 {
-        double * Vi = david_dat.V;
-        for (int i = 0; i < david_dat.m; ++i, Vi += david_dat.size) {
-                double a = -cblas_ddot(david_dat.size, Vi, 1, david_dat.vec_t, 1);
+        double * Vi = dd->V;
+        for (int i = 0; i < dd->m; ++i, Vi += dd->size) {
+                double a = -cblas_ddot(dd->size, Vi, 1, dd->vec_t, 1);
                 if (fabs(a) > 1e-9) {
                         printf("value of a[%d] = %e\n", i, a);
                         exit(EXIT_FAILURE);
@@ -114,44 +116,44 @@ static void check_ortho(void)
 }
 #endif
 
-static void new_search_vector(void)
+static void new_search_vector(struct david_data * dd)
 {
-        double * Vi = david_dat.V;
-        for (int i = 0; i < david_dat.m; ++i, Vi += david_dat.size) {
-                double a = -cblas_ddot(david_dat.size, Vi, 1, david_dat.vec_t, 1);
-                cblas_daxpy(david_dat.size, a, Vi, 1, david_dat.vec_t, 1);
+        double * Vi = dd->V;
+        for (int i = 0; i < dd->m; ++i, Vi += dd->size) {
+                double a = -cblas_ddot(dd->size, Vi, 1, dd->vec_t, 1);
+                cblas_daxpy(dd->size, a, Vi, 1, dd->vec_t, 1);
         }
-        double a = 1 / cblas_dnrm2(david_dat.size, david_dat.vec_t, 1);
-        cblas_dscal(david_dat.size, a, david_dat.vec_t, 1);
+        double a = 1 / cblas_dnrm2(dd->size, dd->vec_t, 1);
+        cblas_dscal(dd->size, a, dd->vec_t, 1);
 #ifndef NDEBUG
-        check_ortho();
+        check_ortho(dd);
 #endif
-        for(int i = 0; i < david_dat.size; ++i) { Vi[i] = david_dat.vec_t[i]; }
+        for(int i = 0; i < dd->size; ++i) { Vi[i] = dd->vec_t[i]; }
 }
 
-static void expand_submatrix(void)
+static void expand_submatrix(struct david_data * dd)
 {
 
-        double * const VAm = david_dat.VA + (long long) david_dat.size * david_dat.m;
-#pragma omp parallel for default(none) shared(david_dat)
-        for (int i = 0; i < david_dat.m + 1; ++i) {
-                const int shift         = david_dat.m * david_dat.max_vecs;
-                const long long  shift2 = (long long) david_dat.size * i;
-                david_dat.sub_matrix[shift + i] = cblas_ddot(david_dat.size, 
-                                                             david_dat.V + shift2, 
-                                                             1, VAm, 1);
+        double * const VAm = dd->VA + (long long) dd->size * dd->m;
+#pragma omp parallel for default(none) shared(dd)
+        for (int i = 0; i < dd->m + 1; ++i) {
+                const int shift         = dd->m * dd->max_vecs;
+                const long long  shift2 = (long long) dd->size * i;
+                dd->sub_matrix[shift + i] = cblas_ddot(dd->size, 
+                                                       dd->V + shift2, 
+                                                       1, VAm, 1);
         }
-        ++david_dat.m;
+        ++dd->m;
 }
 
-static int do_eigsolve(void)
+static int do_eigsolve(struct david_data * dd)
 {
-        const int size = david_dat.m * david_dat.max_vecs;
-        for (int i = 0; i < size; ++i) { david_dat.eigv[i] = david_dat.sub_matrix[i]; }
+        const int size = dd->m * dd->max_vecs;
+        for (int i = 0; i < size; ++i) { dd->eigv[i] = dd->sub_matrix[i]; }
 
-        int info = LAPACKE_dsyev(LAPACK_COL_MAJOR, 'V', 'U', david_dat.m, 
-                                 david_dat.eigv, david_dat.max_vecs, 
-                                 david_dat.eigvalues);
+        int info = LAPACKE_dsyev(LAPACK_COL_MAJOR, 'V', 'U', dd->m, 
+                                 dd->eigv, dd->max_vecs, 
+                                 dd->eigvalues);
         if (info == 0) {
                 return 0;
         } else {
@@ -161,61 +163,61 @@ static int do_eigsolve(void)
         } 
 }
 
-static void deflate(int keep_deflate)
+static void deflate(struct david_data * dd, int keep_deflate)
 {
-        long long size_x_deflate = (long long) david_dat.size * keep_deflate;
+        long long size_x_deflate = (long long) dd->size * keep_deflate;
         double * safe_malloc(new_result, size_x_deflate);
 
-        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, david_dat.size, 
-                    keep_deflate, david_dat.max_vecs, 1, david_dat.V, 
-                    david_dat.size, david_dat.eigv, david_dat.max_vecs, 0, 
-                    new_result , david_dat.size);
-        for (int i = 0; i < size_x_deflate; ++i) { david_dat.V[i] = new_result[i]; }
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, dd->size, 
+                    keep_deflate, dd->max_vecs, 1, dd->V, 
+                    dd->size, dd->eigv, dd->max_vecs, 0, 
+                    new_result , dd->size);
+        for (int i = 0; i < size_x_deflate; ++i) { dd->V[i] = new_result[i]; }
 
-        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, david_dat.size, 
-                    keep_deflate, david_dat.max_vecs, 1, david_dat.VA, 
-                    david_dat.size, david_dat.eigv, david_dat.max_vecs, 0, 
-                    new_result , david_dat.size);
-        for (int i = 0; i < size_x_deflate; ++i) { david_dat.VA[i] = new_result[i]; }
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, dd->size, 
+                    keep_deflate, dd->max_vecs, 1, dd->VA, 
+                    dd->size, dd->eigv, dd->max_vecs, 0, 
+                    new_result , dd->size);
+        for (int i = 0; i < size_x_deflate; ++i) { dd->VA[i] = new_result[i]; }
 
         safe_free(new_result);
 
-        david_dat.m = 0;
-        while (david_dat.m < keep_deflate) { expand_submatrix(); }
+        dd->m = 0;
+        while (dd->m < keep_deflate) { expand_submatrix(dd); }
 }
 
-static double calculate_residue(double * result)
+static double calculate_residue(struct david_data * dd, double * result)
 {
         double norm2 = 0;
-        const double theta = david_dat.eigvalues[0];
-
-#pragma omp parallel for default(none) shared(david_dat,result) reduction(+:norm2)
-        for (int i = 0; i < david_dat.size; ++i) {
-                result[i] = cblas_ddot(david_dat.m, david_dat.V + i, 
-                                       david_dat.size, david_dat.eigv, 1);
-                david_dat.vec_t[i] = cblas_ddot(david_dat.m, david_dat.VA + i, 
-                                                david_dat.size, david_dat.eigv, 1);
-                david_dat.vec_t[i] -= theta * result[i];
-                norm2 += david_dat.vec_t[i] * david_dat.vec_t[i];
+        const double theta = dd->eigvalues[0];
+
+#pragma omp parallel for default(none) shared(dd,result) reduction(+:norm2)
+        for (int i = 0; i < dd->size; ++i) {
+                result[i] = cblas_ddot(dd->m, dd->V + i, 
+                                       dd->size, dd->eigv, 1);
+                dd->vec_t[i] = cblas_ddot(dd->m, dd->VA + i, 
+                                          dd->size, dd->eigv, 1);
+                dd->vec_t[i] -= theta * result[i];
+                norm2 += dd->vec_t[i] * dd->vec_t[i];
         }
         return sqrt(norm2);
 }
 
-static void clean_david_dat(void)
+static void clean_david_dat(struct david_data * dd)
 {
-        safe_free(david_dat.V);
-        safe_free(david_dat.VA);
-        safe_free(david_dat.vec_t);
-        safe_free(david_dat.sub_matrix);
-        safe_free(david_dat.eigv);
-        safe_free(david_dat.eigvalues);
+        safe_free(dd->V);
+        safe_free(dd->VA);
+        safe_free(dd->vec_t);
+        safe_free(dd->sub_matrix);
+        safe_free(dd->eigv);
+        safe_free(dd->eigvalues);
 }
 
-static void create_new_vec_t(const double * result)
+static void create_new_vec_t(struct david_data * dd, const double * result)
 {
-        davidson_diagonal_preconditioner(result, david_dat.eigvalues[0],
-                                         david_dat.size, david_dat.diagonal,
-                                         david_dat.vec_t);
+        davidson_diagonal_preconditioner(result, dd->eigvalues[0],
+                                         dd->size, dd->diagonal,
+                                         dd->vec_t);
 }
 
 /* ========================================================================== */
@@ -267,7 +269,8 @@ int davidson(double * result, double * energy, int size, int max_vecs,
         double d_energy = davidson_tol * 10;
         *energy = 0;
 
-        init_david_dat(result, diagonal, size, max_vecs, keep_deflate);
+        struct david_data dd;
+        init_david_dat(&dd, result, diagonal, size, max_vecs, keep_deflate);
 
         struct timeval t_start, t_end;
         gettimeofday(&t_start, NULL);
@@ -282,24 +285,24 @@ int davidson(double * result, double * energy, int size, int max_vecs,
 #endif
 
         while ((residue_norm > davidson_tol) && its < max_its) {
-                new_search_vector();
-                long long shift = (long long) david_dat.m * david_dat.size;
+                new_search_vector(&dd);
+                long long shift = (long long) dd.m * dd.size;
 
                 /* only here expensive matvec needed */
-                matvec(david_dat.V + shift, david_dat.VA + shift, vdat);
-                expand_submatrix();
-                if (do_eigsolve() != 0)
+                matvec(dd.V + shift, dd.VA + shift, vdat);
+                expand_submatrix(&dd);
+                if (do_eigsolve(&dd) != 0)
                         return -1;
 
-                if (david_dat.m == david_dat.max_vecs) {   /* deflation */
-                        deflate(keep_deflate);
-                        if (do_eigsolve() != 0)
+                if (dd.m == dd.max_vecs) {   /* deflation */
+                        deflate(&dd, keep_deflate);
+                        if (do_eigsolve(&dd) != 0)
                                 return -1;
                 }
-                residue_norm = calculate_residue(result);
+                residue_norm = calculate_residue(&dd, result);
 
-                d_energy = *energy - david_dat.eigvalues[0];
-                *energy  = david_dat.eigvalues[0];
+                d_energy = *energy - dd.eigvalues[0];
+                *energy  = dd.eigvalues[0];
                 ++its;
 #ifdef DAVID_INFO
                 gettimeofday(&t_end2, NULL);
@@ -309,9 +312,9 @@ int davidson(double * result, double * energy, int size, int max_vecs,
                 double d_elapsed = t_elapsed * 1e-6;
                 ++cnt_matvecs;
                 printf("%-4d  %e    %lf\t(%lf s)\n", its, residue_norm, 
-                       david_dat.eigvalues[0], d_elapsed);
+                       dd.eigvalues[0], d_elapsed);
 #endif
-                create_new_vec_t(result);
+                create_new_vec_t(&dd, result);
         }
 
         gettimeofday(&t_end, NULL);
@@ -325,6 +328,6 @@ int davidson(double * result, double * energy, int size, int max_vecs,
                         printf("     - Davidson stopped before converging.\n");
                 }
         }
-        clean_david_dat();
+        clean_david_dat(&dd);
         return its >= max_its;
 }
@@ -0,0 +1,130 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+    
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+    
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <time.h>
+#ifdef T3NS_WITH_MPI
+#include <mpi.h>
+#endif
+
+#include "distributed.h"
+
+static int rank = 0;
+static int nr_ranks = 1;
+
+#ifdef T3NS_WITH_MPI
+static bool initialized_here = false;
+
+static bool mpi_active(void)
+{
+        int initialized, finalized;
+        MPI_Initialized(&initialized);
+        MPI_Finalized(&finalized);
+        return initialized && !finalized && nr_ranks > 1;
+}
+#endif
+
+void init_distributed(int * argc, char *** argv)
+{
+#ifdef T3NS_WITH_MPI
+        int initialized;
+        MPI_Initialized(&initialized);
+        if (!initialized) {
+                /* Only the master thread communicates, MPI calls are never
+                 * made from within parallel regions. */
+                int provided;
+                MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+                initialized_here = true;
+        }
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &nr_ranks);
+
+        if (rank != 0 && freopen("/dev/null", "w", stdout) == NULL) {
+                fprintf(stderr, "%s@%s: Could not silence rank %d.\n",
+                        __FILE__, __func__, rank);
+        }
+        if (nr_ranks > 1) {
+                printf("Running on %d MPI processes. Only the work is divided, "
+                       "every process keeps all renormalized operators.\n",
+                       nr_ranks);
+        }
+#else
+        (void) argc;
+        (void) argv;
+#endif
+}
+
+void finalize_distributed(void)
+{
+#ifdef T3NS_WITH_MPI
+        if (initialized_here) { 
+                fflush(stdout);
+                MPI_Finalize(); 
+        }
+        initialized_here = false;
+#endif
+        rank = 0;
+        nr_ranks = 1;
+}
+
+int get_rank(void) { return rank; }
+
+int get_nr_ranks(void) { return nr_ranks; }
+
+bool is_my_work(long i) { return i % nr_ranks == rank; }
+
+void sum_over_ranks(double * arr, long n)
+{
+#ifdef T3NS_WITH_MPI
+        if (!mpi_active()) { return; }
+        // The count of MPI is an int
+        for (long i = 0; i < n; i += INT_MAX) {
+                const int count = n - i < INT_MAX ? n - i : INT_MAX;
+                MPI_Allreduce(MPI_IN_PLACE, arr + i, count, MPI_DOUBLE, 
+                              MPI_SUM, MPI_COMM_WORLD);
+        }
+#else
+        (void) arr;
+        (void) n;
+#endif
+}
+
+void broadcast_from_root(double * arr, long n)
+{
+#ifdef T3NS_WITH_MPI
+        if (!mpi_active()) { return; }
+        for (long i = 0; i < n; i += INT_MAX) {
+                const int count = n - i < INT_MAX ? n - i : INT_MAX;
+                MPI_Bcast(arr + i, count, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        }
+#else
+        (void) arr;
+        (void) n;
+#endif
+}
+
+unsigned int common_seed(void)
+{
+        unsigned int seed = time(NULL);
+#ifdef T3NS_WITH_MPI
+        if (mpi_active()) {
+                MPI_Bcast(&seed, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+        }
+#endif
+        return seed;
+}
@@ -40,6 +40,9 @@
 #include "RedDM.h"
 #include "timers.h"
 #include "operators.h"
+#include "distributed.h"
+#include "numa_policy.h"
+#include "trace.h"
 
 static const char *timernames[] = {
         "Reading HDF5", 
@@ -139,6 +142,33 @@ T3NS_DESCRIPTION
 "                  Level of Noise : 0.5 * NOISE * W_disc(last_sweep)\n"
 "                  Default : %.0e\n"
 "\n"
+"[PAR_SWEEP]     = int, int, int \n"
+"                  If nonzero, the branches around a branching tensor are\n"
+"                  swept concurrently and merged again at the branching tensor.\n"
+"                  Default : %d\n"
+"\n"
+"[RAND_SVD]      = int, int, int \n"
+"                  If nonzero, large symmetry sectors are split with a\n"
+"                  randomized SVD when far less than all singular values are\n"
+"                  kept. Falls back to the full SVD if it is not accurate.\n"
+"                  Default : %d\n"
+"\n"
+"[GRAM_SVD]      = int, int, int \n"
+"                  If nonzero, symmetry sectors of which one dimension is far\n"
+"                  larger than the other are split through the eigenvalues of\n"
+"                  their Gram matrix. The other sectors use the full SVD. Falls\n"
+"                  back to the full SVD if the kept singular values are badly\n"
+"                  conditioned. 0 always uses the full SVD.\n"
+"                  Default : %d\n"
+"\n"
+"[EXPANSION]     = flt, flt, flt \n"
+"                  Subspace expansion for SITE_SIZE = 1. The bond to the next\n"
+"                  site is enlarged with -EXPANSION times the residual of the\n"
+"                  optimized site and truncated again. The wave function\n"
+"                  itself is not changed. Values between 0.1 and 10 work\n"
+"                  well. 0 disables it.\n"
+"                  Default : %.0e\n"
+"\n"
 "##############################################################################\n"
 "\n"
 "In the case of the option --operator the \'INPUT_FILE\' should be a HDF5 file.";
@@ -160,7 +190,10 @@ static struct argp_option options[] = {
                         "Inbetween the optimization schemes, the network is disentangled by permuting sites."},
         {"operator", 'o', "STRING", 0,
                 "Calculates the value of a certain implemented operator. "
-                        "At this moment you can calculate the weight of different seniority sectors of a wave function."
+                        "At this moment you can calculate the weight of different seniority sectors of a wave function (seniority) "
+                        "the spin-summed 1- and 2-RDM (2rdm or 2rdm=FILE, default file is 2rdm.h5) "
+                        "and the orbital mutual information (mutual or mutual=FILE, default file is mutual.h5), "
+                        "these two need U1 U1 instead of SU2 symmetry. "
                         "The nameless argument \'INPUT_FILE\' is now the HDF5 file where the wave function is stored."
         },
         {0} /* options struct needs to be closed by a { 0 } option */
@@ -185,6 +218,9 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 
         switch (key) {
         case 'o':
+                if (!is_valid_operator(arg)) {
+                        argp_error(state, "Invalid argument for option --operator: %s", arg);
+                }
                 arguments->operator = arg;
                 break;
         case 'c':
@@ -345,7 +381,7 @@ static int initialize_program(struct arguments arguments,
         toc(&chrono, PREP_BOOKIE);
 
         tic(&chrono, INIT_WAV);
-        if (init_wave_function(T3NS, changedSS, &prevbookie, 'r')) { return 1; } 
+        if (init_wave_function(NULL, T3NS, changedSS, &prevbookie, 'r')) { return 1; } 
         toc(&chrono, INIT_WAV);
         if (changedSS) { 
                 destroy_all_rops(rops);
@@ -353,7 +389,7 @@ static int initialize_program(struct arguments arguments,
         }
         // Need to initialize operators still.
         tic(&chrono, INIT_OPS);
-        if (init_operators(rops, *T3NS, false)) { return 1; }
+        if (init_operators(NULL, rops, *T3NS, false)) { return 1; }
         toc(&chrono, INIT_OPS);
 
         print_input(scheme);
@@ -371,6 +407,8 @@ int main(int argc, char *argv[])
         struct timeval t_start, t_end;
 
         gettimeofday(&t_start, NULL);
+        init_distributed(&argc, &argv);
+        init_numa_stats();
 
         /* line by line write-out */
         setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
@@ -388,7 +426,8 @@ int main(int argc, char *argv[])
         snprintf(buffer, buffersize, doc, buffer_symm, MAX_SYMMETRIES,
                  DEFAULT_MINSTATES, DEFAULT_SWEEPS, DEFAULT_E_CONV,
                  DEFAULT_SITESIZE, DEFAULT_SOLVER_TOL, DEFAULT_SOLVER_MAX_ITS,
-                 DEFAULT_NOISE);
+                 DEFAULT_NOISE, DEFAULT_PAR_SWEEP, DEFAULT_RAND_SVD,
+                 DEFAULT_GRAM_SVD, DEFAULT_EXPANSION);
 
         struct argp argp = {options, parse_opt, args_doc, buffer};
 
@@ -404,7 +443,9 @@ int main(int argc, char *argv[])
         argp_parse(&argp, argc, argv, 0, 0, &arguments);
         
         if (arguments.operator != NULL) {
-                return calculate_operator(arguments.operator, arguments.args[0]);
+                const bool ret = calculate_operator(arguments.operator, arguments.args[0]);
+                finalize_distributed();
+                return ret ? EXIT_SUCCESS : EXIT_FAILURE;
         }
 
         if (arguments.saveloc != NULL) {
@@ -417,10 +458,11 @@ int main(int argc, char *argv[])
         }
         if (initialize_program(arguments, &T3NS, &rops, &scheme, &lowD, &lowDb)) {
                 cleanup_before_exit(&T3NS, &rops, &scheme);
+                finalize_distributed();
                 return EXIT_FAILURE;
         }
 
-        execute_optScheme(T3NS, rops, &scheme, arguments.saveloc, lowD, lowDb, 3);
+        execute_optScheme(NULL, T3NS, rops, &scheme, arguments.saveloc, lowD, lowDb, 3);
         for (int i = 0; i < arguments.do_disentangle; ++i) {
                 struct disentScheme sch = {
                         .max_sweeps = 30,
@@ -428,17 +470,20 @@ int main(int argc, char *argv[])
                         .beta = 20,
                         .svd_sel = scheme.regimes[0].svd_sel
                 };
-                disentangle_state(T3NS, &sch, 0);
+                disentangle_state(NULL, T3NS, &sch, 0);
                 destroy_all_rops(&rops);
                 clear_instructions();
                 reinit_hamiltonian();
 
-                init_operators(&rops, T3NS, false);
-                execute_optScheme(T3NS, rops, &scheme, arguments.saveloc, lowD, lowDb, 3);
+                init_operators(NULL, &rops, T3NS, false);
+                execute_optScheme(NULL, T3NS, rops, &scheme, arguments.saveloc, lowD, lowDb, 3);
         }
         write_to_disk(arguments.saveloc, T3NS, rops);
-        print_target_state_coeff(T3NS);
+        print_target_state_coeff(NULL, T3NS);
 
+        print_numa_stats();
+        set_timers_output(NULL);
+        set_trace_output(NULL);
         cleanup_before_exit(&T3NS, &rops, &scheme);
         printf("SUCCESFULL END!\n");
         gettimeofday(&t_end, NULL);
@@ -447,5 +492,6 @@ int main(int argc, char *argv[])
                 t_end.tv_usec - t_start.tv_usec;
         double d_elapsed = t_elapsed * 1e-6;
         printf("elapsed time for calculation in total: %lf sec\n", d_elapsed);
+        finalize_distributed();
         return EXIT_SUCCESS;
 }
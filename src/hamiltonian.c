@@ -20,6 +20,7 @@
 #include <ctype.h>
 
 #include "hamiltonian.h"
+#include "context.h"
 #include "hamiltonian_qc.h"
 #include "hamiltonian_nn_hubbard.h"
 #include "hamiltonian_doci.h"
@@ -28,7 +29,7 @@
 #include "symmetries.h"
 #include "io_to_disk.h"
 
-enum hamtypes ham;
+enum hamtypes * get_ham(void) { return &ham; }
 
 /* ========================================================================== */
 /* ==================== DECLARATION STATIC FUNCTIONS ======================== */
@@ -40,7 +41,13 @@ static int set_hamiltonian(char hamiltonian[], int * const hassu2, int * hasseni
 /* ========================================================================== */
 
 #define BUFLEN 255
-static char interact[BUFLEN];
+
+// The state of this module in the calculation context.
+struct hamiltonian_state {
+        char interact[BUFLEN];
+};
+
+#define interact (CONTEXT_STATE(struct hamiltonian_state, CONTEXT_HAMILTONIAN)->interact)
 
 void readinteraction(char interactionstring[])
 {
@@ -24,13 +24,14 @@
 #include "hamiltonian_doci.h"
 #include "bookkeeper.h"
 #include "network.h"
+#include "context.h"
 #include "symsecs.h"
 #include "macros.h"
 #include "io_to_disk.h"
 #include "instructions_doci.h"
 #include "io.h"
 
-static struct hamdata {
+struct hamdata {
         /// number of orbitals.
         int norb;
         /// core_energy of the system.
@@ -50,18 +51,19 @@ static struct hamdata {
         double ** Vij;
         /// Kinetic energy
         double * Tii;
-} hdat;
+};
 
 static const int irreps_DOCI[3] = {-1, 0, 1};
 
-static struct symsecs MPOsymsecs = {
-        .nrSecs = 0, 
-        .irreps = NULL,
-        .fcidims = NULL,
-        .dims = NULL,
-        .totaldims = 0
+// The state of this module in the calculation context.
+struct doci_state {
+        struct hamdata hdat;
+        struct symsecs MPOsymsecs;
 };
 
+#define hdat (CONTEXT_STATE(struct doci_state, CONTEXT_DOCI)->hdat)
+#define MPOsymsecs (CONTEXT_STATE(struct doci_state, CONTEXT_DOCI)->MPOsymsecs)
+
 void DOCI_destroy_hamiltonian(void)
 {
         safe_free(MPOsymsecs.irreps);
@@ -22,29 +22,31 @@
 
 #include "hamiltonian_nn_hubbard.h"
 #include "network.h"
+#include "context.h"
 #include "bookkeeper.h"
 #include "macros.h"
 #include <assert.h>
 #include "io_to_disk.h"
 
-static struct hamdata {
+struct hamdata {
         double t;
         double U;
         int su2;
-} hdat;
+};
 
 static const int irreps_U1[5][2] = { {-1, 0}, {0, -1}, {0, 0}, {1, 0}, {0, 1}};
 
 static const int irreps_SU2[3][2] = {{-1, 1}, {0, 0}, {1, 1}};
 
-static struct symsecs MPOsymsecs = {
-        .nrSecs = 0,
-        .irreps = NULL,
-        .fcidims = NULL,
-        .dims = NULL,
-        .totaldims = 0
+// The state of this module in the calculation context.
+struct nn_hubbard_state {
+        struct hamdata hdat;
+        struct symsecs MPOsymsecs;
 };
 
+#define hdat (CONTEXT_STATE(struct nn_hubbard_state, CONTEXT_NN_HUBBARD)->hdat)
+#define MPOsymsecs (CONTEXT_STATE(struct nn_hubbard_state, CONTEXT_NN_HUBBARD)->MPOsymsecs)
+
 /* ========================================================================== */
 /* ==================== DECLARATION STATIC FUNCTIONS ======================== */
 /* ========================================================================== */
@@ -25,19 +25,20 @@
 #include "hamiltonian_qc.h"
 #include "io.h"
 #include "network.h"
+#include "context.h"
 #include "bookkeeper.h"
 #include "macros.h"
 #include "opType.h"
 #include "io_to_disk.h"
 #include "qcH.h"
 
-static struct hamdata {
+struct hamdata {
         struct qcH H;       // The stored hamiltonian
         int pg;             /* The point group used.
                              * Same as in the symmetry_pg.h header. */
         int su2;            // has SU(2) turned on or not.
         int has_seniority;  // Seniority restricted calculation.
-} hdat;
+};
 
 static const int irreps_QC[13][2] = {
         {-2,0}, {-1,-1}, {-1,0}, {-1,1}, {0,-2}, {0,-1}, 
@@ -48,14 +49,15 @@ static const int irreps_QCSU2[8][2] = {
         {-2,2}, {-2,0}, {-1,1}, {0,2}, {0,0}, {1,1}, {2,0}, {2,2}};
 static const int valid_QCSU2[8] = {0, 1, 1, 1, 1, 1, 1, 0};
 
-static struct symsecs MPOsymsecs = {
-        .nrSecs = 0, 
-        .irreps = NULL,
-        .fcidims = NULL,
-        .dims = NULL,
-        .totaldims = 0
+// The state of this module in the calculation context.
+struct qc_state {
+        struct hamdata hdat;
+        struct symsecs MPOsymsecs;
 };
 
+#define hdat (CONTEXT_STATE(struct qc_state, CONTEXT_QC)->hdat)
+#define MPOsymsecs (CONTEXT_STATE(struct qc_state, CONTEXT_QC)->MPOsymsecs)
+
 /* ========================================================================== */
 /* ==================== DECLARATION STATIC FUNCTIONS ======================== */
 /* ========================================================================== */
@@ -159,14 +161,16 @@ void QC_make_hamiltonian(char hamiltonianfile[], int su2, int has_seniority)
         init_opType_array(su2);
 }
 
-void QC_ham_from_integrals(int norb, int * irrep, double * h1e, double * eri,
-                           double enuc, int ps, int su2, int has_seniority)
+void QC_ham_from_integrals(int norb, int * irrep, const double * h1e,
+                           const double * eri, int packed, double enuc, int ps,
+                           int su2, int has_seniority)
 {
         hdat.pg = get_pg_symmetry();
         hdat.su2 = su2;
         hdat.has_seniority = has_seniority;
 
-        if (read_integrals(&hdat.H, norb, irrep, h1e, eri, enuc, (enum permsym) ps)) {
+        if (read_integrals(&hdat.H, norb, irrep, h1e, eri, packed, enuc,
+                           (enum permsym) ps)) {
                 fprintf(stderr, "Something went wrong while reading the integrals.\n");
                 exit(EXIT_FAILURE);
         }
@@ -176,6 +180,11 @@ void QC_ham_from_integrals(int norb, int * irrep, double * h1e, double * eri,
         init_opType_array(su2);
 }
 
+int QC_integral_block(char kind, int nr, double ** block)
+{
+        return qcH_block(&hdat.H, kind, nr, block);
+}
+
 void QC_get_physsymsecs(struct symsecs *res, int psite)
 {
         int irrep[4][3]     = {{0,0,0}, {1,1,0}, {1,0,1}, {0,1,1}};
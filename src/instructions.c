@@ -29,13 +29,25 @@
 #include "macros.h"
 #include "network.h"
 #include "bookkeeper.h"
+#include "context.h"
+
+// The state of this module in the calculation context.
+struct instructions_state {
+        // instruction set for the physical updates
+        struct instructionset (*iset_pUpdate)[2];
+        // instruction set for the branching updates
+        struct instructionset (*iset_bUpdate)[2];
+        // instruction set for the merging
+        struct instructionset (*iset_merge)[2];
+        // The instruction set that is filled and its number of instructions.
+        int insrno;
+        struct instructionset * filled;
+};
 
-// instruction set for the physical updates
-static struct instructionset (*iset_pUpdate)[2] = NULL;
-// instruction set for the branching updates
-static struct instructionset (*iset_bUpdate)[2] = NULL;
-// instruction set for the merging
-static struct instructionset (*iset_merge)[2] = NULL;
+#define INSTRUCTIONS_STATE CONTEXT_STATE(struct instructions_state, CONTEXT_INSTRUCTIONS)
+#define iset_pUpdate (INSTRUCTIONS_STATE->iset_pUpdate)
+#define iset_bUpdate (INSTRUCTIONS_STATE->iset_bUpdate)
+#define iset_merge (INSTRUCTIONS_STATE->iset_merge)
 
 //#define PRINT_INSTRUCTIONS
 
@@ -116,34 +128,41 @@ void destroy_instructionset(struct instructionset * const instructions)
 
 struct instructionset fetch_pUpdate(int bond, int is_left)
 {
-        if (iset_pUpdate == NULL) {
-                safe_malloc(iset_pUpdate, netw.nr_bonds);
-                for (int i = 0; i < netw.nr_bonds; ++i) {
-                        iset_pUpdate[i][0] = invalid_instr;
-                        iset_pUpdate[i][1] = invalid_instr;
-                }
-        } 
-        if (iset_pUpdate[bond][is_left].nr_instr == -1) {
-                struct instructionset * instr = &iset_pUpdate[bond][is_left];
-                switch(ham) {
-                case QC :
-                        QC_fetch_pUpdate(instr, bond, is_left);
-                        break;
-                case NN_HUBBARD :
-                        NN_H_fetch_pUpdate(instr, bond, is_left);
-                        break;
-                case DOCI :
-                        DOCI_fetch_pUpdate(instr, bond, is_left);
-                        break;
-                default:
-                        fprintf(stderr, "%s@%s: Unrecognized Hamiltonian.\n", 
-                                __FILE__, __func__);
-                        exit(EXIT_FAILURE);
+        /* The instructions are made lazily and cached, only one thread of
+         * the calculation at a time is allowed to fill the cache. */
+        context_lock(CONTEXT_LOCK_INSTRUCTIONS);
+        {
+                if (iset_pUpdate == NULL) {
+                        safe_malloc(iset_pUpdate, netw.nr_bonds);
+                        for (int i = 0; i < netw.nr_bonds; ++i) {
+                                iset_pUpdate[i][0] = invalid_instr;
+                                iset_pUpdate[i][1] = invalid_instr;
+                        }
+                } 
+                if (iset_pUpdate[bond][is_left].nr_instr == -1) {
+                        struct instructionset * instr = &iset_pUpdate[bond][is_left];
+                        switch(ham) {
+                        case QC :
+                                QC_fetch_pUpdate(instr, bond, is_left);
+                                break;
+                        case NN_HUBBARD :
+                                NN_H_fetch_pUpdate(instr, bond, is_left);
+                                break;
+                        case DOCI :
+                                DOCI_fetch_pUpdate(instr, bond, is_left);
+                                break;
+                        default:
+                                fprintf(stderr, "%s@%s: Unrecognized Hamiltonian.\n", 
+                                        __FILE__, __func__);
+                                exit(EXIT_FAILURE);
+                        }
+                        sort_instructions(instr);
+                        instr->MPOc = NULL;
+                        instr->MPOc_beg = NULL;
                 }
-                sort_instructions(instr);
-                instr->MPOc = NULL;
-                instr->MPOc_beg = NULL;
         }
+        context_unlock(CONTEXT_LOCK_INSTRUCTIONS);
+
 #ifdef PRINT_INSTRUCTIONS
         print_instructions(&iset_pUpdate[bond][is_left], bond, is_left, 'd', 0, true);
 #endif
@@ -152,34 +171,41 @@ struct instructionset fetch_pUpdate(int bond, int is_left)
 
 struct instructionset fetch_bUpdate(int bond, int is_left)
 {
-        if (iset_bUpdate == NULL) {
-                safe_malloc(iset_bUpdate, netw.nr_bonds);
-                for (int i = 0; i < netw.nr_bonds; ++i) {
-                        iset_bUpdate[i][0] = invalid_instr;
-                        iset_bUpdate[i][1] = invalid_instr;
+        /* The instructions are made lazily and cached, only one thread of
+         * the calculation at a time is allowed to fill the cache. */
+        context_lock(CONTEXT_LOCK_INSTRUCTIONS);
+        {
+                if (iset_bUpdate == NULL) {
+                        safe_malloc(iset_bUpdate, netw.nr_bonds);
+                        for (int i = 0; i < netw.nr_bonds; ++i) {
+                                iset_bUpdate[i][0] = invalid_instr;
+                                iset_bUpdate[i][1] = invalid_instr;
+                        }
                 }
-        }
-        if (iset_bUpdate[bond][is_left].nr_instr == -1) {
-                struct instructionset * instr = &iset_bUpdate[bond][is_left];
-                switch(ham) {
-                case QC :
-                        QC_fetch_bUpdate(instr, bond, is_left);
-                        break;
-                case NN_HUBBARD :
-                        NN_H_fetch_bUpdate(instr, bond, is_left);
-                        break;
-                case DOCI :
-                        DOCI_fetch_bUpdate(instr, bond, is_left);
-                        break;
-                default:
-                        fprintf(stderr, "%s@%s: Unrecognized Hamiltonian.\n", 
-                                __FILE__, __func__);
-                        exit(EXIT_FAILURE);
+                if (iset_bUpdate[bond][is_left].nr_instr == -1) {
+                        struct instructionset * instr = &iset_bUpdate[bond][is_left];
+                        switch(ham) {
+                        case QC :
+                                QC_fetch_bUpdate(instr, bond, is_left);
+                                break;
+                        case NN_HUBBARD :
+                                NN_H_fetch_bUpdate(instr, bond, is_left);
+                                break;
+                        case DOCI :
+                                DOCI_fetch_bUpdate(instr, bond, is_left);
+                                break;
+                        default:
+                                fprintf(stderr, "%s@%s: Unrecognized Hamiltonian.\n", 
+                                        __FILE__, __func__);
+                                exit(EXIT_FAILURE);
+                        }
+                        sort_instructions(instr);
+                        instr->MPOc = NULL;
+                        instr->MPOc_beg = NULL;
                 }
-                sort_instructions(instr);
-                instr->MPOc = NULL;
-                instr->MPOc_beg = NULL;
         }
+        context_unlock(CONTEXT_LOCK_INSTRUCTIONS);
+
 #ifdef PRINT_INSTRUCTIONS
         print_instructions(&iset_bUpdate[bond][is_left], bond, is_left, 't', 0, true);
 #endif
@@ -188,33 +214,39 @@ struct instructionset fetch_bUpdate(int bond, int is_left)
 
 struct instructionset fetch_merge(const int bond, int isdmrg, int ** hss_ops)
 {
-        if (iset_merge == NULL) {
-                safe_malloc(iset_merge, netw.nr_bonds);
-                for (int i = 0; i < netw.nr_bonds; ++i) {
-                        iset_merge[i][0] = invalid_instr;
-                        iset_merge[i][1] = invalid_instr;
-                }
-        } 
-        if (iset_merge[bond][isdmrg].nr_instr == -1) {
-                struct instructionset * instr = &iset_merge[bond][isdmrg];
-                switch(ham) {
-                case QC :
-                        QC_fetch_merge(instr, bond, isdmrg);
-                        break;
-                case NN_HUBBARD :
-                        NN_H_fetch_merge(instr, bond);
-                        break;
-                case DOCI :
-                        DOCI_fetch_merge(instr, bond, isdmrg);
-                        break;
-                default:
-                        fprintf(stderr, "%s@%s: Unrecognized Hamiltonian.\n", 
-                                __FILE__, __func__);
-                        exit(EXIT_FAILURE);
+        /* The instructions are made lazily and cached, only one thread of
+         * the calculation at a time is allowed to fill the cache. */
+        context_lock(CONTEXT_LOCK_INSTRUCTIONS);
+        {
+                if (iset_merge == NULL) {
+                        safe_malloc(iset_merge, netw.nr_bonds);
+                        for (int i = 0; i < netw.nr_bonds; ++i) {
+                                iset_merge[i][0] = invalid_instr;
+                                iset_merge[i][1] = invalid_instr;
+                        }
+                } 
+                if (iset_merge[bond][isdmrg].nr_instr == -1) {
+                        struct instructionset * instr = &iset_merge[bond][isdmrg];
+                        switch(ham) {
+                        case QC :
+                                QC_fetch_merge(instr, bond, isdmrg);
+                                break;
+                        case NN_HUBBARD :
+                                NN_H_fetch_merge(instr, bond);
+                                break;
+                        case DOCI :
+                                DOCI_fetch_merge(instr, bond, isdmrg);
+                                break;
+                        default:
+                                fprintf(stderr, "%s@%s: Unrecognized Hamiltonian.\n", 
+                                        __FILE__, __func__);
+                                exit(EXIT_FAILURE);
+                        }
+                        sortinstructions_merge(instr, hss_ops);
+                        instr->hss_of_new = NULL;
                 }
-                sortinstructions_merge(instr, hss_ops);
-                instr->hss_of_new = NULL;
         }
+        context_unlock(CONTEXT_LOCK_INSTRUCTIONS);
 
 #ifdef PRINT_INSTRUCTIONS
         print_instructions(&iset_merge[bond][isdmrg], bond, 0, 'm', isdmrg, true);
@@ -415,17 +447,15 @@ void print_instructions(struct instructionset * instructions, int bond,
         printf("#END INSTR\n");
 }
 
-static int insrno;
-static struct instructionset * instr;
-
 void start_fill_instruction(struct instructionset * instructions, int step)
 {
-        insrno = 0;
+        struct instructions_state * state = INSTRUCTIONS_STATE;
+        state->insrno = 0;
         instructions->step = step;
         if (instructions->instr == NULL) {
                 instructions->nr_instr = 0;
         }
-        instr = instructions;
+        state->filled = instructions;
 }
 
 void fill_instruction(int id1, int id2, int id3, double pref)
@@ -433,16 +463,18 @@ void fill_instruction(int id1, int id2, int id3, double pref)
         if (id1 < 0 || id2 < 0 || id3 < 0) {
                 return;
         }
+        struct instructions_state * state = INSTRUCTIONS_STATE;
+        struct instructionset * instr = state->filled;
         if (instr->instr == NULL) {
                 ++(instr->nr_instr);
         } else {
-                assert(insrno < instr->nr_instr);
+                assert(state->insrno < instr->nr_instr);
                 const struct instruction newinstr = { 
                         .instr = {id1, id2, id3},
                         .pref = pref
                 };
-                instr->instr[insrno] = newinstr;
-                ++insrno;
+                instr->instr[state->insrno] = newinstr;
+                ++state->insrno;
         }
 }
 
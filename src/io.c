@@ -28,6 +28,10 @@
 #include "symmetries.h"
 #include "hamiltonian.h"
 #include "sort.h"
+#include "numa_policy.h"
+#include "timers.h"
+#include "trace.h"
+#include "optimize_network.h"
 
 #define STRTOKSEP " ,\t\n"
 
@@ -141,6 +145,35 @@ int read_inputfile(const char inputfile[], struct optScheme * scheme,
                 (*lowDb)[i] = -1;
         }
 
+        if (read_option("numa", inputfile, buffer) > 0 &&
+            set_numa_policy(buffer)) {
+                return 1;
+        }
+
+        if (read_option("timings", inputfile, buffer) > 0 &&
+            set_timers_output(buffer)) {
+                return 1;
+        }
+        if (read_option("trace", inputfile, buffer) > 0 &&
+            set_trace_output(buffer)) {
+                return 1;
+        }
+
+        ro = read_option("snapshot", inputfile, buffer);
+        if (ro != -1) {
+                char filename[MY_STRING_LEN];
+                int regime, sweep, step;
+                if (ro != 4 || sscanf(buffer, "%s %d %d %d", filename, 
+                                      &regime, &sweep, &step) != 4) {
+                        fprintf(stderr, "Error reading snapshot, it should be: "
+                                "snapshot = FILE REGIME SWEEP STEP.\n");
+                        return 1;
+                }
+                if (set_Heff_snapshot(NULL, filename, regime, sweep, step)) {
+                        return 1;
+                }
+        }
+
         char buffer2[MY_STRING_LEN];
         ro = read_option("interaction", inputfile, buffer);
         strncpy(buffer2, relpath, MY_STRING_LEN);
@@ -164,6 +197,7 @@ void print_input(const struct optScheme * scheme)
         get_tsstring(buffer);
         printf("Targetstate = %s\n", buffer);
         print_interaction();
+        printf("NUMA policy = %s\n", get_numa_policy_string());
         print_optScheme(scheme);
         print_network(&netw);
 }
@@ -31,6 +31,7 @@
 #include "macros.h"
 #include <assert.h>
 #include "hamiltonian.h"
+#include "distributed.h"
 
 static void write_symsec_to_disk(const hid_t id, const struct symsecs * const 
                                  ssec, const int nmbr, char kind)
@@ -121,6 +122,7 @@ static void read_bookkeeper_from_disk(const hid_t file_id)
         read_attribute(group_id, "Max_symmetries", &offset);
 
         read_attribute(group_id, "sgs", (int *) bookie.sgs);
+        set_symmetry_kernels(&bookie);
 
         read_attribute(group_id, "target_state", bookie.target_state);
 
@@ -162,9 +164,10 @@ static void write_sparseblocks_to_disk(const hid_t id,
         H5Gclose(group_id);
 }
 
-static void read_sparseblocks_from_disk(const hid_t id, 
-                                       struct sparseblocks * block, 
-                                       const int nrblocks, const int nmbr)
+/* Reads the beginblock array of block_nmbr in bb, which has place for 
+ * nrblocks + 1 elements. Returns false if nothing is stored. */
+static bool read_beginblock_from_disk(const hid_t id, T3NS_BB_TYPE * bb,
+                                      const int nrblocks, const int nmbr)
 {
         char buffer[255];
         sprintf(buffer, "./block_%d", nmbr);
@@ -172,43 +175,69 @@ static void read_sparseblocks_from_disk(const hid_t id,
 
         const hid_t group_id = H5Gopen(id, buffer, H5P_DEFAULT);
         if (group_id < 0) { 
-                return;
+                return false;
         }
 
         read_attribute(group_id, "nrBlocks", &bloccount);
         assert(bloccount == nrblocks);
         if (bloccount == 0) {
-                block->beginblock = NULL;
-                block->tel = NULL;
                 H5Gclose(group_id);
-                return;
+                return false;
         }
 
-        safe_malloc(block->beginblock, nrblocks + 1);
         hid_t dataset_id = H5Dopen(group_id, "./beginblock", H5P_DEFAULT);
         hid_t datatype =  H5Dget_type(dataset_id);
         const bool sametype = H5Tequal(datatype, T3NS_BB_TYPE_H5) > 0;
         H5Dclose(dataset_id);
         // Needed to make it compatible with old hdf5
         if (sametype) {
-                read_dataset(group_id, "./beginblock", block->beginblock);
+                read_dataset(group_id, "./beginblock", bb);
         } else {
                 int * safe_malloc(tempbb, nrblocks + 1);
                 read_dataset(group_id, "./beginblock", tempbb);
                 for (int i = 0; i < nrblocks + 1; ++i) {
-                        block->beginblock[i] = tempbb[i];
+                        bb[i] = tempbb[i];
                 }
                 safe_free(tempbb);
         }
+        H5Gclose(group_id);
+        return true;
+}
 
-        if (block->beginblock[nrblocks] == 0) {
-                block->tel = NULL;
-        } else {
-                safe_malloc(block->tel, block->beginblock[nrblocks]);
-                read_dataset(group_id, "./tel", block->tel);
+// Reads the elements of block_nmbr in tel.
+static void read_tel_from_disk(const hid_t id, T3NS_EL_TYPE * tel, 
+                               const int nmbr)
+{
+        char buffer[255];
+        sprintf(buffer, "./block_%d", nmbr);
+        const hid_t group_id = H5Gopen(id, buffer, H5P_DEFAULT);
+        read_dataset(group_id, "./tel", tel);
+        H5Gclose(group_id);
+}
+
+/* Quantum numbers are stored column major on disk, independent of the 
+ * format in memory (see qn_columnmajor). For every block there are @p n 
+ * quantum numbers, for the bond triples in @p bonds. */
+static void columnmajor_qnumbers(QN_TYPE * qnumbers, int nrblocks, int n,
+                                 int * bonds, bool tocolumnmajor)
+{
+        int dims[n * 3];
+        get_maxdims_of_bonds(dims, bonds, n * 3);
+        for (int i = 0; i < nrblocks; ++i) {
+                for (int j = 0; j < n; ++j) {
+                        qnumbers[i * n + j] = qn_columnmajor(
+                                qnumbers[i * n + j], &dims[j * 3], 
+                                tocolumnmajor);
+                }
         }
+}
 
-        H5Gclose(group_id);
+static void siteTensor_qnumberbonds(const struct siteTensor * tens, 
+                                    int * bonds)
+{
+        for (int i = 0; i < tens->nrsites; ++i) {
+                get_bonds_of_site(tens->sites[i], &bonds[i * 3]);
+        }
 }
 
 static void write_siteTensor_to_disk(const hid_t id, const struct siteTensor * 
@@ -222,8 +251,15 @@ static void write_siteTensor_to_disk(const hid_t id, const struct siteTensor *
         write_attribute(group_id, "nrsites", &tens->nrsites, 1, THDF5_INT);
         write_attribute(group_id, "sites", tens->sites, tens->nrsites, THDF5_INT);
         write_attribute(group_id, "nrblocks", &tens->nrblocks, 1, THDF5_INT);
-        write_dataset(group_id, "./qnumbers", tens->qnumbers, 
-                      tens->nrblocks * tens->nrsites, THDF5_QN_TYPE);
+        const int nrqn = tens->nrblocks * tens->nrsites;
+        int bonds[STEPSPECS_MSITES * 3];
+        siteTensor_qnumberbonds(tens, bonds);
+        QN_TYPE * safe_malloc(qnumbers, nrqn);
+        for (int i = 0; i < nrqn; ++i) { qnumbers[i] = tens->qnumbers[i]; }
+        columnmajor_qnumbers(qnumbers, tens->nrblocks, tens->nrsites, bonds,
+                             true);
+        write_dataset(group_id, "./qnumbers", qnumbers, nrqn, THDF5_QN_TYPE);
+        safe_free(qnumbers);
         write_sparseblocks_to_disk(group_id, &tens->blocks, tens->nrblocks, 0);
         H5Gclose(group_id);
 }
@@ -240,9 +276,18 @@ static void read_siteTensor_from_disk(const hid_t id, struct siteTensor *
         read_attribute(group_id, "sites", tens->sites);
         read_attribute(group_id, "nrblocks", &tens->nrblocks);
 
-        safe_malloc(tens->qnumbers, tens->nrblocks * tens->nrsites);
+        siteTensor_alloc_meta(tens);
         read_dataset(group_id, "./qnumbers", tens->qnumbers);
-        read_sparseblocks_from_disk(group_id, &tens->blocks, tens->nrblocks, 0);
+        int bonds[STEPSPECS_MSITES * 3];
+        siteTensor_qnumberbonds(tens, bonds);
+        columnmajor_qnumbers(tens->qnumbers, tens->nrblocks, tens->nrsites, 
+                             bonds, false);
+        read_beginblock_from_disk(group_id, tens->blocks.beginblock,
+                                  tens->nrblocks, 0);
+        siteTensor_alloc_tel(tens, 'm');
+        if (siteTensor_get_size(tens) != 0) {
+                read_tel_from_disk(group_id, tens->blocks.tel, 0);
+        }
         H5Gclose(group_id);
 }
 
@@ -297,9 +342,18 @@ static void write_rOperator_to_disk(const hid_t id,
 
         write_dataset(group_id, "./begin_blocks_of_hss",
                       rOp->begin_blocks_of_hss, rOp->nrhss + 1, THDF5_INT);
-        write_dataset(group_id, "./qnumbers", rOp->qnumbers, 
-                      rOp->begin_blocks_of_hss[rOp->nrhss] *
-                      rOperators_give_nr_of_couplings(rOp), THDF5_QN_TYPE);
+        const int nrblocks = rOp->begin_blocks_of_hss[rOp->nrhss];
+        const int nrcoup = rOperators_give_nr_of_couplings(rOp);
+        int bonds[nrcoup * 3];
+        rOperators_give_qnumberbonds(rOp, bonds);
+        QN_TYPE * safe_malloc(qnumbers, nrblocks * nrcoup);
+        for (int i = 0; i < nrblocks * nrcoup; ++i) {
+                qnumbers[i] = rOp->qnumbers[i];
+        }
+        columnmajor_qnumbers(qnumbers, nrblocks, nrcoup, bonds, true);
+        write_dataset(group_id, "./qnumbers", qnumbers, nrblocks * nrcoup, 
+                      THDF5_QN_TYPE);
+        safe_free(qnumbers);
 
         write_attribute(group_id, "nrops", &rOp->nrops, 1, THDF5_INT);
         write_dataset(group_id, "./hss_of_ops", rOp->hss_of_ops, 
@@ -329,24 +383,37 @@ static void read_rOperator_from_disk(const hid_t id,
         safe_malloc(rOp->begin_blocks_of_hss, rOp->nrhss + 1);
         read_dataset(group_id, "./begin_blocks_of_hss", rOp->begin_blocks_of_hss);
 
-        safe_malloc(rOp->qnumbers, rOp->begin_blocks_of_hss[rOp->nrhss] * rOperators_give_nr_of_couplings(rOp));
+        const int nrblocks = rOp->begin_blocks_of_hss[rOp->nrhss];
+        const int nrcoup = rOperators_give_nr_of_couplings(rOp);
+        safe_malloc(rOp->qnumbers, nrblocks * nrcoup);
         read_dataset(group_id, "./qnumbers", rOp->qnumbers);
+        int bonds[nrcoup * 3];
+        rOperators_give_qnumberbonds(rOp, bonds);
+        columnmajor_qnumbers(rOp->qnumbers, nrblocks, nrcoup, bonds, false);
 
         read_attribute(group_id, "nrops", &rOp->nrops);
 
         safe_malloc(rOp->hss_of_ops, rOp->nrops);
         read_dataset(group_id, "./hss_of_ops", rOp->hss_of_ops);
 
-        safe_malloc(rOp->operators, rOp->nrops);
+        // The elements are read in place, in the slab if used.
+        T3NS_BB_TYPE ** safe_calloc(bb, rOp->nrops);
         for (int i = 0; i < rOp->nrops; ++i) {
                 const int nr_blocks = nblocks_in_operator(rOp, i);
-                if (nr_blocks == 0) {
-                        rOp->operators[i].beginblock = NULL;
-                        rOp->operators[i].tel = NULL;
+                if (nr_blocks == 0) { continue; }
+                safe_malloc(bb[i], nr_blocks + 1);
+                if (!read_beginblock_from_disk(group_id, bb[i], nr_blocks, i)) {
+                        safe_free(bb[i]);
                 }
-                else
-                        read_sparseblocks_from_disk(group_id, &rOp->operators[i], 
-                                                    nr_blocks, i);
+        }
+        alloc_operators_rOperators(rOp, (const T3NS_BB_TYPE * const *) bb);
+        for (int i = 0; i < rOp->nrops; ++i) { safe_free(bb[i]); }
+        safe_free(bb);
+        first_touch_rOperators(rOp);
+
+        for (int i = 0; i < rOp->nrops; ++i) {
+                if (rOp->operators[i].tel == NULL) { continue; }
+                read_tel_from_disk(group_id, rOp->operators[i].tel, i);
         }
         H5Gclose(group_id);
 }
@@ -456,26 +523,125 @@ static void make_h5f_name(const char * hdf5_loc, const char hdf5file[],
 void write_to_disk(const char * hdf5_loc, const struct siteTensor * const T3NS, 
                    const struct rOperators * const ops)
 {
-        if (hdf5_loc == NULL) { return; }
+        // Only one process writes, all of them have the same state.
+        if (hdf5_loc == NULL || get_rank() != 0) { return; }
 
         hid_t file_id;
         const char hdf5nam[] = "T3NScalc.h5";
         char hdf5file[MY_STRING_LEN];
         make_h5f_name(hdf5_loc, hdf5nam, MY_STRING_LEN, hdf5file);
 
-        file_id = H5Fcreate(hdf5file, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        // HDF5 is not thread-safe, concurrent calculations take turns.
+#pragma omp critical (hdf5)
+        {
+                file_id = H5Fcreate(hdf5file, H5F_ACC_TRUNC, H5P_DEFAULT, 
+                                    H5P_DEFAULT);
+
+                write_network_to_disk(file_id);
+                write_bookkeeper_to_disk(file_id);
+                write_hamiltonian_to_disk(file_id);
+                write_T3NS_to_disk(file_id, T3NS);
+                //write_rOps_to_disk(file_id, ops);
+
+                H5Fclose(file_id);
+        }
+}
+
+int read_from_disk(const char filename[], struct siteTensor ** const T3NS, 
+                   struct rOperators ** const ops, bool init)
+{
+        if (access(filename, F_OK) != 0) {
+                fprintf(stderr, "Error in %s: Can not read from disk.\n"
+                        "%s was not found.\n", __func__, filename);
+                return 1;
+        }
+
+        // HDF5 is not thread-safe, concurrent calculations take turns.
+#pragma omp critical (hdf5)
+        {
+                hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+
+                read_network_from_disk(file_id);
+                read_bookkeeper_from_disk(file_id);
+                read_T3NS_from_disk(file_id, T3NS);
+                if (!init) {
+                        read_hamiltonian_from_disk(file_id);
+                        if (ops != NULL) { read_rOps_from_disk(file_id, ops); }
+                }
+
+                H5Fclose(file_id);
+        }
+        return 0;
+}
+
+int read_symmetries_from_disk(const char filename[], enum hamtypes * hamtype,
+                              int * nrSyms, enum symmetrygroup * sgs)
+{
+        if (access(filename, F_OK) != 0) {
+                fprintf(stderr, "Error in %s: Can not read from disk.\n"
+                        "%s was not found.\n", __func__, filename);
+                return 1;
+        }
+
+#pragma omp critical (hdf5)
+        {
+                hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+                hid_t group_id = H5Gopen(file_id, "/hamiltonian", H5P_DEFAULT);
+                read_attribute(group_id, "type", hamtype);
+                H5Gclose(group_id);
+
+                group_id = H5Gopen(file_id, "/bookkeeper", H5P_DEFAULT);
+                read_attribute(group_id, "nrSyms", nrSyms);
+                if (*nrSyms <= MAX_SYMMETRIES) {
+                        read_attribute(group_id, "sgs", (int *) sgs);
+                }
+                H5Gclose(group_id);
+                H5Fclose(file_id);
+        }
+        if (*nrSyms > MAX_SYMMETRIES) {
+                fprintf(stderr, "Error in %s: %s has %d symmetries, maximal allowed: %d.\n",
+                        __func__, filename, *nrSyms, MAX_SYMMETRIES);
+                return 1;
+        }
+        return 0;
+}
+
+int write_Heff_snapshot(const char * filename, const struct Heffdata * data,
+                        const T3NS_EL_TYPE * vec)
+{
+        if (get_rank() != 0) { return 0; }
+
+        const hid_t file_id = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, 
+                                        H5P_DEFAULT);
+        if (file_id < 0) {
+                fprintf(stderr, "Error in %s: Can not write to %s.\n",
+                        __func__, filename);
+                return 1;
+        }
 
         write_network_to_disk(file_id);
         write_bookkeeper_to_disk(file_id);
         write_hamiltonian_to_disk(file_id);
-        write_T3NS_to_disk(file_id, T3NS);
-        //write_rOps_to_disk(file_id, ops);
+
+        const hid_t group_id = H5Gcreate(file_id, "/Heff", H5P_DEFAULT, 
+                                         H5P_DEFAULT, H5P_DEFAULT);
+        const int nr_operators = data->isdmrg ? 2 : 3;
+        write_attribute(group_id, "nr_operators", &nr_operators, 1, THDF5_INT);
+        write_siteTensor_to_disk(group_id, &data->siteObject, 0);
+        for (int i = 0; i < nr_operators; ++i) {
+                write_rOperator_to_disk(group_id, &data->Operators[i], i);
+        }
+        write_dataset(group_id, "./vector", vec, 
+                      siteTensor_get_size(&data->siteObject), 
+                      THDF5_T3NS_EL_TYPE);
+        H5Gclose(group_id);
 
         H5Fclose(file_id);
+        return 0;
 }
 
-int read_from_disk(const char filename[], struct siteTensor ** const T3NS, 
-                   struct rOperators ** const ops, bool init)
+int read_Heff_snapshot(const char * filename, struct siteTensor * siteObject,
+                       struct rOperators * Operators, T3NS_EL_TYPE ** vec)
 {
         if (access(filename, F_OK) != 0) {
                 fprintf(stderr, "Error in %s: Can not read from disk.\n"
@@ -483,15 +649,29 @@ int read_from_disk(const char filename[], struct siteTensor ** const T3NS,
                 return 1;
         }
 
-        hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+        const hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (!H5Lexists(file_id, "/Heff", H5P_DEFAULT)) {
+                fprintf(stderr, "Error in %s: %s is not a snapshot of an effective Hamiltonian.\n",
+                        __func__, filename);
+                H5Fclose(file_id);
+                return 1;
+        }
 
         read_network_from_disk(file_id);
         read_bookkeeper_from_disk(file_id);
-        read_T3NS_from_disk(file_id, T3NS);
-        if (!init) {
-                read_hamiltonian_from_disk(file_id);
-                if (ops != NULL) { read_rOps_from_disk(file_id, ops); }
+        read_hamiltonian_from_disk(file_id);
+
+        const hid_t group_id = H5Gopen(file_id, "/Heff", H5P_DEFAULT);
+        int nr_operators;
+        read_attribute(group_id, "nr_operators", &nr_operators);
+        read_siteTensor_from_disk(group_id, siteObject, 0);
+        Operators[2] = null_rOperators();
+        for (int i = 0; i < nr_operators; ++i) {
+                read_rOperator_from_disk(group_id, &Operators[i], i);
         }
+        safe_malloc(*vec, siteTensor_get_size(siteObject));
+        read_dataset(group_id, "./vector", *vec);
+        H5Gclose(group_id);
 
         H5Fclose(file_id);
         return 0;
@@ -529,6 +709,111 @@ void read_attribute(hid_t id, const char atrname[], void * atr)
         H5Aclose(attribute_id);
 }
 
+int open_2RDM_stream(struct RDM_stream * stream, const char * filename,
+                     int orbitals)
+{
+        stream->orbitals = orbitals;
+        stream->file_id = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, 
+                                    H5P_DEFAULT);
+        if (stream->file_id < 0) {
+                fprintf(stderr, "Error in %s: Can not write to %s.\n",
+                        __func__, filename);
+                return 1;
+        }
+        write_attribute(stream->file_id, "orbitals", &orbitals, 1, THDF5_INT);
+
+        const hsize_t dims[4] = { orbitals, orbitals, orbitals, orbitals };
+        const hid_t dataspace_id = H5Screate_simple(4, dims, NULL);
+        stream->dataset_id = H5Dcreate(stream->file_id, "two_rdm", 
+                                       T3NS_EL_TYPE_H5, dataspace_id, 
+                                       H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        H5Sclose(dataspace_id);
+        return 0;
+}
+
+void write_2RDM_slice(const struct RDM_stream * stream, int i, int j,
+                      const T3NS_EL_TYPE * slice)
+{
+        const hsize_t L = stream->orbitals;
+        const hsize_t start[4] = { i, j, 0, 0 };
+        const hsize_t count[4] = { 1, 1, L, L };
+        const hsize_t memdims[1] = { L * L };
+
+        const hid_t filespace = H5Dget_space(stream->dataset_id);
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, count, NULL);
+        const hid_t memspace = H5Screate_simple(1, memdims, NULL);
+        H5Dwrite(stream->dataset_id, T3NS_EL_TYPE_H5, memspace, filespace, 
+                 H5P_DEFAULT, slice);
+        H5Sclose(memspace);
+        H5Sclose(filespace);
+}
+
+void close_2RDM_stream(struct RDM_stream * stream, const T3NS_EL_TYPE * onerdm)
+{
+        if (onerdm != NULL) {
+                const hsize_t dims[2] = { stream->orbitals, stream->orbitals };
+                const hid_t dataspace_id = H5Screate_simple(2, dims, NULL);
+                const hid_t dataset_id = H5Dcreate(stream->file_id, "one_rdm", 
+                                                   T3NS_EL_TYPE_H5, dataspace_id,
+                                                   H5P_DEFAULT, H5P_DEFAULT, 
+                                                   H5P_DEFAULT);
+                H5Dwrite(dataset_id, T3NS_EL_TYPE_H5, H5S_ALL, H5S_ALL, 
+                         H5P_DEFAULT, onerdm);
+                H5Dclose(dataset_id);
+                H5Sclose(dataspace_id);
+        }
+        H5Dclose(stream->dataset_id);
+        H5Fclose(stream->file_id);
+}
+
+int write_mutualInformation(const char * filename, int orbitals, 
+                            const double * entropy, const double * Iij)
+{
+        const hid_t file_id = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, 
+                                        H5P_DEFAULT);
+        if (file_id < 0) {
+                fprintf(stderr, "Error in %s: Can not write to %s.\n",
+                        __func__, filename);
+                return 1;
+        }
+        write_attribute(file_id, "orbitals", &orbitals, 1, THDF5_INT);
+        write_dataset(file_id, "entropy", entropy, orbitals, THDF5_DOUBLE);
+
+        const hsize_t dims[2] = { orbitals, orbitals };
+        const hid_t dataspace_id = H5Screate_simple(2, dims, NULL);
+        const hid_t dataset_id = H5Dcreate(file_id, "mutual_information", 
+                                           H5T_IEEE_F64LE, dataspace_id,
+                                           H5P_DEFAULT, H5P_DEFAULT, 
+                                           H5P_DEFAULT);
+        H5Dwrite(dataset_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                 Iij);
+        H5Dclose(dataset_id);
+        H5Sclose(dataspace_id);
+        H5Fclose(file_id);
+        return 0;
+}
+
+int read_mutualInformation(const char * filename, int orbitals, double * Iij)
+{
+        const hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (file_id < 0) {
+                fprintf(stderr, "Error in %s: Can not read %s.\n",
+                        __func__, filename);
+                return 1;
+        }
+        int file_orbitals;
+        read_attribute(file_id, "orbitals", &file_orbitals);
+        if (file_orbitals != orbitals) {
+                fprintf(stderr, "Error in %s: %s is for %d orbitals instead of %d.\n",
+                        __func__, filename, file_orbitals, orbitals);
+                H5Fclose(file_id);
+                return 1;
+        }
+        read_dataset(file_id, "./mutual_information", Iij);
+        H5Fclose(file_id);
+        return 0;
+}
+
 void write_dataset(hid_t id, const char datname[], const void * dat, hsize_t size,
                    enum hdf5type kind)
 {
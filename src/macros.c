@@ -19,6 +19,7 @@
 #include <string.h>
 #include <stdint.h>
 #include "macros.h"
+#include "timers.h"
 
 static void print_status(void)
 {
@@ -55,6 +56,7 @@ void * safe_malloc_helper(long long s, size_t t, const char * typ,
                 print_status();
                 exit(EXIT_FAILURE);
         }
+        count_alloc(s * t);
         return pn;
 }
 
@@ -71,5 +73,22 @@ void * safe_calloc_helper(long long s, size_t t, const char *typ,
                 print_status();
                 exit(EXIT_FAILURE);
         }
+        count_alloc(s * t);
+        return pn;
+}
+
+void * safe_realloc_helper(void * ptr, long long s, size_t t, const char *typ, 
+                           const char *file, int line, const char *func)
+{
+        void *pn = realloc(ptr, s * t);
+        if ((pn == NULL && s * t != 0) || s < 0) {
+                const char *filname = strrchr(file, '/') + 1;
+                fprintf(stderr, "%s:%d @%s :: Failed to reallocate %s array of size %lld (%llu bytes)!\n"
+                        "Maximal size of size_t : %lu\n",
+                        filname == NULL ? file : filname, line, func, 
+                        typ, s, s*t, SIZE_MAX);
+                print_status();
+                exit(EXIT_FAILURE);
+        }
         return pn;
 }
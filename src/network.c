@@ -26,7 +26,17 @@
 #include "macros.h"
 
 
-struct network netw = {0};
+static int * sitetoorb_view = NULL;
+#pragma omp threadprivate(sitetoorb_view)
+
+void set_sitetoorb_view(int * sitetoorb) { sitetoorb_view = sitetoorb; }
+
+int * get_sitetoorb(void)
+{
+        return sitetoorb_view == NULL ? netw.sitetoorb : sitetoorb_view;
+}
+
+struct network * get_netw(void) { return &netw; }
 
 static int check_network(void)
 {
@@ -386,6 +396,38 @@ void make_network(const char * netwfile)
         }
 }
 
+int write_network(const struct network * net, const char * netwfile)
+{
+        FILE *fp = fopen(netwfile, "w");
+        if (fp == NULL) {
+                fprintf(stderr, "ERROR : Failed writing networkfile %s.\n", netwfile);
+                return 1;
+        }
+
+        fprintf(fp, "NR_SITES = %d\n", net->sites);
+        fprintf(fp, "NR_PHYS_SITES = %d\n", net->psites);
+        fprintf(fp, "NR_BONDS = %d\n", net->nr_bonds);
+        fprintf(fp, "SWEEP_LENGTH = %d\n", net->sweeplength);
+        fprintf(fp, "&END\n");
+        for (int i = 0; i < net->sites; ++i) {
+                if (net->sitetoorb[i] == -1) {
+                        fprintf(fp, "* ");
+                } else {
+                        fprintf(fp, "%d ", net->sitetoorb[i]);
+                }
+        }
+        fprintf(fp, "\n&END\n");
+        for (int i = 0; i < net->sweeplength; ++i) {
+                fprintf(fp, "%d ", net->sweep[i]);
+        }
+        fprintf(fp, "\n&END\n");
+        for (int i = 0; i < net->nr_bonds; ++i) {
+                fprintf(fp, "%d\t%d\n", net->bonds[i][0], net->bonds[i][1]);
+        }
+        fclose(fp);
+        return 0;
+}
+
 void destroy_network(struct network * net)
 {
         safe_free(net->bonds);
@@ -460,7 +502,7 @@ void get_bonds_of_site(int site, int * bonds)
         assert(i != netw.nr_bonds);
 
         if (is_psite(site)) {
-                bonds[1] = 2 * netw.nr_bonds + netw.sitetoorb[site];
+                bonds[1] = 2 * netw.nr_bonds + get_sitetoorb()[site];
         } else {
                 for (++i; i < netw.nr_bonds; ++i) {
                         if (netw.bonds[i][1] == site) {
@@ -564,12 +606,14 @@ void print_stepSpecs(const struct stepSpecs * specs)
 
 // This moves the state forward appropriately.
 // i.e. until the `state + 1` site is not an element of specs->sites_opt.
-static void move_forward_state(struct stepSpecs * specs, int * state)
+static void move_forward_state(const int * sweep, int swl,
+                               struct stepSpecs * specs, int * state)
 {
         bool flag = false;
-        while(!flag) {
+        // Don't run past the end, a short sweep can be covered by one step.
+        while(!flag && *state < swl) {
                 flag = true;
-                const int next_site = netw.sweep[(*state + 1) % netw.sweeplength];
+                const int next_site = sweep[(*state + 1) % swl];
                 for (int i = 0; i < specs->nr_sites_opt; ++i) {
                         if (specs->sites_opt[i] == next_site) {
                                 flag = false;
@@ -582,9 +626,9 @@ static void move_forward_state(struct stepSpecs * specs, int * state)
         }
 }
 
-static int get_sites_to_opt(int maxsites, struct stepSpecs * specs, int * state)
+static int get_sites_to_opt(const int * sweep, int swl, int maxsites, 
+                            struct stepSpecs * specs, int * state)
 {
-        const int swl = netw.sweeplength;
         int * const sites_opt = specs->sites_opt;
 
         if(*state >= swl) {
@@ -593,7 +637,7 @@ static int get_sites_to_opt(int maxsites, struct stepSpecs * specs, int * state)
         }
 
         specs->nr_sites_opt = 0;
-        sites_opt[specs->nr_sites_opt++] = netw.sweep[*state];
+        sites_opt[specs->nr_sites_opt++] = sweep[*state];
         // 1 site optimization
         if (maxsites == 1) { 
                 ++*state;
@@ -601,7 +645,7 @@ static int get_sites_to_opt(int maxsites, struct stepSpecs * specs, int * state)
         }
 
         // Add next site
-        sites_opt[specs->nr_sites_opt++] = netw.sweep[(*state + 1) % swl];
+        sites_opt[specs->nr_sites_opt++] = sweep[(*state + 1) % swl];
         const int cbond = get_common_bond(sites_opt[0], sites_opt[1]);
 
         // This case you selected all sites needed
@@ -623,7 +667,7 @@ static int get_sites_to_opt(int maxsites, struct stepSpecs * specs, int * state)
         }
 
         if (maxsites == 3) {
-                const int nextsite = netw.sweep[(*state + 2) % swl];
+                const int nextsite = sweep[(*state + 2) % swl];
                 for (int i = 0; i < specs->nr_sites_opt; ++i) {
                         // the next site is already in the list or another
                         // branch
@@ -636,7 +680,7 @@ static int get_sites_to_opt(int maxsites, struct stepSpecs * specs, int * state)
         }
 
 end_get_sites_to_opt:
-        move_forward_state(specs, state);
+        move_forward_state(sweep, swl, specs, state);
         return 0;
 }
 
@@ -684,15 +728,15 @@ static void get_bonds_involved(struct stepSpecs * specs)
         if (bo[0] > bo[1]) { swap(&bo[0], &bo[1]); }
 }
 
-static void get_common_with_next(int maxsites, struct stepSpecs * specs, 
-                                 int next_state)
+static void get_common_with_next(const int * sweep, int swl, int maxsites,
+                                 struct stepSpecs * specs, int next_state)
 {
         struct stepSpecs nextSpecs;
         for (int i = 0; i < specs->nr_sites_opt; ++i) {
                 specs->common_next[i] = 0;
         }
         if (maxsites == 1) {
-                const int nsite = netw.sweep[next_state % netw.sweeplength];
+                const int nsite = sweep[next_state % swl];
                 const int cbond = get_common_bond(specs->sites_opt[0], nsite);
                 for (int i = 0; i < specs->nr_bonds_opt; ++i) {
                         if (specs->bonds_opt[i] == cbond) {
@@ -702,9 +746,9 @@ static void get_common_with_next(int maxsites, struct stepSpecs * specs,
                 }
                 assert(0);
         }
-        if(get_sites_to_opt(maxsites, &nextSpecs, &next_state)) {
+        if(get_sites_to_opt(sweep, swl, maxsites, &nextSpecs, &next_state)) {
                 // Make the last site the nCenter.
-                const int last_site = netw.sweep[0];
+                const int last_site = sweep[0];
                 int i;
                 for (i = 0; i < specs->nr_sites_opt; ++i) {
                         if (last_site == specs->sites_opt[i]) {
@@ -748,20 +792,27 @@ static void set_nCenter(struct stepSpecs * specs)
         }
 }
 
-int next_opt_step(int maxsites, struct stepSpecs * specs)
+int next_opt_step_in(const int * sweep, int swlength, int maxsites,
+                     struct stepSpecs * specs, int * state)
 {
         assert(STEPSPECS_MSITES >= maxsites);
-        static int curr_state = 0;
 
-        if(get_sites_to_opt(maxsites, specs, &curr_state)) return 0;
+        if(get_sites_to_opt(sweep, swlength, maxsites, specs, state)) return 0;
         get_bonds_involved(specs);
 
-        get_common_with_next(maxsites, specs, curr_state);
+        get_common_with_next(sweep, swlength, maxsites, specs, *state);
         set_nCenter(specs);
         assert(STEPSPECS_MSITES >= specs->nr_sites_opt);
         return 1;
 }
 
+int next_opt_step(int maxsites, struct stepSpecs * specs)
+{
+        int * curr_state = CONTEXT_STATE(int, CONTEXT_SWEEP);
+        return next_opt_step_in(netw.sweep, netw.sweeplength, maxsites, specs,
+                                curr_state);
+}
+
 int get_common_bond(int site1, int site2)
 {
         int bonds1[3];
@@ -874,6 +925,86 @@ int get_outgoing_bond(void)
         return -1;
 }
 
+/* Gives the site at the other side of the bond, or -1 if site not in bond. */
+static int other_site_of_bond(int bond, int site)
+{
+        if (netw.bonds[bond][0] == site) { return netw.bonds[bond][1]; }
+        if (netw.bonds[bond][1] == site) { return netw.bonds[bond][0]; }
+        return -1;
+}
+
+static int path_recursion(int curr, int prev, int end, int * path, int len)
+{
+        path[len++] = curr;
+        if (curr == end) { return len; }
+
+        for (int i = 0; i < netw.nr_bonds; ++i) {
+                const int next = other_site_of_bond(i, curr);
+                if (next == -1 || next == prev) { continue; }
+                const int result = path_recursion(next, curr, end, path, len);
+                if (result) { return result; }
+        }
+        return 0;
+}
+
+int get_path(int start, int end, int * path)
+{
+        return path_recursion(start, -1, end, path, 0);
+}
+
+static void mark_branch(int curr, int prev, bool * in_branch)
+{
+        in_branch[curr] = true;
+        for (int i = 0; i < netw.nr_bonds; ++i) {
+                const int next = other_site_of_bond(i, curr);
+                if (next == -1 || next == prev) { continue; }
+                mark_branch(next, curr, in_branch);
+        }
+}
+
+int make_branch_sweep(int bond, int site, int ** sweep, int * swlength)
+{
+        const int other = other_site_of_bond(bond, site);
+        assert(other != -1);
+        bool * safe_calloc(in_branch, netw.sites);
+        mark_branch(site, other, in_branch);
+
+        int start;
+        for (start = 0; start < netw.sweeplength; ++start) {
+                if (netw.sweep[start] == site) { break; }
+        }
+
+        safe_malloc(*sweep, netw.sweeplength);
+        *swlength = 0;
+        for (int i = 0; start != netw.sweeplength && i < netw.sweeplength; ++i) {
+                const int csite = netw.sweep[(start + i) % netw.sweeplength];
+                if (!in_branch[csite]) { continue; }
+                // Leaving and reentering the branch gives doubles.
+                if (*swlength != 0 && (*sweep)[*swlength - 1] == csite) { 
+                        continue; 
+                }
+                (*sweep)[(*swlength)++] = csite;
+        }
+        // The sweep is closed, last site should not be the first one again
+        while (*swlength > 1 && (*sweep)[*swlength - 1] == (*sweep)[0]) {
+                --*swlength;
+        }
+        safe_free(in_branch);
+
+        int erflag = *swlength < 2;
+        for (int i = 0; i < *swlength && !erflag; ++i) {
+                const int nsite = (*sweep)[(i + 1) % *swlength];
+                erflag = get_common_bond((*sweep)[i], nsite) == -1;
+        }
+        if (erflag) {
+                safe_free(*sweep);
+                *swlength = 0;
+                return 1;
+        }
+        *sweep = realloc(*sweep, *swlength * sizeof **sweep);
+        return 0;
+}
+
 void fillin_network(int nr_bonds, int psites, int sites, int (*bonds)[2],
                     int * sitetoorb, int sweeplength, int * sweep)
 {
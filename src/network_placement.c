@@ -0,0 +1,329 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "network_placement.h"
+#include "network.h"
+#include "macros.h"
+
+/// A replica of the Monte Carlo simulation.
+struct replica {
+        /// For every physical site the orbital placed on it.
+        int * state;
+        /// The cost of @ref state.
+        double cost;
+        /// The inverse temperature.
+        double beta;
+        /// The state of the random number generator.
+        unsigned long long rng;
+        /// The best state encountered.
+        int * best;
+        /// The cost of @ref best.
+        double bestcost;
+};
+
+/// The problem: the weights of the distances and the correlations.
+struct placement {
+        /// The number of physical sites.
+        int L;
+        /// The physical sites of the network.
+        int * psites;
+        /// \f$d_{kl}^η\f$ for the physical sites @p k and @p l.
+        double * W;
+        /// The correlations in the orbital order.
+        const double * Iij;
+};
+
+struct placementScheme default_placementScheme(void)
+{
+        return (struct placementScheme) {
+                .eta = DEFAULT_PLACEMENT_ETA,
+                .sweeps = DEFAULT_PLACEMENT_SWEEPS,
+                .replicas = DEFAULT_PLACEMENT_REPLICAS,
+                .beta_min = DEFAULT_PLACEMENT_BETA_MIN,
+                .beta_max = DEFAULT_PLACEMENT_BETA_MAX,
+                .seed = 0
+        };
+}
+
+// Walks through the tree and sets the distance of every site to the start.
+static void walk_distances(int curr, int prev, int distance, int * dist)
+{
+        dist[curr] = distance;
+        int bonds[3];
+        get_bonds_of_site(curr, bonds);
+        for (int i = 0; i < 3; ++i) {
+                // The physical bond.
+                if (i == 1 && is_psite(curr)) { continue; }
+                const int * sites = netw.bonds[bonds[i]];
+                const int next = sites[0] == curr ? sites[1] : sites[0];
+                if (next != -1 && next != prev) {
+                        walk_distances(next, curr, distance + 1, dist);
+                }
+        }
+}
+
+static void init_placement(struct placement * pl, const double * Iij,
+                           double eta)
+{
+        pl->L = netw.psites;
+        pl->Iij = Iij;
+        safe_malloc(pl->psites, pl->L);
+        int k = 0;
+        for (int site = 0; site < netw.sites; ++site) {
+                if (is_psite(site)) { pl->psites[k++] = site; }
+        }
+
+        int * safe_malloc(dist, netw.sites);
+        safe_malloc(pl->W, pl->L * pl->L);
+        for (k = 0; k < pl->L; ++k) {
+                walk_distances(pl->psites[k], -1, 0, dist);
+                for (int l = 0; l < pl->L; ++l) {
+                        pl->W[k * pl->L + l] = pow(dist[pl->psites[l]], eta);
+                }
+        }
+        safe_free(dist);
+}
+
+static void destroy_placement(struct placement * pl)
+{
+        safe_free(pl->psites);
+        safe_free(pl->W);
+}
+
+static double cost_of_state(const struct placement * pl, const int * state)
+{
+        const int L = pl->L;
+        double cost = 0;
+        for (int k = 0; k < L; ++k) {
+                for (int l = k + 1; l < L; ++l) {
+                        cost += 2 * pl->W[k * L + l] *
+                                pl->Iij[state[k] * L + state[l]];
+                }
+        }
+        return cost;
+}
+
+// The change of the cost when swapping the orbitals on site k and l.
+static double swap_cost(const struct placement * pl, const int * state,
+                        int k, int l)
+{
+        const int L = pl->L;
+        const double * Wk = &pl->W[k * L];
+        const double * Wl = &pl->W[l * L];
+        const double * Ik = &pl->Iij[state[k] * L];
+        const double * Il = &pl->Iij[state[l] * L];
+        double result = 0;
+        for (int m = 0; m < L; ++m) {
+                if (m == k || m == l) { continue; }
+                result += (Wk[m] - Wl[m]) * (Il[state[m]] - Ik[state[m]]);
+        }
+        return 2 * result;
+}
+
+// Returns a uniform random number in [0, 1).
+static double next_random(unsigned long long * rng)
+{
+        *rng ^= *rng << 13;
+        *rng ^= *rng >> 7;
+        *rng ^= *rng << 17;
+        return (double) (*rng >> 11) / (1ULL << 53);
+}
+
+// L Metropolis steps of swapping two orbitals.
+static void metropolis_sweep(const struct placement * pl, struct replica * rep)
+{
+        const int L = pl->L;
+        if (L < 2) { return; }
+        for (int step = 0; step < L; ++step) {
+                const int k = next_random(&rep->rng) * L;
+                int l = next_random(&rep->rng) * (L - 1);
+                l += l >= k;
+
+                const double delta = swap_cost(pl, rep->state, k, l);
+                if (delta > 0 &&
+                    next_random(&rep->rng) >= exp(-rep->beta * delta)) {
+                        continue;
+                }
+                const int temp = rep->state[k];
+                rep->state[k] = rep->state[l];
+                rep->state[l] = temp;
+                rep->cost += delta;
+
+                if (rep->cost < rep->bestcost) {
+                        // Recalculate to not accumulate rounding errors.
+                        rep->cost = cost_of_state(pl, rep->state);
+                        if (rep->cost < rep->bestcost) {
+                                rep->bestcost = rep->cost;
+                                for (int m = 0; m < L; ++m) {
+                                        rep->best[m] = rep->state[m];
+                                }
+                        }
+                }
+        }
+}
+
+// Exchanges the states of replicas at neighbouring temperatures.
+static void exchange_replicas(struct replica * reps, int nr, int parity,
+                              unsigned long long * rng)
+{
+        for (int r = parity; r + 1 < nr; r += 2) {
+                struct replica * a = &reps[r];
+                struct replica * b = &reps[r + 1];
+                const double x = (a->beta - b->beta) * (a->cost - b->cost);
+                if (x < 0 && next_random(rng) >= exp(x)) { continue; }
+
+                int * temp = a->state;
+                a->state = b->state;
+                b->state = temp;
+                const double tcost = a->cost;
+                a->cost = b->cost;
+                b->cost = tcost;
+        }
+}
+
+// Sets the placement in the network, order_psites depends on it.
+static void set_placement(const struct placement * pl, const int * state)
+{
+        for (int k = 0; k < pl->L; ++k) {
+                netw.sitetoorb[pl->psites[k]] = state[k];
+        }
+        for (int i = 0; i < netw.nr_bonds; ++i) {
+                safe_free(netw.order_psites[i]);
+        }
+        safe_free(netw.order_psites);
+        create_order_psites();
+}
+
+// Returns the current placement in the network.
+static int * current_state(const struct placement * pl)
+{
+        int * safe_malloc(state, pl->L);
+        for (int k = 0; k < pl->L; ++k) {
+                state[k] = netw.sitetoorb[pl->psites[k]];
+        }
+        return state;
+}
+
+double placement_cost(const double * Iij, double eta)
+{
+        struct placement pl;
+        init_placement(&pl, Iij, eta);
+        int * state = current_state(&pl);
+        const double cost = cost_of_state(&pl, state);
+        safe_free(state);
+        destroy_placement(&pl);
+        return cost;
+}
+
+double placement_swap_cost(const double * Iij, double eta, int k, int l)
+{
+        struct placement pl;
+        init_placement(&pl, Iij, eta);
+        int * state = current_state(&pl);
+        const double delta = k == l ? 0 : swap_cost(&pl, state, k, l);
+        safe_free(state);
+        destroy_placement(&pl);
+        return delta;
+}
+
+/* The mean absolute change of the cost for a swap in the given state. It sets
+ * the scale of the temperatures. */
+static double mean_swap_cost(const struct placement * pl, const int * state)
+{
+        const int L = pl->L;
+        double sum = 0;
+        for (int k = 0; k < L; ++k) {
+                for (int l = k + 1; l < L; ++l) {
+                        sum += fabs(swap_cost(pl, state, k, l));
+                }
+        }
+        return L < 2 || sum == 0 ? 1 : sum / (L * (L - 1) / 2);
+}
+
+double optimize_placement(const double * Iij,
+                          const struct placementScheme * scheme, int verbosity)
+{
+        struct placement pl;
+        init_placement(&pl, Iij, scheme->eta);
+        const int L = pl.L;
+        const int nr = scheme->replicas;
+
+        int * initial = current_state(&pl);
+        const double scale = mean_swap_cost(&pl, initial);
+
+        struct replica * safe_malloc(reps, nr);
+        for (int r = 0; r < nr; ++r) {
+                safe_malloc(reps[r].state, L);
+                safe_malloc(reps[r].best, L);
+                for (int k = 0; k < L; ++k) {
+                        reps[r].state[k] = initial[k];
+                        reps[r].best[k] = initial[k];
+                }
+                reps[r].cost = cost_of_state(&pl, reps[r].state);
+                reps[r].bestcost = reps[r].cost;
+                reps[r].beta = nr == 1 ? scheme->beta_max : scheme->beta_min *
+                        pow(scheme->beta_max / scheme->beta_min,
+                            (double) r / (nr - 1));
+                reps[r].beta /= scale;
+                reps[r].rng = 0x9E3779B97F4A7C15ULL *
+                        ((unsigned long long) scheme->seed * nr + r + 1);
+        }
+        unsigned long long rng = 0x9E3779B97F4A7C15ULL *
+                ((unsigned long long) scheme->seed * nr + nr + 1);
+        if (verbosity > 0) {
+                printf(">> Optimizing the placement of %d orbitals with %d replicas.\n"
+                       "   Initial cost: %g\n", L, nr, reps[0].cost);
+        }
+
+        for (int sweep = 0; sweep < scheme->sweeps; ++sweep) {
+#pragma omp parallel for schedule(static) default(none) shared(pl,reps,nr)
+                for (int r = 0; r < nr; ++r) {
+                        metropolis_sweep(&pl, &reps[r]);
+                }
+                exchange_replicas(reps, nr, sweep % 2, &rng);
+
+                if (verbosity > 0 && (sweep + 1) % 100 == 0) {
+                        double best = reps[0].bestcost;
+                        for (int r = 1; r < nr; ++r) {
+                                if (reps[r].bestcost < best) {
+                                        best = reps[r].bestcost;
+                                }
+                        }
+                        printf("   sweep %d: best cost %g\n", sweep + 1, best);
+                }
+        }
+
+        int bestrep = 0;
+        for (int r = 1; r < nr; ++r) {
+                if (reps[r].bestcost < reps[bestrep].bestcost) { bestrep = r; }
+        }
+        const double cost = reps[bestrep].bestcost;
+        set_placement(&pl, reps[bestrep].best);
+        if (verbosity > 0) { printf("   Final cost: %g\n", cost); }
+
+        for (int r = 0; r < nr; ++r) {
+                safe_free(reps[r].state);
+                safe_free(reps[r].best);
+        }
+        safe_free(reps);
+        safe_free(initial);
+        destroy_placement(&pl);
+        return cost;
+}
@@ -0,0 +1,155 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "numa_policy.h"
+#include "macros.h"
+
+#define MAX_NUMA_NODES 64
+
+static enum numa_policy policy = NUMA_FIRST_TOUCH;
+
+static const char * policy_names[] = {
+        [NUMA_SERIAL] = "serial",
+        [NUMA_FIRST_TOUCH] = "first touch",
+        [NUMA_INTERLEAVE] = "interleave"
+};
+
+// Counters of /sys/devices/system/node/node*/numastat.
+struct numastat {
+        int nr_nodes;
+        long long local_node[MAX_NUMA_NODES];
+        long long other_node[MAX_NUMA_NODES];
+};
+
+static struct numastat start_stats = { .nr_nodes = 0 };
+
+enum numa_policy get_numa_policy(void) { return policy; }
+
+int set_numa_policy(const char * name)
+{
+        for (int i = 0; i < (int) (sizeof policy_names / sizeof policy_names[0]); ++i) {
+                if (strcasecmp(name, policy_names[i]) == 0) {
+                        policy = i;
+                        return 0;
+                }
+        }
+        fprintf(stderr, "Error: unknown NUMA policy \"%s\".\n", name);
+        return 1;
+}
+
+const char * get_numa_policy_string(void) { return policy_names[policy]; }
+
+void thread_block_range(int N, int * first, int * last)
+{
+#ifdef _OPENMP
+        const long long t = omp_get_thread_num();
+        const long long T = omp_get_num_threads();
+#else
+        const long long t = 0;
+        const long long T = 1;
+#endif
+        *first = N * t / T;
+        *last = N * (t + 1) / T;
+}
+
+void interleave_pages(void * mem, size_t size)
+{
+        const long pagesize = sysconf(_SC_PAGESIZE);
+        if (pagesize <= 0 || size == 0) { return; }
+        char * const start = mem;
+        const long long nrpages = (size + pagesize - 1) / pagesize;
+
+#pragma omp parallel for schedule(static, 1)
+        for (long long p = 0; p < nrpages; ++p) { start[p * pagesize] = 0; }
+}
+
+static void read_numastat(struct numastat * stats)
+{
+        stats->nr_nodes = 0;
+        for (int node = 0; node < MAX_NUMA_NODES; ++node) {
+                char buffer[MY_STRING_LEN];
+                snprintf(buffer, sizeof buffer,
+                         "/sys/devices/system/node/node%d/numastat", node);
+                FILE * fp = fopen(buffer, "r");
+                if (fp == NULL) { break; }
+
+                stats->local_node[node] = 0;
+                stats->other_node[node] = 0;
+                char key[MY_STRING_LEN];
+                long long value;
+                while (fscanf(fp, "%255s %lld", key, &value) == 2) {
+                        if (strcmp(key, "local_node") == 0) {
+                                stats->local_node[node] = value;
+                        } else if (strcmp(key, "other_node") == 0) {
+                                stats->other_node[node] = value;
+                        }
+                }
+                fclose(fp);
+                ++stats->nr_nodes;
+        }
+}
+
+// Counts the pages of this process on every node through numa_maps.
+static int read_numa_maps(long long pages[MAX_NUMA_NODES])
+{
+        for (int i = 0; i < MAX_NUMA_NODES; ++i) { pages[i] = 0; }
+        FILE * fp = fopen("/proc/self/numa_maps", "r");
+        if (fp == NULL) { return 1; }
+
+        char word[MY_STRING_LEN];
+        while (fscanf(fp, "%255s", word) == 1) {
+                int node;
+                long long nr;
+                if (sscanf(word, "N%d=%lld", &node, &nr) == 2 &&
+                    node >= 0 && node < MAX_NUMA_NODES) {
+                        pages[node] += nr;
+                }
+        }
+        fclose(fp);
+        return 0;
+}
+
+void init_numa_stats(void) { read_numastat(&start_stats); }
+
+void print_numa_stats(void)
+{
+        struct numastat stats;
+        read_numastat(&stats);
+        if (stats.nr_nodes < 2 || stats.nr_nodes != start_stats.nr_nodes) {
+                return;
+        }
+        long long pages[MAX_NUMA_NODES];
+        const int has_maps = !read_numa_maps(pages);
+
+        printf("NUMA placement (policy: %s):\n", get_numa_policy_string());
+        for (int i = 0; i < stats.nr_nodes; ++i) {
+                const long long local = stats.local_node[i] -
+                        start_stats.local_node[i];
+                const long long other = stats.other_node[i] -
+                        start_stats.other_node[i];
+                const long long total = local + other;
+                printf(" * node %d:", i);
+                if (has_maps) { printf(" %lld pages of this process,", pages[i]); }
+                printf(" %.1f %% of the page allocations (system wide) from remote threads\n",
+                       total ? 100. * other / total : 0.);
+        }
+}
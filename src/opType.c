@@ -23,6 +23,7 @@
 #include "instructions_qc.h"
 #include "hamiltonian_qc.h"
 #include "network.h"
+#include "context.h"
 #include <assert.h>
 #include "macros.h"
 
@@ -36,11 +37,23 @@
 /* Always create/annihilate, position, other dof
  * For DOCI there is no other dof
  * But always first the create/annihilate boolean and second the position */
-static int base_tag = 0;
-static int nr_basetags[NR_OPS][NR_TYP];
-static struct opType * opType_arr = NULL;
-static struct opType site_opType  = {.begin_opType = NULL, .tags_opType = NULL};
-static struct opType unity_opType = {.begin_opType = NULL, .tags_opType = NULL};
+// The state of this module in the calculation context.
+struct opType_state {
+        int base_tag;
+        int nr_basetags[NR_OPS][NR_TYP];
+        struct opType * opType_arr;
+        struct opType site_opType;
+        struct opType unity_opType;
+        // The current positions of loop_positions.
+        int loop_i, loop_j;
+};
+
+#define OPTYPE_STATE CONTEXT_STATE(struct opType_state, CONTEXT_OPTYPE)
+#define base_tag (OPTYPE_STATE->base_tag)
+#define nr_basetags (OPTYPE_STATE->nr_basetags)
+#define opType_arr (OPTYPE_STATE->opType_arr)
+#define site_opType (OPTYPE_STATE->site_opType)
+#define unity_opType (OPTYPE_STATE->unity_opType)
 
 struct makeinfo {
         int bond;
@@ -234,14 +247,19 @@ void get_opType(struct opType * const ops, const int bond, const int is_left)
         }
 }
 
-void get_opType_site(struct opType * const ops, const int psite)
+static void get_unchanged_opType_site(struct opType * const ops)
 {
+#pragma omp critical (site_optype)
         if (site_opType.begin_opType == NULL) {
                 make_site_opType(&site_opType.begin_opType, 
                                  &site_opType.tags_opType);
         }
-
         *ops = site_opType;
+}
+
+void get_opType_site(struct opType * const ops, const int psite)
+{
+        get_unchanged_opType_site(ops);
         change_site(ops, psite);
 }
 
@@ -309,10 +327,20 @@ int opType_symsec_siteop(const int siteoperator, const int site)
 {
         struct opType ops;
         int i, j, k;
-        get_opType_site(&ops, netw.sitetoorb[site]);
+        get_unchanged_opType_site(&ops);
         get_opType_type(&ops, siteoperator, &i, &j, &k);
 
-        return symsec_opTypeid(&ops, i, j, k);
+        /* Don't use change_site on the shared site_opType, this can be called
+         * by concurrent rOperator updates. Only patch a local copy of the tag. */
+        const int nr_tags = nr_basetags[i][j];
+        const int * const tag = &ops.tags_opType[i][j][k * base_tag * nr_tags];
+        int ltag[base_tag * nr_tags + 1];
+        for (int l = 0; l < base_tag * nr_tags; ++l) {
+                ltag[l] = l % base_tag == 1 ? netw.sitetoorb[site] : tag[l];
+        }
+
+        const int syms = QC_symsec_tag(ltag, nr_tags, base_tag);
+        return j == 1 ? QC_hermitian_symsec(syms) : syms;
 }
 
 void get_opType_type(const struct opType * const ops, const int id, 
@@ -612,26 +640,27 @@ static void fill_tags(const int nr, const int creator[nr],
 static int loop_positions(const int nr, const int creator[nr], int position[nr], 
                           int * const list, const int nrsites)
 {
-        static int i = 0, j = 0;
+        int * const i = &OPTYPE_STATE->loop_i;
+        int * const j = &OPTYPE_STATE->loop_j;
         int half_count = nr == 2 && creator[0] == creator[1];
         if(nrsites == 0) return 0;
 
-        if (i == nrsites) {
-                i = 0;
-                j = 0;
+        if (*i == nrsites) {
+                *i = 0;
+                *j = 0;
                 return 0;
         }
 
         if (nr == 1) {
-                position[0] = list[i++];
+                position[0] = list[(*i)++];
                 return 1;
         } else if(nr == 2) {
-                position[0] = list[i];
-                position[1] = list[j++];
+                position[0] = list[*i];
+                position[1] = list[(*j)++];
 
-                if (j == nrsites) {
-                        ++i;
-                        j = half_count * i;
+                if (*j == nrsites) {
+                        ++*i;
+                        *j = half_count * *i;
                 }
                 return 1;
         } else {
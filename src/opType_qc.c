@@ -19,11 +19,21 @@
 
 #include "opType.h"
 #include "network.h"
+#include "context.h"
 #include "hamiltonian_qc.h"
 #include "macros.h"
 #include <assert.h>
 
-static enum{QC, QC_SU2, DOCI} ham;
+// The state of this module in the calculation context.
+struct opType_qc_state {
+        enum {QC, QC_SU2, DOCI} ham;
+        // The current position and case of loop_dof.
+        int pos;
+        int cas;
+};
+
+#define OPTYPE_QC_STATE CONTEXT_STATE(struct opType_qc_state, CONTEXT_OPTYPE_QC)
+#define ham (OPTYPE_QC_STATE->ham)
 
 /* ========================================================================== */
 /* ==================== DECLARATION STATIC FUNCTIONS ======================== */
@@ -85,14 +95,12 @@ int loop_dof(const int nr, const int creator[nr], const int position[nr],
              int dof[nr], const char t, const int bond, const int is_left)
 {
         assert(nr > 0 && nr < 3);
-        static int pos = 0;
+        struct opType_qc_state * const state = OPTYPE_QC_STATE;
         static const int dofs_qc2[][2] = {{0,1}, {0,0}, {1,0}, {1,1}};
         static const int max_pos[] = {2, 1, 4, 2, 1, 1};
-        /* cas : 1qc, 1qcsu2, 2qc, 2qcsu2, 2halfqc,2halfsu2 */
-        static int cas;
 
         /* again not for DOCI */
-        if (pos == 0) {
+        if (state->pos == 0) {
                 int half_count = nr == 2 && creator[0] == creator[1] 
                         && position[0] == position[1];
                 if (t == 'n' && nr == 2 && !need_double_ops(bond, is_left))
@@ -101,39 +109,39 @@ int loop_dof(const int nr, const int creator[nr], const int position[nr],
                                                         bond, is_left))
                         return 0;
                 /* cas : 1qc, 1qcsu2, 2qc, 2qcsu2, 2halfqc,2halfsu2 */
-                cas = (ham == QC_SU2) + (nr - 1 + half_count) * 2;
+                state->cas = (ham == QC_SU2) + (nr - 1 + half_count) * 2;
         }
 
-        if (pos >= max_pos[cas])
+        if (state->pos >= max_pos[state->cas])
         {
-                pos = 0;
+                state->pos = 0;
                 return 0;
         }
 
-        switch(cas) {
+        switch(state->cas) {
         case 0:
-                dof[0] = pos;
+                dof[0] = state->pos;
                 break;
         case 1:
                 dof[0] = 1;
                 break;
         case 2:
         case 4:
-                dof[0] = dofs_qc2[pos][0];
-                dof[1] = dofs_qc2[pos][1];
+                dof[0] = dofs_qc2[state->pos][0];
+                dof[1] = dofs_qc2[state->pos][1];
                 break;
         case 3:
         case 5:
                 dof[0] = -1;
-                dof[1] = 2 * pos; /* 0 or 2 */
+                dof[1] = 2 * state->pos; /* 0 or 2 */
                 break;
         default:
                 fprintf(stderr, "%s@%s: Wrong case switch (%d)\n",
-                        __FILE__, __func__, cas);
-                pos = 0;
+                        __FILE__, __func__, state->cas);
+                state->pos = 0;
                 return 0;
         }
-        ++pos;
+        ++state->pos;
         return 1;
 }
 
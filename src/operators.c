@@ -1,3 +1,4 @@
+#include <string.h>
 #include <strings.h>
 #include <stdlib.h>
 
@@ -9,6 +10,7 @@
 #include "instructions.h"
 #include "instructions_qc.h"
 #include "optimize_network.h"
+#include "RedDM.h"
 
 static void calculate_seniority(const struct siteTensor * T3NS)
 {
@@ -139,7 +141,7 @@ static void calculate_seniority(const struct siteTensor * T3NS)
         shallow_copy_instructionsets(pinstr, binstr, NULL);
 
         struct rOperators * rops = NULL;
-        if (init_operators(&rops, T3NS, true)) {
+        if (init_operators(NULL, &rops, T3NS, true)) {
                 fprintf(stderr, "error initializing operators\n");
         }
 
@@ -170,10 +172,44 @@ static void calculate_seniority(const struct siteTensor * T3NS)
         clear_instructions();
 }
 
+// True if operator is name, or name=FILE.
+static bool is_operator(const char * operator, const char * name)
+{
+        const size_t len = strlen(name);
+        return strncasecmp(name, operator, len) == 0 &&
+                (operator[len] == '\0' || operator[len] == '=');
+}
+
+bool is_valid_operator(const char * operator)
+{
+        return strcasecmp("seniority", operator) == 0 || 
+                is_operator(operator, "2rdm") || 
+                is_operator(operator, "mutual");
+}
+
 bool calculate_operator(const char * operator, const char * h5file)
 {
         struct siteTensor * T3NS;
 
+        /* The operator and the symmetries of the state are checked before
+         * the wave function is read. */
+        const bool rdm = is_operator(operator, "2rdm");
+        const bool mutual = is_operator(operator, "mutual");
+        if (!is_valid_operator(operator)) {
+                fprintf(stderr, "Invalid argument for option --operator: %s\n", operator);
+                return false;
+        }
+        if (rdm || mutual) {
+                enum hamtypes hamtype;
+                int nrSyms;
+                enum symmetrygroup sgs[MAX_SYMMETRIES];
+                if (read_symmetries_from_disk(h5file, &hamtype, &nrSyms, sgs) ||
+                    check_opstrings_support(hamtype, nrSyms, sgs, rdm ? 
+                                            "2-RDM" : "mutual information")) {
+                        return false;
+                }
+        }
+
         if (read_from_disk(h5file, &T3NS, NULL, false) != 0) {
                 return false;
         }
@@ -186,8 +222,36 @@ bool calculate_operator(const char * operator, const char * h5file)
 
                 calculate_seniority(T3NS);
                 return true;
+        } else if (rdm) {
+                const char * filename = operator[4] == '=' ? 
+                        &operator[5] : "2rdm.h5";
+                const bool success = write_2RDM(T3NS, filename) == 0;
+                for (int i = 0; i < netw.sites; ++i) {
+                        destroy_siteTensor(&T3NS[i]);
+                }
+                safe_free(T3NS);
+                return success;
         } else {
-                fprintf(stderr, "Invalid argument for option --operator: %s\n", operator);
-                return false;
+                const char * filename = operator[6] == '=' ? 
+                        &operator[7] : "mutual.h5";
+                const int L = netw.psites;
+                double * safe_malloc(entropy, L);
+                double * safe_malloc(Iij, L * L);
+                bool success = get_mutualInformation(T3NS, entropy, Iij) == 0;
+                if (success) {
+                        printf("Orbital entropy:\n");
+                        for (int i = 0; i < L; ++i) {
+                                printf("%d\t%.14g\n", i, entropy[i]);
+                        }
+                        success = write_mutualInformation(filename, L, entropy,
+                                                          Iij) == 0;
+                }
+                safe_free(entropy);
+                safe_free(Iij);
+                for (int i = 0; i < netw.sites; ++i) {
+                        destroy_siteTensor(&T3NS[i]);
+                }
+                safe_free(T3NS);
+                return success;
         }
 }
@@ -28,9 +28,11 @@
 #define STRTOKSEP " ,\t\n"
 
 enum regimeoptions {MIN_D, MAX_D, TRUNCERR, D, SITESIZE, 
-        DAVID_RTL, DAVID_ITS, SWEEPS, E_CONV, NOISE};
+        DAVID_RTL, DAVID_ITS, SWEEPS, E_CONV, NOISE, PAR_SWEEP, RAND_SVD, 
+        GRAM_SVD, EXPANSION};
 static const char *optionnames[] = {"minD", "maxD", "TRUNC_ERR", "D", 
-        "SITE_SIZE", "DAVID_RTL", "DAVID_ITS", "SWEEPS", "E_CONV", "NOISE"};
+        "SITE_SIZE", "DAVID_RTL", "DAVID_ITS", "SWEEPS", "E_CONV", "NOISE", 
+        "PAR_SWEEP", "RAND_SVD", "GRAM_SVD", "EXPANSION"};
 
 /* ========================================================================== */
 /* ========================== STATIC FUNCTIONS ============================== */
@@ -60,6 +62,18 @@ static void fill_regimeoptions_default(struct optScheme * const scheme,
                 case NOISE:
                         reg->noise = DEFAULT_NOISE;
                         break;
+                case PAR_SWEEP:
+                        reg->par_sweep = DEFAULT_PAR_SWEEP;
+                        break;
+                case RAND_SVD:
+                        reg->svd_sel.randomized = DEFAULT_RAND_SVD;
+                        break;
+                case GRAM_SVD:
+                        reg->svd_sel.gram = DEFAULT_GRAM_SVD;
+                        break;
+                case EXPANSION:
+                        reg->expansion = DEFAULT_EXPANSION;
+                        break;
                 default:
                         fprintf(stderr, "%s@%s: No default defined for option %s\n",
                                 __FILE__, __func__, optionnames[option]);
@@ -88,7 +102,11 @@ static void fill_regimeoptions(char buffer[], struct optScheme * const scheme,
                         &reg->davidson_max_its,
                         &reg->max_sweeps,
                         &reg->energy_conv,
-                        &reg->noise
+                        &reg->noise,
+                        &reg->par_sweep,
+                        &reg->svd_sel.randomized,
+                        &reg->svd_sel.gram,
+                        &reg->expansion
                 };
                 errno = 0;
                 switch (option) {
@@ -98,6 +116,9 @@ static void fill_regimeoptions(char buffer[], struct optScheme * const scheme,
                 case SITESIZE:
                 case DAVID_ITS:
                 case SWEEPS:
+                case PAR_SWEEP:
+                case RAND_SVD:
+                case GRAM_SVD:
                         pnti = towrite[option];
                         *pnti = strtol(pch, &endptr, 0);
                         if(errno != 0 || *endptr != '\0') {
@@ -110,6 +131,7 @@ static void fill_regimeoptions(char buffer[], struct optScheme * const scheme,
                 case DAVID_RTL:
                 case E_CONV:
                 case NOISE:
+                case EXPANSION:
                         pntd = towrite[option];
                         *pntd = strtod(pch, &endptr);
                         if(errno != 0 || *endptr != '\0') {
@@ -188,7 +210,7 @@ void read_optScheme(const char inputfile[], struct optScheme * scheme)
 {
         char buffer[255];
         read_bonddim(inputfile, scheme);
-        for (enum regimeoptions opt = SITESIZE; opt <= NOISE; ++opt) {
+        for (enum regimeoptions opt = SITESIZE; opt <= EXPANSION; ++opt) {
                 const int ro = read_option(optionnames[opt], inputfile, buffer);
                 if (ro == -1) {
                         fill_regimeoptions_default(scheme, opt);
@@ -275,5 +297,25 @@ void print_optScheme(const struct optScheme * const scheme)
                 printf("%11.3f", scheme->regimes[i].noise);
         }
         printf("\n");
+        printf("%10s", optionnames[PAR_SWEEP]);
+        for (int i = 0; i < scheme->nrRegimes; ++i) {
+                printf("%11d", scheme->regimes[i].par_sweep);
+        }
+        printf("\n");
+        printf("%10s", optionnames[RAND_SVD]);
+        for (int i = 0; i < scheme->nrRegimes; ++i) {
+                printf("%11d", scheme->regimes[i].svd_sel.randomized);
+        }
+        printf("\n");
+        printf("%10s", optionnames[GRAM_SVD]);
+        for (int i = 0; i < scheme->nrRegimes; ++i) {
+                printf("%11d", scheme->regimes[i].svd_sel.gram);
+        }
+        printf("\n");
+        printf("%10s", optionnames[EXPANSION]);
+        for (int i = 0; i < scheme->nrRegimes; ++i) {
+                printf("%11.2e", scheme->regimes[i].expansion);
+        }
+        printf("\n");
         printf("################################################################################\n\n");
 }
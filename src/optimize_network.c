@@ -16,8 +16,11 @@
 */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <time.h>
+#include <omp.h>
 
 #include "optimize_network.h"
 #include "macros.h"
@@ -29,6 +32,15 @@
 #include "io_to_disk.h"
 #include "RedDM.h" 
 #include "timers.h"
+#include "distributed.h"
+#include "trace.h"
+#include "context.h"
+
+#ifdef T3NS_MKL
+#include "mkl.h"
+#else
+#include <cblas.h>
+#endif
 
 #define MAX_NR_INTERNALS 3
 #define NR_TIMERS 12
@@ -40,6 +52,43 @@
 #define SOLVER_STRING "D"
 #endif
 
+/* Without OpenMP everything runs on a single thread. */
+#ifdef _OPENMP
+static double wall_time(void) { return omp_get_wtime(); }
+
+static int get_max_threads(void) { return omp_get_max_threads(); }
+
+static void set_inner_threads(int nthreads) { omp_set_num_threads(nthreads); }
+
+/* Allows one nested level of parallelism, returns the previous maximum. */
+static int allow_nesting(void)
+{
+        const int max_levels = omp_get_max_active_levels();
+        if (max_levels < 2) { omp_set_max_active_levels(2); }
+        return max_levels;
+}
+
+static void restore_nesting(int max_levels)
+{
+        omp_set_max_active_levels(max_levels);
+}
+#else
+static double wall_time(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static int get_max_threads(void) { return 1; }
+
+static void set_inner_threads(int nthreads) { (void) nthreads; }
+
+static int allow_nesting(void) { return 1; }
+
+static void restore_nesting(int max_levels) { (void) max_levels; }
+#endif
+
 static const char *timernames[] = {
         "rOperators: append physical", 
         "rOperators: update physical",
@@ -55,7 +104,8 @@ static const char *timernames[] = {
         "io: write to disk",
         "siteTensor: permuting",
         "Network: entanglement",
-        "Network: Recanonicalizing"
+        "Network: Recanonicalizing",
+        "Optimization step"
 };
 
 enum timerkeys {
@@ -73,7 +123,8 @@ enum timerkeys {
         IO_DISK,
         STENS_PERM,
         NETW_ENT,
-        NETW_CANON
+        NETW_CANON,
+        OPT_STEP
 };
 
 static const int timkeys[] = {
@@ -91,9 +142,112 @@ static const int timkeys[] = {
         IO_DISK,
         STENS_PERM,
         NETW_ENT,
-        NETW_CANON
+        NETW_CANON,
+        OPT_STEP
+};
+
+// The timers that are part of an optimization step.
+static const int steptimers[] = {
+        ROP_APPEND,
+        ROP_UPDP,
+        ROP_UPDB,
+        PREP_HEFF_T3NS,
+        DIAG_T3NS,
+        HEFF_T3NS, 
+        PREP_HEFF_DMRG,
+        DIAG_DMRG,
+        HEFF_DMRG,
+        STENS_MAKE,
+        STENS_DECOMP
+};
+
+static struct timers init_opt_timers(void)
+{
+        struct timers chrono = init_timers(timernames, timkeys,
+                                           sizeof timkeys / sizeof timkeys[0]);
+        for (int i = 0; i < (int) (sizeof steptimers / sizeof steptimers[0]); ++i) {
+                set_timer_parent(&chrono, steptimers[i], OPT_STEP);
+        }
+        return chrono;
+}
+
+// The data of an optimization step.
+struct optimize_data {
+        struct stepSpecs specs;
+        struct rOperators operators[STEPSPECS_MBONDS];
+        struct siteTensor msiteObj;
+
+        int nr_internals;
+        struct symsecs internalss[MAX_NR_INTERNALS];
+        int internalbonds[MAX_NR_INTERNALS];
+
+        /* The state of rand_r for the noise, every branch of a parallel
+         * sweep has its own. */
+        unsigned int seed;
 };
 
+// The state of this module in the calculation context.
+struct optimize_state {
+        /* The data of the current optimization step, one for every branch
+         * since the branches are optimized concurrently in a parallel
+         * sweep. */
+        struct optimize_data step[3];
+
+        // The optimization step of which the effective Hamiltonian is written.
+        struct {
+                char filename[MY_STRING_LEN];
+                int regime;
+                int sweep;
+                int step;
+        } heff_snapshot;
+
+        // The callback for the progress of the optimization.
+        struct {
+                int (*callback)(const struct progress_info * info, void * data);
+                void * data;
+        } progress;
+};
+
+#define OPTIMIZE_STATE(ctx) \
+        CONTEXT_STATE_OF((ctx), struct optimize_state, CONTEXT_OPTIMIZE)
+
+/* The data of the steps in branch of a parallel sweep, branch is -1 outside
+ * of a parallel sweep. */
+static struct optimize_data * step_data(struct t3ns_context * ctx, int branch)
+{
+        return &OPTIMIZE_STATE(ctx)->step[branch == -1 ? 0 : branch];
+}
+
+/* Passes the progress and the timers to the callback. Returns 1 if the
+ * optimization should stop. The decision of the root is used by every 
+ * process. */
+static int report_progress(struct t3ns_context * ctx, 
+                           struct progress_info * info,
+                           const struct timers * chrono)
+{
+        const struct optimize_state * state = OPTIMIZE_STATE(ctx);
+        double stop = 0;
+        if (state->progress.callback != NULL && get_rank() == 0) {
+                const char ** safe_malloc(names, chrono->n);
+                double * safe_malloc(seconds, chrono->n);
+                for (int i = 0; i < chrono->n; ++i) {
+                        names[i] = chrono->timers[i].name;
+                        seconds[i] = chrono->timers[i].t;
+                }
+                info->nr_timers = chrono->n;
+                info->timer_names = names;
+                info->timer_seconds = seconds;
+                // Serialized within the calculation, not with the others.
+                context_lock(CONTEXT_LOCK_PROGRESS);
+                stop = state->progress.callback(info, state->progress.data) != 0;
+                context_unlock(CONTEXT_LOCK_PROGRESS);
+                safe_free(names);
+                safe_free(seconds);
+        }
+        if (info->kind == PROGRESS_SWEEP) { broadcast_from_root(&stop, 1); }
+        return stop != 0;
+}
+
 static void init_null_T3NS(struct siteTensor ** T3NS)
 {
         safe_malloc(*T3NS, netw.sites);
@@ -108,47 +262,38 @@ static void init_null_rops(struct rOperators ** rops)
         }
 }
 
-static struct optimize_data {
-        struct stepSpecs specs;
-        struct rOperators operators[STEPSPECS_MBONDS];
-        struct siteTensor msiteObj;
-
-        int nr_internals;
-        struct symsecs internalss[MAX_NR_INTERNALS];
-        int internalbonds[MAX_NR_INTERNALS];
-} o_dat;
-
-static void set_internal_symsecs(void)
+static void set_internal_symsecs(struct optimize_data * od)
 {
-        if (o_dat.specs.nr_sites_opt == 1) { 
-                o_dat.nr_internals = 1;
-                o_dat.internalbonds[0] = o_dat.specs.bonds_opt[o_dat.specs.common_next[0]];
+        if (od->specs.nr_sites_opt == 1) { 
+                od->nr_internals = 1;
+                od->internalbonds[0] = od->specs.bonds_opt[od->specs.common_next[0]];
         } else {
-                o_dat.nr_internals = get_nr_internalbonds(&o_dat.msiteObj);
-                assert(o_dat.nr_internals <= MAX_NR_INTERNALS);
-                get_internalbonds(&o_dat.msiteObj, o_dat.internalbonds);
+                od->nr_internals = get_nr_internalbonds(&od->msiteObj);
+                assert(od->nr_internals <= MAX_NR_INTERNALS);
+                get_internalbonds(&od->msiteObj, od->internalbonds);
         }
-        deep_copy_symsecs_from_bookie(o_dat.nr_internals, o_dat.internalss, 
-                                      o_dat.internalbonds);
+        deep_copy_symsecs_from_bookie(od->nr_internals, od->internalss, 
+                                      od->internalbonds);
 
-        for (int i = o_dat.nr_internals; i < MAX_NR_INTERNALS; ++i) 
-                o_dat.internalbonds[i] = -1;
+        for (int i = od->nr_internals; i < MAX_NR_INTERNALS; ++i) 
+                od->internalbonds[i] = -1;
 }
 
-static void preprocess_rOperators(const struct rOperators * rops)
+static void preprocess_rOperators(struct optimize_data * od,
+                                  const struct rOperators * rops)
 { 
         // one-site optimization & DMRG
-        if (o_dat.specs.nr_sites_opt == 1 && is_psite(o_dat.specs.sites_opt[0])) {
-                assert(o_dat.specs.nr_bonds_opt == 2);
+        if (od->specs.nr_sites_opt == 1 && is_psite(od->specs.sites_opt[0])) {
+                assert(od->specs.nr_bonds_opt == 2);
 
-                assert(o_dat.specs.common_next[0] == 0 ||
-                       o_dat.specs.common_next[0] == 1);
+                assert(od->specs.common_next[0] == 0 ||
+                       od->specs.common_next[0] == 1);
 
                 // For 1-site DMRG set the internalbond as the one that is 
                 // common with the next step.
-                const int internalbond = o_dat.specs.common_next[0];
-                const int bond = o_dat.specs.bonds_opt[internalbond];
-                const int otherbond = o_dat.specs.bonds_opt[!internalbond];
+                const int internalbond = od->specs.common_next[0];
+                const int bond = od->specs.bonds_opt[internalbond];
+                const int otherbond = od->specs.bonds_opt[!internalbond];
 
                 struct symsecs * ss = &bookie.v_symsecs[bond];
                 
@@ -156,59 +301,68 @@ static void preprocess_rOperators(const struct rOperators * rops)
                 safe_malloc(ss->dims, ss->nrSecs);
                 for (int i = 0; i < ss->nrSecs; ++i) { ss->dims[i] = 1; }
 
-                rOperators_append_phys(&o_dat.operators[!internalbond], &rops[otherbond]);
+                rOperators_append_phys(&od->operators[!internalbond], &rops[otherbond]);
                 safe_free(ss->dims);
                 ss->dims = tempdim;
-                o_dat.operators[internalbond] = rops[bond];
+                od->operators[internalbond] = rops[bond];
                 return;
         }
 
-        for (int i = 0; i < o_dat.specs.nr_bonds_opt; ++i) {
-                const int bond = o_dat.specs.bonds_opt[i];
+        for (int i = 0; i < od->specs.nr_bonds_opt; ++i) {
+                const int bond = od->specs.bonds_opt[i];
                 const struct rOperators * opToProc = &rops[bond];
                 assert(!opToProc->P_operator);
 
                 if (is_psite(netw.bonds[bond][opToProc->is_left])) {
-                        rOperators_append_phys(&o_dat.operators[i], opToProc);
+                        rOperators_append_phys(&od->operators[i], opToProc);
                 } else {
-                        o_dat.operators[i] = *opToProc;
+                        od->operators[i] = *opToProc;
                 }
         }
 }
 
-static void add_noise(struct siteTensor * tens, double noiseLevel)
+static void add_noise(struct siteTensor * tens, double noiseLevel,
+                      unsigned int * seed)
 {
         const int N = siteTensor_get_size(tens);
         for(int i = 0; i < N; ++i) {
-                const double random_nr = rand() * 1. / RAND_MAX - 0.5;
+                const double random_nr = rand_r(seed) * 1. / RAND_MAX - 0.5;
                 tens->blocks.tel[i] += random_nr * noiseLevel;
         }
 }
 
-static double optimize_siteTensor(const struct regime * reg,
-                                  struct timers * timings, const int verbosity)
+/* Optimizes od->msiteObj. If perturb is not NULL, the perturbation
+ * -reg->expansion (H|psi> - E|psi>) of the result is stored in it. */
+static double optimize_siteTensor(struct optimize_data * od,
+                                  const struct regime * reg,
+                                  struct timers * timings, const int verbosity,
+                                  const char * snapshot, 
+                                  T3NS_EL_TYPE ** perturb)
 {
-        assert(o_dat.specs.nr_bonds_opt == 2 || o_dat.specs.nr_bonds_opt == 3);
-        const int isdmrg = o_dat.specs.nr_bonds_opt == 2;
+        assert(od->specs.nr_bonds_opt == 2 || od->specs.nr_bonds_opt == 3);
+        const int isdmrg = od->specs.nr_bonds_opt == 2;
         const enum timerkeys prep_heff = isdmrg ? PREP_HEFF_DMRG : PREP_HEFF_T3NS;
         const enum timerkeys diag = isdmrg ? DIAG_DMRG : DIAG_T3NS;
         const enum timerkeys heff = isdmrg ? HEFF_DMRG : HEFF_T3NS;
 
         struct Heffdata mv_dat;
-        const int size = siteTensor_get_size(&o_dat.msiteObj);
+        const int size = siteTensor_get_size(&od->msiteObj);
 
         tic(timings, prep_heff);
-        init_Heffdata(&mv_dat, o_dat.operators, &o_dat.msiteObj);
+        init_Heffdata(&mv_dat, od->operators, &od->msiteObj);
         toc(timings, prep_heff);
+        if (snapshot != NULL) {
+                write_Heff_snapshot(snapshot, &mv_dat, od->msiteObj.blocks.tel);
+        }
 
         if (verbosity > 0) {
-                printf(">> Optimize site%s", o_dat.msiteObj.nrsites == 1 ? "" : "s");
-                for (int i = 0; i < o_dat.msiteObj.nrsites; ++i) {
-                        printf(" %d%s", o_dat.msiteObj.sites[i], 
-                               i == o_dat.msiteObj.nrsites - 1 ? ": " : " &");
+                printf(">> Optimize site%s", od->msiteObj.nrsites == 1 ? "" : "s");
+                for (int i = 0; i < od->msiteObj.nrsites; ++i) {
+                        printf(" %d%s", od->msiteObj.sites[i], 
+                               i == od->msiteObj.nrsites - 1 ? ": " : " &");
                 }
                 printf("(blocks: %d, qns: %d, dim: %d, instr: %d)\n", 
-                       o_dat.msiteObj.nrblocks, mv_dat.nr_qnB, size, mv_dat.iset.nr_instr);
+                       od->msiteObj.nrblocks, mv_dat.nr_qnB, size, mv_dat.iset.nr_instr);
         }
 
         tic(timings, diag);
@@ -217,10 +371,19 @@ static double optimize_siteTensor(const struct regime * reg,
 
         double energy;
         tic(timings, heff);
-        sparse_eigensolve(o_dat.msiteObj.blocks.tel, &energy, size, 
+        sparse_eigensolve(od->msiteObj.blocks.tel, &energy, size, 
                           DAVIDSON_MAX_VECS, DAVIDSON_KEEP_DEFLATE, 
                           reg->davidson_rtl, reg->davidson_max_its, 
                           diagonal, matvecT3NS, &mv_dat, SOLVER_STRING, verbosity);
+        if (perturb != NULL) {
+                T3NS_EL_TYPE * psi = od->msiteObj.blocks.tel;
+                safe_malloc(*perturb, size);
+                matvecT3NS(psi, *perturb, &mv_dat);
+                const double norm2 = cblas_ddot(size, psi, 1, psi, 1);
+                const double E = cblas_ddot(size, psi, 1, *perturb, 1) / norm2;
+                cblas_daxpy(size, -E, psi, 1, *perturb, 1);
+                cblas_dscal(size, -reg->expansion, *perturb, 1);
+        }
         toc(timings, heff);
         destroy_Heffdata(&mv_dat);
         safe_free(diagonal);
@@ -235,7 +398,8 @@ static int find_in_array(const int size, const int * array, const int id)
         return -1;
 }
 
-static void postprocess_rOperators(struct rOperators * rops,
+static void postprocess_rOperators(struct optimize_data * od,
+                                   struct rOperators * rops,
                                    const struct siteTensor * T3NS,
                                    struct timers * timings)
 {
@@ -243,16 +407,16 @@ static void postprocess_rOperators(struct rOperators * rops,
 
         /* first do all dmrg updates possible */
         tic(timings, ROP_UPDP);
-        for (int i = 0; i < o_dat.specs.nr_bonds_opt; ++i) {
-                struct rOperators * currOp = &o_dat.operators[i];
+        for (int i = 0; i < od->specs.nr_bonds_opt; ++i) {
+                struct rOperators * currOp = &od->operators[i];
                 if (!currOp->P_operator)
                         continue;
 
                 const int site = netw.bonds[currOp->bond][!currOp->is_left];
-                const int siteid = find_in_array(o_dat.specs.nr_sites_opt, 
-                                                 o_dat.specs.sites_opt, site);
+                const int siteid = find_in_array(od->specs.nr_sites_opt, 
+                                                 od->specs.sites_opt, site);
                 assert(siteid != -1 && is_psite(site));
-                if (o_dat.specs.common_next[siteid] && o_dat.specs.nr_sites_opt != 1) {
+                if (od->specs.common_next[siteid] && od->specs.nr_sites_opt != 1) {
                         /* This Operator is not updated since it has a 
                          * common site with the next step */
                         assert(unupdated == -1 && unupdatedbond == -1);
@@ -264,28 +428,28 @@ static void postprocess_rOperators(struct rOperators * rops,
 
                 const struct siteTensor * tens = &T3NS[site];
                 struct rOperators * newOp = &rops[currOp->bond];
-                const int internalid = find_in_array(o_dat.nr_internals, 
-                                                     o_dat.internalbonds, 
+                const int internalid = find_in_array(od->nr_internals, 
+                                                     od->internalbonds, 
                                                      currOp->bond);
                 assert(internalid != -1);
 
                 destroy_rOperators(newOp);
                 update_rOperators_physical(currOp, tens, 
-                                           &o_dat.internalss[internalid]);
+                                           &od->internalss[internalid]);
                 *newOp= *currOp;
         }
         toc(timings, ROP_UPDP);
 
-        if (o_dat.specs.nr_sites_opt == 1) {
-                unupdated = o_dat.specs.common_next[0];
-                unupdatedbond = o_dat.specs.bonds_opt[unupdated];
+        if (od->specs.nr_sites_opt == 1) {
+                unupdated = od->specs.common_next[0];
+                unupdatedbond = od->specs.bonds_opt[unupdated];
         }
         /* now do the possible T3NS update. Only 1 or none always */
         tic(timings, ROP_UPDB);
-        for (int i = 0; i < o_dat.specs.nr_sites_opt; ++i) {
-                const int site = o_dat.specs.sites_opt[i];
+        for (int i = 0; i < od->specs.nr_sites_opt; ++i) {
+                const int site = od->specs.sites_opt[i];
 
-                if (is_psite(site) || (o_dat.specs.common_next[i] && o_dat.specs.nr_sites_opt != 1))
+                if (is_psite(site) || (od->specs.common_next[i] && od->specs.nr_sites_opt != 1))
                         continue;
 
                 const struct siteTensor * tens   = &T3NS[site];
@@ -295,20 +459,20 @@ static void postprocess_rOperators(struct rOperators * rops,
 
                 destroy_rOperators(new_operator);
                 struct rOperators ops[2] = {
-                        o_dat.operators[unupdated == 0], 
-                        o_dat.operators[unupdated == 2 ? 1 : 2]
+                        od->operators[unupdated == 0], 
+                        od->operators[unupdated == 2 ? 1 : 2]
                 };
-                assert(unupdated == 0 || o_dat.operators[0].bond == bonds[0]);
-                assert(unupdated == 1 || o_dat.operators[1].bond == bonds[1]);
-                assert(unupdated == 2 || o_dat.operators[2].bond == bonds[2]);
+                assert(unupdated == 0 || od->operators[0].bond == bonds[0]);
+                assert(unupdated == 1 || od->operators[1].bond == bonds[1]);
+                assert(unupdated == 2 || od->operators[2].bond == bonds[2]);
                 assert(!ops[0].P_operator && !ops[1].P_operator);
 
                 update_rOperators_branching(new_operator, ops, tens);
         }
         toc(timings, ROP_UPDB);
 
-        for (int i = 0; i < o_dat.nr_internals; ++i) {
-                destroy_symsecs(&o_dat.internalss[i]);
+        for (int i = 0; i < od->nr_internals; ++i) {
+                destroy_symsecs(&od->internalss[i]);
         }
 }
 
@@ -318,74 +482,571 @@ struct sweep_info {
         int sw_maxdim;
 
         struct timers chrono;
+
+        // The regime and sweep number, and the steps done in this sweep.
+        int regime;
+        int sweep;
+        int step;
+        // The branch in a parallel sweep, -1 if not in a branch.
+        int branch;
 };
 
-static struct sweep_info execute_sweep(struct siteTensor * T3NS, 
-                                       struct rOperators * rops, 
-                                       const struct regime * reg, 
-                                       double trunc_err, const char * saveloc,
-                                       int lowD, int * lowDb, int verbosity)
+/* Updates the rOperators of bond by contracting the tensor of site with the
+ * rOperators of its other bonds. These should be directed towards site. */
+static void update_rops_of_bond(struct rOperators * const newops,
+                                const struct rOperators * const rops,
+                                const struct siteTensor * const tens,
+                                const int bond, const int site,
+                                struct timers * chrono)
 {
-        struct sweep_info swinfo = {
-                .chrono = init_timers(timernames, timkeys, 
-                                            sizeof timkeys / sizeof timkeys[0])
-        };
-        int first = 1;
-
-        while (next_opt_step(reg->sitesize, &o_dat.specs)) {
-                /* The order of makesiteTensor and preprocess_rOperators is
-                 * really important!
-                 * In makesiteTensor the symsec is set to an internal symsec. 
-                 * This is what you need also for preprocess_rOperators */
-                tic(&swinfo.chrono, STENS_MAKE);
-                makesiteTensor(&o_dat.msiteObj, T3NS, o_dat.specs.sites_opt,
-                               o_dat.specs.nr_sites_opt);
-                toc(&swinfo.chrono, STENS_MAKE);
-
-                tic(&swinfo.chrono, ROP_APPEND);
-                preprocess_rOperators(rops);
-                toc(&swinfo.chrono, ROP_APPEND);
-                set_internal_symsecs();
-
-                double energy = optimize_siteTensor(reg, &swinfo.chrono, verbosity);
-                if (verbosity > 0) { printf("   * Energy: %.12lf\n", energy); }
-
-                tic(&swinfo.chrono, STENS_DECOMP);
-                /* same noise as CheMPS2 */
-                add_noise(&o_dat.msiteObj, reg->noise * trunc_err);
-                norm_tensor(&o_dat.msiteObj);
-
-                struct SvalSelect svd_sel = reg->svd_sel;
-                if (lowDb != NULL) {
-                        const int bnd = get_common_bond(o_dat.msiteObj.sites[0], o_dat.msiteObj.sites[1]);
-                        for (int * ii = lowDb; *ii != -1; ++ii) {
-                                if (bnd == *ii) {
-                                        svd_sel.minD = lowD;
-                                        svd_sel.maxD = lowD;
-                                        break;
-                                }
+        int bonds[3];
+        get_bonds_of_site(site, bonds);
+        assert(bonds[0] == bond || bonds[1] == bond || bonds[2] == bond);
+
+        if (is_psite(site)) { /* physical tensor, DMRG update needed */
+                assert(bonds[1] != bond);
+                const int otherbond = bonds[0] == bond ? bonds[2] : bonds[0];
+                struct symsecs * const ss = &bookie.v_symsecs[bond];
+                int * tempdim = ss->dims;
+                safe_malloc(ss->dims, ss->nrSecs);
+                for (int i = 0; i < ss->nrSecs; ++i) { ss->dims[i] = 1; }
+
+                tic(chrono, ROP_APPEND);
+                rOperators_append_phys(newops, &rops[otherbond]);
+                toc(chrono, ROP_APPEND);
+                safe_free(ss->dims);
+                ss->dims = tempdim;
+                /* Just pass the same symsecs as internal one. Doesnt really matter that dims != 1.
+                 * What matters is that both have the same symsecs and this way a correct array can be made
+                 * in update_rOperators_physical */
+                tic(chrono, ROP_UPDP);
+                update_rOperators_physical(newops, tens, ss);
+                toc(chrono, ROP_UPDP);
+        } else { /* branching tensor, T3NS update needed */
+                struct rOperators ops[2];
+                int j = 0;
+                for (int i = 0; i < 3; ++i) {
+                        if (bonds[i] != bond) { ops[j++] = rops[bonds[i]]; }
+                }
+                tic(chrono, ROP_UPDB);
+                update_rOperators_branching(newops, ops, tens);
+                toc(chrono, ROP_UPDB);
+        }
+}
+
+/* Gives the file for the snapshot of the effective Hamiltonian if it is asked
+ * for this step, else NULL. */
+static const char * snapshot_of_step(struct t3ns_context * ctx,
+                                     const struct sweep_info * swinfo)
+{
+        const char * res = NULL;
+        struct optimize_state * state = OPTIMIZE_STATE(ctx);
+#pragma omp critical (snapshot)
+        if (state->heff_snapshot.filename[0] != '\0' && 
+            state->heff_snapshot.regime == swinfo->regime &&
+            state->heff_snapshot.sweep == swinfo->sweep &&
+            state->heff_snapshot.step == swinfo->step) {
+                res = state->heff_snapshot.filename;
+                // Only written once, also if the branches have the same step.
+                state->heff_snapshot.regime = -1;
+        }
+        return res;
+}
+
+/* Executes the optimization step specified in od->specs. */
+static void execute_step(struct t3ns_context * ctx, struct optimize_data * od,
+                         struct siteTensor * T3NS, struct rOperators * rops,
+                         const struct regime * reg, double trunc_err,
+                         int lowD, int * lowDb, int verbosity,
+                         struct sweep_info * swinfo, bool * first)
+{
+        /* The order of makesiteTensor and preprocess_rOperators is
+         * really important!
+         * In makesiteTensor the symsec is set to an internal symsec. 
+         * This is what you need also for preprocess_rOperators */
+        char tracename[MY_STRING_LEN] = "Sites";
+        char traceargs[MY_STRING_LEN];
+        if (trace_enabled()) {
+                for (int i = 0; i < od->specs.nr_sites_opt; ++i) {
+                        const size_t len = strlen(tracename);
+                        snprintf(tracename + len, sizeof tracename - len, 
+                                 " %d", od->specs.sites_opt[i]);
+                }
+                snprintf(traceargs, sizeof traceargs, 
+                         "{\"regime\":%d,\"sweep\":%d,\"step\":%d,\"branch\":%d}",
+                         swinfo->regime, swinfo->sweep, swinfo->step, 
+                         swinfo->branch);
+                trace_begin(tracename, "step", traceargs);
+        }
+        const double start = wall_time();
+        struct timers stepchrono = init_opt_timers();
+        struct timers * chrono = &stepchrono;
+        tic(chrono, OPT_STEP);
+        tic(chrono, STENS_MAKE);
+        makesiteTensor(&od->msiteObj, T3NS, od->specs.sites_opt,
+                       od->specs.nr_sites_opt);
+        toc(chrono, STENS_MAKE);
+
+        tic(chrono, ROP_APPEND);
+        preprocess_rOperators(od, rops);
+        toc(chrono, ROP_APPEND);
+        set_internal_symsecs(od);
+
+        /* Subspace expansion of the bond to the next site, only for one-site
+         * steps. */
+        const bool expand = od->specs.nr_sites_opt == 1 && 
+                reg->expansion != 0;
+        T3NS_EL_TYPE * perturb = NULL;
+        double energy = optimize_siteTensor(od, reg, chrono, verbosity,
+                                            snapshot_of_step(ctx, swinfo),
+                                            expand ? &perturb : NULL);
+        if (verbosity > 0) { printf("   * Energy: %.12lf\n", energy); }
+
+        tic(chrono, STENS_DECOMP);
+        /* same noise as CheMPS2 */
+        add_noise(&od->msiteObj, reg->noise * trunc_err, &od->seed);
+        norm_tensor(&od->msiteObj);
+        /* All processes continue with the tensor of the root, so that they
+         * make the same decomposition. */
+        broadcast_from_root(od->msiteObj.blocks.tel,
+                            siteTensor_get_size(&od->msiteObj));
+        if (expand) {
+                broadcast_from_root(perturb, 
+                                    siteTensor_get_size(&od->msiteObj));
+        }
+
+        struct SvalSelect svd_sel = reg->svd_sel;
+        if (lowDb != NULL) {
+                const int bnd = get_common_bond(od->msiteObj.sites[0], od->msiteObj.sites[1]);
+                for (int * ii = lowDb; *ii != -1; ++ii) {
+                        if (bnd == *ii) {
+                                svd_sel.minD = lowD;
+                                svd_sel.maxD = lowD;
+                                break;
                         }
                 }
+        }
 
-                struct decompose_info d_inf = 
-                        decompose_siteTensor(&o_dat.msiteObj, 
-                                             o_dat.specs.nCenter,
+        struct decompose_info d_inf;
+        if (expand) {
+                d_inf = expand_step(ctx, &od->msiteObj, perturb, 
+                                    od->specs.nCenter, T3NS, &svd_sel);
+                safe_free(perturb);
+        } else {
+                d_inf = decompose_siteTensor(ctx, &od->msiteObj, 
+                                             od->specs.nCenter,
                                              T3NS, &svd_sel);
+        }
+
+        if (d_inf.erflag) { exit(EXIT_FAILURE); }
+        toc(chrono, STENS_DECOMP);
+        if (verbosity > 0 ) { print_decompose_info(&d_inf, "   * "); }
+
+        postprocess_rOperators(od, rops, T3NS, chrono);
+
+        if (*first || swinfo->sw_energy > energy) 
+                swinfo->sw_energy = energy;
+        if (*first || swinfo->sw_trunc < d_inf.cut_Mtrunc) 
+                swinfo->sw_trunc = d_inf.cut_Mtrunc;
+        if (*first || swinfo->sw_maxdim < d_inf.cut_Mdim) 
+                swinfo->sw_maxdim = d_inf.cut_Mdim;
+        *first = false;
+        if (verbosity > 0) { printf("\n"); }
+
+        toc(chrono, OPT_STEP);
+        struct progress_info info = {
+                .kind = PROGRESS_STEP,
+                .regime = swinfo->regime,
+                .sweep = swinfo->sweep,
+                .step = swinfo->step,
+                .branch = swinfo->branch,
+                .energy = energy,
+                .trunc_err = d_inf.cut_Mtrunc,
+                .maxdim = d_inf.cut_Mdim,
+                .seconds = wall_time() - start
+        };
+        report_progress(ctx, &info, chrono);
+        if (get_rank() == 0) {
+                const char * labels[] = {"regime", "sweep", "step", "branch"};
+                const int values[] = {
+                        swinfo->regime, swinfo->sweep, swinfo->step, 
+                        swinfo->branch
+                };
+                write_timers_record(chrono, labels, values, 4);
+        }
+        ++swinfo->step;
+        add_timers(&swinfo->chrono, chrono);
+        destroy_timers(chrono);
+        trace_end(tracename, "step");
+}
+
+/* The partition of the network in the three branches around a branching
+ * site. The branches are optimized concurrently in a parallel sweep. */
+struct partition {
+        /// The branching site.
+        int branch;
+        /// The bonds of the branching site.
+        int bonds[3];
+        /// The site at the other side of every bond.
+        int sites[3];
+        /// The sweep through every branch, starting at sites[i].
+        int * sweeps[3];
+        int swlength[3];
+        /// The path from netw.sweep[0] to the branching site.
+        int * path;
+        int pathlength;
+};
+
+static void destroy_partition(struct partition * part)
+{
+        for (int i = 0; i < 3; ++i) { safe_free(part->sweeps[i]); }
+        safe_free(part->path);
+        part->branch = -1;
+}
+
+static int try_partition(struct partition * part, int branch)
+{
+        part->branch = branch;
+        get_bonds_of_site(branch, part->bonds);
+        for (int i = 0; i < 3; ++i) { part->sweeps[i] = NULL; }
+        part->path = NULL;
+
+        /* The sites next to the branching site should be physical, else a
+         * 4-site step in a branch could include the branching site. */
+        for (int i = 0; i < 3; ++i) {
+                const int * sb = netw.bonds[part->bonds[i]];
+                part->sites[i] = sb[0] == branch ? sb[1] : sb[0];
+                if (part->sites[i] == -1 || !is_psite(part->sites[i])) {
+                        return 1;
+                }
+        }
+
+        for (int i = 0; i < 3; ++i) {
+                if (make_branch_sweep(part->bonds[i], part->sites[i], 
+                                      &part->sweeps[i], &part->swlength[i])) {
+                        destroy_partition(part);
+                        return 1;
+                }
+        }
+
+        safe_malloc(part->path, netw.sites);
+        part->pathlength = get_path(netw.sweep[0], branch, part->path);
+        if (part->pathlength < 2) {
+                destroy_partition(part);
+                return 1;
+        }
+        return 0;
+}
+
+/* Looks for the branching site that splits the network in the most balanced
+ * branches. Returns 1 if no suitable branching site is found. */
+static int make_partition(struct partition * part)
+{
+        part->branch = -1;
+        int bestsize = 0;
+        for (int site = 0; site < netw.sites; ++site) {
+                if (is_psite(site)) { continue; }
+
+                struct partition trial;
+                if (try_partition(&trial, site)) { continue; }
+                int minsize = trial.swlength[0];
+                for (int i = 1; i < 3; ++i) {
+                        if (trial.swlength[i] < minsize) { 
+                                minsize = trial.swlength[i]; 
+                        }
+                }
+                if (minsize > bestsize) {
+                        if (part->branch != -1) { destroy_partition(part); }
+                        *part = trial;
+                        bestsize = minsize;
+                } else {
+                        destroy_partition(&trial);
+                }
+        }
+        return part->branch == -1;
+}
+
+/* Moves the orthogonality center along the path and updates the rOperators
+ * of the bonds left behind. */
+static void move_center(struct t3ns_context * ctx, struct siteTensor * T3NS, 
+                        struct rOperators * rops, const int * path, int length,
+                        struct timers * chrono)
+{
+        for (int i = 0; i < length - 1; ++i) {
+                const int bond = get_common_bond(path[i], path[i + 1]);
+                tic(chrono, STENS_DECOMP);
+                struct decompose_info info = qr_step(ctx, &T3NS[path[i]], 
+                                                     path[i + 1], T3NS, false);
+                toc(chrono, STENS_DECOMP);
+                if (info.erflag) { exit(EXIT_FAILURE); }
+
+                destroy_rOperators(&rops[bond]);
+                update_rops_of_bond(&rops[bond], rops, &T3NS[path[i]], bond,
+                                    path[i], chrono);
+        }
+}
+
+static int * copy_dims_of_bond(int bond)
+{
+        const struct symsecs * const ss = &bookie.v_symsecs[bond];
+        int * safe_malloc(dims, ss->nrSecs);
+        for (int i = 0; i < ss->nrSecs; ++i) { dims[i] = ss->dims[i]; }
+        return dims;
+}
+
+static void set_dims_of_bond(int bond, const int * dims)
+{
+        struct symsecs * const ss = &bookie.v_symsecs[bond];
+        for (int i = 0; i < ss->nrSecs; ++i) { ss->dims[i] = dims[i]; }
+}
+
+/* Splits the branching site (which should be the orthogonality center) in a
+ * Q and R for every bond. The R's are absorbed in the neighbouring sites and 
+ * the rOperators of the bonds are replaced by the environment of the
+ * branches, made with the Q's. In this way every branch has its own
+ * orthogonality center and can be optimized independently.
+ *
+ * The original R's and dimensions of the bonds are returned. */
+static void split_at_branch(struct siteTensor * T3NS, struct rOperators * rops,
+                            const struct partition * part, 
+                            struct Rmatrix R[3], int * origdims[3],
+                            struct timers * chrono)
+{
+        struct siteTensor * const Tb = &T3NS[part->branch];
+        struct rOperators env[3];
+        int * mindims[3];
+
+        for (int i = 0; i < 3; ++i) { 
+                origdims[i] = copy_dims_of_bond(part->bonds[i]); 
+        }
+
+        for (int i = 0; i < 3; ++i) {
+                // qr changes the dimensions of the bond in the bookkeeper
+                for (int j = 0; j < 3; ++j) { 
+                        set_dims_of_bond(part->bonds[j], origdims[j]); 
+                }
+                struct siteTensor Q;
+                tic(chrono, STENS_DECOMP);
+                if (qr(Tb, i, &Q, &R[i])) { exit(EXIT_FAILURE); }
+                toc(chrono, STENS_DECOMP);
+                mindims[i] = copy_dims_of_bond(part->bonds[i]);
+
+                update_rops_of_bond(&env[i], rops, &Q, part->bonds[i],
+                                    part->branch, chrono);
+                destroy_siteTensor(&Q);
+        }
+
+        for (int i = 0; i < 3; ++i) {
+                const int site = part->sites[i];
+                const int bond = part->bonds[i];
+                set_dims_of_bond(bond, mindims[i]);
+                safe_free(mindims[i]);
+
+                struct siteTensor B;
+                const int bondid = siteTensor_give_bondid(&T3NS[site], bond);
+                tic(chrono, STENS_DECOMP);
+                if (multiplyR(&T3NS[site], bondid, &R[i], 1, &B)) { 
+                        exit(EXIT_FAILURE); 
+                }
+                toc(chrono, STENS_DECOMP);
+                destroy_siteTensor(&T3NS[site]);
+                T3NS[site] = B;
+
+                destroy_rOperators(&rops[bond]);
+                rops[bond] = env[i];
+        }
+}
+
+/* Brings the optimized branches back together in the branching site.
+ *
+ * Every branch has changed its R independently. The new R is split off again
+ * and the change of basis R_old^+ R_new^T is absorbed in the branching site.
+ * The rOperators of the bonds are rebuilt from the branches. */
+static void merge_at_branch(struct siteTensor * T3NS, struct rOperators * rops,
+                            const struct partition * part, 
+                            struct Rmatrix R[3], int * origdims[3],
+                            struct timers * chrono)
+{
+        struct siteTensor * const Tb = &T3NS[part->branch];
+        struct Rmatrix P[3];
+        int * newdims[3];
+
+        for (int i = 0; i < 3; ++i) {
+                const int site = part->sites[i];
+                const int bond = part->bonds[i];
+                struct siteTensor Q;
+                struct Rmatrix Rnew;
+                const int bondid = siteTensor_give_bondid(&T3NS[site], bond);
+
+                tic(chrono, STENS_DECOMP);
+                if (qr(&T3NS[site], bondid, &Q, &Rnew)) { exit(EXIT_FAILURE); }
+                destroy_siteTensor(&T3NS[site]);
+                T3NS[site] = Q;
+                if (R_transition(&R[i], &Rnew, 1e-12, &P[i])) { 
+                        exit(EXIT_FAILURE); 
+                }
+                toc(chrono, STENS_DECOMP);
+                destroy_Rmatrix(&R[i]);
+                destroy_Rmatrix(&Rnew);
+                newdims[i] = copy_dims_of_bond(bond);
+        }
 
-                if (d_inf.erflag) { exit(EXIT_FAILURE); }
-                toc(&swinfo.chrono, STENS_DECOMP);
-                if (verbosity > 0 ) { print_decompose_info(&d_inf, "   * "); }
+        /* The bonds not yet contracted with P should have their original
+         * dimensions in the bookkeeper. */
+        for (int i = 0; i < 3; ++i) {
+                set_dims_of_bond(part->bonds[i], origdims[i]);
+        }
+        tic(chrono, STENS_DECOMP);
+        for (int i = 0; i < 3; ++i) {
+                struct siteTensor B;
+                if (multiplyR(Tb, i, &P[i], 0, &B)) { exit(EXIT_FAILURE); }
+                destroy_siteTensor(Tb);
+                *Tb = B;
+                set_dims_of_bond(part->bonds[i], newdims[i]);
+                destroy_Rmatrix(&P[i]);
+                safe_free(newdims[i]);
+                safe_free(origdims[i]);
+        }
+        norm_tensor(Tb);
+        toc(chrono, STENS_DECOMP);
+
+        /* The truncations in the branches can leave sectors of the bonds
+         * without states, these are kicked out before the rOperators are
+         * made. */
+        for (int i = 0; i < 3; ++i) {
+                const int site = part->sites[i];
+                const int bond = part->bonds[i];
+                kick_empties_of_bond(Tb, i, &T3NS[site], 
+                                     siteTensor_give_bondid(&T3NS[site], bond));
+                destroy_rOperators(&rops[bond]);
+                update_rops_of_bond(&rops[bond], rops, &T3NS[site], bond, site,
+                                    chrono);
+        }
+}
 
-                postprocess_rOperators(rops, T3NS, &swinfo.chrono);
+static void combine_sweep_info(struct sweep_info * swinfo, 
+                               const struct sweep_info * other, bool * first)
+{
+        if (*first || swinfo->sw_energy > other->sw_energy) 
+                swinfo->sw_energy = other->sw_energy;
+        if (*first || swinfo->sw_trunc < other->sw_trunc) 
+                swinfo->sw_trunc = other->sw_trunc;
+        if (*first || swinfo->sw_maxdim < other->sw_maxdim) 
+                swinfo->sw_maxdim = other->sw_maxdim;
+        *first = false;
+        swinfo->step += other->step;
+        add_timers(&swinfo->chrono, &other->chrono);
+}
+
+/* A sweep where the three branches around a branching site are optimized
+ * concurrently.
+ *
+ * The orthogonality center is moved to the branching site, which is split
+ * so every branch gets its own center. The branches are swept independently
+ * and afterwards merged again in the branching site. This site is optimized
+ * at last and the center is moved back to the start of the sweep. */
+static void execute_parallel_sweep(struct t3ns_context * ctx,
+                                   struct siteTensor * T3NS,
+                                   struct rOperators * rops,
+                                   const struct regime * reg, double trunc_err,
+                                   int lowD, int * lowDb, int verbosity,
+                                   const struct partition * part,
+                                   struct sweep_info * swinfo)
+{
+        struct Rmatrix R[3];
+        int * origdims[3];
+        bool first = true;
+
+        move_center(ctx, T3NS, rops, part->path, part->pathlength, 
+                    &swinfo->chrono);
+        split_at_branch(T3NS, rops, part, R, origdims, &swinfo->chrono);
+
+        struct sweep_info brinfo[3];
+        int inner_threads = get_max_threads() / 3;
+        if (inner_threads < 1) { inner_threads = 1; }
+        const int max_levels = allow_nesting();
+
+#pragma omp parallel for num_threads(3) schedule(static, 1) \
+        shared(ctx, T3NS, rops, reg, trunc_err, lowD, lowDb, part, brinfo, \
+               inner_threads) copyin(t3ns_ctx)
+        for (int i = 0; i < 3; ++i) {
+                set_inner_threads(inner_threads);
+                brinfo[i] = (struct sweep_info) {
+                        .chrono = init_opt_timers(),
+                        .regime = swinfo->regime,
+                        .sweep = swinfo->sweep,
+                        .branch = i
+                };
+                struct optimize_data * od = step_data(ctx, i);
+                bool brfirst = true;
+                int state = 0;
+                while (next_opt_step_in(part->sweeps[i], part->swlength[i],
+                                        reg->sitesize, &od->specs, &state)) {
+                        execute_step(ctx, od, T3NS, rops, reg, trunc_err, lowD,
+                                     lowDb, 0, &brinfo[i], &brfirst);
+                }
+        }
+        restore_nesting(max_levels);
+
+        for (int i = 0; i < 3; ++i) {
+                combine_sweep_info(swinfo, &brinfo[i], &first);
+                destroy_timers(&brinfo[i].chrono);
+        }
+
+        merge_at_branch(T3NS, rops, part, R, origdims, &swinfo->chrono);
+
+        /* One-site optimization of the branching site, moving the center to
+         * the next site on the way back. */
+        const int nCenter = part->path[part->pathlength - 2];
+        const int cbond = get_common_bond(part->branch, nCenter);
+        struct optimize_data * od = step_data(ctx, -1);
+        od->specs.nr_sites_opt = 1;
+        od->specs.sites_opt[0] = part->branch;
+        od->specs.nr_bonds_opt = 3;
+        for (int i = 0; i < 3; ++i) { 
+                od->specs.bonds_opt[i] = part->bonds[i]; 
+                if (part->bonds[i] == cbond) { od->specs.common_next[0] = i; }
+        }
+        od->specs.nCenter = nCenter;
+        execute_step(ctx, od, T3NS, rops, reg, trunc_err, lowD, lowDb, 
+                     verbosity, swinfo, &first);
+
+        int * safe_malloc(backpath, part->pathlength - 1);
+        for (int i = 0; i < part->pathlength - 1; ++i) {
+                backpath[i] = part->path[part->pathlength - 2 - i];
+        }
+        move_center(ctx, T3NS, rops, backpath, part->pathlength - 1, 
+                    &swinfo->chrono);
+        safe_free(backpath);
+}
+
+static struct sweep_info execute_sweep(struct t3ns_context * ctx,
+                                       struct siteTensor * T3NS, 
+                                       struct rOperators * rops, 
+                                       const struct regime * reg, 
+                                       double trunc_err, const char * saveloc,
+                                       int lowD, int * lowDb, 
+                                       const struct partition * part,
+                                       int regnumber, int sweepnr,
+                                       int verbosity)
+{
+        struct sweep_info swinfo = {
+                .chrono = init_opt_timers(),
+                .regime = regnumber,
+                .sweep = sweepnr,
+                .branch = -1
+        };
+        bool first = true;
 
-                if (first || swinfo.sw_energy > energy) 
-                        swinfo.sw_energy = energy;
-                if (first || swinfo.sw_trunc < d_inf.cut_Mtrunc) 
-                        swinfo.sw_trunc = d_inf.cut_Mtrunc;
-                if (first || swinfo.sw_maxdim < d_inf.cut_Mdim) 
-                        swinfo.sw_maxdim = d_inf.cut_Mdim;
-                first = 0;
-                if (verbosity > 0) { printf("\n"); }
+        if (part != NULL) {
+                execute_parallel_sweep(ctx, T3NS, rops, reg, trunc_err, lowD,
+                                       lowDb, verbosity, part, &swinfo);
+        } else {
+                struct optimize_data * od = step_data(ctx, -1);
+                while (next_opt_step(reg->sitesize, &od->specs)) {
+                        execute_step(ctx, od, T3NS, rops, reg, trunc_err, lowD,
+                                     lowDb, verbosity, &swinfo, &first);
+                }
         }
 
         tic(&swinfo.chrono, IO_DISK);
@@ -407,38 +1068,74 @@ static void print_sweep_info(struct sweep_info * info, int sw_nr, int regnr)
         printf("============================================================================\n\n");
 }
 
-static double execute_regime(struct siteTensor * T3NS, struct rOperators * rops, 
+static double execute_regime(struct t3ns_context * ctx,
+                             struct siteTensor * T3NS, struct rOperators * rops, 
                              const struct regime * reg, int regnumber, 
                              double * trunc_err, const char * saveloc, 
                              struct timers * timings, int lowD, int * lowDb,
-                             const int verbosity)
+                             bool * stopped, const int verbosity)
 {
         int sweepnrs = 0;
         double energy = 0;
 
+        struct partition part;
+        // The MPI calls in a sweep can not be made from concurrent branches.
+        const bool multiproc = get_nr_ranks() > 1;
+        const bool parallel = reg->par_sweep && !multiproc && !make_partition(&part);
+        if (reg->par_sweep && multiproc) {
+                fprintf(stderr, "WARNING: Parallel sweeps are not supported with multiple processes.\n"
+                        "Falling back to normal sweeps.\n");
+        } else if (reg->par_sweep && !parallel) {
+                fprintf(stderr, "WARNING: No branching tensor found to split the network for a parallel sweep.\n"
+                        "Falling back to normal sweeps.\n");
+        }
+        if (parallel && verbosity > 0) {
+                printf(">> Parallel sweeps around branching site %d.\n", 
+                       part.branch);
+        }
+
         while(sweepnrs < reg->max_sweeps) {
-                struct sweep_info info = execute_sweep(T3NS, rops, reg, 
+                const double start = wall_time();
+                struct sweep_info info = execute_sweep(ctx, T3NS, rops, reg, 
                                                        *trunc_err, saveloc, lowD,
-                                                       lowDb, verbosity - 2);
+                                                       lowDb, 
+                                                       parallel ? &part : NULL,
+                                                       regnumber, sweepnrs + 1,
+                                                       verbosity - 2);
                 *trunc_err = info.sw_trunc;
                 if(verbosity > 1) { print_sweep_info(&info, sweepnrs + 1, regnumber); }
+                struct progress_info pinfo = {
+                        .kind = PROGRESS_SWEEP,
+                        .regime = regnumber,
+                        .sweep = sweepnrs + 1,
+                        .step = info.step,
+                        .branch = -1,
+                        .energy = info.sw_energy,
+                        .trunc_err = info.sw_trunc,
+                        .maxdim = info.sw_maxdim,
+                        .seconds = wall_time() - start
+                };
+                *stopped = report_progress(ctx, &pinfo, &info.chrono);
                 add_timers(timings, &info.chrono);
                 destroy_timers(&info.chrono);
 
-                int flag = sweepnrs != 0 && 
-                        fabs(energy - info.sw_energy) < reg->energy_conv;
+                int flag = *stopped || (sweepnrs != 0 && 
+                        fabs(energy - info.sw_energy) < reg->energy_conv);
                 energy = info.sw_energy;
                 ++sweepnrs;
                 if (flag) { break; }
         }
         if (verbosity > 0) { printf("============================================================================\n"  ); }
         if (verbosity > 0) { printf("END OF REGIME %d AFTER %d/%d SWEEPS.\n", regnumber, sweepnrs, reg->max_sweeps);} 
-        if (sweepnrs == reg->max_sweeps && verbosity > 0) {
+        if (*stopped && verbosity > 0) {
+                printf("STOPPED BY THE PROGRESS CALLBACK.\n");
+        } else if (sweepnrs == reg->max_sweeps && verbosity > 0) {
                 printf("THE ENERGY DID NOT CONVERGE UP TO ASKED TOLERANCE OF %e\n", reg->energy_conv);
         }
         if (verbosity > 0) { printf("MINIMUM ENERGY ENCOUNTERED : %.16lf\n", energy                                  ); }
         if (verbosity > 0) { printf("============================================================================\n\n"); }
 
+        if (parallel) { destroy_partition(&part); }
         return energy;
 }
 
@@ -452,59 +1149,99 @@ static void init_rops(struct rOperators * const rops,
 
         if (siteL == -1 || (!tilltheend && siteR == -1)) {
                 *curr_rops = vacuum_rOperators(bond, siteL == -1);
-        } else if (is_psite(siteL)) { /* physical tensor, DMRG update needed */
+        } else {
                 assert(tens != NULL);
-                int bonds[3];
-                int * tempdim = bookie.v_symsecs[bond].dims;
-                int i;
-                safe_malloc(bookie.v_symsecs[bond].dims, bookie.v_symsecs[bond].nrSecs);
-                for (i = 0; i < bookie.v_symsecs[bond].nrSecs; ++i)
-                        bookie.v_symsecs[bond].dims[i] = 1;
-
-                get_bonds_of_site(siteL, bonds);
-                assert(bonds[2] == bond);
-                tic(chrono, ROP_APPEND);
-                rOperators_append_phys(curr_rops, &rops[bonds[0]]); 
-                toc(chrono, ROP_APPEND);
-                safe_free(bookie.v_symsecs[bond].dims);
-                bookie.v_symsecs[bond].dims = tempdim;
-                /* Just pass the same symsecs as internal one. Doesnt really matter that dims != 1.
-                 * What matters is that both have the same symsecs and this way a correct array can be made
-                 * in update_rOperators_physical */
-                tic(chrono, ROP_UPDP);
-                update_rOperators_physical(curr_rops, tens, &bookie.v_symsecs[bond]);
-                toc(chrono, ROP_UPDP);
-        } else { /* branching tensor, T3NS update needed */
-                int bonds[3];
-                get_bonds_of_site(siteL, bonds);
-                assert(bonds[2] == bond);
-                struct rOperators ops[2] = {rops[bonds[0]], rops[bonds[1]]};
-                tic(chrono, ROP_UPDB);
-                update_rOperators_branching(curr_rops, ops, tens);
-                toc(chrono, ROP_UPDB);
+                update_rops_of_bond(curr_rops, rops, tens, bond, siteL, chrono);
         }
 }
 
+/* Gives the bonds of which the rOperators are needed to make the rOperators of
+ * the given bond. Returns the number of such bonds. */
+static int init_rops_dependencies(int deps[2], const int bond, bool tilltheend)
+{
+        const int siteL = netw.bonds[bond][0];
+        const int siteR = netw.bonds[bond][1];
+        int bonds[3];
+
+        if (siteL == -1 || (!tilltheend && siteR == -1)) { return 0; }
+        get_bonds_of_site(siteL, bonds);
+        deps[0] = bonds[0];
+        /* For a physical site bonds[1] is the physical bond */
+        deps[1] = is_psite(siteL) ? bonds[0] : bonds[1];
+        return is_psite(siteL) ? 1 : 2;
+}
+
+/* Builds the rOperators of a single bond in its own task, the timings are
+ * added to chrono afterwards. */
+static void init_rops_task(struct rOperators * const rops, 
+                           const struct siteTensor * const T3NS, const int bond, 
+                           struct timers * chrono, bool tilltheend, 
+                           int nthreads)
+{
+        const int siteL = netw.bonds[bond][0];
+        struct timers tchrono = init_opt_timers();
+
+        /* Number of threads for the block-level loops nested in this task */
+        set_inner_threads(nthreads);
+        init_rops(rops, siteL == -1 ? NULL : &T3NS[siteL], bond, &tchrono,
+                  tilltheend);
+
+#pragma omp critical (init_operators_timers)
+        add_timers(chrono, &tchrono);
+        destroy_timers(&tchrono);
+}
+
 /* ========================================================================== */
 
-int init_operators(struct rOperators ** rOps, const struct siteTensor * T3NS,
-                   bool tilltheend)
+static void make_operators(struct rOperators ** rOps, 
+                           const struct siteTensor * T3NS, bool tilltheend)
 {
-        struct timers chrono = init_timers(timernames, timkeys,
-                                           sizeof timkeys / sizeof timkeys[0]);
-        if (*rOps) { return 0; }
+        struct timers chrono = init_opt_timers();
         printf(">> Preparing renormalized operators...\n");
         init_null_rops(rOps);
+
+        /* The network is walked as a dependency graph. Every bond is a task
+         * depending on the tasks of its incoming bonds, so independent
+         * branches are built concurrently. The available threads are divided
+         * between the branches and the block-level loops inside each update. */
+        struct rOperators * rops = *rOps;
+        int nr_branches = 0;
         for (int i = 0; i < netw.nr_bonds; ++i) {
-                const int siteL = netw.bonds[i][0];
-                if (siteL == -1) {
-                        init_rops(*rOps, NULL, i, &chrono, tilltheend);
-                } else {
-                        init_rops(*rOps, &T3NS[siteL], i, &chrono, tilltheend);
-                }
+                nr_branches += netw.bonds[i][0] == -1;
+        }
+        const int max_threads = get_max_threads();
+        int outer_threads = nr_branches < max_threads ? nr_branches : max_threads;
+        /* With several processes every update communicates, so the bonds
+         * are handled one after the other in the same order everywhere. */
+        if (outer_threads < 1 || get_nr_ranks() > 1) { outer_threads = 1; }
+        int inner_threads = max_threads / outer_threads;
+
+        const int max_levels = allow_nesting();
+
+#pragma omp parallel num_threads(outer_threads) default(none) \
+        shared(rops, T3NS, chrono, tilltheend, inner_threads, outer_threads) \
+        copyin(t3ns_ctx)
+#pragma omp single
+        for (int i = 0; i < netw.nr_bonds; ++i) {
+                int deps[2] = {i, i};
+                init_rops_dependencies(deps, i, tilltheend);
+#pragma omp task depend(in: rops[deps[0]], rops[deps[1]]) depend(out: rops[i]) \
+        if(outer_threads > 1)
+                init_rops_task(rops, T3NS, i, &chrono, tilltheend, inner_threads);
         }
+
+        restore_nesting(max_levels);
         print_timers(&chrono, " * ", true);
         destroy_timers(&chrono);
+}
+
+int init_operators(struct t3ns_context * ctx, struct rOperators ** rOps,
+                   const struct siteTensor * T3NS, bool tilltheend)
+{
+        if (*rOps) { return 0; }
+        struct t3ns_context * prev = use_context(ctx);
+        make_operators(rOps, T3NS, tilltheend);
+        use_context(prev);
         return 0;
 }
 
@@ -532,7 +1269,8 @@ static int make_new_T3NS(struct siteTensor ** T3NS, char option)
         return 0;
 }
 
-static int recanonicalize_T3NS(struct siteTensor * T3NS, int centersite)
+static int recanonicalize_T3NS(struct t3ns_context * ctx,
+                               struct siteTensor * T3NS, int centersite)
 {
         // The amount of R matrices absorbed by every site
         int * safe_calloc(canonicalized, netw.sites);
@@ -559,8 +1297,8 @@ static int recanonicalize_T3NS(struct siteTensor * T3NS, int centersite)
 
                                 const int uncansite = lcan ? rsite : lsite;
                                 struct decompose_info info =
-                                        qr_step(&T3NS[site], uncansite, T3NS,
-                                                false);
+                                        qr_step(ctx, &T3NS[site], uncansite,
+                                                T3NS, false);
                                 if (info.erflag) { return 1; }
 
                                 canonicalized[site] = 1;
@@ -585,8 +1323,8 @@ static int recanonicalize_T3NS(struct siteTensor * T3NS, int centersite)
                                 const int uncansite = 
                                         nsites[ncan[0] * (1 + ncan[1])];
                                 struct decompose_info info =
-                                        qr_step(&T3NS[site], uncansite, T3NS,
-                                                false);
+                                        qr_step(ctx, &T3NS[site], uncansite,
+                                                T3NS, false);
                                 if (info.erflag) { return 1; }
 
                                 canonicalized[site] = 1;
@@ -598,11 +1336,39 @@ static int recanonicalize_T3NS(struct siteTensor * T3NS, int centersite)
         return 0;
 }
 
-int init_wave_function(struct siteTensor ** T3NS, int changedSS, 
-                       struct bookkeeper * prevbookie, char option)
+/* Returns for every site if the symmetry sectors of one of its bonds differ
+ * between prevbookie and bookie. The tensors of the other sites can be
+ * reused as they are. */
+static bool * changed_sites(const struct bookkeeper * prevbookie)
+{
+        bool samesyms = prevbookie->nrSyms == bookie.nrSyms;
+        for (int i = 0; samesyms && i < bookie.nrSyms; ++i) {
+                samesyms = prevbookie->sgs[i] == bookie.sgs[i];
+        }
+
+        bool * safe_malloc(changed, netw.sites);
+        for (int site = 0; site < netw.sites; ++site) {
+                int bonds[3];
+                struct symsecs prevss[3], newss[3];
+                get_bonds_of_site(site, bonds);
+                bookkeeper_get_symsecs_arr(prevbookie, 3, prevss, bonds);
+                bookkeeper_get_symsecs_arr(&bookie, 3, newss, bonds);
+
+                changed[site] = !samesyms;
+                for (int i = 0; !changed[site] && i < 3; ++i) {
+                        changed[site] = !same_symsecs(&prevss[i], &newss[i]);
+                }
+        }
+        return changed;
+}
+
+static int remake_wave_function(struct t3ns_context * ctx,
+                                struct siteTensor ** T3NS, int changedSS, 
+                                struct bookkeeper * prevbookie, char option)
 {
         printf(">> Preparing siteTensors...\n");
-        srand(time(NULL));
+        unsigned int seed = common_seed();
+        srand(seed);
         // Case no previous T3NS read.
         if (*T3NS == NULL) { return make_new_T3NS(T3NS, option); } 
         // Case nothing has changed.
@@ -612,9 +1378,14 @@ int init_wave_function(struct siteTensor ** T3NS, int changedSS,
 
         double norm = 10;
         double noise = 1;
+        bool * changed = changed_sites(prevbookie);
         struct siteTensor * safe_malloc(origT3NS, netw.sites);
         for (int i = 0 ; i < netw.sites; ++i) {
                 assert((*T3NS)[i].nrsites == 1);
+                if (!changed[i]) {
+                        deep_copy_siteTensor(&origT3NS[i], &(*T3NS)[i]);
+                        continue;
+                }
                 // Initialize the new site tensor to zero
                 init_1siteTensor(&origT3NS[i], (*T3NS)[i].sites[0], '0');
                 // Fill in the sectors
@@ -637,11 +1408,13 @@ int init_wave_function(struct siteTensor ** T3NS, int changedSS,
                 // add noise
                 for (int i = 0 ; i < netw.sites; ++i) {
                         deep_copy_siteTensor(&(*T3NS)[i], &origT3NS[i]);
-                        add_noise(&(*T3NS)[i], noise);
+                        if (changed[i]) { 
+                                add_noise(&(*T3NS)[i], noise, &seed); 
+                        }
                 }
                 // Normalizes the newT3NS
                 const int lastsite = netw.bonds[get_outgoing_bond()][0];
-                if (recanonicalize_T3NS(*T3NS, lastsite)) { return 1; }
+                if (recanonicalize_T3NS(ctx, *T3NS, lastsite)) { return 1; }
 
                 norm = 2 - 2 / norm_tensor(&(*T3NS)[lastsite]);
                 // norm_tensor(&newT3NS[lastsite]); // needed to normalize the T3NS
@@ -650,7 +1423,7 @@ int init_wave_function(struct siteTensor ** T3NS, int changedSS,
 
                 // NOTE this overlap calculation is not valid anymore!
                 printf(" > (noise %g) ||Psi_new - Psi_orig||^2 = %g\n", noise, norm);
-                print_target_state_coeff(*T3NS);
+                print_target_state_coeff(ctx, *T3NS);
                 noise *= 0.5;
         }
         for (int i = 0; i < bookie.nr_bonds; ++i) { destroy_symsecs(&ss_backup[i]); }
@@ -659,34 +1432,103 @@ int init_wave_function(struct siteTensor ** T3NS, int changedSS,
                 destroy_siteTensor(&origT3NS[i]);
         }
         safe_free(origT3NS);
+        safe_free(changed);
         return 0;
 }
 
-void init_calculation(struct siteTensor ** T3NS, struct rOperators ** rOps, 
-                      char option)
+int init_wave_function(struct t3ns_context * ctx, struct siteTensor ** T3NS,
+                       int changedSS, struct bookkeeper * prevbookie,
+                       char option)
+{
+        struct t3ns_context * prev = use_context(ctx);
+        const int erflag = remake_wave_function(ctx, T3NS, changedSS,
+                                                prevbookie, option);
+        use_context(prev);
+        return erflag;
+}
+
+void init_calculation(struct t3ns_context * ctx, struct siteTensor ** T3NS,
+                      struct rOperators ** rOps, char option)
 {
+        struct t3ns_context * prev = use_context(ctx);
         if (make_new_T3NS(T3NS, option)) { exit(EXIT_FAILURE); }
-        if (init_operators(rOps, *T3NS, false)) { exit(EXIT_FAILURE); }
+        use_context(prev);
+        if (init_operators(ctx, rOps, *T3NS, false)) { exit(EXIT_FAILURE); }
 }
 
-double execute_optScheme(struct siteTensor * const T3NS, struct rOperators * const rops, 
+/* Checks again which symmetry sectors are populated when the bond dimension
+ * changes between two regimes, as preparebookkeeper does for a restart.
+ * Sectors that were truncated away are filled again with DEFAULT_MINSTATES
+ * states. Only the site tensors with a changed bond are remade, and the
+ * renormalized operators are rebuilt. If all sectors are still populated,
+ * nothing is touched. */
+static int adapt_sectors(struct t3ns_context * ctx, struct siteTensor * T3NS,
+                         struct rOperators * rops, const struct regime * reg)
+{
+        struct bookkeeper prevbookie = shallow_copy_bookkeeper(&bookie);
+        int changedSS = 0;
+        printf(">> Checking the symmetry sectors for bond dimension %d...\n",
+               reg->svd_sel.maxD);
+        if (preparebookkeeper(&prevbookie, reg->svd_sel.minD, 1,
+                              DEFAULT_MINSTATES, &changedSS)) { return 1; }
+        if (!changedSS) { return 0; }
+
+        if (remake_wave_function(ctx, &T3NS, changedSS, &prevbookie, 'r')) {
+                return 1;
+        }
+        destroy_bookkeeper(&prevbookie);
+
+        for (int i = 0; i < netw.nr_bonds; ++i) {
+                destroy_rOperators(&rops[i]);
+        }
+        struct rOperators * newrops;
+        make_operators(&newrops, T3NS, false);
+        for (int i = 0; i < netw.nr_bonds; ++i) { rops[i] = newrops[i]; }
+        safe_free(newrops);
+        return 0;
+}
+
+double execute_optScheme(struct t3ns_context * ctx,
+                         struct siteTensor * const T3NS,
+                         struct rOperators * const rops, 
                          const struct optScheme * const  scheme, const char * saveloc,
                          int lowD, int * lowDb, const int verbosity)
 {
-        struct timers timings = init_timers(timernames, timkeys,
-                                            sizeof timkeys / sizeof timkeys[0]);
-        srand(time(NULL));
+        ctx = context_or_default(ctx);
+        struct t3ns_context * prev = use_context(ctx);
+        struct optimize_state * state = OPTIMIZE_STATE(ctx);
+        struct timers timings = init_opt_timers();
+        const unsigned int seed = common_seed();
+        srand(seed);
+        // A different sequence of noise for every branch.
+        for (int i = 0; i < 3; ++i) {
+                state->step[i].seed = seed ^ (2654435761u * (i + 1));
+        }
 
         double energy = 3000;
         double trunc_err = scheme->regimes[0].svd_sel.truncerr;
 
         if (verbosity > 0) { printf("============================================================================\n"); }
-        for (int i = 0; i < scheme->nrRegimes; ++i) {
-                double current_energy = execute_regime(T3NS, rops, &scheme->regimes[i], 
+        bool stopped = false;
+        for (int i = 0; i < scheme->nrRegimes && !stopped; ++i) {
+                if (i != 0 && scheme->regimes[i].svd_sel.maxD !=
+                    scheme->regimes[i - 1].svd_sel.maxD &&
+                    adapt_sectors(ctx, T3NS, rops, &scheme->regimes[i])) {
+                        exit(EXIT_FAILURE);
+                }
+                double current_energy = execute_regime(ctx, T3NS, rops, &scheme->regimes[i], 
                                                        i + 1, &trunc_err, saveloc, &timings,
-                                                       lowD, lowDb, verbosity - 1);
+                                                       lowD, lowDb, &stopped, verbosity - 1);
                 if (current_energy  < energy) energy = current_energy;
         }
+        if (state->heff_snapshot.filename[0] != '\0' && 
+            state->heff_snapshot.regime != -1) {
+                fprintf(stderr, "Warning: regime %d, sweep %d, step %d of the snapshot was not reached. "
+                        "%s is not written.\n", state->heff_snapshot.regime,
+                        state->heff_snapshot.sweep, state->heff_snapshot.step,
+                        state->heff_snapshot.filename);
+        }
+        state->heff_snapshot.filename[0] = '\0';
 
         if (verbosity > 0) { printf("============================================================================\n"
                                     "END OF CONVERGENCE SCHEME.\n"
@@ -697,10 +1539,40 @@ double execute_optScheme(struct siteTensor * const T3NS, struct rOperators * con
         if (verbosity > 0) { print_timers(&timings, " * ", true); }
         if (verbosity > 0) { printf("============================================================================\n\n"); }
         destroy_timers(&timings);
+        use_context(prev);
         return energy;
 }
 
-void print_target_state_coeff(const struct siteTensor * T3NS)
+int set_Heff_snapshot(struct t3ns_context * ctx, const char * filename,
+                      int regime, int sweep, int step)
+{
+        struct optimize_state * state = OPTIMIZE_STATE(context_or_default(ctx));
+        state->heff_snapshot.filename[0] = '\0';
+        if (filename == NULL) { return 0; }
+        if (regime < 1 || sweep < 1 || step < 0) {
+                fprintf(stderr, "Error in %s: regime %d, sweep %d, step %d does not exist. "
+                        "Regimes and sweeps start from 1, steps from 0.\n",
+                        __func__, regime, sweep, step);
+                return 1;
+        }
+        strncpy(state->heff_snapshot.filename, filename, MY_STRING_LEN - 1);
+        state->heff_snapshot.filename[MY_STRING_LEN - 1] = '\0';
+        state->heff_snapshot.regime = regime;
+        state->heff_snapshot.sweep = sweep;
+        state->heff_snapshot.step = step;
+        return 0;
+}
+
+void set_progress_callback(struct t3ns_context * ctx,
+                           int (*callback)(const struct progress_info * info,
+                                           void * data), void * data)
+{
+        struct optimize_state * state = OPTIMIZE_STATE(context_or_default(ctx));
+        state->progress.callback = callback;
+        state->progress.data = data;
+}
+
+static void print_coeffs(const struct siteTensor * T3NS)
 {
         // Just do a QR at the last bond.
         struct siteTensor lastT;
@@ -744,6 +1616,14 @@ void print_target_state_coeff(const struct siteTensor * T3NS)
         destroy_Rmatrix(&R);
 }
 
+void print_target_state_coeff(struct t3ns_context * ctx,
+                              const struct siteTensor * T3NS)
+{
+        struct t3ns_context * prev = use_context(ctx);
+        print_coeffs(T3NS);
+        use_context(prev);
+}
+
 /*****************************************************************************/
 /**************************** DISENTANGLING SWEEP ****************************/
 /*****************************************************************************/
@@ -770,7 +1650,8 @@ static void print_entanglement_info(const struct entanglement_info * enti,
         }
 }
 
-static struct entanglement_info entanglement_state(struct siteTensor * T3NS)
+static struct entanglement_info entanglement_state(struct t3ns_context * ctx,
+                                                   struct siteTensor * T3NS)
 {
         struct entanglement_info enti = {
                 .nr_bonds = netw.nr_bonds,
@@ -783,8 +1664,8 @@ static struct entanglement_info entanglement_state(struct siteTensor * T3NS)
         make_simplesweep(true, &sweep, &swlength);
         for (int i = 0; i < swlength; ++i) {
                 const struct decompose_info info = 
-                        qr_step(&T3NS[sweep[i]], sweep[(i + 1) % swlength], 
-                                T3NS, true);
+                        qr_step(ctx, &T3NS[sweep[i]], 
+                                sweep[(i + 1) % swlength], T3NS, true);
                 assert(info.wasQR);
                 const int bond = info.cutted_bonds[0];
                 if (!already_touched[bond]) {
@@ -846,7 +1727,8 @@ static void destroy_bestPerm(struct bestPerm * bp)
         safe_free(bp->vss);
 }
 
-static int accept_bestPerm(struct bestPerm * bp, struct siteTensor * T3NS)
+static int accept_bestPerm(struct t3ns_context * ctx, struct bestPerm * bp,
+                           struct siteTensor * T3NS)
 {
         for (int i = 0; i < netw.sites; ++i) {
                 destroy_siteTensor(&T3NS[i]);
@@ -863,80 +1745,90 @@ static int accept_bestPerm(struct bestPerm * bp, struct siteTensor * T3NS)
         safe_free(bp->vss);
 
         const int lastsite = netw.bonds[get_outgoing_bond()][0];
-        return recanonicalize_T3NS(T3NS, lastsite);
+        return recanonicalize_T3NS(ctx, T3NS, lastsite);
 }
 
-static bool written;
-static int nribs;
-static int internalbonds[STEPSPECS_MBONDS];
-
-static int orig_sitetoorb[STEPSPECS_MSITES];
-static struct symsecs origss[STEPSPECS_MBONDS];
-
-static int best_sitetoorb[STEPSPECS_MSITES];
-static struct siteTensor besttens[STEPSPECS_MSITES];
-static struct symsecs bestss[STEPSPECS_MBONDS];
+/* A candidate permutation in selectBestPerm.
+ * Every candidate is decomposed on its own copy of the bookkeeper and the
+ * site to orbital mapping, so the global ones are only changed for the
+ * accepted candidate. */
+struct permCandidate {
+        struct bookkeeper keeper;
+        int * sitetoorb;
+        // The resulting tensors, only the optimized sites are filled in.
+        struct siteTensor * T3NS;
+        struct decompose_info info;
+        struct timers chrono;
+};
 
-static void backup_orig(const struct stepSpecs * specs)
+static void init_permCandidate(struct permCandidate * c)
 {
-        assert(!written);
-        for (int i = 0; i < specs->nr_sites_opt; ++i) {
-                orig_sitetoorb[i] = netw.sitetoorb[specs->sites_opt[i]];
-        }
-        for (int i = 0; i < nribs; ++i) {
-                struct symsecs css;
-                get_symsecs(&css, internalbonds[i]);
-                deep_copy_symsecs(&origss[i], &css);
+        deep_copy_bookkeeper(&c->keeper, &bookie);
+        safe_malloc(c->sitetoorb, netw.sites);
+        for (int i = 0; i < netw.sites; ++i) {
+                c->sitetoorb[i] = netw.sitetoorb[i];
         }
+        init_null_T3NS(&c->T3NS);
+        c->chrono = init_opt_timers();
 }
 
-static void backup_perm(const struct siteTensor * T3NS,
-                        const struct stepSpecs * specs)
+static void destroy_permCandidate(struct permCandidate * c)
 {
-        for (int i = 0; i < specs->nr_sites_opt; ++i) {
-                best_sitetoorb[i] = netw.sitetoorb[specs->sites_opt[i]];
-                if (written) { destroy_siteTensor(&besttens[i]); }
-                deep_copy_siteTensor(&besttens[i], &T3NS[specs->sites_opt[i]]);
-        }
-        for (int i = 0; i < nribs; ++i) {
-                if (written) { destroy_symsecs(&bestss[i]); }
-                struct symsecs css;
-                get_symsecs(&css, internalbonds[i]);
-                deep_copy_symsecs(&bestss[i], &css);
+        destroy_bookkeeper(&c->keeper);
+        safe_free(c->sitetoorb);
+        for (int i = 0; i < netw.sites; ++i) {
+                destroy_siteTensor(&c->T3NS[i]);
         }
-        written = true;
+        safe_free(c->T3NS);
+        destroy_timers(&c->chrono);
 }
 
-static void put_back_perm(struct siteTensor * T3NS,
-                          const struct stepSpecs * specs)
+/* Permutes S (if perm is not NULL) and decomposes it, with the private copies
+ * of the candidate in place of the global bookie and netw.sitetoorb. */
+static void eval_permCandidate(struct t3ns_context * ctx,
+                               struct permCandidate * c, 
+                               const struct siteTensor * S,
+                               const int * perm, int nr, int nCenter,
+                               const struct SvalSelect * sel)
 {
-        for (int i = 0; i < specs->nr_sites_opt; ++i) {
-                netw.sitetoorb[specs->sites_opt[i]] = best_sitetoorb[i];
-                destroy_siteTensor(&T3NS[specs->sites_opt[i]]);
-                T3NS[specs->sites_opt[i]] = besttens[i];
-        }
-        for (int i = 0; i < nribs; ++i) {
-                destroy_symsecs(&bookie.v_symsecs[internalbonds[i]]);
-                bookie.v_symsecs[internalbonds[i]] = bestss[i];
+        set_bookie_view(&c->keeper);
+        set_sitetoorb_view(c->sitetoorb);
+
+        struct siteTensor Sp;
+        tic(&c->chrono, STENS_PERM);
+        if (perm == NULL || permute_siteTensor(S, &Sp, perm, nr)) {
+                deep_copy_siteTensor(&Sp, S);
         }
-        written = false;
+        toc(&c->chrono, STENS_PERM);
+        tic(&c->chrono, STENS_DECOMP);
+        c->info = decompose_siteTensor(ctx, &Sp, nCenter, c->T3NS, sel);
+        toc(&c->chrono, STENS_DECOMP);
+
+        set_bookie_view(NULL);
+        set_sitetoorb_view(NULL);
 }
 
-static void put_back_orig(const struct stepSpecs * specs)
+// Moves the result of the candidate into T3NS, bookie and netw.
+static void commit_permCandidate(struct permCandidate * c, 
+                                 struct siteTensor * T3NS,
+                                 const struct siteTensor * S)
 {
-        for (int i = 0; i < specs->nr_sites_opt; ++i) {
-                netw.sitetoorb[specs->sites_opt[i]] = orig_sitetoorb[i];
-        }
-        for (int i = 0; i < nribs; ++i) {
-                destroy_symsecs(&bookie.v_symsecs[internalbonds[i]]);
-                deep_copy_symsecs(&bookie.v_symsecs[internalbonds[i]], &origss[i]);
+        for (int i = 0; i < S->nrsites; ++i) {
+                const int site = S->sites[i];
+                destroy_siteTensor(&T3NS[site]);
+                T3NS[site] = c->T3NS[site];
+                init_null_siteTensor(&c->T3NS[site]);
+                netw.sitetoorb[site] = c->sitetoorb[site];
         }
-}
 
-static void clean_orig(void)
-{
+        int internalbonds[STEPSPECS_MBONDS];
+        const int nribs = get_nr_internalbonds(S);
+        get_internalbonds(S, internalbonds);
         for (int i = 0; i < nribs; ++i) {
-                destroy_symsecs(&origss[i]);
+                struct symsecs temp = bookie.v_symsecs[internalbonds[i]];
+                bookie.v_symsecs[internalbonds[i]] = 
+                        c->keeper.v_symsecs[internalbonds[i]];
+                c->keeper.v_symsecs[internalbonds[i]] = temp;
         }
 }
 
@@ -948,7 +1840,8 @@ static void print_permutation(int * perm, int nr)
         }
 }
 
-static struct decompose_info selectBestPerm(struct siteTensor * T3NS,
+static struct decompose_info selectBestPerm(struct t3ns_context * ctx,
+                                            struct siteTensor * T3NS,
                                             const struct stepSpecs * specs,
                                             const struct disentScheme * scheme,
                                             int verbosity,
@@ -970,32 +1863,14 @@ static struct decompose_info selectBestPerm(struct siteTensor * T3NS,
         tic(chrono, STENS_MAKE);
         makesiteTensor(&S, T3NS, specs->sites_opt, specs->nr_sites_opt);
         toc(chrono, STENS_MAKE);
-        nribs = get_nr_internalbonds(&S);
-        get_internalbonds(&S, internalbonds);
-        backup_orig(specs);
-
-        struct siteTensor Stemp;
-        deep_copy_siteTensor(&Stemp, &S);
-        tic(chrono, STENS_DECOMP);
-        struct decompose_info info = 
-                decompose_siteTensor(&Stemp, specs->nCenter, 
-                                     T3NS, &scheme->svd_sel);
-        toc(chrono, STENS_DECOMP);
 
         assert(S.nrsites == 2 || S.nrsites == 3 || S.nrsites == 4);
 
-
         int (*perm)[3] = S.nrsites == 4 ? perm3 : perm2;
         int nrperm = S.nrsites == 4 ? sizeof perm3 / sizeof perm3[0] : 
                 sizeof perm2 / sizeof perm2[0];
         const int nr = S.nrsites == 4 ? 3 : 2;
-
-        backup_perm(T3NS, specs);
-        if (verbosity > 0) { 
-                print_permutation(perm[0], nr);
-                printf("\n");
-                print_decompose_info(&info, NULL);
-        }
+        int * identity = perm[0];
 
         if (scheme->gambling) {
                 // Do a Metropolis step instead of trying all permutations!
@@ -1003,27 +1878,36 @@ static struct decompose_info selectBestPerm(struct siteTensor * T3NS,
                 nrperm = 2;
         }
 
-        for (int i = 1; i < nrperm; ++i) {
-                put_back_orig(specs);
-                struct siteTensor Sp;
-                tic(chrono, STENS_PERM);
-                if (permute_siteTensor(&S, &Sp, perm[i], nr)) {
-                        deep_copy_siteTensor(&Sp, &S);
-                }
-                toc(chrono, STENS_PERM);
-                tic(chrono, STENS_DECOMP);
-                struct decompose_info cinfo = 
-                        decompose_siteTensor(&Sp, specs->nCenter, T3NS, 
-                                             &scheme->svd_sel);
-                toc(chrono, STENS_DECOMP);
+        /* The first candidate is the original order. The candidates are
+         * evaluated one after another and only the accepted one is kept, so
+         * at most two decompositions are in memory. */
+        struct permCandidate best, cand;
+        init_permCandidate(&best);
+        eval_permCandidate(ctx, &best, &S, NULL, nr, specs->nCenter, 
+                           &scheme->svd_sel);
+        struct decompose_info info = best.info;
+        if (verbosity > 0) { 
+                print_permutation(identity, nr);
+                printf("\n");
+                print_decompose_info(&info, NULL);
+        }
 
+        for (int i = 1; i < nrperm; ++i) {
+                init_permCandidate(&cand);
+                eval_permCandidate(ctx, &cand, &S, perm[i], nr, 
+                                   specs->nCenter, &scheme->svd_sel);
+                const struct decompose_info cinfo = cand.info;
                 if (verbosity > 0) { 
                         print_permutation(perm[i], nr);
                         printf("\n");
-                        print_decompose_info(&info, NULL);
+                        print_decompose_info(&cinfo, NULL);
+                }
+                bool accepted = false;
+                if (!cinfo.erflag) {
+                        accepted = info.erflag || 
+                                cinfo.cut_totalent < info.cut_totalent;
                 }
-                bool accepted = cinfo.cut_totalent < info.cut_totalent;
-                if (scheme->gambling) {
+                if (!cinfo.erflag && scheme->gambling) {
                         // Metropolis step
                         // Acceptance with probability exp(-b * dS)
                         double diff = cinfo.cut_totalent - info.cut_totalent;
@@ -1033,23 +1917,30 @@ static struct decompose_info selectBestPerm(struct siteTensor * T3NS,
                 if (accepted) {
                         accepted_perm = i;
                         info = cinfo;
-                        backup_perm(T3NS, specs);
+                        const struct permCandidate temp = best;
+                        best = cand;
+                        cand = temp;
                 }
+                add_timers(chrono, &cand.chrono);
+                destroy_permCandidate(&cand);
         }
 
         if (verbosity > 0) {
                 printf("Accepted ");
-                print_permutation(perm[accepted_perm], nr);
+                print_permutation(accepted_perm == 0 ? 
+                                  identity : perm[accepted_perm], nr);
                 printf("with entanglement %g\n", info.cut_totalent);
         }
 
-        put_back_perm(T3NS, specs);
+        if (!info.erflag) { commit_permCandidate(&best, T3NS, &S); }
+        add_timers(chrono, &best.chrono);
+        destroy_permCandidate(&best);
         destroy_siteTensor(&S);
-        clean_orig();
         return info;
 }
 
-static void disentangle_sweep(struct siteTensor * T3NS, 
+static void disentangle_sweep(struct t3ns_context * ctx,
+                              struct siteTensor * T3NS, 
                               const struct disentScheme * scheme,
                               struct entanglement_info * enti,
                               struct bestPerm * bp, int verbosity,
@@ -1058,8 +1949,8 @@ static void disentangle_sweep(struct siteTensor * T3NS,
         struct stepSpecs specs;
         while (next_opt_step(4, &specs)) {
                 const struct decompose_info dinfo = 
-                        selectBestPerm(T3NS, &specs, scheme, verbosity - 1,
-                                       chrono);
+                        selectBestPerm(ctx, T3NS, &specs, scheme, 
+                                       verbosity - 1, chrono);
                 if (dinfo.erflag) { exit(EXIT_FAILURE); }
 
                 for (int i = 0; i < dinfo.cuts; ++i) {
@@ -1094,21 +1985,21 @@ static void print_siteorder(void)
         }
 }
 
-double disentangle_state(struct siteTensor * T3NS,
+double disentangle_state(struct t3ns_context * ctx, struct siteTensor * T3NS,
                          const struct disentScheme * scheme,
                          int verbosity)
 {
-        struct timers chrono = init_timers(timernames, timkeys,
-                                           sizeof timkeys / sizeof timkeys[0]);
+        struct t3ns_context * prev = use_context(ctx);
+        struct timers chrono = init_opt_timers();
 
         int * tempsweep = netw.sweep;
         int tempswlength = netw.sweeplength;
         make_simplesweep(true, &netw.sweep, &netw.sweeplength);
         tic(&chrono, NETW_ENT);
-        struct entanglement_info enti = entanglement_state(T3NS);
+        struct entanglement_info enti = entanglement_state(ctx, T3NS);
         toc(&chrono, NETW_ENT);
 
-        srand(time(NULL));
+        srand(common_seed());
         struct bestPerm bp = init_bestPerm(T3NS);
         bp.totent = enti.totent;
 
@@ -1121,7 +2012,8 @@ double disentangle_state(struct siteTensor * T3NS,
                 printf("\n");
         }
         for (int i = 0; i < scheme->max_sweeps; ++i) {
-                disentangle_sweep(T3NS, scheme, &enti, &bp, verbosity - 1, &chrono);
+                disentangle_sweep(ctx, T3NS, scheme, &enti, &bp, verbosity - 1,
+                                  &chrono);
                 if (verbosity > 1) {
                         printf("@ sweep %d: ", i + 1);
                         print_entanglement_info(&enti, verbosity - 2);
@@ -1129,13 +2021,13 @@ double disentangle_state(struct siteTensor * T3NS,
         }
 
         tic(&chrono, NETW_CANON);
-        if (accept_bestPerm(&bp, T3NS)) {
+        if (accept_bestPerm(ctx, &bp, T3NS)) {
                 fprintf(stderr, "Error: something went wrong when recanonicalizing the wave function.\n");
         }
         toc(&chrono, NETW_CANON);
         safe_free(enti.entanglement);
         tic(&chrono, NETW_ENT);
-        enti = entanglement_state(T3NS);
+        enti = entanglement_state(ctx, T3NS);
         toc(&chrono, NETW_ENT);
 
         if (verbosity > 0) {
@@ -1158,10 +2050,11 @@ double disentangle_state(struct siteTensor * T3NS,
                 safe_free(netw.order_psites[i]);
         safe_free(netw.order_psites);
         create_order_psites();
+        use_context(prev);
         return enti.totent;
 }
 
-int print_singular_values_wav(struct siteTensor * T3NS)
+static void print_singular_values_of_bonds(struct siteTensor * T3NS)
 {
         // Making backup
         struct siteTensor * safe_malloc(T3NS_backup, netw.sites);
@@ -1196,13 +2089,13 @@ int print_singular_values_wav(struct siteTensor * T3NS)
                 // Do QR
                 struct siteTensor Q;
                 struct Rmatrix R;
-                if(qr(&A, oc_id, &Q, &R)) { return 0; }
+                if(qr(&A, oc_id, &Q, &R)) { return; }
                 destroy_siteTensor(&A);
                 T3NS[site] = Q;
 
                 // Contract R
                 struct siteTensor B;
-                if(multiplyR(&T3NS[nCenter], o_id, &R, 1, &B)) { return 0; }
+                if(multiplyR(&T3NS[nCenter], o_id, &R, 1, &B)) { return; }
                 destroy_siteTensor(&T3NS[nCenter]);
                 T3NS[nCenter] = B;
 
@@ -1227,5 +2120,13 @@ int print_singular_values_wav(struct siteTensor * T3NS)
                 T3NS[i] = T3NS_backup[i];
         }
         safe_free(T3NS_backup);
+}
+
+int print_singular_values_wav(struct t3ns_context * ctx,
+                              struct siteTensor * T3NS)
+{
+        struct t3ns_context * prev = use_context(ctx);
+        print_singular_values_of_bonds(T3NS);
+        use_context(prev);
         return 0;
 }
@@ -0,0 +1,124 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <argp.h>
+
+#include "io_to_disk.h"
+#include "macros.h"
+#include "network.h"
+#include "network_placement.h"
+
+static char doc[] =
+"T3NS-placement -- Optimizes the placement of the orbitals in a network.\n"
+"\n"
+"Orbitals with a large mutual information are placed close to each other in\n"
+"the network. The mutual information is read from the file written by\n"
+"\'T3NS --operator mutual=MUTUAL_FILE\', typically for a cheap low-D run.\n"
+"The bonds of NETWORK_FILE are kept, the resulting network file can be used\n"
+"directly in the input file of T3NS.";
+
+static char args_doc[] = "NETWORK_FILE MUTUAL_FILE";
+
+static struct argp_option options[] = {
+        {"output", 'o', "FILE", 0, "The resulting network file. Default is placement.netw."},
+        {"eta", 'e', "double", 0, "The exponent of the distance in the cost. Default is 2."},
+        {"sweeps", 's', "int", 0, "The number of Monte Carlo sweeps. Default is 1000."},
+        {"replicas", 'r', "int", 0, "The number of replicas for the parallel tempering. "
+                "Default is 8."},
+        {"beta", 'b', "MIN,MAX", 0, "The lowest and highest inverse temperature, in units of the inverse of the mean change of the cost by a swap. Default is 0.1,10."},
+        {"seed", 'S', "int", 0, "The seed of the random number generators. Default is 0."},
+        {0}
+};
+
+struct arguments {
+        struct placementScheme scheme;
+        const char * output;
+        char * files[2];
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+        struct arguments *arguments = state->input;
+        struct placementScheme * scheme = &arguments->scheme;
+
+        switch (key) {
+        case 'o':
+                arguments->output = arg;
+                break;
+        case 'e':
+                scheme->eta = atof(arg);
+                break;
+        case 's':
+                scheme->sweeps = atoi(arg);
+                if (scheme->sweeps < 0) { argp_usage(state); }
+                break;
+        case 'r':
+                scheme->replicas = atoi(arg);
+                if (scheme->replicas < 1) { argp_usage(state); }
+                break;
+        case 'b':
+                if (sscanf(arg, "%lf,%lf", &scheme->beta_min,
+                           &scheme->beta_max) != 2 || scheme->beta_min <= 0 ||
+                    scheme->beta_max < scheme->beta_min) {
+                        argp_usage(state);
+                }
+                break;
+        case 'S':
+                scheme->seed = atoi(arg);
+                break;
+        case ARGP_KEY_ARG:
+                if (state->arg_num >= 2) { argp_usage(state); }
+                arguments->files[state->arg_num] = arg;
+                break;
+        case ARGP_KEY_END:
+                if (state->arg_num < 2) { argp_usage(state); }
+                break;
+        default:
+                return ARGP_ERR_UNKNOWN;
+        }
+        return 0;
+}
+
+int main(int argc, char *argv[])
+{
+        struct argp argp = {options, parse_opt, args_doc, doc};
+        struct arguments arguments = {
+                .scheme = default_placementScheme(),
+                .output = "placement.netw",
+                .files = { NULL, NULL }
+        };
+        argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+        make_network(arguments.files[0]);
+        double * safe_malloc(Iij, netw.psites * netw.psites);
+        if (read_mutualInformation(arguments.files[1], netw.psites, Iij)) {
+                safe_free(Iij);
+                destroy_network(&netw);
+                return EXIT_FAILURE;
+        }
+
+        optimize_placement(Iij, &arguments.scheme, 1);
+        const int exitcode = write_network(&netw, arguments.output);
+        if (!exitcode) {
+                printf(">> Network written to %s.\n", arguments.output);
+        }
+
+        safe_free(Iij);
+        destroy_network(&netw);
+        return exitcode ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -440,9 +440,28 @@ static int read_integrals_from_DUMP(struct qcH * H, const char * dumpfile)
         return 0;
 }
 
+/* Returns [ij|kl] from the integrals in memory.
+ *
+ * Full integrals are indexed as i + L j + L^2 k + L^3 l. Packed integrals are
+ * the fourfold compressed ones of pyscf, i.e. a C-ordered
+ * [L (L + 1) / 2, L (L + 1) / 2] array with pair index i (i + 1) / 2 + j for
+ * i >= j. */
+static double eri_from_mem(const double * eri, int L, bool packed,
+                           int i, int j, int k, int l)
+{
+        if (!packed) {
+                return eri[i + L * j + L * L * k + (long long) L * L * L * l];
+        }
+        if (j > i) { const int temp = i; i = j; j = temp; }
+        if (l > k) { const int temp = k; k = l; l = temp; }
+        const long long ij = i * (i + 1) / 2 + j;
+        const long long kl = k * (k + 1) / 2 + l;
+        return eri[ij * (L * (L + 1) / 2) + kl];
+}
+
 // Reads the integrals from the memory.
-static int read_integrals_from_mem(struct qcH * H, double * h1e, double * eri,
-                                   double enuc)
+static int read_integrals_from_mem(struct qcH * H, const double * h1e,
+                                   const double * eri, bool packed, double enuc)
 {
         H->E0 = enuc;
         assert(H->ps == EIGHTFOLD);
@@ -458,11 +477,8 @@ static int read_integrals_from_mem(struct qcH * H, double * h1e, double * eri,
                 for (int j = i; j < H->L; ++j) {
                         for (int k = i; k < H->L; ++k) {
                                 for (int l = k; l < H->L; ++l) {
-                                        const double val = eri[i +
-                                                H->L * j +
-                                                H->L * H->L * k + 
-                                                H->L * H->L * H->L * l
-                                        ];
+                                        const double val = eri_from_mem(
+                                                eri, H->L, packed, i, j, k, l);
                                         if (!COMPARE_INTEGRAL_TO_ZERO(val)) {
                                                 setV(H, val, i, j, k, l, 0, 0);
                                         }
@@ -648,8 +664,9 @@ int read_FCIDUMP(struct qcH * H, const char * dumpfile)
         return 0;
 }
 
-int read_integrals(struct qcH * H, int norb, int * irreps, double * h1e,
-                   double * eri, double enuc, enum permsym ps)
+int read_integrals(struct qcH * H, int norb, int * irreps, const double * h1e,
+                   const double * eri, bool packed, double enuc,
+                   enum permsym ps)
 {
         // For unrestricted orbitals this would be 2
         H->particles = 1;
@@ -659,7 +676,7 @@ int read_integrals(struct qcH * H, int norb, int * irreps, double * h1e,
         allocate(H, 'T');
         allocate(H, 'V');
 
-        if (read_integrals_from_mem(H, h1e, eri, enuc)) {
+        if (read_integrals_from_mem(H, h1e, eri, packed, enuc)) {
                 destroy_qcH(H);
                 return 1;
         }
@@ -667,6 +684,34 @@ int read_integrals(struct qcH * H, int norb, int * irreps, double * h1e,
         return 0;
 }
 
+int qcH_block(const struct qcH * H, char kind, int nr, double ** block)
+{
+        int p = -1, c, i, k, size;
+        int cnt = 0;
+        switch (kind) {
+        case 'T':
+                while (iterate_one_body(H, &p, &i, &size)) {
+                        if (cnt++ == nr) {
+                                *block = H->T[p][i];
+                                return size;
+                        }
+                }
+                break;
+        case 'V':
+                while (iterate_two_body(H, &p, &c, &i, &k, &size)) {
+                        if (cnt++ == nr) {
+                                *block = H->V[p][c][i][k];
+                                return size;
+                        }
+                }
+                break;
+        default:
+                fprintf(stderr, "%s::%s: Invalid option kind (%c)\n", __FILE__, __func__, kind);
+        }
+        *block = NULL;
+        return -1;
+}
+
 int qcH_pg_irrep_orbital(const struct qcH * H, int orbital)
 {
         assert(orbital >= 0 && orbital < H->L);
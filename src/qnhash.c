@@ -0,0 +1,131 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "qnhash.h"
+#include "sort.h"
+#include "macros.h"
+
+// Finalizer of MurmurHash3, spreads all bits of the key over the hash.
+static inline uint64_t mix_qn(uint64_t h)
+{
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+}
+
+static inline uint64_t hash_key(const QN_TYPE * key, int stride)
+{
+        uint64_t h = 0;
+        for (int i = 0; i < stride; ++i) {
+                h = mix_qn(h ^ (uint64_t) key[i]) + i;
+        }
+        return h;
+}
+
+static inline int equal_key(const QN_TYPE * a, const QN_TYPE * b, int stride)
+{
+        for (int i = 0; i < stride; ++i) {
+                if (a[i] != b[i]) { return 0; }
+        }
+        return 1;
+}
+
+struct qnhash null_qnhash(void)
+{
+        return (struct qnhash) {
+                .qn = NULL,
+                .n = 0,
+                .stride = 1,
+                .size = 0,
+                .slots = NULL
+        };
+}
+
+void init_qnhash(struct qnhash * hash, const QN_TYPE * qn, int n, int stride)
+{
+        assert(stride >= 1 && stride <= 4);
+        *hash = null_qnhash();
+        hash->qn = qn;
+        hash->n = n;
+        hash->stride = stride;
+        if (n < QNHASH_MIN_SIZE) { return; }
+
+        // Load factor of maximally 1/2.
+        hash->size = 1;
+        while (hash->size < 2 * n) { hash->size *= 2; }
+        safe_malloc(hash->slots, hash->size);
+        for (int i = 0; i < hash->size; ++i) { hash->slots[i] = -1; }
+
+        const uint64_t mask = hash->size - 1;
+        for (int i = 0; i < n; ++i) {
+                uint64_t s = hash_key(&qn[i * stride], stride) & mask;
+                while (hash->slots[s] != -1) { s = (s + 1) & mask; }
+                hash->slots[s] = i;
+        }
+}
+
+void destroy_qnhash(struct qnhash * hash)
+{
+        safe_free(hash->slots);
+        *hash = null_qnhash();
+}
+
+struct qnhash * init_qnhash_rOperators(const struct rOperators * ops)
+{
+        const int stride = rOperators_give_nr_of_couplings(ops);
+        struct qnhash * safe_malloc(hash, ops->nrhss);
+        for (int i = 0; i < ops->nrhss; ++i) {
+                init_qnhash(&hash[i], rOperators_give_qnumbers_for_hss(ops, i),
+                            rOperators_give_nr_blocks_for_hss(ops, i), stride);
+        }
+        return hash;
+}
+
+void destroy_qnhash_rOperators(struct qnhash ** hash,
+                               const struct rOperators * ops)
+{
+        if (*hash == NULL) { return; }
+        for (int i = 0; i < ops->nrhss; ++i) { destroy_qnhash(&(*hash)[i]); }
+        safe_free(*hash);
+}
+
+int search_qnhash(const QN_TYPE * key, const struct qnhash * hash)
+{
+        const int stride = hash->stride;
+        if (hash->size == 0) {
+                if (hash->n == 0) { return -1; }
+                return binSearch(key, hash->qn, hash->n, sort_qn[stride],
+                                 stride * sizeof *key);
+        }
+
+        const uint64_t mask = hash->size - 1;
+        uint64_t s = hash_key(key, stride) & mask;
+        while (hash->slots[s] != -1) {
+                const int id = hash->slots[s];
+                if (equal_key(&hash->qn[id * stride], key, stride)) {
+                        return id;
+                }
+                s = (s + 1) & mask;
+        }
+        return -1;
+}
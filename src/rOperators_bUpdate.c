@@ -20,12 +20,17 @@
 #include <omp.h>
 
 #include "rOperators.h"
+#include "numa_policy.h"
 #include <assert.h>
 #include "macros.h"
 #include "network.h"
 #include "instructions.h"
 #include "hamiltonian.h"
 #include "sort.h"
+#include "qnhash.h"
+#include "distributed.h"
+#include "trace.h"
+#include "context.h"
 
 /**
  * tens:
@@ -126,25 +131,33 @@
 struct nextshelper {
         int nrqns;
         QN_TYPE * qns;
+        struct qnhash qns_hash;
         int (**helper)[2];
 };
 
-static struct indexhelper {
+struct indexhelper {
         int id_ops[3];
         int maxdims[3][3];
         struct symsecs symarr[3][3];
         int looptype;
+        // The irrep arithmetic and prefactors for the symmetries.
+        const struct symmetryKernels * kern;
 
         /* Deze drie kan ik in 1 functie groep verwerken */
         int nrqnumbertens;
         QN_TYPE * qnumbertens; // sorted
+        struct qnhash qnumbertens_hash;
         int ** sbqnumbertens;
-        QN_TYPE divide;
+        // The number of sectors of the bonds of the siteTensor.
+        int tensdims[3];
+        // Index on the qnumbers of the siteTensor itself
+        struct qnhash tens_hash;
 
         // For instructions
         int  nrMPO_combos;        // size of array MPO_combos_arr
         QN_TYPE * MPO_combos_arr; // MPO1 + MPO2 * dimhss + MPO3 * dimhss * dimhss
                                   // Sorted.
+        struct qnhash MPO_combos_hash;
         int (**instrhelper)[2];    // for every MPO_combos an array of int[2]
                                    // [0] is an instruction id, 
                                    // [1] is the unique_id linked to it
@@ -152,7 +165,9 @@ static struct indexhelper {
 
         // For second op:
         struct nextshelper * sop;
-} idh;
+};
+
+#define idh (*CONTEXT_STATE(struct indexhelper, CONTEXT_BUPDATE))
 
 #define OPS1 0
 #define OPS2 1
@@ -240,7 +255,13 @@ void update_rOperators_branching(struct rOperators * const newops, const struct
                               uniqueOperators.is_left);
 
         init_uniqueOperators(&uniqueOperators, &instructions);
+        /* The indexhelper is shared by the threads of the calculation, so only
+         * one branching update of it at a time. The update itself is still
+         * parallelized over the blocks. */
+        context_lock(CONTEXT_LOCK_BUPDATE);
         update_unique_ops_T3NS(&uniqueOperators, Operator, tens, updateCase, &instructions);
+        context_unlock(CONTEXT_LOCK_BUPDATE);
+        sum_rOperators_over_ranks(&uniqueOperators);
 
         *newops = sum_unique_rOperators(&uniqueOperators, &instructions);
 
@@ -276,15 +297,12 @@ static void init_uniqueOperators(struct rOperators * const uniqueOps, const stru
         assert(count == uniqueOps->nrops);
 
         /* initializing the stensors */
-        safe_malloc(uniqueOps->operators, uniqueOps->nrops);
-        for (count = 0; count < uniqueOps->nrops; ++count) {
-                /* The current operator and current hamsymsec */
-                struct sparseblocks * const blocks = &uniqueOps->operators[count];
-                const int currhss                  = uniqueOps->hss_of_ops[count]; 
-                const int N                        = rOperators_give_nr_blocks_for_hss(uniqueOps, currhss);
-
-                init_sparseblocks(blocks, nkappa_begin[currhss], N, 'c');
-        }
+        const T3NS_BB_TYPE ** safe_malloc(bb, uniqueOps->nrops);
+        for (count = 0; count < uniqueOps->nrops; ++count)
+                bb[count] = nkappa_begin[uniqueOps->hss_of_ops[count]];
+        alloc_operators_rOperators(uniqueOps, bb);
+        safe_free(bb);
+        first_touch_rOperators(uniqueOps);
 
         for (count = 0; count < uniqueOps->nrhss; ++count)
                 safe_free(nkappa_begin[count]);
@@ -316,57 +334,50 @@ static int prepare_update_branching(struct rOperators * const newops, const stru
 static void make_qntens(const struct siteTensor * tens)
 {
         QN_TYPE * safe_malloc(qntenshelper, tens->nrblocks);
+        for (int i = 0; i < 3; ++i) { idh.tensdims[i] = idh.maxdims[i][KET]; }
         if (idh.looptype) {
-                idh.divide = idh.maxdims[0][KET] * idh.maxdims[1][KET];
                 for (int i = 0; i < tens->nrblocks; ++i) {
-                        qntenshelper[i] = tens->qnumbers[i] % idh.divide;
+                        qntenshelper[i] = qn_head(tens->qnumbers[i], 2, 
+                                                  idh.tensdims);
                 }
         } else {
-                idh.divide = idh.maxdims[0][KET];
                 for (int i = 0; i < tens->nrblocks; ++i) {
-                        qntenshelper[i] = tens->qnumbers[i] / idh.divide;
+                        qntenshelper[i] = qn_tail(tens->qnumbers[i], 1, 
+                                                  idh.tensdims);
                 }
         }
+        init_qnhash(&idh.tens_hash, tens->qnumbers, tens->nrblocks, 1);
 
-        QN_TYPE * safe_malloc(qnumbertenshelper2, tens->nrblocks);
-        int * safe_calloc(nrsbhelper, tens->nrblocks);
-        idh.nrqnumbertens = 0;
+        // The sorted unique qnumbers
+        idh.nrqnumbertens = tens->nrblocks;
+        safe_malloc(idh.qnumbertens, idh.nrqnumbertens);
         for (int i = 0; i < tens->nrblocks; ++i) {
-                const QN_TYPE qn = qntenshelper[i];
-                int j;
-                for (j = 0; j < idh.nrqnumbertens; ++j) {
-                        if (qnumbertenshelper2[j] == qn) { break; }
-                }
-                ++nrsbhelper[j];
-                qnumbertenshelper2[j] = qn;
-                idh.nrqnumbertens += j == idh.nrqnumbertens;
+                idh.qnumbertens[i] = qntenshelper[i];
         }
-        int * idx = quickSort(qnumbertenshelper2, idh.nrqnumbertens, SORT_QN_TYPE);
-        safe_malloc(idh.qnumbertens, idh.nrqnumbertens);
-        int * safe_malloc(nrsbhelper3, idh.nrqnumbertens);
-        for (int i = 0; i < idh.nrqnumbertens; ++i) {
-                idh.qnumbertens[i] = qnumbertenshelper2[idx[i]];
-                nrsbhelper3[i] = nrsbhelper[idx[i]];
+        inplace_quickSort(idh.qnumbertens, idh.nrqnumbertens, SORT_QN_TYPE,
+                          sizeof *idh.qnumbertens);
+        rm_duplicates(idh.qnumbertens, &idh.nrqnumbertens, SORT_QN_TYPE,
+                      sizeof *idh.qnumbertens);
+        init_qnhash(&idh.qnumbertens_hash, idh.qnumbertens, 
+                    idh.nrqnumbertens, 1);
+
+        int * safe_malloc(qnid, tens->nrblocks);
+        int * safe_calloc(nrsbhelper, idh.nrqnumbertens);
+        for (int i = 0; i < tens->nrblocks; ++i) {
+                qnid[i] = search_qnhash(&qntenshelper[i], 
+                                        &idh.qnumbertens_hash);
+                assert(qnid[i] != -1);
+                ++nrsbhelper[qnid[i]];
         }
-        safe_free(qnumbertenshelper2);
-        safe_free(nrsbhelper);
-        safe_free(idx);
-        nrsbhelper = nrsbhelper3;
 
         safe_malloc(idh.sbqnumbertens, idh.nrqnumbertens);
         for (int i = 0; i < idh.nrqnumbertens; ++i) {
                 safe_malloc(idh.sbqnumbertens[i], nrsbhelper[i] + 1);
         }
 
-        int * safe_calloc(nrsbhelper2, tens->nrblocks);
+        int * safe_calloc(nrsbhelper2, idh.nrqnumbertens);
         for (int i = 0; i < tens->nrblocks; ++i) {
-                const QN_TYPE qn = qntenshelper[i];
-                int j;
-                for (j = 0; j < idh.nrqnumbertens; ++j) {
-                        if (idh.qnumbertens[j] == qn) { break; }
-                }
-                assert(j != idh.nrqnumbertens);
-
+                const int j = qnid[i];
                 idh.sbqnumbertens[j][nrsbhelper2[j]] = i;
                 ++nrsbhelper2[j];
         }
@@ -375,17 +386,19 @@ static void make_qntens(const struct siteTensor * tens)
         for (int i = 0; i < idh.nrqnumbertens; ++i) {
                 idh.sbqnumbertens[i][nrsbhelper[i]] = -1;
         }
+        safe_free(qnid);
         safe_free(nrsbhelper);
         safe_free(nrsbhelper2);
         safe_free(qntenshelper);
 }
 
 static void init_helperdiv(struct nextshelper * help, const QN_TYPE * todiv,
-                           int n, const QN_TYPE divide)
+                           int n, const int * dims)
 {
         if (n == 0) {
                 help->nrqns = 0;
                 help->qns = NULL;
+                help->qns_hash = null_qnhash();
                 help->helper = NULL;
                 return;
         }
@@ -398,8 +411,8 @@ static void init_helperdiv(struct nextshelper * help, const QN_TYPE * todiv,
         int ch = -1;
         int currhelpers = 0;
         for (int i = 0; i < n; ++i) {
-                QN_TYPE currdiv = todiv[i] / divide;
-                int currmod     = todiv[i] % divide;
+                QN_TYPE currdiv = qn_tail(todiv[i], 1, dims);
+                int currmod     = qn_index(todiv[i], 0, dims);
 
                 if (currdiv != prevqndiv) {
                         if (ch != -1) {
@@ -448,6 +461,7 @@ static void init_helperdiv(struct nextshelper * help, const QN_TYPE * todiv,
                 fprintf(stderr, "Error %s:%d: realloc failed.\n", __FILE__, 
                         __LINE__);
         }
+        init_qnhash(&help->qns_hash, help->qns, help->nrqns, 1);
 }
 
 static void init_instrhelper(const struct instructionset * instructions,
@@ -492,6 +506,8 @@ static void init_instrhelper(const struct instructionset * instructions,
         safe_free(nrinstrhelper);
         safe_free(idx);
         nrinstrhelper= nrinstrhelper2;
+        init_qnhash(&idh.MPO_combos_hash, idh.MPO_combos_arr, 
+                    idh.nrMPO_combos, 1);
 
         safe_malloc(idh.instrhelper, idh.nrMPO_combos);
         for (int i = 0; i < idh.nrMPO_combos; ++i) {
@@ -507,11 +523,8 @@ static void init_instrhelper(const struct instructionset * instructions,
                         hss_of_ops[1][currinstr[1]] * dimhss +
                         instructions->hss_of_new[currinstr[2]] * dimhss * dimhss;
 
-                int j;
-                for (j = 0; j < idh.nrMPO_combos; ++j) {
-                        if (idh.MPO_combos_arr[j] == currMPOc) { break; }
-                }
-                assert(j != idh.nrMPO_combos);
+                const int j = search_qnhash(&currMPOc, &idh.MPO_combos_hash);
+                assert(j != -1);
 
                 idh.instrhelper[j][nrinstrhelper[j]][0] = instrunique[i];
                 idh.instrhelper[j][nrinstrhelper[j]][1] = i;
@@ -537,6 +550,7 @@ static void initialize_indexhelper(int updateCase, int site,
         idh.id_ops[1] = updateCase == 2 ? 1 : 2;
         idh.id_ops[2] = updateCase;
         idh.looptype = updateCase == 0;
+        idh.kern = bookie.kernels;
 
         int tmpbonds[3];
         get_bonds_of_site(site, tmpbonds);
@@ -555,13 +569,13 @@ static void initialize_indexhelper(int updateCase, int site,
 
         const int second_op = idh.looptype ? OPS2 : OPS1;
         const struct rOperators * operator = &operators[second_op];
-        const QN_TYPE divid = idh.maxdims[idh.id_ops[second_op]][BRA];
         const int hssdim = get_nr_hamsymsec();
         safe_malloc(idh.sop, hssdim);
         for (int mpod = 0; mpod < hssdim; ++mpod) {
                 const int nr = rOperators_give_nr_blocks_for_hss(operator, mpod);
                 const QN_TYPE * qn = rOperators_give_qnumbers_for_hss(operator, mpod);
-                init_helperdiv(&idh.sop[mpod], qn, nr, divid);
+                init_helperdiv(&idh.sop[mpod], qn, nr, 
+                               idh.maxdims[idh.id_ops[second_op]]);
         }
 }
 
@@ -572,17 +586,21 @@ static void destroy_helper(struct nextshelper * help)
         }
         safe_free(help->helper);
         safe_free(help->qns);
+        destroy_qnhash(&help->qns_hash);
 }
 
 static void clean_indexhelper(void)
 {
         safe_free(idh.qnumbertens);
+        destroy_qnhash(&idh.qnumbertens_hash);
+        destroy_qnhash(&idh.tens_hash);
         for (int i = 0; i < idh.nrqnumbertens; ++i) {
                 safe_free(idh.sbqnumbertens[i]);
         }
         safe_free(idh.sbqnumbertens);
 
         safe_free(idh.MPO_combos_arr);
+        destroy_qnhash(&idh.MPO_combos_hash);
         for (int i = 0; i < idh.nrMPO_combos; ++i) {
                 safe_free(idh.instrhelper[i]);
         }
@@ -598,19 +616,11 @@ static void clean_indexhelper(void)
 static void fill_indexes(struct update_data * const data, 
                          const int operator, QN_TYPE qn)
 {
-        int i;
         const int opmap = idh.id_ops[operator];
         int * const idarr = data->id[opmap];
-        int * const mdims = idh.maxdims[opmap];
-
-        for (i = 0; i < 2; ++i) {
-                idarr[i] = qn % mdims[i];
-                qn       = qn / mdims[i];
-        }
-        idarr[2] = qn;
-        assert(qn < mdims[2]);
 
-        for (i = 0; i < 3; ++i) {
+        qn_split(idarr, qn, idh.maxdims[opmap]);
+        for (int i = 0; i < 3; ++i) {
                 data->irreps[opmap][i] = idh.symarr[opmap][i].irreps[idarr[i]];
                 if (i != MPO)
                         data->teldims[opmap][i] = idh.symarr[opmap][i].dims[idarr[i]];
@@ -649,28 +659,39 @@ static void update_unique_ops_T3NS(struct rOperators * const newops,
         initialize_indexhelper(updateCase, site, tens, instructions, hss_of_ops,
                                Operator);
 
-#pragma omp parallel for schedule(dynamic) default(none)
-        for (int new_sb = 0; new_sb < N; ++new_sb) {
-                struct update_data data;
-                int prod, nr_of_prods, *possible_prods;
-
-                fill_indexes(&data, NEWOPS, newops->qnumbers[new_sb]);
-                data.sb_op[NEWOPS] = new_sb - 
-                        newops->begin_blocks_of_hss[get_id(&data, NEWOPS, MPO)];
-
-                /* This function decides which hss_1 and hss_2 I need for 
-                 * the possible making of newhss. */
-
-                /* WATCH OUT! Are inward and outward bonds correct? */
-                tprods_ham(&nr_of_prods, &possible_prods, 
-                           get_id(&data, NEWOPS, MPO), site);
-
-                for (prod = 0; prod < nr_of_prods; ++prod) {
-                        update_newblock_w_MPO_set(&possible_prods[prod * 2], 
-                                                  Operator, newops, tens, &data, 
-                                                  updateCase, instructions);
+#pragma omp parallel default(none) copyin(t3ns_ctx)
+        {
+                const double start = trace_now();
+                int items = 0;
+                // Every thread fills the blocks it placed in first_touch_rOperators.
+                int first, last;
+                thread_block_range(N, &first, &last);
+                for (int new_sb = first; new_sb < last; ++new_sb) {
+                        struct update_data data;
+                        int prod, nr_of_prods, *possible_prods;
+                        // With several processes, each one makes a part of the blocks.
+                        if (!is_my_work(new_sb)) { continue; }
+                        ++items;
+
+                        fill_indexes(&data, NEWOPS, newops->qnumbers[new_sb]);
+                        data.sb_op[NEWOPS] = new_sb - 
+                                newops->begin_blocks_of_hss[get_id(&data, NEWOPS, MPO)];
+
+                        /* This function decides which hss_1 and hss_2 I need for 
+                         * the possible making of newhss. */
+
+                        /* WATCH OUT! Are inward and outward bonds correct? */
+                        tprods_ham(&nr_of_prods, &possible_prods, 
+                                   get_id(&data, NEWOPS, MPO), site);
+
+                        for (prod = 0; prod < nr_of_prods; ++prod) {
+                                update_newblock_w_MPO_set(&possible_prods[prod * 2], 
+                                                          Operator, newops, tens, &data, 
+                                                          updateCase, instructions);
+                        }
+                        safe_free(possible_prods);
                 }
-                safe_free(possible_prods);
+                trace_span("rOperators: update branching blocks", start, items);
         }
         clean_indexhelper();
 }
@@ -687,9 +708,7 @@ static int next_sb_tens(const int ** sb, int * qnid, QN_TYPE qntomatch,
 
         /* First time we are entering this function since the while-loop. */
         if (*qnid == -1) {
-                *qnid = binSearch(&qntomatch, idh.qnumbertens, 
-                                  idh.nrqnumbertens, SORT_QN_TYPE,
-                                  sizeof qntomatch);
+                *qnid = search_qnhash(&qntomatch, &idh.qnumbertens_hash);
                 if (*qnid == -1) { return 0; }
                 *sb = idh.sbqnumbertens[*qnid];
                 if (**sb == -1) { return 0; }
@@ -698,12 +717,9 @@ static int next_sb_tens(const int ** sb, int * qnid, QN_TYPE qntomatch,
                 if (**sb == -1) { return 0; }
         }
 
-        int ket_to_be_found;
-        if (!idh.looptype) {
-                ket_to_be_found = tens->qnumbers[**sb] % idh.divide;
-        } else {
-                ket_to_be_found = tens->qnumbers[**sb] / idh.divide;
-        }
+        const int ket_to_be_found = qn_index(tens->qnumbers[**sb], 
+                                             idh.looptype ? 2 : 0, 
+                                             idh.tensdims);
 
         fill_index(ket_to_be_found, data, second_op, KET);
         data->tels[TENS] = get_tel_block(&tens->blocks, **sb);
@@ -720,13 +736,15 @@ static int next_sb_sec_op(int (**curr_sb)[2], struct update_data * data,
 
         if (*curr_sb == NULL) {
                 int idmpo = get_id(data, second_op, MPO);
-                const QN_TYPE qntomatch = data->id[idh.id_ops[second_op]][KET] + 
-                        data->id[idh.id_ops[second_op]][MPO] * idh.maxdims[idh.id_ops[second_op]][KET];
-                QN_TYPE * qntosearch = idh.sop[idmpo].qns;
-                int nr = idh.sop[idmpo].nrqns;
-                if (nr == 0) { return 0; }
-                int curid = binSearch(&qntomatch, qntosearch, nr, SORT_QN_TYPE,
-                                      sizeof qntomatch);
+                const int opmap = idh.id_ops[second_op];
+                const int ids[3] = {
+                        0, data->id[opmap][KET], data->id[opmap][MPO]
+                };
+                const QN_TYPE qntomatch = qn_tail(
+                        qn_combine(ids, idh.maxdims[opmap]), 1, 
+                        idh.maxdims[opmap]);
+                if (idh.sop[idmpo].nrqns == 0) { return 0; }
+                int curid = search_qnhash(&qntomatch, &idh.sop[idmpo].qns_hash);
 
                 if (curid == -1) { return 0; }
 
@@ -765,9 +783,16 @@ static void update_newblock_w_MPO_set(const int * hss_ops,
                 fill_index(hss_ops[second_op], data, second_op, MPO);
 
                 if (idh.looptype) {
-                        qntomatch = data->id[0][KET] + data->id[1][KET] * idh.maxdims[0][KET];
+                        const int ids[3] = {
+                                data->id[0][KET], data->id[1][KET], 0
+                        };
+                        qntomatch = qn_combine(ids, idh.tensdims);
                 } else {
-                        qntomatch = data->id[1][KET] + data->id[2][KET] * idh.maxdims[1][KET];
+                        const int ids[3] = {
+                                0, data->id[1][KET], data->id[2][KET]
+                        };
+                        qntomatch = qn_tail(qn_combine(ids, idh.tensdims), 1, 
+                                            idh.tensdims);
                 }
 
                 int qnid = -1;
@@ -786,15 +811,14 @@ static void update_newblock_w_MPO_set(const int * hss_ops,
 static int find_block_adj(const struct siteTensor * tens, 
                           struct update_data * data)
 {
-        QN_TYPE qn = 0;
         /* make the quantum number to search for */
-        for (int i = 2; i >= 0; --i) {
-                qn *= idh.maxdims[i][BRA];
-                qn += data->id[i][BRA];
-        }
+        const int ids[3] = {data->id[0][BRA], data->id[1][BRA], data->id[2][BRA]};
+        const int dims[3] = {
+                idh.maxdims[0][BRA], idh.maxdims[1][BRA], idh.maxdims[2][BRA]
+        };
+        const QN_TYPE qn = qn_combine(ids, dims);
         /* find the qnumber */
-        int block = binSearch(&qn, tens->qnumbers, tens->nrblocks, 
-                              SORT_QN_TYPE, sizeof qn);
+        int block = search_qnhash(&qn, &idh.tens_hash);
         if (block == -1) { return 0; }
 
         data->tels[ADJ] = get_tel_block(&tens->blocks, block);
@@ -1025,9 +1049,7 @@ static int find_matching_instr(int (**instr_id)[2], struct update_data * data)
                 MPOtomatch += get_id(data, OPS2, MPO) * dimhss;
                 MPOtomatch += get_id(data, NEWOPS, MPO) * dimhss * dimhss;
 
-                int MPOid = binSearch(&MPOtomatch, idh.MPO_combos_arr, 
-                                      idh.nrMPO_combos, SORT_QN_TYPE, 
-                                      sizeof MPOtomatch);
+                int MPOid = search_qnhash(&MPOtomatch, &idh.MPO_combos_hash);
                 if (MPOid == -1) { return 0; }
 
                 *instr_id = idh.instrhelper[MPOid];
@@ -1045,8 +1067,10 @@ static void update_selected_blocks(const struct rOperators * Operator,
                                    const struct instructionset * instructions, 
                                    int updateCase)
 {
-        const double prefactor = prefactor_bUpdate(data->irreps, updateCase, 
-                                                   bookie.sgs, bookie.nrSyms);
+        const double prefactor = idh.kern->prefactor_bUpdate(data->irreps, 
+                                                             updateCase, 
+                                                             bookie.sgs, 
+                                                             bookie.nrSyms);
 
         struct contractinfo cinfo[3];
         int worksize[2] = {-1, -1};
@@ -1087,12 +1111,12 @@ static int get_tels_operators(struct update_data * data, const int * ops,
                                            data->sb_op[NEWOPS]);
         if (data->tels[NEWOPS] == NULL) { return 0; }
 
-        assert(data->teldims[idh.id_ops[OPS1]][BRA] * data->teldims[idh.id_ops[OPS1]][KET] ==
-               get_size_block(&Operator[OPS1].operators[ops[OPS1]], data->sb_op[OPS1]));
-        assert(data->teldims[idh.id_ops[OPS2]][BRA] * data->teldims[idh.id_ops[OPS2]][KET] ==
-               get_size_block(&Operator[OPS2].operators[ops[OPS2]], data->sb_op[OPS2]));
-        assert(data->teldims[idh.id_ops[NEWOPS]][BRA] * data->teldims[idh.id_ops[NEWOPS]][KET] ==
-               get_size_block(&newops->operators[curr_unique], data->sb_op[NEWOPS]));
+        assert(block_has_size(&Operator[OPS1].operators[ops[OPS1]], data->sb_op[OPS1],
+                              data->teldims[idh.id_ops[OPS1]][BRA] * data->teldims[idh.id_ops[OPS1]][KET]));
+        assert(block_has_size(&Operator[OPS2].operators[ops[OPS2]], data->sb_op[OPS2],
+                              data->teldims[idh.id_ops[OPS2]][BRA] * data->teldims[idh.id_ops[OPS2]][KET]));
+        assert(block_has_size(&newops->operators[curr_unique], data->sb_op[NEWOPS],
+                              data->teldims[idh.id_ops[NEWOPS]][BRA] * data->teldims[idh.id_ops[NEWOPS]][KET]));
         return 1;
 }
 
@@ -16,6 +16,7 @@
 */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <stdbool.h>
 #include <omp.h>
@@ -28,6 +29,7 @@
 #endif
 
 #include "rOperators.h"
+#include "numa_policy.h"
 #include "tensorproducts.h"
 #include "bookkeeper.h"
 #include "network.h"
@@ -46,7 +48,8 @@ struct rOperators null_rOperators(void)
                 .qnumbers = NULL,
                 .nrops = 0,
                 .hss_of_ops = NULL,
-                .operators = NULL
+                .operators = NULL,
+                .slab = NULL
         };
         return nullops;
 }
@@ -56,13 +59,215 @@ void destroy_rOperators(struct rOperators * rops)
         safe_free(rops->begin_blocks_of_hss);
         safe_free(rops->hss_of_ops);
         safe_free(rops->qnumbers);
-        for (int i = 0; i < rops->nrops; ++i) {
-                destroy_sparseblocks(&rops->operators[i]);
+        if (rops->slab != NULL) {
+                // The operators themselves live in the slab.
+                safe_free(rops->slab);
+        } else {
+                for (int i = 0; i < rops->nrops; ++i) {
+                        destroy_sparseblocks(&rops->operators[i]);
+                }
+                safe_free(rops->operators);
         }
-        safe_free(rops->operators);
         *rops = null_rOperators();
 }
 
+// Gives the local blocks [first, last) of operator op that are in the global
+// block range [gfirst, glast).
+static void local_block_range(const struct rOperators * rops, int op, 
+                              int gfirst, int glast, int * first, int * last)
+{
+        const int b0 = rops->begin_blocks_of_hss[rops->hss_of_ops[op]];
+        const int nrbl = nblocks_in_operator(rops, op);
+        *first = gfirst - b0 > 0 ? gfirst - b0 : 0;
+        *last = glast - b0 < nrbl ? glast - b0 : nrbl;
+}
+
+void first_touch_rOperators(struct rOperators * rops)
+{
+#pragma omp parallel if (get_numa_policy() != NUMA_SERIAL)
+        {
+                int gfirst, glast;
+                thread_block_range(rops->begin_blocks_of_hss[rops->nrhss], 
+                                   &gfirst, &glast);
+                for (int i = 0; i < rops->nrops; ++i) {
+                        struct sparseblocks * op = &rops->operators[i];
+                        int first, last;
+                        local_block_range(rops, i, gfirst, glast, &first, &last);
+                        if (first >= last) { continue; }
+                        const T3NS_BB_TYPE N = op->beginblock[last] - 
+                                op->beginblock[first];
+                        if (N != 0) {
+                                memset(op->tel + op->beginblock[first], 0,
+                                       N * sizeof *op->tel);
+                        }
+                }
+        }
+}
+
+// Gives every operator its own beginblock and tel arrays.
+static void alloc_scattered_operators(struct rOperators * rops,
+                                      const T3NS_BB_TYPE * const * bb)
+{
+        safe_malloc(rops->operators, rops->nrops);
+        for (int i = 0; i < rops->nrops; ++i) {
+                if (bb[i] == NULL) {
+                        init_null_sparseblocks(&rops->operators[i]);
+                } else {
+                        init_sparseblocks(&rops->operators[i], bb[i],
+                                          nblocks_in_operator(rops, i), 'm');
+                }
+        }
+        rops->slab = NULL;
+}
+
+#ifdef T3NS_SLAB
+static size_t round_up(size_t n, size_t multiple)
+{
+        return (n + multiple - 1) / multiple * multiple;
+}
+
+// Shrinks the slab and moves the pointers of the operators along with it.
+static void shrink_slab(struct rOperators * rops, size_t size)
+{
+        const uintptr_t old = (uintptr_t) rops->slab;
+        char * slab = realloc(rops->slab, size);
+        // Keep the larger slab.
+        if (slab == NULL) { return; }
+        if ((uintptr_t) slab % T3NS_SLAB_ALIGN != 0) {
+                // Only when realloc moved it to a less aligned place.
+                char * aligned = aligned_alloc(T3NS_SLAB_ALIGN, size);
+                if (aligned == NULL) {
+                        fprintf(stderr, "%s@%s: could not realign the slab.\n",
+                                __FILE__, __func__);
+                        exit(EXIT_FAILURE);
+                }
+                memcpy(aligned, slab, size);
+                safe_free(slab);
+                slab = aligned;
+        }
+        rops->slab = slab;
+        rops->operators = (struct sparseblocks *) slab;
+        if ((uintptr_t) slab == old) { return; }
+
+        for (int i = 0; i < rops->nrops; ++i) {
+                struct sparseblocks * op = &rops->operators[i];
+                if (op->beginblock != NULL) {
+                        op->beginblock = (T3NS_BB_TYPE *) 
+                                (slab + ((uintptr_t) op->beginblock - old));
+                }
+                if (op->tel != NULL) {
+                        op->tel = (T3NS_EL_TYPE *)
+                                (slab + ((uintptr_t) op->tel - old));
+                }
+        }
+}
+#endif
+
+void alloc_operators_rOperators(struct rOperators * rops,
+                                const T3NS_BB_TYPE * const * bb)
+{
+#ifdef T3NS_SLAB
+        // Number of elements that fill up T3NS_SLAB_ALIGN bytes.
+        const size_t elalign = T3NS_SLAB_ALIGN / sizeof(T3NS_EL_TYPE);
+        size_t nrbb = 0;
+        size_t nrtel = 0;
+        for (int i = 0; i < rops->nrops; ++i) {
+                if (bb[i] == NULL) { continue; }
+                const int nrbl = nblocks_in_operator(rops, i);
+                nrbb += nrbl + 1;
+                nrtel += round_up(bb[i][nrbl], elalign);
+        }
+
+        /* Layout of the slab:
+         * [operators | all beginblocks | tel op 0 | tel op 1 | ...]
+         * with every part starting on a T3NS_SLAB_ALIGN boundary. */
+        const size_t opsize = round_up(rops->nrops * sizeof *rops->operators,
+                                       T3NS_SLAB_ALIGN);
+        const size_t bbsize = round_up(nrbb * sizeof(T3NS_BB_TYPE), 
+                                       T3NS_SLAB_ALIGN);
+        const size_t size = opsize + bbsize + nrtel * sizeof(T3NS_EL_TYPE);
+        char * slab = aligned_alloc(T3NS_SLAB_ALIGN, size);
+        if (slab == NULL) {
+                fprintf(stderr, "Warning %s:%d: could not allocate slab of %zu bytes.\n",
+                        __FILE__, __LINE__, size);
+                alloc_scattered_operators(rops, bb);
+                return;
+        }
+        if (get_numa_policy() == NUMA_INTERLEAVE) { interleave_pages(slab, size); }
+
+        struct sparseblocks * ops = (struct sparseblocks *) slab;
+        T3NS_BB_TYPE * cbb = (T3NS_BB_TYPE *) (slab + opsize);
+        T3NS_EL_TYPE * tel = (T3NS_EL_TYPE *) (slab + opsize + bbsize);
+        for (int i = 0; i < rops->nrops; ++i) {
+                init_null_sparseblocks(&ops[i]);
+                if (bb[i] == NULL) { continue; }
+
+                const int nrbl = nblocks_in_operator(rops, i);
+                const T3NS_BB_TYPE N = bb[i][nrbl];
+                memcpy(cbb, bb[i], (nrbl + 1) * sizeof *cbb);
+                ops[i].beginblock = cbb;
+                cbb += nrbl + 1;
+                if (N != 0) {
+                        ops[i].tel = tel;
+                        tel += round_up(N, elalign);
+                }
+        }
+        rops->operators = ops;
+        rops->slab = slab;
+#else
+        alloc_scattered_operators(rops, bb);
+#endif
+}
+
+void pack_rOperators(struct rOperators * rops)
+{
+        if (rops->slab == NULL) {
+                for (int i = 0; i < rops->nrops; ++i) {
+                        struct sparseblocks * op = &rops->operators[i];
+                        if (op->beginblock == NULL) { continue; }
+                        kick_zero_blocks(op, nblocks_in_operator(rops, i));
+                }
+                return;
+        }
+#ifdef T3NS_SLAB
+#pragma omp parallel for schedule(dynamic) default(none) shared(rops)
+        for (int i = 0; i < rops->nrops; ++i) {
+                struct sparseblocks * op = &rops->operators[i];
+                if (op->beginblock == NULL) { continue; }
+                squeeze_zero_blocks(op, nblocks_in_operator(rops, i));
+        }
+
+        // Close the gaps between the operators. Every operator keeps 
+        // starting on a T3NS_SLAB_ALIGN boundary.
+        const size_t elalign = T3NS_SLAB_ALIGN / sizeof(T3NS_EL_TYPE);
+        T3NS_EL_TYPE * tel = NULL;
+        char * end = NULL;
+        for (int i = 0; i < rops->nrops; ++i) {
+                struct sparseblocks * op = &rops->operators[i];
+                if (op->beginblock == NULL) { continue; }
+                const int nrbl = nblocks_in_operator(rops, i);
+                // The beginblock arrays all come before the elements.
+                if (tel == NULL) { end = (char *) (op->beginblock + nrbl + 1); }
+                if (op->tel == NULL) { continue; }
+                if (tel == NULL) { tel = op->tel; }
+
+                const T3NS_BB_TYPE N = op->beginblock[nrbl];
+                if (N == 0) {
+                        op->tel = NULL;
+                        continue;
+                }
+                memmove(tel, op->tel, N * sizeof *tel);
+                op->tel = tel;
+                tel += round_up(N, elalign);
+        }
+        if (tel != NULL) { end = (char *) tel; }
+        if (end != NULL) { 
+                shrink_slab(rops, round_up(end - (char *) rops->slab,
+                                           T3NS_SLAB_ALIGN));
+        }
+#endif
+}
+
 static void make_unitOperator(struct rOperators * ops, int op)
 {
         assert(ops->P_operator == 0 && "Not implemented for physical rOperators");
@@ -134,6 +339,7 @@ struct rOperators vacuum_rOperators(int bond, int is_left)
         struct symsecs ss;
         get_symsecs(&ss, bond);
         const int trivhss = get_trivialhamsymsec();
+        const int dims[3] = {ss.nrSecs, ss.nrSecs, result.nrhss};
 
         // Only the trivial hamsymsec is valid at these vacuum operators.
         int i;
@@ -148,8 +354,8 @@ struct rOperators vacuum_rOperators(int bond, int is_left)
 
                 safe_malloc(result.qnumbers, ss.nrSecs);
                 for (i = 0; i < ss.nrSecs; ++i) {
-                        result.qnumbers[i] = i * (ss.nrSecs + 1) + 
-                                ss.nrSecs * ss.nrSecs * trivhss;
+                        const int ids[3] = {i, i, trivhss};
+                        result.qnumbers[i] = qn_combine(ids, dims);
                 }
         } else {
                 // For seniority calculations the unit operator at the end
@@ -160,8 +366,10 @@ struct rOperators vacuum_rOperators(int bond, int is_left)
 
                 safe_malloc(result.qnumbers, ss.nrSecs * ss.nrSecs);
                 for (i = 0; i < ss.nrSecs * ss.nrSecs; ++i) {
-                        result.qnumbers[i] = i + 
-                                ss.nrSecs * ss.nrSecs * trivhss;
+                        const int ids[3] = {
+                                i % ss.nrSecs, i / ss.nrSecs, trivhss
+                        };
+                        result.qnumbers[i] = qn_combine(ids, dims);
                 }
         }
         result.nrops = 1;
@@ -177,6 +385,9 @@ static struct rOperators deep_copy_metadata(const struct rOperators * tocopy)
         const int c = rOperators_give_nr_of_couplings(tocopy);
         // copy everything the bond info and so on.
         struct rOperators copy = *tocopy;
+        // The operators themselves are not copied.
+        copy.operators = NULL;
+        copy.slab = NULL;
 
         // Making deepcopy of qnumbers and begin_block_of_hss
         safe_malloc(copy.begin_blocks_of_hss, copy.nrhss + 1);
@@ -204,28 +415,23 @@ static struct rOperators init_sum_unique(const struct rOperators * ur,
         }
 
         safe_malloc(res.hss_of_ops, res.nrops);
-        safe_malloc(res.operators, res.nrops);
-#pragma omp parallel for schedule(static) default(none) shared(ur,set,res)
+        const T3NS_BB_TYPE ** safe_malloc(bb, res.nrops);
         for (int i = 0; i < res.nrops; ++i) {
-                struct sparseblocks * nOp = &res.operators[i];
                 res.hss_of_ops[i] = set->hss_of_new[i];
-                const int N = rOperators_give_nr_blocks_for_hss(&res, res.hss_of_ops[i]);
-                safe_malloc(nOp->beginblock, N + 1);
 
                 // find in uniquerops a operator with same symsecs that is 
                 // already initialized. For this operator no zero-symsecs are
                 // kicked out yet.
-                struct sparseblocks * oOp = &ur->operators[0];
+                const struct sparseblocks * oOp = &ur->operators[0];
                 for (int j = 0; j < ur->nrops; ++j, ++oOp) {
                         if (ur->hss_of_ops[j] == res.hss_of_ops[i]) { break; }
                 }
                 assert(oOp != &ur->operators[ur->nrops]);
-
-                for (int j = 0; j < N + 1; ++j) {
-                        nOp->beginblock[j] = oOp->beginblock[j];
-                }
-                safe_calloc(nOp->tel, nOp->beginblock[N]);
+                bb[i] = oOp->beginblock;
         }
+        alloc_operators_rOperators(&res, bb);
+        safe_free(bb);
+        first_touch_rOperators(&res);
         return res;
 }
 
@@ -274,7 +480,8 @@ struct rOperators sum_unique_rOperators(const struct rOperators * ur,
                 pinstr = instr;
         }
 
-#pragma omp parallel for schedule(guided) default(none) shared(res, nrins, ins)
+#pragma omp parallel for schedule(guided) default(none) shared(res, nrins, ins) \
+        copyin(t3ns_ctx)
         for (int i = 0; i < res.nrops; ++i) {
                 const int nrbl = nblocks_in_operator(&res, i);
                 struct sparseblocks * const nOp = &res.operators[i];
@@ -284,11 +491,11 @@ struct rOperators sum_unique_rOperators(const struct rOperators * ur,
                 for (struct sum_instr * ii = &ins[i][0]; ii < &ins[i][nrins[i]]; ++ii) {
                         cblas_daxpy(N, ii->pref, ii->uOpblock, 1, nOptel, 1);
                 }
-
-                kick_zero_blocks(nOp, nrbl);
         }
         safe_free(nrins);
         for (int i = 0; i < res.nrops; ++i) { safe_free(ins[i]); }
+        // The operators will not change anymore, kick out the zero blocks.
+        pack_rOperators(&res);
         return res;
 }
 
@@ -307,9 +514,11 @@ static T3NS_BB_TYPE * nP_make_qnumbers_for_hss(struct rOperators * rops,
         assert(iter.length == N);
         while (iterate_gs(&iter)) {
                 assert(iter.cid[0] == hss);
-                qntmp[iter.cnt] = iter.cid[id0] +
-                        iter.cid[id1] * gs->ss[id0].nrSecs + 
-                        iter.cid[0] * gs->ss[1].nrSecs * gs->ss[2].nrSecs;
+                const int ids[3] = {iter.cid[id0], iter.cid[id1], iter.cid[0]};
+                const int dims[3] = {
+                        gs->ss[id0].nrSecs, gs->ss[id1].nrSecs, gs->ss[0].nrSecs
+                };
+                qntmp[iter.cnt] = qn_combine(ids, dims);
                 dimtmp[iter.cnt] = iter.cdim;
                 assert(dimtmp[iter.cnt] >= 0 && "Maybe integer overflow?");
         }
@@ -320,7 +529,7 @@ static T3NS_BB_TYPE * nP_make_qnumbers_for_hss(struct rOperators * rops,
         QN_TYPE *qnrOps = rOperators_give_qnumbers_for_hss(rops, hss);
         for (int i = 0; i < N; ++i) {
                 qnrOps[i] = qntmp[idx[i]];
-                bb[i + 1] = dimtmp[idx[i]] + bb[i];
+                bb[i + 1] = slab_block_size(dimtmp[idx[i]]) + bb[i];
                 assert(bb[i + 1] >= 0 && "Maybe integer overflow?");
         }
         safe_free(qntmp);
@@ -353,6 +562,7 @@ static void init_nP_rOperators(struct rOperators * const rops,
         rops->is_left = is_left;
         rops->P_operator = 0;
         rops->nrhss = get_nr_hamsymsec();
+        rops->slab = NULL;
 
         safe_malloc(rops->begin_blocks_of_hss, rops->nrhss + 1);
 
@@ -371,7 +581,8 @@ static void init_nP_rOperators(struct rOperators * const rops,
         rops->hss_of_ops = NULL;
         rops->operators = NULL;
 
-#pragma omp parallel for schedule(dynamic) default(none) shared(gs,tmpbb)
+#pragma omp parallel for schedule(dynamic) default(none) shared(gs,tmpbb) \
+        copyin(t3ns_ctx)
         for (int hss = 0; hss < rops->nrhss; ++hss) {
                 (*tmpbb)[hss] = nP_make_qnumbers_for_hss(rops, &gs, hss);
         }
@@ -416,7 +627,8 @@ static struct qndarr * make_qndarr(struct rOperators * const rops)
         const int ibond = rops->is_left * 2;
         struct qndarr * const safe_malloc(res, sitegs.ss[ibond].nrSecs);
 
-#pragma omp parallel for schedule(dynamic) default(none) shared(ss, sitegs)
+#pragma omp parallel for schedule(dynamic) default(none) shared(ss, sitegs) \
+        copyin(t3ns_ctx)
         for (int i = 0; i < sitegs.ss[ibond].nrSecs; ++i) {
                 struct iter_gs iter = init_iter_gs(i, ibond, &sitegs);
                 res[i].L = iter.length;
@@ -446,9 +658,12 @@ static T3NS_BB_TYPE * P_make_qnumbers_for_hss(struct rOperators * rops,
                 assert(iter.cid[0] == hss);
                 const int bra = iter.cid[id0];
                 const int ket = iter.cid[id1];
-                const QN_TYPE MPOqnumber = bra +
-                        ket * intgs->ss[id0].nrSecs +
-                        hss * intgs->ss[id0].nrSecs * intgs->ss[id1].nrSecs;
+                const int ids[3] = {bra, ket, hss};
+                const int dims[3] = {
+                        intgs->ss[id0].nrSecs, intgs->ss[id1].nrSecs, 
+                        intgs->ss[0].nrSecs
+                };
+                const QN_TYPE MPOqnumber = qn_combine(ids, dims);
                 assert(iter.cdim == 1 && "Not all elements of dimarray_internal are equal to 1!");
 
                 const struct qndarr * qnket = &qna[ket];
@@ -476,7 +691,7 @@ static T3NS_BB_TYPE * P_make_qnumbers_for_hss(struct rOperators * rops,
                 qnrOps[i * 3 + 0] = qntmp[idx[i] * 3 + 0];
                 qnrOps[i * 3 + 1] = qntmp[idx[i] * 3 + 1];
                 qnrOps[i * 3 + 2] = qntmp[idx[i] * 3 + 2];
-                bb[i + 1] = dimtmp[idx[i]] + bb[i];
+                bb[i + 1] = slab_block_size(dimtmp[idx[i]]) + bb[i];
                 assert(bb[i + 1] >= 0 && "Maybe integer overflow?");
         }
 
@@ -493,6 +708,7 @@ static void init_P_rOperators(struct rOperators * const rops, T3NS_BB_TYPE *** t
         rops->is_left = is_left;
         rops->P_operator = 1;
         rops->nrhss = get_nr_hamsymsec();
+        rops->slab = NULL;
         assert(3 == rOperators_give_nr_of_couplings(rops));
 
         /* make sure that the dimensions of the internal bonds are all set = 1,
@@ -519,7 +735,8 @@ static void init_P_rOperators(struct rOperators * const rops, T3NS_BB_TYPE *** t
 
         safe_malloc(rops->qnumbers, rops->begin_blocks_of_hss[rops->nrhss] * 3);
         safe_malloc(*tmpbb, rops->nrhss);
-#pragma omp parallel for schedule(dynamic) default(none) shared(qna,intgs,tmpbb)
+#pragma omp parallel for schedule(dynamic) default(none) shared(qna,intgs,tmpbb) \
+        copyin(t3ns_ctx)
         for (int hss = 0; hss < rops->nrhss; ++hss) {
                 (*tmpbb)[hss] = P_make_qnumbers_for_hss(rops, &intgs, qna, hss);
         }
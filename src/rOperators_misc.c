@@ -22,6 +22,7 @@
 #include "network.h"
 #include "bookkeeper.h"
 #include "hamiltonian.h"
+#include "distributed.h"
 
 /* ========================================================================== */
 /* ==================== DECLARATION STATIC FUNCTIONS ======================== */
@@ -85,6 +86,18 @@ int nblocks_in_operator(const struct rOperators * const rops, const int op)
   return rOperators_give_nr_blocks_for_hss(rops, rops->hss_of_ops[op]);
 }
 
+void sum_rOperators_over_ranks(struct rOperators * const rops)
+{
+  if (get_nr_ranks() == 1)
+    return;
+
+  for (int op = 0; op < rops->nrops; ++op)
+  {
+    struct sparseblocks * const blocks = &rops->operators[op];
+    sum_over_ranks(blocks->tel, blocks->beginblock[nblocks_in_operator(rops, op)]);
+  }
+}
+
 QN_TYPE * rOperators_give_qnumbers_for_hss(const struct rOperators * const rops, const int hss)
 {
   const int nr_couplings = rOperators_give_nr_of_couplings(rops);
@@ -319,17 +332,15 @@ static void print_qnumber(const struct rOperators * const rops, const int op, co
 
   for (coup = 0; coup < nrcoup; ++coup)
   {
-    QN_TYPE ind = qnumberspointer[block * nrcoup + coup];
+    const QN_TYPE ind = qnumberspointer[block * nrcoup + coup];
     int bond;
     int currind[3];
+    indexize(currind, ind, &symarr[3 * coup]);
     for (bond = 0; bond < 3; ++bond)
     {
-      currind[bond] = ind % symarr[bond + 3 * coup].nrSecs;
-      ind             = ind / symarr[bond + 3 * coup].nrSecs;
       get_sectorstring(&symarr[bond + 3 * coup], currind[bond], buffer);
       printf("%14s %c", buffer,  bond != 2  ? '-' : '\n');
     }
-    assert(ind == 0);
   }
 }
 
@@ -20,10 +20,13 @@
 #include <assert.h>
 
 #include "rOperators.h"
+#include "numa_policy.h"
 #include "network.h"
 #include "instructions.h"
 #include "hamiltonian.h"
-#include "sort.h"
+#include "qnhash.h"
+#include "distributed.h"
+#include "trace.h"
 
 /*****************************************************************************/
 /******************** Updating Physical rOperators ***************************/
@@ -72,14 +75,14 @@ static struct rOperators init_updated_rOperators(struct rOperators * rops)
         init_rOperators(&urops, &tmpbb, rops->bond, rops->is_left, false);
         urops.nrops = rops->nrops;
         safe_malloc(urops.hss_of_ops, urops.nrops);
-        safe_malloc(urops.operators, urops.nrops);
+        const T3NS_BB_TYPE ** safe_malloc(bb, urops.nrops);
         for (int i = 0; i < rops->nrops; ++i) {
-                const int chss = rops->hss_of_ops[i];
-                const int nrbl = rOperators_give_nr_blocks_for_hss(&urops, chss);
-                struct sparseblocks * cBlock = &urops.operators[i];
-                urops.hss_of_ops[i] = chss;
-                init_sparseblocks(cBlock, tmpbb[chss], nrbl, 'c');
+                urops.hss_of_ops[i] = rops->hss_of_ops[i];
+                bb[i] = tmpbb[urops.hss_of_ops[i]];
         }
+        alloc_operators_rOperators(&urops, bb);
+        safe_free(bb);
+        first_touch_rOperators(&urops);
         for (int i = 0; i < urops.nrhss; ++i) { safe_free(tmpbb[i]); }
         safe_free(tmpbb);
 
@@ -96,6 +99,8 @@ struct udata {
         struct rOperators * ur;
         // The physical site Tensor with which to update
         const struct siteTensor * T;
+        // Index on the quantum numbers of T
+        struct qnhash Thash;
 
         // The symmetry sectors of the original physical rOperators
         // Order same as in qnumbers for rOperators with P_operator = 1
@@ -109,6 +114,8 @@ struct udata {
         int * oldtonew;
         // Which original blocks are needed for updated blocks?
         int * usb_to_osb;
+        // The irrep arithmetic and prefactors for the symmetries.
+        const struct symmetryKernels * kern;
 };
 
 static int * make_usb_to_osb(const struct udata * const dat)
@@ -148,11 +155,13 @@ static struct udata make_update_data(struct rOperators * urops,
                 .ur = urops,
                 .T = T,
                 .oldtonew = make_oldtonew(iss, rops->bond),
+                .kern = bookie.kernels,
         };
 
         int bonds[3];
         get_bonds_of_site(T->sites[0], bonds);
         get_symsecs_arr(3, dat.Tss, bonds);
+        init_qnhash(&dat.Thash, T->qnumbers, T->nrblocks, 1);
 
         // Free bond of siteTensor, Free bond of siteTensor, MPO
         dat.uss[0] = dat.Tss[dat.il ? 2 : 0];
@@ -179,11 +188,8 @@ static void cleanup_update(struct udata * dat)
 {
         safe_free(dat->oldtonew);
         safe_free(dat->usb_to_osb);
+        destroy_qnhash(&dat->Thash);
         destroy_rOperators(dat->or);
-        for (int i = 0; i < dat->ur->nrops; ++i) {
-                const int nbl = nblocks_in_operator(dat->ur, i);
-                kick_zero_blocks(&dat->ur->operators[i], nbl);
-        }
 }
 
 #define SITETENS 0
@@ -226,10 +232,8 @@ static bool select_site_blocks(struct update_aide * aide,
         const QN_TYPE Tqn = qntypize(Tids[0], dat->Tss);
         const QN_TYPE Thqn = qntypize(Tids[1], dat->Tss);
 
-        const int Tsb = binSearch(&Tqn, dat->T->qnumbers, dat->T->nrblocks, 
-                                  SORT_QN_TYPE, sizeof Tqn);
-        const int Thsb = binSearch(&Thqn, dat->T->qnumbers, dat->T->nrblocks, 
-                                   SORT_QN_TYPE, sizeof Thqn);
+        const int Tsb = search_qnhash(&Tqn, &dat->Thash);
+        const int Thsb = search_qnhash(&Thqn, &dat->Thash);
         // Block was not found
         if (Tsb == -1 || Thsb == -1) { return false; }
 
@@ -263,10 +267,11 @@ static bool select_site_blocks(struct update_aide * aide,
                 }
         }
 
-        aide->pref = prefactor_adjoint(irrep_arr[0], (char) (dat->il ? '3' : '1'),
-                                      bookie.sgs, bookie.nrSyms);
-        aide->pref *= prefactor_pUpdate(irrep_arr, dat->il, 
-                                       bookie.sgs, bookie.nrSyms);
+        aide->pref = dat->kern->prefactor_adjoint(irrep_arr[0], 
+                                                  (char) (dat->il ? '3' : '1'),
+                                                  bookie.sgs, bookie.nrSyms);
+        aide->pref *= dat->kern->prefactor_pUpdate(irrep_arr, dat->il, 
+                                                   bookie.sgs, bookie.nrSyms);
         return true;
 }
 
@@ -351,8 +356,8 @@ static void pUpdate_block(const struct udata * dat, int usb)
                                 continue;
                         }
 
-                        assert(get_size_block(oop, osb2) == aide.M[0] * aide.M[1]);
-                        assert(get_size_block(uop, usb2) == aide.N[0] * aide.N[1]);
+                        assert(block_has_size(oop, osb2, aide.M[0] * aide.M[1]));
+                        assert(block_has_size(uop, usb2, aide.N[0] * aide.N[1]));
 
                         do_contract(&aide.cinfo[0], aide.els, 1, 0);
                         do_contract(&aide.cinfo[1], aide.els, aide.pref, 1);
@@ -377,12 +382,27 @@ void update_rOperators_physical(struct rOperators * rops,
         struct udata dat = make_update_data(&urops, rops, tens, internalss);
 
         // Loop over the different symmetryblocks of the new rOperators.
-#pragma omp parallel for schedule(dynamic) default(none) shared(urops, dat)
-        for (int usb = 0; usb < urops.begin_blocks_of_hss[urops.nrhss]; ++usb) {
-                pUpdate_block(&dat, usb);
+        // With several processes, each one makes a part of the blocks.
+#pragma omp parallel default(none) shared(urops, dat) copyin(t3ns_ctx)
+        {
+                const double start = trace_now();
+                int items = 0;
+                // Every thread fills the blocks it placed in first_touch_rOperators.
+                int first, last;
+                thread_block_range(urops.begin_blocks_of_hss[urops.nrhss],
+                                   &first, &last);
+                for (int usb = first; usb < last; ++usb) {
+                        if (is_my_work(usb)) { 
+                                pUpdate_block(&dat, usb); 
+                                ++items;
+                        }
+                }
+                trace_span("rOperators: update physical blocks", start, items);
         }
+        sum_rOperators_over_ranks(&urops);
         
         cleanup_update(&dat);
+        pack_rOperators(&urops);
         *rops = urops;
 }
 
@@ -412,15 +432,11 @@ static void init_unique_rOperators(struct rOperators * ur, int bond, bool il,
         assert(count == ur->nrops);
 
         // initializing the stensors
-        safe_malloc(ur->operators, ur->nrops);
-        for (int i = 0; i < ur->nrops; ++i) {
-                // The current operator and current hamsymsec
-                struct sparseblocks * cBlock = &ur->operators[i];
-                int chss = ur->hss_of_ops[i];
-                int nrbl = rOperators_give_nr_blocks_for_hss(ur, chss);
-
-                init_sparseblocks(cBlock, tmpbb[chss], nrbl, 'c');
-        }
+        const T3NS_BB_TYPE ** safe_malloc(bb, ur->nrops);
+        for (int i = 0; i < ur->nrops; ++i) { bb[i] = tmpbb[ur->hss_of_ops[i]]; }
+        alloc_operators_rOperators(ur, bb);
+        safe_free(bb);
+        first_touch_rOperators(ur);
         for (int i = 0; i < ur->nrhss; ++i) { safe_free(tmpbb[i]); }
         safe_free(tmpbb);
 }
@@ -466,6 +482,8 @@ struct append_data {
         struct rOperators ur;
         // The original renormalized operators
         struct rOperators or;
+        // Index on the quantum numbers of every MPO symsec of or
+        struct qnhash * ohash;
         // The compressed instructionset
         struct instructionset cinstr;
 
@@ -487,6 +505,8 @@ struct append_data {
          *      bra(β), ket(β), MPO(β)
          */
         struct symsecs oss[3];
+        // The irrep arithmetic and prefactors for the symmetries.
+        const struct symmetryKernels * kern;
 };
 
 static struct append_data init_append_data(const struct rOperators * or,
@@ -495,6 +515,8 @@ static struct append_data init_append_data(const struct rOperators * or,
         struct append_data ad = {
                 .site = netw.bonds[or->bond][or->is_left],
                 .or = *or,
+                .ohash = init_qnhash_rOperators(or),
+                .kern = bookie.kernels,
         };
         assert(is_psite(ad.site));
 
@@ -532,6 +554,7 @@ static struct append_data init_append_data(const struct rOperators * or,
 static void destroy_append_data(struct append_data * ad)
 {
         destroy_instructionset(&ad->cinstr);
+        destroy_qnhash_rOperators(&ad->ohash, &ad->or);
 }
 
 static void pAppend_block(const struct append_data * dat, int usb)
@@ -593,12 +616,11 @@ static void pAppend_block(const struct append_data * dat, int usb)
                 for (int j = 0; j < 3; ++j) {
                         irr[2][j] = dat->MPOss[j].irreps[ids[2][j]];
                 }
-                const double pref = prefactor_pAppend(irr, dat->ur.is_left,
-                                                      bookie.sgs, bookie.nrSyms);
+                const double pref = 
+                        dat->kern->prefactor_pAppend(irr, dat->ur.is_left,
+                                                     bookie.sgs, bookie.nrSyms);
 
-                const QN_TYPE * oqn_arr = rOperators_give_qnumbers_for_hss(&dat->or, hsso);
-                const int nbl = rOperators_give_nr_blocks_for_hss(&dat->or, hsso);
-                const int oblock = binSearch(&oqn, oqn_arr, nbl, SORT_QN_TYPE, sizeof oqn);
+                const int oblock = search_qnhash(&oqn, &dat->ohash[hsso]);
 
                 /* symsec not found */
                 if (oblock == -1 || COMPARE_ELEMENT_TO_ZERO(pref)) { continue; }
@@ -628,7 +650,8 @@ static void pAppend_block(const struct append_data * dat, int usb)
 
                         T3NS_EL_TYPE * oTel = get_tel_block(oBlock, oblock);
                         T3NS_EL_TYPE * uTel = get_tel_block(uBlock, ublock);
-                        assert(N == 0 || N == get_size_block(uBlock, ublock));
+                        assert(N == 0 || slab_block_size(N) == 
+                               slab_block_size(get_size_block(uBlock, ublock)));
 
                         for (int j = 0; j < N; ++j) { uTel[j] = site_el * oTel[j]; }
                 }
@@ -653,9 +676,19 @@ static struct rOperators unique_rOperators_ap(const struct rOperators * or,
         struct append_data ad = init_append_data(or, set);
 
         // Loop over different symsecs of uniquerops.
-#pragma omp parallel for schedule(dynamic) default(none) shared(ad)
-        for (int usb = 0; usb < ad.ur.begin_blocks_of_hss[ad.ur.nrhss]; ++usb) {
-                pAppend_block(&ad, usb);
+#pragma omp parallel default(none) shared(ad) copyin(t3ns_ctx)
+        {
+                const double start = trace_now();
+                int items = 0;
+                // Every thread fills the blocks it placed in first_touch_rOperators.
+                int first, last;
+                thread_block_range(ad.ur.begin_blocks_of_hss[ad.ur.nrhss],
+                                   &first, &last);
+                for (int usb = first; usb < last; ++usb) {
+                        pAppend_block(&ad, usb);
+                        ++items;
+                }
+                trace_span("rOperators: append physical blocks", start, items);
         }
 
         destroy_append_data(&ad);
@@ -0,0 +1,243 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <argp.h>
+#include <omp.h>
+
+#include "io_to_disk.h"
+#include "macros.h"
+#include "options.h"
+#include "network.h"
+#include "bookkeeper.h"
+#include "hamiltonian.h"
+#include "instructions.h"
+#include "Heff.h"
+#include "wrapper_solvers.h"
+#include "timers.h"
+#include "distributed.h"
+
+#ifdef T3NS_WITH_PRIMME
+#define SOLVER_STRING "PRIMME"
+#else
+#define SOLVER_STRING "D"
+#endif
+
+#define MAX_THREAD_COUNTS 32
+
+static char doc[] =
+"T3NS-replay -- Replays the effective Hamiltonian of a single optimization step.\n"
+"\n"
+"The snapshot is written by T3NS with the option \'snapshot\' in the input file.\n"
+"For every number of threads, the effective Hamiltonian is prepared and the\n"
+"matrix-vector product is timed. The first product also makes the plan for\n"
+"the next ones and is reported separately.";
+
+static char args_doc[] = "SNAPSHOT_FILE";
+
+static struct argp_option options[] = {
+        {"threads", 't', "LIST", 0, "Comma separated list of the numbers of threads to use. "
+                "Default is the number of threads given by OMP_NUM_THREADS."},
+        {"matvecs", 'n', "int", 0, "The number of timed matrix-vector products. Default is 20."},
+        {"eigensolver", 'e', 0, 0, "Also solve for the lowest eigenvalue, starting from the saved vector."},
+        {0}
+};
+
+struct arguments {
+        int threads[MAX_THREAD_COUNTS];
+        int nr_threads;
+        int matvecs;
+        bool eigensolver;
+        char * snapshot;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+        struct arguments *arguments = state->input;
+
+        switch (key) {
+        case 't':
+                arguments->nr_threads = 0;
+                for (char * pch = strtok(arg, ","); pch != NULL;
+                     pch = strtok(NULL, ",")) {
+                        if (arguments->nr_threads == MAX_THREAD_COUNTS ||
+                            atoi(pch) < 1) { argp_usage(state); }
+                        arguments->threads[arguments->nr_threads++] = atoi(pch);
+                }
+                break;
+        case 'n':
+                arguments->matvecs = atoi(arg);
+                if (arguments->matvecs < 1) { argp_usage(state); }
+                break;
+        case 'e':
+                arguments->eigensolver = true;
+                break;
+        case ARGP_KEY_ARG:
+                if (state->arg_num >= 1) { argp_usage(state); }
+                arguments->snapshot = arg;
+                break;
+        case ARGP_KEY_END:
+                if (state->arg_num < 1) { argp_usage(state); }
+                break;
+        default:
+                return ARGP_ERR_UNKNOWN;
+        }
+        return 0;
+}
+
+static double now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void * a, const void * b)
+{
+        const double x = *(const double *) a;
+        const double y = *(const double *) b;
+        return (x > y) - (x < y);
+}
+
+// Counts the matrix-vector products done by the eigensolver.
+struct counted_Heff {
+        struct Heffdata * data;
+        int matvecs;
+};
+
+static void counted_matvec(const double * vec, double * result, void * vdata)
+{
+        struct counted_Heff * c = vdata;
+        ++c->matvecs;
+        matvecT3NS(vec, result, c->data);
+}
+
+static void replay(const struct arguments * arguments, int threads,
+                   const struct siteTensor * siteObject,
+                   const struct rOperators * Operators,
+                   const T3NS_EL_TYPE * vec)
+{
+#ifdef _OPENMP
+        omp_set_num_threads(threads);
+#endif
+        const int size = siteTensor_get_size(siteObject);
+        T3NS_EL_TYPE * safe_malloc(result, size);
+        struct Heffdata data;
+
+        double t = now();
+        init_Heffdata(&data, Operators, siteObject);
+        const double t_init = now() - t;
+
+        t = now();
+        matvecT3NS(vec, result, &data);
+        const double t_first = now() - t;
+
+        double * safe_malloc(samples, arguments->matvecs);
+        const struct perf_counters start = get_perf_counters();
+        for (int i = 0; i < arguments->matvecs; ++i) {
+                t = now();
+                matvecT3NS(vec, result, &data);
+                samples[i] = now() - t;
+        }
+        const double flops = (get_perf_counters().flops - start.flops) /
+                arguments->matvecs;
+        qsort(samples, arguments->matvecs, sizeof samples[0], compare_doubles);
+        const double median = samples[arguments->matvecs / 2];
+
+        double norm = 0;
+        for (int i = 0; i < size; ++i) { norm += result[i] * result[i]; }
+
+        printf("%7d %10.3e %10.3e %10.3e %10.3e %9.2f  %.12e\n", threads,
+               t_init, t_first, median, samples[0], flops / median * 1e-9,
+               sqrt(norm));
+
+        if (arguments->eigensolver) {
+                struct counted_Heff c = { .data = &data, .matvecs = 0 };
+                for (int i = 0; i < size; ++i) { result[i] = vec[i]; }
+                t = now();
+                T3NS_EL_TYPE * diagonal = make_diagonal(&data);
+                double energy;
+                sparse_eigensolve(result, &energy, size, DAVIDSON_MAX_VECS,
+                                  DAVIDSON_KEEP_DEFLATE, DEFAULT_SOLVER_TOL,
+                                  DEFAULT_SOLVER_MAX_ITS, diagonal,
+                                  counted_matvec, &c, SOLVER_STRING, 0);
+                printf("        eigensolver: %.3e s, %d matvecs, energy %.12lf\n",
+                       now() - t, c.matvecs, energy);
+                safe_free(diagonal);
+        }
+
+        safe_free(samples);
+        safe_free(result);
+        destroy_Heffdata(&data);
+}
+
+int main(int argc, char *argv[])
+{
+        init_distributed(&argc, &argv);
+#ifdef _OPENMP
+        const int max_threads = omp_get_max_threads();
+#else
+        const int max_threads = 1;
+#endif
+        struct argp argp = {options, parse_opt, args_doc, doc};
+        struct arguments arguments = {
+                .threads = { max_threads },
+                .nr_threads = 1,
+                .matvecs = 20,
+                .eigensolver = false,
+                .snapshot = NULL
+        };
+        argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+        struct siteTensor siteObject;
+        struct rOperators Operators[3];
+        T3NS_EL_TYPE * vec;
+        if (read_Heff_snapshot(arguments.snapshot, &siteObject, Operators,
+                               &vec)) {
+                finalize_distributed();
+                return EXIT_FAILURE;
+        }
+        const bool isdmrg = Operators[2].bond == -1;
+
+        printf(">> Replaying %s: %s Heff of site%s", arguments.snapshot,
+               isdmrg ? "DMRG" : "T3NS", siteObject.nrsites == 1 ? "" : "s");
+        for (int i = 0; i < siteObject.nrsites; ++i) {
+                printf(" %d", siteObject.sites[i]);
+        }
+        printf(" (blocks: %d, dim: %d)\n\n", siteObject.nrblocks,
+               (int) siteTensor_get_size(&siteObject));
+        printf("%7s %10s %10s %10s %10s %9s  %s\n", "threads", "init (s)",
+               "first (s)", "median (s)", "min (s)", "GFLOP/s", "|H v|");
+
+        for (int i = 0; i < arguments.nr_threads; ++i) {
+                replay(&arguments, arguments.threads[i], &siteObject,
+                       Operators, vec);
+        }
+
+        safe_free(vec);
+        destroy_siteTensor(&siteObject);
+        for (int i = 0; i < 3; ++i) { destroy_rOperators(&Operators[i]); }
+        clear_instructions();
+        destroy_bookkeeper(&bookie);
+        destroy_network(&netw);
+        destroy_hamiltonian();
+        finalize_distributed();
+        return EXIT_SUCCESS;
+}
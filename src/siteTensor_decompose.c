@@ -36,6 +36,23 @@
 
 #define ALPHA 0.25
 
+/* Settings of the randomized SVD (see svdblocks_randomized).
+ * It is only tried if the sector is at least RSVD_MIN_RATIO times larger
+ * than the number of singular values asked. */
+#define RSVD_OVERSAMPLING 10
+#define RSVD_POWER_ITS 2
+#define RSVD_MIN_RATIO 2
+
+/* Settings of the Gram matrix path (see svdblocks_gram).
+ * If asked for (SvalSelect.gram), it is used if one dimension of the sector is at least GRAM_MIN_ASPECT times
+ * the other. Its result is kept if the ratio between the largest and the
+ * smallest kept singular value of the sector is at most GRAM_MAX_COND, the
+ * error of the Gram matrix grows with the square of this ratio. */
+#define GRAM_MIN_ASPECT 4
+#define GRAM_MAX_COND 1e4
+// Rows or columns per panel when the long singular vectors are made in place.
+#define GRAM_PANEL 256
+
 //#define T3NS_SITETENSOR_DECOMPOSE_DEBUG
 
 static int * sort_indices(int (*indices)[3], int n, int b)
@@ -130,15 +147,13 @@ static void make_Q(struct qrdata * dat)
                 dat->Q->sites[i] = dat->A->sites[i]; 
         }
         dat->Q->nrblocks = dat->A->nrblocks;
-        safe_malloc(dat->Q->qnumbers, dat->Q->nrblocks * dat->Q->nrsites);
+        siteTensor_alloc_meta(dat->Q);
         for (int i = 0; i < dat->Q->nrsites * dat->Q->nrblocks; ++i) {
                 dat->Q->qnumbers[i] = dat->A->qnumbers[i];
         }
 
         // Initialize the sparseblocks of Q
-        safe_calloc(dat->Q->blocks.beginblock, dat->Q->nrblocks + 1);
-
-#pragma omp parallel for schedule(dynamic) shared(dat)
+#pragma omp parallel for schedule(dynamic) shared(dat) copyin(t3ns_ctx)
         for (int block = 0; block < dat->nrRblocks; ++block) {
                 int M, N, minMN;
                 getQRdimensions(dat, &M, &N, &minMN, block);
@@ -162,7 +177,7 @@ static void make_Q(struct qrdata * dat)
                 dat->Q->blocks.beginblock[i + 1] += dat->Q->blocks.beginblock[i];
                 assert(dat->Q->blocks.beginblock[i + 1] >= 0 && "Integer overflow?");
         }
-        safe_malloc(dat->Q->blocks.tel, dat->Q->blocks.beginblock[dat->Q->nrblocks]);
+        siteTensor_alloc_tel(dat->Q, 'm');
 }
 
 static struct qrdata init_qrdata(struct siteTensor * A, struct siteTensor * Q, 
@@ -267,6 +282,33 @@ static void QR_copy_fromto_mem(struct qrdata * dat, T3NS_EL_TYPE * mem, int Rblo
         assert(cmem - mem == ldmem);
 }
 
+/* Returns the block of Q in which the QR of Rblock can be done in place.
+ *
+ * This is possible if Rblock consists of a single block of A which has no
+ * legs after the bond, i.e. it is already a column-major M x N matrix, and if
+ * Q has the same size (M >= N). Otherwise NULL is returned. */
+static T3NS_EL_TYPE * QR_in_place_block(struct qrdata * dat, int Rblock, 
+                                        int M, int N)
+{
+        if (dat->Q == NULL || M < N) { return NULL; }
+        if (dat->idstart[Rblock + 1] - dat->idstart[Rblock] != 1) { 
+                return NULL; 
+        }
+
+        const int id = dat->idperm[dat->idstart[Rblock]];
+        for (int i = dat->bond + 1; i < 3; ++i) {
+                if (dat->symarr[i].dims[dat->indices[id][i]] != 1) { 
+                        return NULL; 
+                }
+        }
+        assert(get_size_block(&dat->A->blocks, id) == M * N);
+        assert(get_size_block(&dat->Q->blocks, id) == M * N);
+
+        T3NS_EL_TYPE * mem = get_tel_block(&dat->Q->blocks, id);
+        cblas_dcopy(M * N, get_tel_block(&dat->A->blocks, id), 1, mem, 1);
+        return mem;
+}
+
 static int qrblocks(struct qrdata * dat, int Rblock)
 {
         int M, N, minMN;
@@ -277,16 +319,20 @@ static int qrblocks(struct qrdata * dat, int Rblock)
         }
         assert(dat->symarr[dat->bond].dims[Rblock] == N);
 
-        const int memsize = M * N;
-        T3NS_EL_TYPE * safe_malloc(mem, memsize);
-        QR_copy_fromto_mem(dat, mem, Rblock, M, N, TO_MEMORY);
+        // Only gather the blocks in working memory if needed.
+        T3NS_EL_TYPE * mem = QR_in_place_block(dat, Rblock, M, N);
+        const bool in_place = mem != NULL;
+        if (!in_place) {
+                safe_malloc(mem, M * N);
+                QR_copy_fromto_mem(dat, mem, Rblock, M, N, TO_MEMORY);
+        }
 
         T3NS_EL_TYPE * safe_malloc(tau, minMN);
         int info = LAPACKE_dgeqrf(LAPACK_COL_MAJOR, M, N, mem, M, tau);
         if (info) {
                 fprintf(stderr, "%d %d %p %p\n", M, N, (void *) mem, (void *) tau);
                 fprintf(stderr, "dgeqrf exited with %d.\n", info);
-                safe_free(mem);
+                if (!in_place) { safe_free(mem); }
                 safe_free(tau);
                 return 1;
         }
@@ -295,17 +341,19 @@ static int qrblocks(struct qrdata * dat, int Rblock)
         info = LAPACKE_dorgqr(LAPACK_COL_MAJOR, M, minMN, minMN, mem, M, tau);
         if (info) {
                 fprintf(stderr, "dorgqr exited with %d.\n", info);
-                safe_free(mem);
+                if (!in_place) { safe_free(mem); }
                 safe_free(tau);
                 return 1;
         }
-        QR_copy_fromto_mem(dat, mem, Rblock, M, minMN, FROM_MEMORY);
+        if (!in_place) {
+                QR_copy_fromto_mem(dat, mem, Rblock, M, minMN, FROM_MEMORY);
+                safe_free(mem);
+        }
 
         // change the dimension in the bookkeeper
         assert(M >= minMN);
         dat->symarr[dat->bond].dims[Rblock] = minMN;
 
-        safe_free(mem);
         safe_free(tau);
         return 0;
 }
@@ -319,7 +367,8 @@ int qr(struct siteTensor * A, int bond,
         struct qrdata dat = init_qrdata(A, Q, R, bond);
 
         int erflag = 0;
-#pragma omp parallel for schedule(dynamic) default(none) shared(erflag, dat)
+#pragma omp parallel for schedule(dynamic) default(none) shared(erflag, dat) \
+        copyin(t3ns_ctx)
         for (int block = 0; block < dat.nrRblocks; ++block) {
                 if (!erflag && qrblocks(&dat, block) != 0) { erflag = 1; }
         }
@@ -373,26 +422,22 @@ static void makeB(const struct siteTensor * const A, const int bondA,
         struct symsecs symarr[3];
         get_bonds_of_site(A->sites[0], legs);
         get_symsecs_arr(3, symarr, legs);
-        QN_TYPE divide = 1;
-        for (int i = 0; i < bondA; ++i) { divide *= symarr[i].nrSecs; }
-        const int modulo = symarr[bondA].nrSecs;
+        const int dims[3] = {
+                symarr[0].nrSecs, symarr[1].nrSecs, symarr[2].nrSecs
+        };
 
         assert(A->nrsites == 1);
         B->nrsites = A->nrsites;
         for (int i = 0; i < B->nrsites; ++i) { B->sites[i] = A->sites[i]; }
         B->nrblocks = A->nrblocks;
-        safe_malloc(B->qnumbers, B->nrblocks * B->nrsites);
+        siteTensor_alloc_meta(B);
         for (int i = 0; i < B->nrblocks * B->nrsites; ++i) {
                 B->qnumbers[i] = A->qnumbers[i];
         }
-        safe_malloc(B->blocks.beginblock, B->nrblocks + 1);
-        B->blocks.beginblock[0] = 0;
-#pragma omp parallel for schedule(static) shared(divide,B,symarr)
+#pragma omp parallel for schedule(static) shared(B,symarr) copyin(t3ns_ctx)
         for (int i = 0; i < B->nrblocks; ++i) {
                 const int sizeA = get_size_block(&A->blocks, i);
-                QN_TYPE id = B->qnumbers[i];
-                id /= divide;
-                id %= modulo;
+                const int id = qn_index(B->qnumbers[i], bondA, dims);
                 assert(R->dims[id][0] == symarr[bondA].dims[id]);
                 if(R->dims[id][0] == 0) {
                         B->blocks.beginblock[i + 1] = 0;
@@ -408,7 +453,7 @@ static void makeB(const struct siteTensor * const A, const int bondA,
                 B->blocks.beginblock[i + 1] += B->blocks.beginblock[i];
                 assert(B->blocks.beginblock[i + 1] >= 0 && "Integer overflow?");
         }
-        safe_malloc(B->blocks.tel, B->blocks.beginblock[B->nrblocks]);
+        siteTensor_alloc_tel(B, 'm');
 }
 
 // It is possible to do this bit more efficient by using dtrmm instead of dgemm
@@ -435,18 +480,14 @@ int multiplyR(struct siteTensor * A, const int bondA,
 
         makeB(A, bondA, R, bondR, B);
 
-#pragma omp parallel for schedule(dynamic) shared(A,B,R,symarr,legs,dims)
+#pragma omp parallel for schedule(dynamic) shared(A,B,R,symarr,legs,dims) \
+        copyin(t3ns_ctx)
         for (int block = 0; block < B->nrblocks; ++block) {
                 struct contractinfo cinfo;
 
                 // get of symsecs of block
-                QN_TYPE qn = B->qnumbers[block];
                 int id[3];
-                id[0] = qn % dims[0];
-                qn /= dims[0];
-                id[1] = qn % dims[1];
-                id[2] = qn / dims[1];
-                assert(id[2] < dims[2]);
+                qn_split(id, B->qnumbers[block], dims);
 
                 T3NS_EL_TYPE * tels[] = {
                         get_tel_block(&A->blocks, block),
@@ -490,6 +531,82 @@ int multiplyR(struct siteTensor * A, const int bondA,
         return 0;
 }
 
+static int transitionblock(const struct Rmatrix * Rold, 
+                           const struct Rmatrix * Rnew, double cutoff,
+                           struct Rmatrix * P, int block)
+{
+        const int M = Rold->dims[block][0];
+        const int N = Rold->dims[block][1];
+        const int K = Rnew->dims[block][0];
+        // Rnew is empty if the sector is not present anymore in the new tensor
+        assert(Rnew->dims[block][1] == M || K == 0);
+
+        P->dims[block][0] = N;
+        P->dims[block][1] = K;
+        P->Rels[block] = NULL;
+        if (N == 0 || K == 0) { return 0; }
+        safe_calloc(P->Rels[block], N * K);
+        if (M == 0) { return 0; }
+
+        // Rold = U S VT
+        const int minMN = M < N ? M : N;
+        T3NS_EL_TYPE * safe_malloc(mem, M * N);
+        T3NS_EL_TYPE * safe_malloc(U, M * minMN);
+        T3NS_EL_TYPE * safe_malloc(VT, minMN * N);
+        T3NS_EL_TYPE * safe_malloc(S, minMN);
+        T3NS_EL_TYPE * safe_malloc(W, minMN * K);
+        for (int i = 0; i < M * N; ++i) { mem[i] = Rold->Rels[block][i]; }
+
+        int info = LAPACKE_dgesdd(LAPACK_COL_MAJOR, 'S', M, N, mem, M, S, 
+                                  U, M, VT, minMN);
+        if (info) { fprintf(stderr, "dgesdd exited with %d.\n", info); }
+
+        if (!info) {
+                // W = S^+ U^T Rnew^T
+                cblas_dgemm(CblasColMajor, CblasTrans, CblasTrans, minMN, K, M,
+                            1, U, M, Rnew->Rels[block], K, 0, W, minMN);
+                for (int i = 0; i < minMN; ++i) {
+                        const double sinv = S[i] > cutoff * S[0] ? 1 / S[i] : 0;
+                        cblas_dscal(K, sinv, W + i, minMN);
+                }
+                // P = V W
+                cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, N, K, minMN,
+                            1, VT, minMN, W, minMN, 0, P->Rels[block], N);
+        }
+
+        safe_free(mem);
+        safe_free(U);
+        safe_free(VT);
+        safe_free(S);
+        safe_free(W);
+        return info != 0;
+}
+
+int R_transition(const struct Rmatrix * Rold, const struct Rmatrix * Rnew,
+                 double cutoff, struct Rmatrix * P)
+{
+        assert(Rold->bond == Rnew->bond && Rold->nrblocks == Rnew->nrblocks);
+        P->bond = Rold->bond;
+        P->nrblocks = Rold->nrblocks;
+        safe_malloc(P->dims, P->nrblocks);
+        safe_calloc(P->Rels, P->nrblocks);
+
+        int erflag = 0;
+#pragma omp parallel for schedule(dynamic) default(none) \
+        shared(erflag, Rold, Rnew, cutoff, P) copyin(t3ns_ctx)
+        for (int block = 0; block < P->nrblocks; ++block) {
+                if (transitionblock(Rold, Rnew, cutoff, P, block)) { 
+                        erflag = 1; 
+                }
+        }
+
+        if (erflag) {
+                fprintf(stderr, "Making the transition matrix failed.\n");
+                destroy_Rmatrix(P);
+        }
+        return erflag;
+}
+
 static int orthoblock(struct qrdata * dat, int Rblock)
 {
         int M, N, minMN;
@@ -537,7 +654,8 @@ int is_orthogonal(struct siteTensor * Q, const int bond)
         struct qrdata dat = init_qrdata(Q, NULL, NULL, bond);
 
         int orthoflag = 1;
-#pragma omp parallel for schedule(dynamic) default(none) shared(orthoflag, dat)
+#pragma omp parallel for schedule(dynamic) default(none) shared(orthoflag, dat) \
+        copyin(t3ns_ctx)
         for (int block = 0; block < dat.nrRblocks; ++block) {
                 if (orthoflag && !orthoblock(&dat, block)) { orthoflag = 0; }
         }
@@ -621,6 +739,9 @@ struct svddata {
         // V-tensor from SVD.
         struct siteTensor * V;
 
+        // Selection criteria, decides if the randomized SVD can be used.
+        const struct SvalSelect * sel;
+
         // number of symmetry sectors in the bond.
         int nrSss;
         // Information for each symmetry sector in the cutted bond.
@@ -645,7 +766,8 @@ struct svd_bond_info {
          *
          * > [0, m[0], m[0] + m[1], m[0] + m[1] + m[2],...] */
         int * Mstart;
-        // Allocated memory for U
+        /* U of the sector, M x dimS column-major.
+         * If M >= N, the sector itself is gathered in here before the SVD. */
         T3NS_EL_TYPE * memU;
 
         /* Permutation array which groups the blocks in VT with the same 
@@ -659,8 +781,15 @@ struct svd_bond_info {
          *
          * > [0, n[0], n[0] + n[1], n[0] + n[1] + n[2],...] */
         int * Nstart;
-        // Allocated memory for VT
+        /* VT of the sector, dimS x N column-major.
+         * If M < N, the sector itself is gathered in here before the SVD. */
         T3NS_EL_TYPE * memVT;
+
+        /* Weight of the singular values which were not calculated.
+         * Only nonzero if the randomized SVD is used. */
+        double tail;
+        // How the sector is decomposed.
+        enum svd_method method;
 };
 
 static void destroy_svd_bond_info(struct svd_bond_info * info)
@@ -694,8 +823,8 @@ static struct siteTensor init_splitted_tens(const struct siteTensor * A,
         }
 
         // First worst case guess
-        safe_malloc(result.qnumbers, A->nrblocks * result.nrsites);
         result.nrblocks = A->nrblocks;
+        siteTensor_alloc_meta(&result);
         // Copy all
         for (int i = 0; i < A->nrblocks; ++i) {
                 QN_TYPE * qn_o = &A->qnumbers[i * A->nrsites];
@@ -728,15 +857,12 @@ static int calc_block_size(struct symsecs(*symarr)[3], const QN_TYPE * qnarr,
 
 static void make_r_count_svdinfos(struct svddata * dat, int make)
 {
-        QN_TYPE divide = 1;
-        int mod = dat->symarr[dat->id_siteV][dat->id_bond].nrSecs;
-        for (int i = 0; i < dat->id_bond; ++i) {
-                divide *= dat->symarr[dat->id_siteV][i].nrSecs;
-        }
+        const struct symsecs * ssV = dat->symarr[dat->id_siteV];
+        const int dimsV[3] = {ssV[0].nrSecs, ssV[1].nrSecs, ssV[2].nrSecs};
         for (int i = 0; i < dat->A->nrblocks; ++i) {
                 const QN_TYPE qn = dat->A->qnumbers[i * dat->A->nrsites +
                         dat->id_siteV];
-                const int ssid = (qn / divide) % mod;
+                const int ssid = qn_index(qn, dat->id_bond, dimsV);
                 struct svd_bond_info * inf = &dat->ss_info[ssid];
                 if (!make) { 
                         ++inf->idpermAsize;
@@ -757,14 +883,12 @@ static void make_r_count_svdinfos(struct svddata * dat, int make)
         }
         const int id_csite = dat->id_csite - (dat->id_csite > dat->id_siteV);
         assert(dat->U->sites[id_csite] == dat->A->sites[dat->id_csite]);
-        divide = 1;
-        for (int i = 0; i < dat->id_cbond; ++i) {
-                divide *= dat->symarr[dat->id_csite][i].nrSecs;
-        }
-        mod = dat->symarr[dat->id_csite][dat->id_cbond].nrSecs;
+        const struct symsecs * ssC = dat->symarr[dat->id_csite];
+        const int dimsC[3] = {ssC[0].nrSecs, ssC[1].nrSecs, ssC[2].nrSecs};
         for (int i = 0; i < dat->U->nrblocks; ++i) {
                 const QN_TYPE * qnarr = &dat->U->qnumbers[i * dat->U->nrsites];
-                const int ssid = (qnarr[id_csite] / divide) % mod;
+                const int ssid = qn_index(qnarr[id_csite], dat->id_cbond, 
+                                          dimsC);
                 struct svd_bond_info * inf = &dat->ss_info[ssid];
                 if (!make) {
                         ++inf->Msecs;
@@ -776,14 +900,9 @@ static void make_r_count_svdinfos(struct svddata * dat, int make)
                 ++inf->Msecs;
         }
 
-        divide = 1;
-        for (int i = 0; i < dat->id_bond; ++i) {
-                divide *= dat->symarr[dat->id_siteV][i].nrSecs;
-        }
-        mod = dat->symarr[dat->id_siteV][dat->id_bond].nrSecs;
         for (int i = 0; i < dat->V->nrblocks; ++i) {
                 const QN_TYPE qn = dat->V->qnumbers[i];
-                const int ssid = (qn / divide) % mod;
+                const int ssid = qn_index(qn, dat->id_bond, dimsV);
                 struct svd_bond_info * inf = &dat->ss_info[ssid];
                 if (!make) {
                         ++inf->Nsecs;
@@ -808,6 +927,10 @@ static void make_svdinfos(struct svddata * dat)
                 inf->idpermAsize = 0;
                 inf->Msecs = 0;
                 inf->Nsecs = 0;
+                inf->tail = 0;
+                inf->method = SVD_DGESDD;
+                inf->memU = NULL;
+                inf->memVT = NULL;
         }
         make_r_count_svdinfos(dat, 0);
         for (int ss = 0; ss < dat->nrSss; ++ss) {
@@ -836,16 +959,16 @@ static void make_svdinfos(struct svddata * dat)
                 dat->S->dimS[ss][0] = dimS;
                 dat->S->dimS[ss][1] = 0;
                 safe_malloc(dat->S->sing[ss], dimS);
-                safe_malloc(inf->memU, dimS * M);
-                safe_malloc(inf->memVT, dimS * N);
         }
 }
 
 static struct svddata init_svddata(const struct siteTensor * A, int site, 
                                    struct siteTensor * U, struct Sval * S, 
-                                   struct siteTensor * V)
+                                   struct siteTensor * V,
+                                   const struct SvalSelect * sel)
 {
         struct svddata result;
+        result.sel = sel;
         result.A = A;
         result.U = U;
         result.V = V;
@@ -997,11 +1120,11 @@ static void SVD_copy_to_mem(struct svddata * dat, const int ssid,
 }
 
 // Copies and permutes blocks from the working memory to U and V
+// The working memory should already be shrunk by shrink_to_kept.
 static int SVD_copy_from_mem(struct svddata * dat, const int ssid)
 {
         const struct svd_bond_info inf = dat->ss_info[ssid];
         const int dimS = dat->S->dimS[ssid][1];
-        const int origdimS = dat->S->dimS[ssid][0];
         if (dimS == 0) { return 0; }
         assert(dat->V->nrsites == 1);
 
@@ -1009,7 +1132,7 @@ static int SVD_copy_from_mem(struct svddata * dat, const int ssid)
                 const int block = inf.idpermV[idV];
                 T3NS_EL_TYPE * telV = get_tel_block(&dat->V->blocks, block);
 
-                const T3NS_EL_TYPE * mem = &inf.memVT[inf.Nstart[idV] * origdimS];
+                const T3NS_EL_TYPE * mem = &inf.memVT[inf.Nstart[idV] * dimS];
 
                 int tdims[3];
                 get_dims(tdims, block, dat->V, 0, dat->id_bond, 
@@ -1017,14 +1140,14 @@ static int SVD_copy_from_mem(struct svddata * dat, const int ssid)
                 assert(tdims[1] == dimS);
                 int dims[3] = {dimS, tdims[0], tdims[2]};
                 const int ld[2][3] = {
-                        {1, origdimS, origdimS * dims[1]}, 
+                        {1, dimS, dimS * dims[1]}, 
                         {1, dims[1], dims[0] * dims[1]}
                 };
                 assert(dims[1] * dims[2] == inf.Nstart[idV+1]-inf.Nstart[idV]);
                 assert(dims[0] * dims[1] * dims[2] == 
                        get_size_block(&dat->V->blocks, block));
 
-                const int old[] = {origdimS, 1, origdimS * dims[1]};
+                const int old[] = {dimS, 1, dimS * dims[1]};
                 permadd_block(mem, old, telV, ld[1], tdims, 3, 1);
         }
 
@@ -1066,27 +1189,224 @@ static int SVD_copy_from_mem(struct svddata * dat, const int ssid)
         return 0;
 }
 
-static int svdblocks(struct svddata * dat, int ssid)
+// Replaces the M x N matrix A by an orthonormal basis of its column space.
+static int orthonormalize(T3NS_EL_TYPE * A, int M, int N)
 {
+        T3NS_EL_TYPE * safe_malloc(tau, N);
+        int info = LAPACKE_dgeqrf(LAPACK_COL_MAJOR, M, N, A, M, tau);
+        if (!info) {
+                info = LAPACKE_dorgqr(LAPACK_COL_MAJOR, M, N, N, A, M, tau);
+        }
+        if (info) { fprintf(stderr, "QR exited with %d.\n", info); }
+        safe_free(tau);
+        return info != 0;
+}
+
+/* Randomized range finder followed by an SVD of the projected matrix.
+ *
+ * Only the largest singular values are calculated, i.e. the current dimension
+ * of the sector plus RSVD_OVERSAMPLING, so the sector can grow a bit every
+ * step. The weight of all others is kept in inf->tail. Whether this was enough
+ * is checked after the selection in redo_unreliable_blocks.
+ * Returns -1 if the sector is too small to gain anything, memA is untouched
+ * then. Otherwise memA is reused for VT.
+ * The random matrix only depends on ssid, so the result is reproducible. */
+static int svdblocks_randomized(struct svddata * dat, int ssid,
+                                T3NS_EL_TYPE * memA)
+{
+        struct svd_bond_info * inf = &dat->ss_info[ssid];
+        const int M = inf->Mstart[inf->Msecs];
+        const int N = inf->Nstart[inf->Nsecs];
+        const int minMN = M < N ? M : N;
+        const int curr = dat->symarr[dat->id_csite][dat->id_cbond].dims[ssid];
+        const int k = dat->sel->maxD < curr ? dat->sel->maxD : curr;
+        const int l = k + RSVD_OVERSAMPLING;
+        if (l * RSVD_MIN_RATIO > minMN) { return -1; }
+
+        T3NS_EL_TYPE * safe_malloc(Y, M * l);
+        T3NS_EL_TYPE * safe_malloc(Z, N * l);
+        T3NS_EL_TYPE * safe_malloc(B, l * N);
+        T3NS_EL_TYPE * safe_malloc(Ub, l * l);
+
+        unsigned long long state = 0x9E3779B97F4A7C15ULL * (ssid + 1);
+        for (int i = 0; i < N * l; ++i) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                Z[i] = (double) (state >> 11) / (1ULL << 53) - 0.5;
+        }
+
+        // Y = A Z, with power iterations Y = (A A^T)^q A Z.
+        cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, M, l, N,
+                    1, memA, M, Z, N, 0, Y, M);
+        int info = orthonormalize(Y, M, l);
+        for (int q = 0; q < RSVD_POWER_ITS && !info; ++q) {
+                cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, N, l, M,
+                            1, memA, M, Y, M, 0, Z, N);
+                info = orthonormalize(Z, N, l);
+                if (info) { break; }
+                cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans, M, l, N,
+                            1, memA, M, Z, N, 0, Y, M);
+                info = orthonormalize(Y, M, l);
+        }
+        const double normA = cblas_ddot(M * N, memA, 1, memA, 1);
+
+        // A is not needed anymore, VT is stored in its memory.
+        inf->memVT = memA;
+        if (!info) {
+                // B = Y^T A = Ub S VT
+                cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, l, N, M,
+                            1, Y, M, memA, M, 0, B, l);
+                info = LAPACKE_dgesdd(LAPACK_COL_MAJOR, 'S', l, N, B, l, 
+                                      dat->S->sing[ssid], Ub, l, 
+                                      inf->memVT, l);
+                if (info) { fprintf(stderr, "dgesdd exited with %d.\n", info); }
+        }
+
+        if (!info) {
+                // U = Y Ub
+                safe_malloc(inf->memU, M * l);
+                cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans,
+                            M, l, l, 1, Y, M, Ub, l, 0, inf->memU, M);
+                const double * s = dat->S->sing[ssid];
+                inf->tail = normA - cblas_ddot(l, s, 1, s, 1);
+                if (inf->tail < 0) { inf->tail = 0; }
+                dat->S->dimS[ssid][0] = l;
+                inf->method = SVD_RANDOMIZED;
+        }
+
+        safe_free(Y);
+        safe_free(Z);
+        safe_free(B);
+        safe_free(Ub);
+        return info != 0;
+}
+
+/* Singular values and vectors from the eigendecomposition of the Gram matrix
+ * of the smallest dimension, A^T A or A A^T. The other singular vectors follow
+ * from a multiplication with A, which is done in place in the memory of A
+ * (inf->memU if M >= N, otherwise inf->memVT) by panels of GRAM_PANEL.
+ * Whether the result is accurate enough is checked after the selection in
+ * redo_unreliable_blocks. */
+static int svdblocks_gram(struct svddata * dat, int ssid)
+{
+        struct svd_bond_info * inf = &dat->ss_info[ssid];
+        const int M = inf->Mstart[inf->Msecs];
+        const int N = inf->Nstart[inf->Nsecs];
+        const bool tall = M >= N;
+        const int minMN = tall ? N : M;
+        double * sing = dat->S->sing[ssid];
+        T3NS_EL_TYPE * memA = tall ? inf->memU : inf->memVT;
+
+        T3NS_EL_TYPE * safe_malloc(G, minMN * minMN);
+        T3NS_EL_TYPE * safe_malloc(W, minMN);
+        cblas_dsyrk(CblasColMajor, CblasUpper, tall ? CblasTrans : CblasNoTrans,
+                    minMN, tall ? M : N, 1, memA, M, 0, G, minMN);
+        int info = LAPACKE_dsyevd(LAPACK_COL_MAJOR, 'V', 'U', minMN, G, minMN, W);
+        if (info) { fprintf(stderr, "dsyevd exited with %d.\n", info); }
+
+        if (!info) {
+                // Eigenvalues are ascending, singular values descending.
+                // The vectors of the small dimension are stored in G.
+                T3NS_EL_TYPE * small = tall ? inf->memVT : inf->memU;
+                for (int i = 0; i < minMN; ++i) {
+                        const int ei = minMN - 1 - i;
+                        sing[i] = W[ei] > 0 ? sqrt(W[ei]) : 0;
+                        for (int j = 0; j < minMN; ++j) {
+                                // VT is stored by rows, U by columns
+                                small[tall ? i + j * minMN : j + i * minMN] = 
+                                        G[j + ei * minMN];
+                        }
+                }
+
+                const int maxMN = tall ? M : N;
+                T3NS_EL_TYPE * safe_malloc(panel, GRAM_PANEL * minMN);
+                for (int p = 0; p < maxMN; p += GRAM_PANEL) {
+                        const int b = maxMN - p < GRAM_PANEL ? 
+                                maxMN - p : GRAM_PANEL;
+                        if (tall) {
+                                // U = A V S^-1, by rows
+                                for (int j = 0; j < N; ++j) {
+                                        cblas_dcopy(b, memA + p + j * M, 1, 
+                                                    panel + j * b, 1);
+                                }
+                                cblas_dgemm(CblasColMajor, CblasNoTrans, 
+                                            CblasTrans, b, N, N, 1, panel, b,
+                                            inf->memVT, N, 0, memA + p, M);
+                        } else {
+                                // VT = S^-1 U^T A, by columns
+                                T3NS_EL_TYPE * col = memA + p * M;
+                                cblas_dcopy(M * b, col, 1, panel, 1);
+                                cblas_dgemm(CblasColMajor, CblasTrans, 
+                                            CblasNoTrans, M, b, M, 1, 
+                                            inf->memU, M, panel, M, 0, col, M);
+                        }
+                }
+                safe_free(panel);
+
+                for (int i = 0; i < minMN; ++i) {
+                        const double sinv = sing[i] > 0 ? 1 / sing[i] : 0;
+                        if (tall) {
+                                cblas_dscal(M, sinv, inf->memU + i * M, 1);
+                        } else {
+                                cblas_dscal(N, sinv, inf->memVT + i, minMN);
+                        }
+                }
+                inf->method = SVD_GRAM;
+        }
+
+        safe_free(G);
+        safe_free(W);
+        return info != 0;
+}
+
+/* Decomposes a symmetry sector.
+ * If exact is false, cheaper alternatives for dgesdd are tried.
+ *
+ * The sector is gathered directly in the memory of its largest factor and
+ * overwritten by it, i.e. U if M >= N and VT otherwise. Only the square
+ * factor is allocated separately. */
+static int svdblocks(struct svddata * dat, int ssid, bool exact)
+{
+        struct svd_bond_info * inf = &dat->ss_info[ssid];
+        safe_free(inf->memU);
+        safe_free(inf->memVT);
         if (dat->S->dimS[ssid][0] == 0) { return 0; }
-        const struct svd_bond_info inf = dat->ss_info[ssid];
-        const int M = inf.Mstart[inf.Msecs];
-        const int N = inf.Nstart[inf.Nsecs];
-        assert(dat->S->dimS[ssid][0] == (M < N ? M : N));
+        const int M = inf->Mstart[inf->Msecs];
+        const int N = inf->Nstart[inf->Nsecs];
+        const int minMN = M < N ? M : N;
+        assert(dat->S->dimS[ssid][0] == minMN);
+        inf->method = SVD_DGESDD;
 
         T3NS_EL_TYPE * safe_calloc(memA, M * N);
         SVD_copy_to_mem(dat, ssid, memA);
-        int info = LAPACKE_dgesdd(LAPACK_COL_MAJOR, 'S', M, N, memA, M, 
-                                  dat->S->sing[ssid], inf.memU, M, 
-                                  inf.memVT, dat->S->dimS[ssid][0]);
+        if (!exact && dat->sel->randomized) {
+                const int rinfo = svdblocks_randomized(dat, ssid, memA);
+                if (rinfo != -1) { return rinfo; }
+        }
+
+        if (M >= N) {
+                inf->memU = memA;
+                safe_malloc(inf->memVT, N * N);
+        } else {
+                safe_malloc(inf->memU, M * M);
+                inf->memVT = memA;
+        }
+        if (!exact && dat->sel->gram &&
+            (M >= GRAM_MIN_ASPECT * N || N >= GRAM_MIN_ASPECT * M)) {
+                return svdblocks_gram(dat, ssid);
+        }
+
+        // With jobz = 'O' the largest factor overwrites A.
+        int info = LAPACKE_dgesdd(LAPACK_COL_MAJOR, 'O', M, N, memA, M, 
+                                  dat->S->sing[ssid], inf->memU, M, 
+                                  inf->memVT, minMN);
 
         if (info) {
                 fprintf(stderr, "%d %d %d %d %d %d\n", M, N,
-                        dat->S->dimS[ssid][0], ssid, inf.Msecs, inf.Nsecs);
+                        dat->S->dimS[ssid][0], ssid, inf->Msecs, inf->Nsecs);
                 fprintf(stderr, "dgesdd exited with %d.\n", info);
         }
-        safe_free(memA);
-
         return info != 0;
 }
 
@@ -1220,13 +1540,15 @@ static double calculateRenyi(struct Sval * S, double alpha, char trunc)
  * param sel [in] structure with the selection criteria.
  * param res [out] structure which stores the discarded weight and loss in 
  * entanglement entropy.
+ * param tail [in] weight of the singular values not calculated by a randomized
+ * SVD, these are always discarded.
  * return 0 for success, 1 for failure.
  */
 static int selectS(struct Sval * S, const struct SvalSelect * sel, 
-                   struct SelectRes * res)
+                   struct SelectRes * res, double tail)
 {
         res->entropy[0] = calculateRenyi(S, ALPHA, 'A');
-        res->norm[0] = calculateWeight(S, 'A');
+        res->norm[0] = calculateWeight(S, 'A') + tail;
         assert(fabs(res->norm[0] - 1) < 1e-10);
         
         int totalsings = 0;
@@ -1267,9 +1589,8 @@ static int selectS(struct Sval * S, const struct SvalSelect * sel,
                 res->norm[1] += tempS[idxss] * tempS[idxss];
                 ++S->dimS[origblock[idxss]][1];
 
+                // Both norms stay squared, as in the other exits of the loop.
                 if (fabs(res->norm[0] - res->norm[1]) < sel->truncerr) {
-                        res->norm[0] = sqrt(res->norm[0]);
-                        res->norm[1] = sqrt(res->norm[1]);
                         break;
                 }
         }
@@ -1283,13 +1604,123 @@ static int selectS(struct Sval * S, const struct SvalSelect * sel,
         return 0;
 }
 
-static void init_UV_tensors_and_change_symsec(struct svddata * dat)
+static double total_tail(const struct svddata * dat)
+{
+        double tail = 0;
+        for (int ssid = 0; ssid < dat->nrSss; ++ssid) {
+                tail += dat->ss_info[ssid].tail;
+        }
+        return tail;
+}
+
+/* CholeskyQR of the kept rows of VT of a sector decomposed through its Gram
+ * matrix. If M < N, VT = S^-1 U^T A lost its orthogonality with the square of
+ * the condition number of the kept singular values, one pass restores it up to
+ * rounding. If M >= N, VT comes from the eigendecomposition itself.
+ * Returns nonzero if the Cholesky decomposition failed. */
+static int reorthonormalize_gram(struct svddata * dat, int ssid)
+{
+        struct svd_bond_info * inf = &dat->ss_info[ssid];
+        const int M = inf->Mstart[inf->Msecs];
+        const int N = inf->Nstart[inf->Nsecs];
+        if (M >= N) { return 0; }
+        const int kept = dat->S->dimS[ssid][1];
+        const int ld = dat->S->dimS[ssid][0];
+
+        // VT VT^T = R^T R, VT <- R^-T VT
+        T3NS_EL_TYPE * safe_malloc(G, kept * kept);
+        cblas_dsyrk(CblasColMajor, CblasUpper, CblasNoTrans, kept, N, 1, 
+                    inf->memVT, ld, 0, G, kept);
+        int info = LAPACKE_dpotrf(LAPACK_COL_MAJOR, 'U', kept, G, kept);
+        if (!info) {
+                cblas_dtrsm(CblasColMajor, CblasLeft, CblasUpper, CblasTrans,
+                            CblasNonUnit, kept, N, 1, G, kept, inf->memVT, ld);
+        }
+        safe_free(G);
+        return info != 0;
+}
+
+/* A randomized SVD of a sector is trusted if none of the singular values it
+ * did not calculate could have been kept, i.e. if the weight of all of them is
+ * smaller than the square of the smallest kept singular value.
+ * The Gram matrix path is trusted if the condition number of the kept part of
+ * the sector is at most GRAM_MAX_COND, its kept singular vectors are made
+ * orthonormal again by reorthonormalize_gram.
+ * The untrusted sectors are redone with the full SVD and the selection is
+ * repeated. */
+static int redo_unreliable_blocks(struct svddata * dat, struct SelectRes * res)
+{
+        double cut = -1;
+        for (int ssid = 0; ssid < dat->nrSss; ++ssid) {
+                const int kept = dat->S->dimS[ssid][1];
+                if (kept == 0) { continue; }
+                const double s = dat->S->sing[ssid][kept - 1];
+                if (cut < 0 || s < cut) { cut = s; }
+        }
+
+        int erflag = 0;
+        int redone = 0;
+#pragma omp parallel for schedule(dynamic) default(none) shared(erflag, dat, cut) reduction(+:redone) \
+        copyin(t3ns_ctx)
+        for (int ssid = 0; ssid < dat->nrSss; ++ssid) {
+                struct svd_bond_info * inf = &dat->ss_info[ssid];
+                const int kept = dat->S->dimS[ssid][1];
+                const double * s = dat->S->sing[ssid];
+                if (inf->method == SVD_DGESDD) { continue; }
+                if (inf->method == SVD_RANDOMIZED && (inf->tail == 0 || 
+                    (cut >= 0 && inf->tail < cut * cut))) { continue; }
+                if (inf->method == SVD_GRAM && (kept == 0 || 
+                    (s[0] <= GRAM_MAX_COND * s[kept - 1] && 
+                     !reorthonormalize_gram(dat, ssid)))) { 
+                        continue; 
+                }
+                const int M = inf->Mstart[inf->Msecs];
+                const int N = inf->Nstart[inf->Nsecs];
+                dat->S->dimS[ssid][0] = M < N ? M : N;
+                inf->tail = 0;
+                if (!erflag && svdblocks(dat, ssid, true)) { erflag = 1; }
+                ++redone;
+        }
+
+        if (!erflag && redone) {
+                erflag = selectS(dat->S, dat->sel, res, total_tail(dat));
+        }
+        return erflag;
+}
+
+/* Drops the singular vectors which are not kept from the working memory.
+ * U keeps its leading dimension M, VT gets dimS as leading dimension. */
+static void shrink_to_kept(struct svddata * dat, int ssid)
 {
-        safe_calloc(dat->U->blocks.beginblock, dat->U->nrblocks + 1);
-        safe_calloc(dat->V->blocks.beginblock, dat->V->nrblocks + 1);
+        struct svd_bond_info * inf = &dat->ss_info[ssid];
+        const int dimS = dat->S->dimS[ssid][1];
+        const int origdimS = dat->S->dimS[ssid][0];
+        if (dimS == 0) {
+                safe_free(inf->memU);
+                safe_free(inf->memVT);
+                return;
+        }
+        if (dimS == origdimS) { return; }
+
+        const int M = inf->Mstart[inf->Msecs];
+        const int N = inf->Nstart[inf->Nsecs];
+        for (int n = 1; n < N; ++n) {
+                memmove(&inf->memVT[n * dimS], &inf->memVT[n * origdimS], 
+                        dimS * sizeof *inf->memVT);
+        }
 
+        T3NS_EL_TYPE * newmem = realloc(inf->memU, M * dimS * sizeof *newmem);
+        if (newmem != NULL) { inf->memU = newmem; }
+        newmem = realloc(inf->memVT, dimS * N * sizeof *newmem);
+        if (newmem != NULL) { inf->memVT = newmem; }
+}
+
+static void init_UV_tensors_and_change_symsec(struct svddata * dat)
+{
+        // The beginblock arrays are zero since init_splitted_tens.
         int totaldims = 0;
-#pragma omp parallel for schedule(dynamic) default(none) shared(dat) reduction(+:totaldims)
+#pragma omp parallel for schedule(dynamic) default(none) shared(dat) reduction(+:totaldims) \
+        copyin(t3ns_ctx)
         for (int ssid = 0; ssid < dat->nrSss; ++ssid) {
                 const struct svd_bond_info info = dat->ss_info[ssid];
                 const int dimS = dat->S->dimS[ssid][1];
@@ -1321,8 +1752,10 @@ static void init_UV_tensors_and_change_symsec(struct svddata * dat)
                 assert(dat->V->blocks.beginblock[i + 1] >= 0 && "Integer overflow?");
         }
 
-        safe_calloc(dat->U->blocks.tel, siteTensor_get_size(dat->U));
-        safe_calloc(dat->V->blocks.tel, siteTensor_get_size(dat->V));
+        siteTensor_alloc_tel(dat->U, 'm');
+        siteTensor_alloc_tel(dat->V, 'm');
+        first_touch_sparseblocks(&dat->U->blocks, dat->U->nrblocks);
+        first_touch_sparseblocks(&dat->V->blocks, dat->V->nrblocks);
 }
 
 static void reform_tensor(struct siteTensor * tens, const int * nd, 
@@ -1332,13 +1765,8 @@ static void reform_tensor(struct siteTensor * tens, const int * nd,
         for (int i = 0; i < tens->nrblocks; ++i) {
                 if (get_size_block(&tens->blocks, i) == 0) { continue; }
                 QN_TYPE * qn_arr = &tens->qnumbers[i * tens->nrsites];
-                const QN_TYPE qn = qn_arr[site];
-                int ind[3] =  {
-                        qn % od[0],
-                        (qn / od[0]) % od[1],
-                        (qn / od[0]) / od[1]
-                };
-                assert(ind[2] < od[2]);
+                int ind[3];
+                qn_split(ind, qn_arr[site], od);
                 ind[bond] = nid[ind[bond]];
                 assert(ind[bond] >= 0);
 
@@ -1346,7 +1774,7 @@ static void reform_tensor(struct siteTensor * tens, const int * nd,
                 for (int j = 0; j < tens->nrsites; ++j) {
                         newqn_arr[j] = qn_arr[j];
                 }
-                newqn_arr[site] = ind[0] + ind[1] * nd[0] + ind[2] * nd[0] *nd[1];
+                newqn_arr[site] = qn_combine(ind, nd);
 
                 tens->blocks.beginblock[cnt + 1] = tens->blocks.beginblock[i + 1];
                 ++cnt;
@@ -1389,8 +1817,8 @@ static void adapt_UV_tensors_and_kick_empties(struct svddata * dat)
 
         
         const int leg = dat->legs[dat->id_siteV][dat->id_bond];
-        kick_empty_symsecs(&bookie.v_symsecs[leg], 'n');
-        assert(cnt == bookie.v_symsecs[leg].nrSecs);
+        kick_empty_symsecs(&get_bookie()->v_symsecs[leg], 'n');
+        assert(cnt == get_bookie()->v_symsecs[leg].nrSecs);
 }
 
 struct SelectRes split_of_site(struct siteTensor * A, int site, 
@@ -1400,20 +1828,32 @@ struct SelectRes split_of_site(struct siteTensor * A, int site,
 {
         struct SelectRes res = { .erflag = 1 };
         if (!good_site_to_split(A, site)) { return res; }
-        struct svddata dat = init_svddata(A, site, U, S, V);
+        struct svddata dat = init_svddata(A, site, U, S, V, sel);
 
         int erflag = 0;
-#pragma omp parallel for schedule(dynamic) default(none) shared(erflag, dat)
+#pragma omp parallel for schedule(dynamic) default(none) shared(erflag, dat) \
+        copyin(t3ns_ctx)
         for (int ssid = 0; ssid < dat.nrSss; ++ssid) {
-                if (!erflag && svdblocks(&dat, ssid)) { erflag = 1; }
+                if (!erflag && svdblocks(&dat, ssid, false)) { erflag = 1; }
         }
 
-        if (!erflag && selectS(S, sel, &res)) { erflag = 1; }
+        if (!erflag && selectS(S, sel, &res, total_tail(&dat))) { erflag = 1; }
+        if (!erflag && redo_unreliable_blocks(&dat, &res)) { erflag = 1; }
+        for (int ssid = 0; ssid < dat.nrSss; ++ssid) {
+                if (dat.S->dimS[ssid][0] == 0) { continue; }
+                ++res.methods[dat.ss_info[ssid].method];
+                shrink_to_kept(&dat, ssid);
+        }
+        // A is not needed anymore, free it before U and V are allocated.
+        destroy_siteTensor(A);
 
         init_UV_tensors_and_change_symsec(&dat);
-#pragma omp parallel for schedule(dynamic) default(none) shared(erflag, dat)
+#pragma omp parallel for schedule(dynamic) default(none) shared(erflag, dat) \
+        copyin(t3ns_ctx)
         for (int ssid = 0; ssid < dat.nrSss; ++ssid) {
                 if (!erflag && SVD_copy_from_mem(&dat, ssid)) { erflag = 1; }
+                safe_free(dat.ss_info[ssid].memU);
+                safe_free(dat.ss_info[ssid].memVT);
         }
         if (erflag) {
                 fprintf(stderr, "SVD failed.\n");
@@ -1422,7 +1862,6 @@ struct SelectRes split_of_site(struct siteTensor * A, int site,
                 destroy_siteTensor(V);
         }
         adapt_UV_tensors_and_kick_empties(&dat);
-        destroy_siteTensor(A);
 
         norm_tensor(U);
         destroy_svddata(&dat);
@@ -1451,7 +1890,13 @@ static void print_dimdiment(const struct decompose_info * info, int i)
         if (need_multiplicity(bookie.nrSyms, bookie.sgs)) {
                 printf(" <%d>", info->cut_rdim[i]);
         }
-        printf("),\t(S: %.4g)\n", info->cut_ent[i]);
+        printf("),\t(S: %.4g)", info->cut_ent[i]);
+        const int * m = info->cut_methods[i];
+        if (m[SVD_RANDOMIZED] || m[SVD_GRAM]) {
+                printf(",\t(sectors: %d svd, %d rsvd, %d gram)",
+                       m[SVD_DGESDD], m[SVD_RANDOMIZED], m[SVD_GRAM]);
+        }
+        printf("\n");
 }
 
 void print_decompose_info(const struct decompose_info * info,
@@ -1560,6 +2005,9 @@ struct decompose_info HOSVD(struct siteTensor * A,
                         info.cut_trunc[info.cuts] = 0;
                 }
                 info.cut_ent[info.cuts] = res.entropy[1];
+                for (int i = 0; i < SVD_METHODS; ++i) {
+                        info.cut_methods[info.cuts][i] = res.methods[i];
+                }
                 info.cut_totalent += res.entropy[1];
                 select_ls_sigma(&S, &info, info.cuts);
                 fill_rdim_and_dim(&info);
@@ -1575,8 +2023,9 @@ struct decompose_info HOSVD(struct siteTensor * A,
         return info;
 }
 
-struct decompose_info qr_step(struct siteTensor * A, int nCenter, 
-                              struct siteTensor * T3NS, bool calc_ent)
+static struct decompose_info do_qr_step(struct siteTensor * A, int nCenter,
+                                        struct siteTensor * T3NS,
+                                        bool calc_ent)
 {
         struct decompose_info info = {
                 .erflag = 1, 
@@ -1620,13 +2069,334 @@ struct decompose_info qr_step(struct siteTensor * A, int nCenter,
         return info;
 }
 
-struct decompose_info decompose_siteTensor(struct siteTensor * A, int nCenter, 
+/* Makes res, which is the one-site tensor A with the dimension of every
+ * symmetry sector of leg doubled. The first half is A, the second half is P,
+ * which has the same block structure as A, or zero if P is NULL.
+ * The bookkeeper should still have the dimensions of A. */
+static void enlarge_leg(const struct siteTensor * A, const T3NS_EL_TYPE * P,
+                        int leg, struct siteTensor * res)
+{
+        assert(A->nrsites == 1);
+        int legs[3];
+        int maxdims[3];
+        struct symsecs symarr[3];
+        get_bonds_of_site(A->sites[0], legs);
+        get_symsecs_arr(3, symarr, legs);
+        get_maxdims_of_bonds(maxdims, legs, 3);
+
+        res->nrsites = A->nrsites;
+        res->sites[0] = A->sites[0];
+        res->nrblocks = A->nrblocks;
+        siteTensor_alloc_meta(res);
+        for (int i = 0; i < res->nrblocks; ++i) {
+                res->qnumbers[i] = A->qnumbers[i];
+                res->blocks.beginblock[i + 1] = res->blocks.beginblock[i] + 
+                        2 * get_size_block(&A->blocks, i);
+        }
+        siteTensor_alloc_tel(res, 'c');
+
+#pragma omp parallel for schedule(dynamic) default(none) \
+        shared(A, P, res, leg, symarr, maxdims) copyin(t3ns_ctx)
+        for (int block = 0; block < A->nrblocks; ++block) {
+                const int size = get_size_block(&A->blocks, block);
+                if (size == 0) { continue; }
+
+                int id[3];
+                qn_split(id, A->qnumbers[block], maxdims);
+                int MN = symarr[leg].dims[id[leg]];
+                for (int i = 0; i < leg; ++i) { MN *= symarr[i].dims[id[i]]; }
+                assert(size % MN == 0);
+
+                const T3NS_EL_TYPE * a = get_tel_block(&A->blocks, block);
+                T3NS_EL_TYPE * r = get_tel_block(&res->blocks, block);
+                for (int o = 0; o < size / MN; ++o) {
+                        cblas_dcopy(MN, a + o * MN, 1, r + 2 * o * MN, 1);
+                        if (P == NULL) { continue; }
+                        cblas_dcopy(MN, P + A->blocks.beginblock[block] + 
+                                    o * MN, 1, r + (2 * o + 1) * MN, 1);
+                }
+        }
+}
+
+/* The expansion can not make new symmetry sectors, so every non-empty one
+ * keeps at least one state, as long as that fits in maxD. Above maxD, the
+ * states with the smallest singular values go, first from the sectors with
+ * more than one state. */
+static void keep_sectors(struct Sval * S, int maxD, struct SelectRes * res)
+{
+        int total = 0;
+        for (int ss = 0; ss < S->nrblocks; ++ss) {
+                if (S->dimS[ss][0] != 0 && S->dimS[ss][1] == 0) {
+                        S->dimS[ss][1] = 1;
+                }
+                total += S->dimS[ss][1];
+        }
+        if (total <= maxD) { return; }
+
+        for (; total > maxD; --total) {
+                int smallest = -1;
+                for (int single = 0; single < 2 && smallest == -1; ++single) {
+                        for (int ss = 0; ss < S->nrblocks; ++ss) {
+                                const int kept = S->dimS[ss][1];
+                                if (kept == 0 || (kept == 1) != single) {
+                                        continue;
+                                }
+                                if (smallest == -1 || S->sing[ss][kept - 1] <
+                                    S->sing[smallest][S->dimS[smallest][1] - 1]) {
+                                        smallest = ss;
+                                }
+                        }
+                }
+                --S->dimS[smallest][1];
+        }
+        res->norm[0] = calculateWeight(S, 'A');
+        res->norm[1] = calculateWeight(S, 'T');
+        res->entropy[1] = calculateRenyi(S, ALPHA, 'T');
+}
+
+/* Truncated SVD of R = U S VT for every sector. U keeps the selected columns
+ * and SV the selected rows of S VT. */
+static struct SelectRes truncate_R(const struct Rmatrix * R,
+                                   const struct SvalSelect * sel,
+                                   struct Sval * S, struct Rmatrix * U,
+                                   struct Rmatrix * SV)
+{
+        struct SelectRes res = { .erflag = 1 };
+        S->bond = R->bond;
+        S->nrblocks = R->nrblocks;
+        safe_malloc(S->dimS, S->nrblocks);
+        safe_malloc(S->sing, S->nrblocks);
+        T3NS_EL_TYPE ** safe_calloc(memU, R->nrblocks);
+        T3NS_EL_TYPE ** safe_calloc(memVT, R->nrblocks);
+
+        int lapack_info = 0;
+#pragma omp parallel for schedule(dynamic) default(none) \
+        shared(R, S, memU, memVT, lapack_info) copyin(t3ns_ctx)
+        for (int ss = 0; ss < R->nrblocks; ++ss) {
+                const int M = R->dims[ss][0];
+                const int N = R->dims[ss][1];
+                const int minMN = M < N ? M : N;
+                S->dimS[ss][0] = minMN;
+                S->sing[ss] = NULL;
+                if (minMN == 0) { continue; }
+
+                T3NS_EL_TYPE * safe_malloc(mem, M * N);
+                cblas_dcopy(M * N, R->Rels[ss], 1, mem, 1);
+                safe_malloc(S->sing[ss], minMN);
+                safe_malloc(memU[ss], M * minMN);
+                safe_malloc(memVT[ss], minMN * N);
+                const int info = LAPACKE_dgesdd(LAPACK_COL_MAJOR, 'S', M, N, 
+                                                mem, M, S->sing[ss], memU[ss],
+                                                M, memVT[ss], minMN);
+                if (info) {
+#pragma omp atomic write
+                        lapack_info = info;
+                }
+                safe_free(mem);
+        }
+        int erflag = 0;
+        if (lapack_info) {
+                fprintf(stderr, "dgesdd exited with %d.\n", lapack_info);
+                erflag = 1;
+        }
+
+        double norm = 0;
+        for (int ss = 0; !erflag && ss < S->nrblocks; ++ss) {
+                for (int i = 0; i < S->dimS[ss][0]; ++i) {
+                        norm += S->sing[ss][i] * S->sing[ss][i];
+                }
+        }
+        norm = sqrt(norm);
+        if (!erflag && norm != 0) {
+                // selectS works on the singular values of a normed state.
+                for (int ss = 0; ss < S->nrblocks; ++ss) {
+                        cblas_dscal(S->dimS[ss][0], 1 / norm, S->sing[ss], 1);
+                }
+                erflag = selectS(S, sel, &res, 0);
+        }
+        if (!erflag && norm != 0) { keep_sectors(S, sel->maxD, &res); }
+
+        U->bond = SV->bond = R->bond;
+        U->nrblocks = SV->nrblocks = R->nrblocks;
+        safe_malloc(U->dims, U->nrblocks);
+        safe_calloc(U->Rels, U->nrblocks);
+        safe_malloc(SV->dims, SV->nrblocks);
+        safe_calloc(SV->Rels, SV->nrblocks);
+        for (int ss = 0; ss < R->nrblocks; ++ss) {
+                const int M = R->dims[ss][0];
+                const int N = R->dims[ss][1];
+                const int minMN = S->dimS[ss][0];
+                const int kept = erflag || norm == 0 ? 0 : S->dimS[ss][1];
+                U->dims[ss][0] = M;
+                U->dims[ss][1] = kept;
+                SV->dims[ss][0] = kept;
+                SV->dims[ss][1] = N;
+                if (kept != 0) {
+                        safe_malloc(U->Rels[ss], M * kept);
+                        cblas_dcopy(M * kept, memU[ss], 1, U->Rels[ss], 1);
+                        safe_malloc(SV->Rels[ss], kept * N);
+                        for (int i = 0; i < kept; ++i) {
+                                cblas_dcopy(N, memVT[ss] + i, minMN, 
+                                            SV->Rels[ss] + i, kept);
+                                cblas_dscal(N, S->sing[ss][i] * norm, 
+                                            SV->Rels[ss] + i, kept);
+                        }
+                }
+                safe_free(memU[ss]);
+                safe_free(memVT[ss]);
+        }
+        safe_free(memU);
+        safe_free(memVT);
+
+        res.erflag = erflag || norm == 0;
+        return res;
+}
+
+void kick_empties_of_bond(struct siteTensor * A, int bondA,
+                          struct siteTensor * B, int bondB)
+{
+        int legsA[3], legsB[3];
+        get_bonds_of_site(A->sites[0], legsA);
+        get_bonds_of_site(B->sites[0], legsB);
+        assert(legsA[bondA] == legsB[bondB]);
+        struct symsecs * ss = &get_bookie()->v_symsecs[legsA[bondA]];
+
+        int olddimA[3], olddimB[3];
+        get_maxdims_of_bonds(olddimA, legsA, 3);
+        get_maxdims_of_bonds(olddimB, legsB, 3);
+        int * safe_malloc(newid, ss->nrSecs);
+        int cnt = 0;
+        for (int i = 0; i < ss->nrSecs; ++i) {
+                newid[i] = ss->dims[i] == 0 ? -1 : cnt++;
+        }
+        int newdimA[3] = {olddimA[0], olddimA[1], olddimA[2]};
+        newdimA[bondA] = cnt;
+        int newdimB[3] = {olddimB[0], olddimB[1], olddimB[2]};
+        newdimB[bondB] = cnt;
+
+        reform_tensor(A, newdimA, olddimA, newid, 0, bondA);
+        reform_tensor(B, newdimB, olddimB, newid, 0, bondB);
+        safe_free(newid);
+        kick_empty_symsecs(ss, 'n');
+        assert(cnt == ss->nrSecs);
+}
+
+static struct decompose_info do_expand_step(struct siteTensor * A,
+                                            const T3NS_EL_TYPE * P,
+                                            int nCenter,
+                                            struct siteTensor * T3NS,
+                                            const struct SvalSelect * sel)
+{
+        struct decompose_info info = {
+                .erflag = 1, 
+                .wasQR = false,
+                .cuts = 0,
+                .cutted_bonds = {get_common_bond(A->sites[0], nCenter)},
+                .cut_totalent = 0
+        };
+        const int bond = info.cutted_bonds[0];
+        const int oc_id = siteTensor_give_bondid(A, bond);
+        if (oc_id == -1) { return info; }
+        const int o_id = siteTensor_give_bondid(&T3NS[nCenter], bond);
+        if (o_id == -1) { return info; }
+        const int site = A->sites[0];
+
+        // A' = [A P] and B' = [B 0] over the bond, so that A' B' = A B.
+        struct siteTensor Aexp, Bexp;
+        enlarge_leg(A, P, oc_id, &Aexp);
+        enlarge_leg(&T3NS[nCenter], NULL, o_id, &Bexp);
+        struct symsecs * ss = &bookie.v_symsecs[bond];
+        // The expansion only adds states, at least the old ones are kept.
+        struct SvalSelect esel = *sel;
+        int olddim = 0;
+        for (int i = 0; i < ss->nrSecs; ++i) { olddim += ss->dims[i]; }
+        if (esel.minD < olddim) { 
+                esel.minD = olddim < esel.maxD ? olddim : esel.maxD; 
+        }
+        for (int i = 0; i < ss->nrSecs; ++i) { ss->dims[i] *= 2; }
+
+        // A' = Q R = (Q U) (S VT)
+        struct siteTensor Q;
+        struct Rmatrix R, U, SV;
+        struct Sval S;
+        const int erflag = qr(&Aexp, oc_id, &Q, &R);
+        destroy_siteTensor(&Aexp);
+        if (erflag) {
+                destroy_siteTensor(&Bexp);
+                return info;
+        }
+        const struct SelectRes res = truncate_R(&R, &esel, &S, &U, &SV);
+        destroy_Rmatrix(&R);
+        if (res.erflag) {
+                destroy_siteTensor(&Q);
+                destroy_siteTensor(&Bexp);
+                destroy_Rmatrix(&U);
+                destroy_Rmatrix(&SV);
+                destroy_Sval(&S);
+                return info;
+        }
+
+        destroy_siteTensor(A);
+        if (multiplyR(&Q, oc_id, &U, 0, &T3NS[site])) { return info; }
+        destroy_siteTensor(&Q);
+        destroy_Rmatrix(&U);
+
+        for (int i = 0; i < ss->nrSecs; ++i) { ss->dims[i] = S.dimS[i][1]; }
+        destroy_siteTensor(&T3NS[nCenter]);
+        if (multiplyR(&Bexp, o_id, &SV, 1, &T3NS[nCenter])) { return info; }
+        destroy_siteTensor(&Bexp);
+        destroy_Rmatrix(&SV);
+        kick_empties_of_bond(&T3NS[site], oc_id, &T3NS[nCenter], o_id);
+
+        info.cut_trunc[0] = res.norm[0] - res.norm[1];
+        if (info.cut_trunc[0] < 1e-16) { info.cut_trunc[0] = 0; }
+        info.cut_Mtrunc = info.cut_trunc[0];
+        info.cut_ent[0] = res.entropy[1];
+        info.cut_totalent = res.entropy[1];
+        for (int i = 0; i < SVD_METHODS; ++i) { info.cut_methods[0][i] = 0; }
+        info.cut_methods[0][SVD_DGESDD] = S.nrblocks;
+        select_ls_sigma(&S, &info, 0);
+        fill_rdim_and_dim(&info);
+        ++info.cuts;
+        destroy_Sval(&S);
+
+        info.erflag = 0;
+        return info;
+}
+
+struct decompose_info qr_step(struct t3ns_context * ctx, struct siteTensor * A,
+                              int nCenter, struct siteTensor * T3NS,
+                              bool calc_ent)
+{
+        struct t3ns_context * prev = use_context(ctx);
+        const struct decompose_info info = do_qr_step(A, nCenter, T3NS, 
+                                                      calc_ent);
+        use_context(prev);
+        return info;
+}
+
+struct decompose_info expand_step(struct t3ns_context * ctx,
+                                  struct siteTensor * A,
+                                  const T3NS_EL_TYPE * P, int nCenter, 
+                                  struct siteTensor * T3NS, 
+                                  const struct SvalSelect * sel)
+{
+        struct t3ns_context * prev = use_context(ctx);
+        const struct decompose_info info = do_expand_step(A, P, nCenter, T3NS,
+                                                          sel);
+        use_context(prev);
+        return info;
+}
+
+struct decompose_info decompose_siteTensor(struct t3ns_context * ctx,
+                                           struct siteTensor * A, int nCenter, 
                                            struct siteTensor * T3NS,
                                            const struct SvalSelect * sel)
 {
-        if (A->nrsites > 1) {
-                return HOSVD(A, nCenter, T3NS, sel);
-        } else {
-                return qr_step(A, nCenter, T3NS, true);
-        }
+        struct t3ns_context * prev = use_context(ctx);
+        const struct decompose_info info = A->nrsites > 1 ?
+                HOSVD(A, nCenter, T3NS, sel) :
+                do_qr_step(A, nCenter, T3NS, true);
+        use_context(prev);
+        return info;
 }
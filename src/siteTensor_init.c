@@ -17,6 +17,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 #include <time.h>
 #include <omp.h>
@@ -25,6 +27,10 @@
 #include "siteTensor.h"
 #include "tensorproducts.h"
 #include "sort.h"
+#include "qnhash.h"
+#include "distributed.h"
+#include "numa_policy.h"
+#include "context.h"
 
 void init_null_siteTensor(struct siteTensor * tens)
 {
@@ -32,6 +38,56 @@ void init_null_siteTensor(struct siteTensor * tens)
         tens->nrblocks = 0;
         tens->qnumbers = NULL;
         init_null_sparseblocks(&tens->blocks);
+        tens->slab = false;
+}
+
+void siteTensor_alloc_meta(struct siteTensor * tens)
+{
+        const int nrqn = tens->nrsites * tens->nrblocks;
+        tens->blocks.tel = NULL;
+#ifdef T3NS_SLAB
+        const size_t qnsize = nrqn * sizeof *tens->qnumbers;
+        char * safe_malloc(slab, qnsize + (tens->nrblocks + 1) * 
+                           sizeof *tens->blocks.beginblock);
+        tens->qnumbers = (QN_TYPE *) slab;
+        tens->blocks.beginblock = (T3NS_BB_TYPE *) (slab + qnsize);
+        tens->slab = true;
+#else
+        safe_malloc(tens->qnumbers, nrqn);
+        safe_malloc(tens->blocks.beginblock, tens->nrblocks + 1);
+        tens->slab = false;
+#endif
+        for (int i = 0; i < tens->nrblocks + 1; ++i) {
+                tens->blocks.beginblock[i] = 0;
+        }
+}
+
+void siteTensor_alloc_tel(struct siteTensor * tens, char o)
+{
+        const T3NS_BB_TYPE N = siteTensor_get_size(tens);
+        if (!tens->slab) {
+                if (o == 'c') {
+                        safe_calloc(tens->blocks.tel, N);
+                } else {
+                        safe_malloc(tens->blocks.tel, N);
+                }
+                return;
+        }
+
+        // The slab is grown, the quantum numbers and beginblock move along.
+        char * slab = (char *) tens->qnumbers;
+        const size_t qnsize = (char *) tens->blocks.beginblock - slab;
+        const size_t metasize = qnsize + (tens->nrblocks + 1) * 
+                sizeof *tens->blocks.beginblock;
+        safe_realloc(slab, metasize + T3NS_SLAB_ALIGN + N * sizeof *tens->blocks.tel);
+        tens->qnumbers = (QN_TYPE *) slab;
+        tens->blocks.beginblock = (T3NS_BB_TYPE *) (slab + qnsize);
+
+        const uintptr_t start = (uintptr_t) (slab + metasize);
+        const size_t pad = (T3NS_SLAB_ALIGN - start % T3NS_SLAB_ALIGN) % 
+                T3NS_SLAB_ALIGN;
+        tens->blocks.tel = (T3NS_EL_TYPE *) (slab + metasize + pad);
+        if (o == 'c') { memset(tens->blocks.tel, 0, N * sizeof *tens->blocks.tel); }
 }
 
 void deep_copy_siteTensor(struct siteTensor * copy, 
@@ -40,14 +96,20 @@ void deep_copy_siteTensor(struct siteTensor * copy,
         copy->nrsites = orig->nrsites;
         copy->nrblocks = orig->nrblocks;
 
-        safe_malloc(copy->qnumbers, copy->nrsites * copy->nrblocks);
+        siteTensor_alloc_meta(copy);
         for (int i = 0; i < copy->nrsites; ++i) {
                 copy->sites[i] = orig->sites[i];
         }
         for (int i = 0; i < copy->nrsites * copy->nrblocks; ++i) {
                 copy->qnumbers[i] = orig->qnumbers[i];
         }
-        deep_copy_sparseblocks(&copy->blocks, &orig->blocks, orig->nrblocks);
+        for (int i = 0; i < copy->nrblocks + 1; ++i) {
+                copy->blocks.beginblock[i] = orig->blocks.beginblock[i];
+        }
+        siteTensor_alloc_tel(copy, 'm');
+        for (T3NS_BB_TYPE i = 0; i < siteTensor_get_size(copy); ++i) {
+                copy->blocks.tel[i] = orig->blocks.tel[i];
+        }
 }
 
 void destroy_siteTensor(struct siteTensor * tens)
@@ -55,7 +117,13 @@ void destroy_siteTensor(struct siteTensor * tens)
         tens->nrsites = 0;
         tens->nrblocks = 0;
         safe_free(tens->qnumbers);
-        destroy_sparseblocks(&tens->blocks);
+        if (tens->slab) {
+                // Everything was stored together with the quantum numbers.
+                init_null_sparseblocks(&tens->blocks);
+                tens->slab = false;
+        } else {
+                destroy_sparseblocks(&tens->blocks);
+        }
 }
 
 /* Makes the blocks out of the dimarray and qnumbersarray
@@ -76,14 +144,15 @@ static void make_1sblocks(struct siteTensor * tens)
         int cnt = 0;
         for (int i = 0; i < symarr[0].nrSecs; ++i ) {
                 for (int j = 0; j < symarr[1].nrSecs; ++j) {
-                        const QN_TYPE ind = i + j * symarr[0].nrSecs;
-                        const QN_TYPE inc = symarr[0].nrSecs * symarr[1].nrSecs;
                         if (gs.sectors[i] == NULL) { continue; }
                         struct gsec_arr * gsa = &gs.sectors[i][j];
                         for (int k = 0; k < gsa->L; ++k) {
                                 if (gsa->sectors[k].d == 0) { continue; }
                                 dims[cnt] = gsa->sectors[k].d;
-                                qnumbers[cnt] = ind + gsa->sectors[k].id3 * inc;
+                                const int ids[3] = {
+                                        i, j, gsa->sectors[k].id3
+                                };
+                                qnumbers[cnt] = qntypize(ids, symarr);
                                 ++cnt;
                         }
                 }
@@ -93,8 +162,7 @@ static void make_1sblocks(struct siteTensor * tens)
 
         /* Reform leading order, and I could kick this order */
         int * idx = quickSort(qnumbers, tens->nrblocks, sort_qn[tens->nrsites]);
-        safe_malloc(tens->qnumbers, tens->nrblocks);
-        safe_malloc(tens->blocks.beginblock, tens->nrblocks + 1);
+        siteTensor_alloc_meta(tens);
 
         tens->blocks.beginblock[0] = 0;
         for (int i = 0; i < tens->nrblocks; ++i) {
@@ -118,13 +186,13 @@ void init_1siteTensor(struct siteTensor * tens, int site, char o)
         /* initialization of the tel array */
         switch(o) {
         case 'r':
-                srand(time(NULL));
+                srand(common_seed());
                 break;
         case 'c':
                 srand(0);
                 break;
         case '0':
-                safe_calloc(tens->blocks.tel, N);
+                siteTensor_alloc_tel(tens, 'c');
                 return;
         default:
                 fprintf(stderr, "%s@%s: Unknown option \'%c\' was inputted.\n",
@@ -132,7 +200,7 @@ void init_1siteTensor(struct siteTensor * tens, int site, char o)
                 exit(EXIT_FAILURE);
         }
 
-        safe_malloc(tens->blocks.tel, N);
+        siteTensor_alloc_tel(tens, 'm');
 
         for (int i = 0; i <  N; ++i) {
                 tens->blocks.tel[i] = (rand() - RAND_MAX / 2.) / RAND_MAX;
@@ -140,11 +208,13 @@ void init_1siteTensor(struct siteTensor * tens, int site, char o)
 }
 
 // Struct for helping making multisite Tensor.
-static struct {
+struct multisite_data {
         // Pointer to the multisite tensor.
         struct siteTensor * T;
         // The original site tensors, same order as in T->nrsites
         struct siteTensor oT[STEPSPECS_MSITES];
+        // Index on the qnumbers of the original site tensors.
+        struct qnhash oThash[STEPSPECS_MSITES];
         // Number of internal bonds in the multi-site tensor.
         int nr_internal;
         // The internal bonds.
@@ -168,7 +238,9 @@ static struct {
         struct symsecs ssarr[STEPSPECS_MSITES][3];
         // Pointer to the original symsecs.
         struct symsecs ssarr_old[STEPSPECS_MSITES][3];
-} md;
+};
+
+#define md (*CONTEXT_STATE(struct multisite_data, CONTEXT_MULTISITE))
 
 static void add_psite(int bond, int bid, const int * sitelist, int nr) 
 {
@@ -259,8 +331,9 @@ static int init_md(struct siteTensor * T, const int * sitelistdumdum, int nr,
 static void change_internals_in_bookkeeper(void)
 {
         for (int i = 0; i < md.nr_internal; ++i) {
-                destroy_symsecs(&bookie.v_symsecs[md.internals[i]]);
-                bookie.v_symsecs[md.internals[i]] = md.intss[i];
+                struct symsecs * ss = &get_bookie()->v_symsecs[md.internals[i]];
+                destroy_symsecs(ss);
+                *ss = md.intss[i];
         }
 }
 
@@ -331,27 +404,30 @@ static void sort_and_make(void)
 {
         const int nb = md.T->nrblocks;
         const int ns = md.T->nrsites;
-        QN_TYPE * safe_malloc(new_qn, nb * ns);
-        T3NS_BB_TYPE * safe_malloc(new_dim, nb + 1);
+        QN_TYPE * old_qn = md.T->qnumbers;
+        T3NS_BB_TYPE * old_dim = md.T->blocks.beginblock;
+        siteTensor_alloc_meta(md.T);
         // Sorting
-        int * idx = quickSort(md.T->qnumbers, nb, sort_qn[ns]);
+        int * idx = quickSort(old_qn, nb, sort_qn[ns]);
 
+        QN_TYPE * new_qn = md.T->qnumbers;
+        T3NS_BB_TYPE * new_dim = md.T->blocks.beginblock;
         new_dim[0] = 0; 
         for (int i = 0; i < nb; ++i) {
                 for (int j = 0; j < ns; ++j) {
-                        new_qn[i * ns + j] = md.T->qnumbers[idx[i] * ns + j];
+                        new_qn[i * ns + j] = old_qn[idx[i] * ns + j];
                 }
-                new_dim[i + 1] = md.T->blocks.beginblock[idx[i]] + new_dim[i];
+                new_dim[i + 1] = old_dim[idx[i]] + new_dim[i];
                 assert(new_dim[i + 1] >= 0 && "Integer overflow?");
         }
 
-        safe_free(md.T->blocks.beginblock);
-        safe_free(md.T->qnumbers);
+        safe_free(old_dim);
+        safe_free(old_qn);
         safe_free(idx);
 
-        md.T->blocks.beginblock = new_dim;
-        md.T->qnumbers = new_qn;
-        safe_calloc(md.T->blocks.tel, siteTensor_get_size(md.T));
+        // Filled with the same split over the threads in contractsiteTensors.
+        siteTensor_alloc_tel(md.T, 'm');
+        first_touch_sparseblocks(&md.T->blocks, md.T->nrblocks);
 }
 
 static int get_partqn_and_dim(bool counted, int id, int leg, QN_TYPE ** partqn, 
@@ -447,7 +523,7 @@ static void make_qnumbers_and_dims(const struct good_sectors * const gs)
         int nrblocks = 0;
         const bool counted = md.T->nrblocks != 0;
 
-#pragma omp parallel default(none) shared(md) reduction(+:nrblocks)
+#pragma omp parallel default(none) reduction(+:nrblocks) copyin(t3ns_ctx)
         {
                 QN_TYPE * qnumbers = NULL;
                 T3NS_BB_TYPE * dims = NULL;
@@ -620,9 +696,7 @@ static struct makeinfo init_makeinfo(int sb)
                 translate_indices(nids, nsym, oids, osym, 3);
                 const QN_TYPE old_qn = qntypize(oids, osym);
 
-                const int csb = binSearch(&old_qn, md.oT[i].qnumbers,
-                                          md.oT[i].nrblocks,
-                                          sort_qn[1], sizeof old_qn);
+                const int csb = search_qnhash(&old_qn, &md.oThash[i]);
                 if (csb == -1) {
                         minfo.is_valid = false;
                         return minfo;
@@ -763,18 +837,33 @@ static void clean_makeinfo(struct makeinfo * minfo)
 
 static void contractsiteTensors(void)
 {
-#pragma omp parallel for schedule(static) default(none) shared(md)
-        for (int sb = 0; sb < md.T->nrblocks; ++sb) {
-                const int order[3] = {0, 1, 2};
-                struct makeinfo minfo = init_makeinfo(sb);
-                if (minfo.is_valid == false) { continue; }
-
-                struct contractinfo cinfo[STEPSPECS_MSITES - 1];
-                const int nrcont = init_contractinfo(&minfo, cinfo, order);
-                for (int i = 0; i < nrcont; ++i) {
-                        do_contract(&cinfo[i], minfo.tel, 1, 0);
+        for (int i = 0; i < md.T->nrsites; ++i) {
+                init_qnhash(&md.oThash[i], md.oT[i].qnumbers, 
+                            md.oT[i].nrblocks, 1);
+        }
+
+#pragma omp parallel default(none) copyin(t3ns_ctx)
+        {
+                // Every thread fills the blocks it placed.
+                int first, last;
+                thread_block_range(md.T->nrblocks, &first, &last);
+                for (int sb = first; sb < last; ++sb) {
+                        const int order[3] = {0, 1, 2};
+                        struct makeinfo minfo = init_makeinfo(sb);
+                        if (minfo.is_valid == false) { continue; }
+
+                        struct contractinfo cinfo[STEPSPECS_MSITES - 1];
+                        const int nrcont = init_contractinfo(&minfo, cinfo,
+                                                             order);
+                        for (int i = 0; i < nrcont; ++i) {
+                                do_contract(&cinfo[i], minfo.tel, 1, 0);
+                        }
+                        clean_makeinfo(&minfo);
                 }
-                clean_makeinfo(&minfo);
+        }
+
+        for (int i = 0; i < md.T->nrsites; ++i) { 
+                destroy_qnhash(&md.oThash[i]); 
         }
 }
 
@@ -787,18 +876,27 @@ int makesiteTensor(struct siteTensor * tens, const struct siteTensor * T3NS,
                 return 0;
         }
 
-        if (init_md(tens, sitelist, nr_sites, T3NS)) { return 1; }
-        make_internalss_and_tensor();
-        /* contracts the correct tensor objects in T3NS to a new big site and
-         * destroys them */
-        contractsiteTensors();
-        // Put the internal symmetry sectors in the bookkeeper.
-        change_internals_in_bookkeeper();
-        return 0;
+        int erflag = 0;
+        /* md is shared by the threads of the calculation, only one multisite
+         * tensor can be made at a time. */
+        context_lock(CONTEXT_LOCK_MULTISITE);
+        {
+                erflag = init_md(tens, sitelist, nr_sites, T3NS);
+                if (!erflag) {
+                        make_internalss_and_tensor();
+                        /* contracts the correct tensor objects in T3NS to a
+                         * new big site and destroys them */
+                        contractsiteTensors();
+                        // Put the internal symmetry sectors in the bookkeeper.
+                        change_internals_in_bookkeeper();
+                }
+        }
+        context_unlock(CONTEXT_LOCK_MULTISITE);
+        return erflag;
 }
 
 // Structure with data for performing of permutations of orbitals.
-static struct {
+struct permute_data {
         /* The type of permutation:
          *      0 : 1 ↔ 2 (dmrg)
          *   (T3NS)
@@ -854,7 +952,9 @@ static struct {
         int indexperm[6];
         // Maps the new bond to the old bond.
         int indexperminv[6];
-} pd;
+};
+
+#define pd (*CONTEXT_STATE(struct permute_data, CONTEXT_PERMUTE))
 
 struct permute_helper {
         // Old block index.
@@ -893,12 +993,13 @@ struct permute_helper {
 
 static void permute_orbitals(const int * perm)
 {
+        int * sitetoorb = get_sitetoorb();
         int posP[STEPSPECS_MSITES];
         int orbitals[STEPSPECS_MSITES];
         int cnt = 0;
         for (int i = 0; i < pd.ns; ++i) {
                 if (is_psite(pd.T->sites[i])) { 
-                        orbitals[cnt] = netw.sitetoorb[pd.T->sites[i]];
+                        orbitals[cnt] = sitetoorb[pd.T->sites[i]];
                         posP[cnt++] = i; 
                 }
         }
@@ -906,7 +1007,7 @@ static void permute_orbitals(const int * perm)
         cnt = 0;
         for (int i = 0; i < pd.ns; ++i) {
                 if (is_psite(pd.T->sites[i])) { 
-                        netw.sitetoorb[pd.T->sites[i]] = orbitals[perm[cnt]];
+                        sitetoorb[pd.T->sites[i]] = orbitals[perm[cnt]];
                         ++cnt;
                 }
         }
@@ -1174,13 +1275,17 @@ static bool get_o_perm_block(struct permute_helper * ph)
 
 static void permute_tensors(void)
 {
-#pragma omp parallel for schedule(dynamic) default(none) shared(pd,bookie)
+        const struct symmetryKernels * kern = bookie.kernels;
+#pragma omp parallel for schedule(dynamic) default(none) shared(kern) \
+        copyin(t3ns_ctx)
         for (int nb = 0; nb < pd.Tp->nrblocks; ++nb) {
                 struct permute_helper ph = init_permute_helper(nb);
                 while (get_o_perm_block(&ph)) { 
                         const double pref = 
-                                prefactor_permutation(ph.irreps, pd.permuteType,
-                                                      bookie.sgs, bookie.nrSyms);
+                                kern->prefactor_permutation(ph.irreps, 
+                                                            pd.permuteType,
+                                                            bookie.sgs, 
+                                                            bookie.nrSyms);
                         permadd_block(ph.p_ob, ph.old, 
                                       ph.p_nb, ph.nld, ph.ndims, 
                                       pd.nr_outerb, pref);
@@ -1228,23 +1333,33 @@ int permute_siteTensor(const struct siteTensor * T, struct siteTensor * Tp,
                 return 0;
         }
 
-        // Initial making of the permutation data
-        // In this function some needed symsecs and so are stored and also
-        // the permutation is performed on the netw.sitetoorb array.
-        init_pd(T, Tp, perm);
-        // Making the md
-        if (init_md(Tp, T->sites, pd.ns, NULL)) { return 1; }
-        // Initializing the permuted tensor
-        make_internalss_and_tensor();
-        // Put the internals at their spot
-        // (I should have copied the old internals in the permute_data)
-        change_internals_in_bookkeeper();
-        // Move relevant information from the mda to the pda.
-        move_from_make_to_perm();
-
-        // Do the permutation of the elements
-        permute_tensors();
-        // Cleanup
-        cleanup_permute();
-        return 0;
+        int erflag = 0;
+        /* md and pd are shared by the threads of the calculation, only one
+         * permutation (or multisite tensor) can be made at a time. */
+        context_lock(CONTEXT_LOCK_MULTISITE);
+        {
+                // Initial making of the permutation data
+                // In this function some needed symsecs and so are stored and 
+                // also the permutation is performed on the sitetoorb array.
+                init_pd(T, Tp, perm);
+                // Making the md
+                erflag = init_md(Tp, T->sites, pd.ns, NULL);
+                if (!erflag) {
+                        // Initializing the permuted tensor
+                        make_internalss_and_tensor();
+                        // Put the internals at their spot
+                        // (I should have copied the old internals in the 
+                        // permute_data)
+                        change_internals_in_bookkeeper();
+                        // Move relevant information from the mda to the pda.
+                        move_from_make_to_perm();
+
+                        // Do the permutation of the elements
+                        permute_tensors();
+                }
+                // Cleanup
+                cleanup_permute();
+        }
+        context_unlock(CONTEXT_LOCK_MULTISITE);
+        return erflag;
 }
@@ -29,7 +29,7 @@
 #include "network.h"
 #include "bookkeeper.h"
 #include "symsecs.h"
-#include "sort.h"
+#include "qnhash.h"
 
 /* ========================================================================== */
 /* ==================== DECLARATION STATIC FUNCTIONS ======================== */
@@ -282,6 +282,9 @@ void change_sectors_tensor(struct siteTensor * oldtens,
         bookkeeper_get_symsecs_arr(prevbookie, 3, oldss, bonds);
         bookkeeper_get_symsecs_arr(&bookie, 3, newss, bonds);
 
+        struct qnhash newhash;
+        init_qnhash(&newhash, newtens->qnumbers, newtens->nrblocks, 1);
+
         for (int oldblock = 0; oldblock < oldtens->nrblocks; ++oldblock) {
                 int oldid[3], newid[3];
                 indexize(oldid, oldtens->qnumbers[oldblock], oldss);
@@ -295,9 +298,7 @@ void change_sectors_tensor(struct siteTensor * oldtens,
 
                 const QN_TYPE newqn = qntypize(newid, newss);
 
-                const int newblock = binSearch(&newqn, newtens->qnumbers,
-                                               newtens->nrblocks, SORT_QN_TYPE,
-                                               sizeof newqn);
+                const int newblock = search_qnhash(&newqn, &newhash);
 
                 if (newblock == -1) { continue; }
 
@@ -337,15 +338,7 @@ void change_sectors_tensor(struct siteTensor * oldtens,
                         }
                 }
         }
-}
-
-static void get_indices_for_qn(QN_TYPE qn, int * indices, const int * dims)
-{
-        indices[0] = qn % dims[0];
-        qn /= dims[0];
-        indices[1] = qn % dims[1];
-        indices[2] = qn / dims[1];
-        assert(indices[2] < dims[2]);
+        destroy_qnhash(&newhash);
 }
 
 int (*qn_to_indices_1s(const struct siteTensor * tens))[3]
@@ -356,7 +349,7 @@ int (*qn_to_indices_1s(const struct siteTensor * tens))[3]
         get_maxdims_of_bonds(dims, legs, 3);
 
         for (int block = 0; block < tens->nrblocks; ++block) {
-                get_indices_for_qn(tens->qnumbers[block], indices[block], dims);
+                qn_split(indices[block], tens->qnumbers[block], dims);
         }
         return indices;
 }
@@ -374,7 +367,7 @@ int (*qn_to_indices(const struct siteTensor * tens))[STEPSPECS_MSITES][3]
         for (int i = 0; i < tens->nrblocks; ++i) {
                 const QN_TYPE * qn = &tens->qnumbers[i * tens->nrsites];
                 for (int j = 0; j < tens->nrsites; ++j) {
-                        get_indices_for_qn(qn[j], indices[i][j], dims[j]);
+                        qn_split(indices[i][j], qn[j], dims[j]);
                 }
         }
         return indices;
@@ -91,34 +91,41 @@ static int comparinstrucsearch(const void * a, const void * b)
         return (bb.instr[2] - bb.instr[2]);
 }
 
+/* Quantum numbers do not fit in an int, so the difference can not be 
+ * returned. */
+static inline int compare_qn(QN_TYPE a, QN_TYPE b)
+{
+        return (a > b) - (a < b);
+}
+
 static int comparqnsearch(const void * a, const void * b)
 {
         QN_TYPE aa = *((QN_TYPE *) a), bb = *((QN_TYPE *) b);
-        return (aa - bb);
+        return compare_qn(aa, bb);
 }
 
 static int comparqn2search(const void * a, const void * b)
 {
         QN_TYPE *aa = ((QN_TYPE *) a), *bb = ((QN_TYPE *) b);
-        if (aa[1] != bb[1]) { return (aa[1] - bb[1]); }
-        return (aa[0] - bb[0]);
+        if (aa[1] != bb[1]) { return compare_qn(aa[1], bb[1]); }
+        return compare_qn(aa[0], bb[0]);
 }
 
 static int comparqn3search(const void * a, const void * b)
 {
         QN_TYPE *aa = ((QN_TYPE *) a), *bb = ((QN_TYPE *) b);
-        if (aa[2] != bb[2]) { return (aa[2] - bb[2]); }
-        if (aa[1] != bb[1]) { return (aa[1] - bb[1]); }
-        return (aa[0] - bb[0]);
+        if (aa[2] != bb[2]) { return compare_qn(aa[2], bb[2]); }
+        if (aa[1] != bb[1]) { return compare_qn(aa[1], bb[1]); }
+        return compare_qn(aa[0], bb[0]);
 }
 
 static int comparqn4search(const void * a, const void * b)
 {
         QN_TYPE *aa = ((QN_TYPE *) a), *bb = ((QN_TYPE *) b);
-        if (aa[3] != bb[3]) { return (aa[3] - bb[3]); }
-        if (aa[2] != bb[2]) { return (aa[2] - bb[2]); }
-        if (aa[1] != bb[1]) { return (aa[1] - bb[1]); }
-        return (aa[0] - bb[0]);
+        if (aa[3] != bb[3]) { return compare_qn(aa[3], bb[3]); }
+        if (aa[2] != bb[2]) { return compare_qn(aa[2], bb[2]); }
+        if (aa[1] != bb[1]) { return compare_qn(aa[1], bb[1]); }
+        return compare_qn(aa[0], bb[0]);
 }
 
 static int comparintsort(const void * a, const void * b, void * base_arr)
@@ -18,8 +18,11 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "sparseblocks.h"
+#include "numa_policy.h"
+#include "timers.h"
 #include "macros.h"
 #ifdef T3NS_MKL
 #include "mkl.h"
@@ -67,13 +70,28 @@ void deep_copy_sparseblocks(struct sparseblocks * copy,
         }
 }
 
+void first_touch_sparseblocks(struct sparseblocks * blocks, int nr_blocks)
+{
+#pragma omp parallel if (get_numa_policy() != NUMA_SERIAL)
+        {
+                int first, last;
+                thread_block_range(nr_blocks, &first, &last);
+                const T3NS_BB_TYPE N = blocks->beginblock[last] - 
+                        blocks->beginblock[first];
+                if (N != 0) {
+                        memset(blocks->tel + blocks->beginblock[first], 0, 
+                               N * sizeof *blocks->tel);
+                }
+        }
+}
+
 void destroy_sparseblocks(struct sparseblocks * blocks)
 {
         safe_free(blocks->beginblock);
         safe_free(blocks->tel);
 }
 
-void kick_zero_blocks(struct sparseblocks * blocks, int nr_blocks)
+void squeeze_zero_blocks(struct sparseblocks * blocks, int nr_blocks)
 {
         T3NS_BB_TYPE start = blocks->beginblock[0];
 #ifndef NDEBUG
@@ -96,7 +114,11 @@ void kick_zero_blocks(struct sparseblocks * blocks, int nr_blocks)
                 blocks->beginblock[i + 1] = blocks->beginblock[i] + N;
         }
         assert(prevsize >= blocks->beginblock[nr_blocks]);
+}
 
+void kick_zero_blocks(struct sparseblocks * blocks, int nr_blocks)
+{
+        squeeze_zero_blocks(blocks, nr_blocks);
         blocks->tel = realloc(blocks->tel, blocks->beginblock[nr_blocks] * sizeof *blocks->tel);
 
         if (blocks->tel == NULL && blocks->beginblock[nr_blocks] != 0) {
@@ -105,6 +127,22 @@ void kick_zero_blocks(struct sparseblocks * blocks, int nr_blocks)
         }
 }
 
+T3NS_BB_TYPE slab_block_size(T3NS_BB_TYPE N)
+{
+#ifdef T3NS_SLAB
+        const T3NS_BB_TYPE elalign = T3NS_SLAB_ALIGN / sizeof(T3NS_EL_TYPE);
+        return (N + elalign - 1) / elalign * elalign;
+#else
+        return N;
+#endif
+}
+
+bool block_has_size(const struct sparseblocks * blocks, int id, T3NS_BB_TYPE N)
+{
+        const T3NS_BB_TYPE size = get_size_block(blocks, id);
+        return size == N || size == slab_block_size(N);
+}
+
 int get_size_block(const struct sparseblocks * blocks, int id)
 {
         return (int) (blocks->beginblock[id + 1] - blocks->beginblock[id]);
@@ -141,6 +179,7 @@ void do_contract(const struct contractinfo * cinfo, T3NS_EL_TYPE ** tel,
          * Although I am not sure this will make a difference 
          * since this is probably more for parallel dgemm */
         //printf("%p %lf\n", B, beta);
+        count_gemm(cinfo->M, cinfo->N, cinfo->K, cinfo->L);
         cblas_dgemm(CblasColMajor, cinfo->trans[0], cinfo->trans[1], 
                     cinfo->M, cinfo->N, cinfo->K, 
                     alpha, A, cinfo->lda, B, cinfo->ldb, 
@@ -19,6 +19,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <stdbool.h>
 
 #include "symmetries.h"
 #include "macros.h"
@@ -40,8 +41,9 @@ int get_max_irrep(int (*prop1)[MAX_SYMMETRIES], int nr1,
         }
 }
 
-void tensprod_irrep(int *min_irrep, int *nr_irreps, int *step, int irrep1, 
-                    int irrep2, int sign, enum symmetrygroup sg)
+static inline void step_tensprod_irrep(int *min_irrep, int *nr_irreps, 
+                                       int *step, int irrep1, int irrep2, 
+                                       int sign, enum symmetrygroup sg)
 {
         switch(sg) {
         case Z2 :
@@ -64,6 +66,23 @@ void tensprod_irrep(int *min_irrep, int *nr_irreps, int *step, int irrep1,
         }
 }
 
+void tensprod_irrep(int *min_irrep, int *nr_irreps, int *step, int irrep1, 
+                    int irrep2, int sign, enum symmetrygroup sg)
+{
+        step_tensprod_irrep(min_irrep, nr_irreps, step, irrep1, irrep2, sign,
+                            sg);
+}
+
+void tensprod_irreps(int * min_irrep, int * nr_irreps, int * step, 
+                     const int * irrep1, const int * irrep2, int sign,
+                     const enum symmetrygroup * sgs, int nrsy)
+{
+        for (int i = 0; i < nrsy; ++i) {
+                step_tensprod_irrep(&min_irrep[i], &nr_irreps[i], &step[i],
+                                    irrep1[i], irrep2[i], sign, sgs[i]);
+        }
+}
+
 const char * symmetrynames[] = {
         "Z2", "U1", "SU2", "C1", "Ci", "C2", "Cs", "D2", "C2v", "C2h", "D2h", "SENIORITY"
 };
@@ -157,73 +176,87 @@ int find_str_in_array(char * buffer, const char ** arr, int length, int * ind)
         return 0;
 }
 
+static inline double step_pAppend(const int * (*irrep_arr)[3], int is_left, 
+                                  enum symmetrygroup sg, int i)
+{
+        int sv[3][3];
+        switch(sg) {
+        case Z2 :
+                for (int j = 0; j < 3; ++j)
+                        for (int k = 0; k < 3; ++k)
+                                sv[j][k] = (irrep_arr[j][k])[i];
+                return Z2_prefactor_pAppend(sv, is_left);
+        case SU2 :
+                for (int j = 0; j < 3; ++j)
+                        for (int k = 0; k < 3; ++k)
+                                sv[j][k] = (irrep_arr[j][k])[i];
+                return SU2_prefactor_pAppend(sv, is_left);
+        default :
+                return 1;
+        }
+}
+
 double prefactor_pAppend(const int * (*irrep_arr)[3], int is_left, 
                          const enum symmetrygroup * sgs, int nrsy)
 {
-        int sv[3][3];
         double prefactor = 1;
         for (int i = 0; i < nrsy; ++i) {
-                switch(sgs[i]) {
-                case Z2 :
-                        for (int j = 0; j < 3; ++j)
-                                for (int k = 0; k < 3; ++k)
-                                        sv[j][k] = (irrep_arr[j][k])[i];
-                        prefactor *= Z2_prefactor_pAppend(sv, is_left);
-                        break;
+                prefactor *= step_pAppend(irrep_arr, is_left, sgs[i], i);
+        }
+        return prefactor;
+}
 
-                case SU2 :
-                        for (int j = 0; j < 3; ++j)
-                                for (int k = 0; k < 3; ++k)
-                                        sv[j][k] = (irrep_arr[j][k])[i];
-                        prefactor *= SU2_prefactor_pAppend(sv, is_left);
-                        break;
-                default :
-                        break;
+static inline double step_adjoint(const int ** irrep_arr, char c, 
+                                  enum symmetrygroup sg, int i)
+{
+        int symvalues[3];
+        switch(sg) {
+        case Z2 :
+                /* Only Z2 needs a sign change */
+                for (int j = 0; j < 3; ++j) {
+                        symvalues[j] = irrep_arr[j][i];
                 }
+                return Z2_prefactor_adjoint(symvalues, c);
+        default :
+                return 1;
         }
-        return prefactor;
 }
 
 double prefactor_adjoint(const int ** irrep_arr, char c, 
                          const enum symmetrygroup * sgs, int nrsy)
 {
-        int symvalues[3];
         double prefactor = 1;
         for (int i = 0; i < nrsy; ++i) {
-                switch(sgs[i]) {
-                case Z2 :
-                        /* Only Z2 needs a sign change */
-                        for (int j = 0; j < 3; ++j) {
-                                symvalues[j] = irrep_arr[j][i];
-                        }
-                        prefactor *= Z2_prefactor_adjoint(symvalues, c);
-                        break;
-                default :
-                        break;
-                }
+                prefactor *= step_adjoint(irrep_arr, c, sgs[i], i);
         }
         return prefactor;
 }
 
+static inline double step_pUpdate(const int * (*irrep_arr)[3], int is_left, 
+                                  enum symmetrygroup sg, int i)
+{
+        int symvalues[7];
+        switch(sg) {
+        case Z2 :
+                for (int j = 0; j < 3; ++j) {
+                        symvalues[j] = irrep_arr[0][j][i];
+                        symvalues[3 + j] = irrep_arr[1][j][i];
+                }
+                symvalues[6] = irrep_arr[2][1][i];
+                /* only Z2 needs a sign change for this contract */
+                return Z2_prefactor_pUpdate(symvalues, is_left);
+        default :
+                return 1;
+        }
+}
+
 double prefactor_pUpdate(const int * (*irrep_arr)[3], int is_left, 
                          const enum symmetrygroup * sgs, int nrsy)
 {
-        int symvalues[7];
         double prefactor = 1;
-        for (int i = 0; i < nrsy; ++i)
-                switch(sgs[i]) {
-                case Z2 :
-                        for (int j = 0; j < 3; ++j) {
-                                symvalues[j] = irrep_arr[0][j][i];
-                                symvalues[3 + j] = irrep_arr[1][j][i];
-                        }
-                        symvalues[6] = irrep_arr[2][1][i];
-                        /* only Z2 needs a sign change for this contract */
-                        prefactor *= Z2_prefactor_pUpdate(symvalues, is_left);
-                        break;
-                default :
-                        break;
-                }
+        for (int i = 0; i < nrsy; ++i) {
+                prefactor *= step_pUpdate(irrep_arr, is_left, sgs[i], i);
+        }
         return prefactor;
 }
 
@@ -252,109 +285,128 @@ double prefactor_mirror_coupling(int ** irrep_arr,
         return prefactor;
 }
 
+static inline double step_bUpdate(int * (*irrep_arr)[3], int updateCase,
+                                  enum symmetrygroup sg, int i)
+{
+        int symvalues[3][3];
+        switch(sg) {
+        case Z2 :
+                for (int j = 0; j < 3; ++j)
+                        for (int k = 0; k < 3; ++k)
+                                symvalues[j][k] = (irrep_arr[j][k])[i];
+                return Z2_prefactor_bUpdate(symvalues, updateCase);
+        case SU2 :
+                for (int j = 0; j < 3; ++j)
+                        for (int k = 0; k < 3; ++k)
+                                symvalues[j][k] = (irrep_arr[j][k])[i];
+                return SU2_prefactor_bUpdate(symvalues, updateCase);
+        default :
+                return 1;
+        }
+}
+
 double prefactor_bUpdate(int * (*irrep_arr)[3], int updateCase,
                          const enum symmetrygroup * sgs, int nrsy)
 {
-        int symvalues[3][3];
         double prefactor = 1;
         for (int i = 0; i < nrsy; ++i) {
-                switch(sgs[i]) {
-                case Z2 :
-                        for (int j = 0; j < 3; ++j)
-                                for (int k = 0; k < 3; ++k)
-                                        symvalues[j][k] = (irrep_arr[j][k])[i];
-                        prefactor *= Z2_prefactor_bUpdate(symvalues, updateCase);
-                        break;
-
-                case SU2 :
-                        for (int j = 0; j < 3; ++j)
-                                for (int k = 0; k < 3; ++k)
-                                        symvalues[j][k] = (irrep_arr[j][k])[i];
-                        prefactor *= SU2_prefactor_bUpdate(symvalues, updateCase);
-                        break;
-                default :
-                        break;
-                }
+                prefactor *= step_bUpdate(irrep_arr, updateCase, sgs[i], i);
         }
         return prefactor;
 }
 
+static inline double step_add_P_operator(int * const (*irreps)[3], int isleft,
+                                         enum symmetrygroup sg, int i)
+{
+        int symvalues[2][3];
+        switch(sg) {
+        case Z2 :
+                for (int j = 0; j < 2; ++j)
+                        for (int k = 0; k < 3; ++k)
+                                symvalues[j][k] = (irreps[j][k])[i];
+
+                return Z2_prefactor_add_P_operator(symvalues, isleft);
+        default :
+                return 1;
+        }
+}
+
 double prefactor_add_P_operator(int * const (*irreps)[3], int isleft, 
                                 const enum symmetrygroup * sgs, int nrsy)
 {
-        int symvalues[2][3];
         double prefactor = 1;
         for (int i = 0; i < nrsy; ++i) {
-                switch(sgs[i]) {
-                case Z2 :
-                        for (int j = 0; j < 2; ++j)
-                                for (int k = 0; k < 3; ++k)
-                                        symvalues[j][k] = (irreps[j][k])[i];
-
-                        prefactor *= Z2_prefactor_add_P_operator(symvalues, isleft);
-                        break;
-                default :
-                        break;
-                }
+                prefactor *= step_add_P_operator(irreps, isleft, sgs[i], i);
         }
         return prefactor;
 }
 
-double prefactor_combine_MPOs(int * const (*irreps)[3], int * const *irrMPO, 
-                              const enum symmetrygroup * sgs, int nrsy, int isdmrg, int extradinge)
+static inline double step_combine_MPOs(int * const (*irreps)[3], 
+                                       int * const *irrMPO, 
+                                       enum symmetrygroup sg, int i,
+                                       int isdmrg, int extradinge)
 {
         int symvalues[2][3];
         int symvaluesMPO[3];
-        double prefactor = 1;
-        for (int i = 0; i < nrsy; ++i) {
-                switch(sgs[i]) {
-                case Z2 :
-                        for (int j = 0; j < 2; ++j)
-                                for (int k = 0; k < 3; ++k)
-                                        symvalues[j][k] = (irreps[j][k])[i];
-                        for (int k = 0; k < (isdmrg ? 2 : 3); ++k)
-                                symvaluesMPO[k] = (irrMPO[k])[i];
+        switch(sg) {
+        case Z2 :
+                for (int j = 0; j < 2; ++j)
+                        for (int k = 0; k < 3; ++k)
+                                symvalues[j][k] = (irreps[j][k])[i];
+                for (int k = 0; k < (isdmrg ? 2 : 3); ++k)
+                        symvaluesMPO[k] = (irrMPO[k])[i];
 
-                        prefactor *= Z2_prefactor_combine_MPOs(symvalues, symvaluesMPO, isdmrg, extradinge);
-                        break;
-                case SU2 :
-                        for (int j = 0; j < 2; ++j)
-                                for (int k = 0; k < 3; ++k)
-                                        symvalues[j][k] = (irreps[j][k])[i];
-                        for (int k = 0; k < (isdmrg ? 2 : 3); ++k)
-                                symvaluesMPO[k] = (irrMPO[k])[i];
+                return Z2_prefactor_combine_MPOs(symvalues, symvaluesMPO, isdmrg, extradinge);
+        case SU2 :
+                for (int j = 0; j < 2; ++j)
+                        for (int k = 0; k < 3; ++k)
+                                symvalues[j][k] = (irreps[j][k])[i];
+                for (int k = 0; k < (isdmrg ? 2 : 3); ++k)
+                        symvaluesMPO[k] = (irrMPO[k])[i];
 
-                        prefactor *= SU2_prefactor_combine_MPOs(symvalues, symvaluesMPO, isdmrg, extradinge);
-                        break;
-                default :
-                        break;
-                }
+                return SU2_prefactor_combine_MPOs(symvalues, symvaluesMPO, isdmrg, extradinge);
+        default :
+                return 1;
+        }
+}
+
+double prefactor_combine_MPOs(int * const (*irreps)[3], int * const *irrMPO, 
+                              const enum symmetrygroup * sgs, int nrsy, int isdmrg, int extradinge)
+{
+        double prefactor = 1;
+        for (int i = 0; i < nrsy; ++i) {
+                prefactor *= step_combine_MPOs(irreps, irrMPO, sgs[i], i, 
+                                               isdmrg, extradinge);
         }
         return prefactor;
 }
 
+static inline double step_permutation(int * irreps[5][3], int permuteType,
+                                      enum symmetrygroup sg, int i)
+{
+        int symvalues[5][3];
+        switch(sg) {
+        case Z2 :
+                for (int j = 0; j < 5; ++j)
+                        for (int k = 0; k < 3; ++k)
+                                symvalues[j][k] = irreps[j][k] == NULL ? -1 : irreps[j][k][i];
+                return Z2_prefactor_permutation(symvalues, permuteType);
+        case SU2 :
+                for (int j = 0; j < 5; ++j)
+                        for (int k = 0; k < 3; ++k)
+                                symvalues[j][k] = irreps[j][k] == NULL ? -1 : irreps[j][k][i];
+                return SU2_prefactor_permutation(symvalues, permuteType);
+        default :
+                return 1;
+        }
+}
+
 double prefactor_permutation(int * irreps[5][3], int permuteType,
                              const enum symmetrygroup * sgs, int nrsy)
 {
-        int symvalues[5][3];
         double prefactor = 1;
         for (int i = 0; i < nrsy; ++i) {
-                switch(sgs[i]) {
-                case Z2 :
-                        for (int j = 0; j < 5; ++j)
-                                for (int k = 0; k < 3; ++k)
-                                        symvalues[j][k] = irreps[j][k] == NULL ? -1 : irreps[j][k][i];
-                        prefactor *= Z2_prefactor_permutation(symvalues, permuteType);
-                        break;
-                case SU2 :
-                        for (int j = 0; j < 5; ++j)
-                                for (int k = 0; k < 3; ++k)
-                                        symvalues[j][k] = irreps[j][k] == NULL ? -1 : irreps[j][k][i];
-                        prefactor *= SU2_prefactor_permutation(symvalues, permuteType);
-                        break;
-                default :
-                        break;
-                }
+                prefactor *= step_permutation(irreps, permuteType, sgs[i], i);
         }
         return prefactor;
 }
@@ -412,17 +464,21 @@ int need_multiplicity(int nrSyms, const enum symmetrygroup * sgs)
         return 0;
 }
 
+static inline int step_multiplicity(enum symmetrygroup sg, int irrep)
+{
+        switch (sg) {
+        case SU2:
+                return SU2_multiplicity(irrep);
+        default:
+                return 1;
+        }
+}
+
 int multiplicity(int nrSyms, const enum symmetrygroup * sgs, const int * irreps)
 {
         int result = 1;
         for (int i = 0; i < nrSyms; ++i) {
-                switch (sgs[i]) {
-                case SU2:
-                        result *= SU2_multiplicity(irreps[i]);
-                        break;
-                default:
-                        break;
-                }
+                result *= step_multiplicity(sgs[i], irreps[i]);
         }
         return result;
 }
@@ -435,3 +491,197 @@ void get_sgsstring(enum symmetrygroup * sgs, int nrSyms, char * buffer)
                 strcat(buffer, "\t");
         }
 }
+
+/* ========================================================================== */
+/* ===================== SPECIALIZED SYMMETRY KERNELS ======================= */
+/* ========================================================================== */
+
+// The maximal number of symmetries of a specialization.
+#define SPECIALIZED_SYMMETRIES 4
+
+/* Executes STATEMENT for every symmetry i of the specialization NAME. The
+ * symmetry groups are constants, so the switches in the inlined steps are
+ * resolved at compile time and the symmetries past NAME##_nrsy are removed. */
+#define FOR_SPECIALIZED_SYMMETRIES(NAME, STATEMENT)                           \
+        { const int i = 0; if (i < NAME##_nrsy) { STATEMENT; } }              \
+        { const int i = 1; if (i < NAME##_nrsy) { STATEMENT; } }              \
+        { const int i = 2; if (i < NAME##_nrsy) { STATEMENT; } }              \
+        { const int i = 3; if (i < NAME##_nrsy) { STATEMENT; } }
+
+/* Makes the kernels for a fixed combination of symmetries. The passed
+ * symmetry groups are ignored.
+ *
+ * The point group in a combination stands for every point group, since they
+ * are all treated the same by these kernels. */
+#define SYMMETRY_KERNELS(NAME, ...)                                           \
+static const enum symmetrygroup NAME##_sgs[SPECIALIZED_SYMMETRIES] = {       \
+        __VA_ARGS__                                                           \
+};                                                                            \
+enum { NAME##_nrsy = sizeof (enum symmetrygroup[]) { __VA_ARGS__ } /         \
+        sizeof (enum symmetrygroup) };                                        \
+                                                                              \
+static void NAME##_tensprod_irreps(int * min_irrep, int * nr_irreps,         \
+                                   int * step, const int * irrep1,           \
+                                   const int * irrep2, int sign,             \
+                                   const enum symmetrygroup * sgs, int nrsy) \
+{                                                                             \
+        (void) sgs; (void) nrsy;                                              \
+        FOR_SPECIALIZED_SYMMETRIES(NAME,                                      \
+                step_tensprod_irrep(&min_irrep[i], &nr_irreps[i], &step[i],  \
+                                    irrep1[i], irrep2[i], sign,               \
+                                    NAME##_sgs[i]))                           \
+}                                                                             \
+                                                                              \
+static double NAME##_pAppend(const int * (*irrep_arr)[3], int is_left,       \
+                             const enum symmetrygroup * sgs, int nrsy)       \
+{                                                                             \
+        (void) sgs; (void) nrsy;                                              \
+        double prefactor = 1;                                                 \
+        FOR_SPECIALIZED_SYMMETRIES(NAME, prefactor *=                         \
+                step_pAppend(irrep_arr, is_left, NAME##_sgs[i], i))          \
+        return prefactor;                                                     \
+}                                                                             \
+                                                                              \
+static double NAME##_adjoint(const int ** irrep_arr, char c,                 \
+                             const enum symmetrygroup * sgs, int nrsy)       \
+{                                                                             \
+        (void) sgs; (void) nrsy;                                              \
+        double prefactor = 1;                                                 \
+        FOR_SPECIALIZED_SYMMETRIES(NAME, prefactor *=                         \
+                step_adjoint(irrep_arr, c, NAME##_sgs[i], i))                \
+        return prefactor;                                                     \
+}                                                                             \
+                                                                              \
+static double NAME##_pUpdate(const int * (*irrep_arr)[3], int is_left,       \
+                             const enum symmetrygroup * sgs, int nrsy)       \
+{                                                                             \
+        (void) sgs; (void) nrsy;                                              \
+        double prefactor = 1;                                                 \
+        FOR_SPECIALIZED_SYMMETRIES(NAME, prefactor *=                         \
+                step_pUpdate(irrep_arr, is_left, NAME##_sgs[i], i))          \
+        return prefactor;                                                     \
+}                                                                             \
+                                                                              \
+static double NAME##_bUpdate(int * (*irrep_arr)[3], int updateCase,          \
+                             const enum symmetrygroup * sgs, int nrsy)       \
+{                                                                             \
+        (void) sgs; (void) nrsy;                                              \
+        double prefactor = 1;                                                 \
+        FOR_SPECIALIZED_SYMMETRIES(NAME, prefactor *=                         \
+                step_bUpdate(irrep_arr, updateCase, NAME##_sgs[i], i))       \
+        return prefactor;                                                     \
+}                                                                             \
+                                                                              \
+static double NAME##_add_P_operator(int * const (*irreps)[3], int isleft,    \
+                                    const enum symmetrygroup * sgs,           \
+                                    int nrsy)                                 \
+{                                                                             \
+        (void) sgs; (void) nrsy;                                              \
+        double prefactor = 1;                                                 \
+        FOR_SPECIALIZED_SYMMETRIES(NAME, prefactor *=                         \
+                step_add_P_operator(irreps, isleft, NAME##_sgs[i], i))       \
+        return prefactor;                                                     \
+}                                                                             \
+                                                                              \
+static double NAME##_combine_MPOs(int * const (*irreps)[3],                  \
+                                  int * const * irrMPO,                       \
+                                  const enum symmetrygroup * sgs, int nrsy,  \
+                                  int isdmrg, int extradinge)                 \
+{                                                                             \
+        (void) sgs; (void) nrsy;                                              \
+        double prefactor = 1;                                                 \
+        FOR_SPECIALIZED_SYMMETRIES(NAME, prefactor *=                         \
+                step_combine_MPOs(irreps, irrMPO, NAME##_sgs[i], i,          \
+                                  isdmrg, extradinge))                        \
+        return prefactor;                                                     \
+}                                                                             \
+                                                                              \
+static double NAME##_permutation(int * irreps[5][3], int permuteType,        \
+                                 const enum symmetrygroup * sgs, int nrsy)   \
+{                                                                             \
+        (void) sgs; (void) nrsy;                                              \
+        double prefactor = 1;                                                 \
+        FOR_SPECIALIZED_SYMMETRIES(NAME, prefactor *=                         \
+                step_permutation(irreps, permuteType, NAME##_sgs[i], i))     \
+        return prefactor;                                                     \
+}                                                                             \
+                                                                              \
+static int NAME##_multiplicity(int nrSyms, const enum symmetrygroup * sgs,   \
+                               const int * irreps)                            \
+{                                                                             \
+        (void) sgs; (void) nrSyms;                                            \
+        int result = 1;                                                       \
+        FOR_SPECIALIZED_SYMMETRIES(NAME, result *=                            \
+                step_multiplicity(NAME##_sgs[i], irreps[i]))                  \
+        return result;                                                        \
+}
+
+#define SYMMETRY_KERNELS_ENTRY(NAME, STRING) {                                \
+        .name = STRING,                                                       \
+        .nrSyms = NAME##_nrsy,                                                \
+        .sgs = NAME##_sgs,                                                    \
+        .tensprod_irreps = NAME##_tensprod_irreps,                            \
+        .prefactor_pAppend = NAME##_pAppend,                                  \
+        .prefactor_adjoint = NAME##_adjoint,                                  \
+        .prefactor_pUpdate = NAME##_pUpdate,                                  \
+        .prefactor_bUpdate = NAME##_bUpdate,                                  \
+        .prefactor_add_P_operator = NAME##_add_P_operator,                    \
+        .prefactor_combine_MPOs = NAME##_combine_MPOs,                        \
+        .prefactor_permutation = NAME##_permutation,                          \
+        .multiplicity = NAME##_multiplicity                                   \
+}
+
+SYMMETRY_KERNELS(Z2_U1_SU2, Z2, U1, SU2)
+SYMMETRY_KERNELS(Z2_U1_U1, Z2, U1, U1)
+#if MAX_SYMMETRIES >= 4
+SYMMETRY_KERNELS(Z2_U1_SU2_PG, Z2, U1, SU2, C1)
+SYMMETRY_KERNELS(Z2_U1_U1_PG, Z2, U1, U1, C1)
+#endif
+
+static const struct symmetryKernels specialized_kernels[] = {
+        SYMMETRY_KERNELS_ENTRY(Z2_U1_SU2, "Z2 U1 SU2"),
+        SYMMETRY_KERNELS_ENTRY(Z2_U1_U1, "Z2 U1 U1"),
+#if MAX_SYMMETRIES >= 4
+        SYMMETRY_KERNELS_ENTRY(Z2_U1_SU2_PG, "Z2 U1 SU2 PG"),
+        SYMMETRY_KERNELS_ENTRY(Z2_U1_U1_PG, "Z2 U1 U1 PG"),
+#endif
+};
+
+static const struct symmetryKernels generic_kernels = {
+        .name = "generic",
+        .nrSyms = 0,
+        .sgs = NULL,
+        .tensprod_irreps = tensprod_irreps,
+        .prefactor_pAppend = prefactor_pAppend,
+        .prefactor_adjoint = prefactor_adjoint,
+        .prefactor_pUpdate = prefactor_pUpdate,
+        .prefactor_bUpdate = prefactor_bUpdate,
+        .prefactor_add_P_operator = prefactor_add_P_operator,
+        .prefactor_combine_MPOs = prefactor_combine_MPOs,
+        .prefactor_permutation = prefactor_permutation,
+        .multiplicity = multiplicity
+};
+
+static bool is_pointgroup(enum symmetrygroup sg)
+{
+        return sg >= C1 && sg <= D2h;
+}
+
+const struct symmetryKernels * get_symmetry_kernels(int nrSyms, 
+                                                    const enum symmetrygroup * sgs)
+{
+        const int nrkernels = sizeof specialized_kernels / 
+                sizeof specialized_kernels[0];
+        for (int k = 0; k < nrkernels; ++k) {
+                const struct symmetryKernels * kern = &specialized_kernels[k];
+                if (kern->nrSyms != nrSyms) { continue; }
+
+                int i;
+                for (i = 0; i < nrSyms; ++i) {
+                        if (sgs[i] != kern->sgs[i] && !(is_pointgroup(sgs[i]) &&
+                            is_pointgroup(kern->sgs[i]))) { break; }
+                }
+                if (i == nrSyms) { return kern; }
+        }
+        return &generic_kernels;
+}
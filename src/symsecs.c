@@ -35,13 +35,13 @@ void init_null_symsecs(struct symsecs * symsec)
 
 void get_symsecs(struct symsecs *res, int bond)
 {
-        bookkeeper_get_symsecs(&bookie, res, bond);
+        bookkeeper_get_symsecs(get_bookie(), res, bond);
         assert(res->bond == bond);
 }
 
 void get_symsecs_arr(int n, struct symsecs * symarr, const int * bonds)
 {
-        bookkeeper_get_symsecs_arr(&bookie, n, symarr, bonds);
+        bookkeeper_get_symsecs_arr(get_bookie(), n, symarr, bonds);
 }
 
 void destroy_symsecs(struct symsecs *sectors)
@@ -137,6 +137,18 @@ void deep_copy_symsecs(struct symsecs * copy, const struct symsecs * tocopy)
                 copy->dims[i] = tocopy->dims[i];
 }
 
+bool same_symsecs(const struct symsecs * a, const struct symsecs * b)
+{
+        if (a->nrSecs != b->nrSecs) { return false; }
+        for (int i = 0; i < a->nrSecs; ++i) {
+                if (a->dims[i] != b->dims[i]) { return false; }
+                for (int j = 0; j < bookie.nrSyms; ++j) {
+                        if (a->irreps[i][j] != b->irreps[i][j]) { return false; }
+                }
+        }
+        return true;
+}
+
 int full_dimension(const struct symsecs * const sym)
 {
         if (!need_multiplicity(bookie.nrSyms, bookie.sgs))
@@ -177,6 +189,22 @@ void print_symsecinfo(struct symsecs * ss)
         printf("in %d non-empty sectors.\n", counter);
 }
 
+extern bool qn_packed(const int * dims);
+
+extern QN_TYPE qn_combine(const int * ids, const int * dims);
+
+extern void qn_split(int * ids, QN_TYPE qn, const int * dims);
+
+extern int qn_index(QN_TYPE qn, int i, const int * dims);
+
+extern QN_TYPE qn_head(QN_TYPE qn, int n, const int * dims);
+
+extern QN_TYPE qn_tail(QN_TYPE qn, int n, const int * dims);
+
+extern QN_TYPE qn_join(QN_TYPE head, QN_TYPE tail, int n, const int * dims);
+
+extern QN_TYPE qn_columnmajor(QN_TYPE qn, const int * dims, bool tocolumnmajor);
+
 extern void indexize(int * ids, QN_TYPE qn, const struct symsecs * ss);
 
 extern QN_TYPE qntypize(const int * ids, const struct symsecs * ss);
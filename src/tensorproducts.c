@@ -43,18 +43,19 @@ struct iter_tprod {
 
 // Initializes the iterator
 static struct iter_tprod init_tprod(const int *ir1, const int * ir2, int sign,
+                                    const struct symmetryKernels * kern,
                                     const enum symmetrygroup * sgs, int nrsy)
 {
         struct iter_tprod iter;
+        int nrirr[MAX_SYMMETRIES];
         iter.nrsy = nrsy;
         iter.total = 1;
+        kern->tensprod_irreps(iter.minirr, nrirr, iter.step, ir1, ir2, sign,
+                              sgs, nrsy);
         for (int i = 0; i < nrsy; ++i) {
-                int nrirr;
-                tensprod_irrep(&iter.minirr[i], &nrirr, &iter.step[i], 
-                               ir1[i], ir2[i], sign, sgs[i]);
-                iter.maxirr[i] = iter.minirr[i] + (nrirr - 1) * iter.step[i];
+                iter.maxirr[i] = iter.minirr[i] + (nrirr[i] - 1) * iter.step[i];
                 iter.cirr[i] = iter.minirr[i];
-                iter.total *= nrirr;
+                iter.total *= nrirr[i];
         }
         // Needed for first iteration
         iter.cirr[0] = iter.minirr[0] - iter.step[0];
@@ -73,7 +74,8 @@ static inline bool iterate_tprod(struct iter_tprod * iter)
 }
 
 static struct gsec_arr sel_goodsymsecs(struct symsecs * ss, 
-                                       int i, int j, int sign)
+                                       int i, int j, int sign,
+                                       const struct symmetryKernels * kern)
 {
         const int dim = ss[0].dims[i] * ss[1].dims[j];
         if (dim == 0) {
@@ -82,7 +84,8 @@ static struct gsec_arr sel_goodsymsecs(struct symsecs * ss,
         }
 
         struct iter_tprod iter = init_tprod(ss[0].irreps[i], ss[1].irreps[j],
-                                            sign, bookie.sgs, bookie.nrSyms);
+                                            sign, kern, bookie.sgs, 
+                                            bookie.nrSyms);
         struct gsec_arr gsa = {
                 .L = iter.total,
                 .sectors = malloc(iter.total * sizeof *gsa.sectors)
@@ -123,8 +126,10 @@ struct good_sectors find_good_sectors(const struct symsecs * symarr, int sign)
                 .total = 0
         };
         int total = 0;
+        const struct symmetryKernels * kern = bookie.kernels;
 
-#pragma omp parallel for schedule(dynamic) default(none) shared(res,sign) reduction(+:total)
+#pragma omp parallel for schedule(dynamic) default(none) shared(res,sign,kern) reduction(+:total) \
+        copyin(t3ns_ctx)
         for (int i = 0; i < res.ss[0].nrSecs; ++i) {
                 res.sectors[i] = NULL;
                 if (res.ss[0].dims[i] == 0) { continue; }
@@ -133,7 +138,8 @@ struct good_sectors find_good_sectors(const struct symsecs * symarr, int sign)
                         res.sectors[i][j].L = 0;
                         res.sectors[i][j].sectors = NULL;
                         if (res.ss[1].dims[j] == 0) { continue; }
-                        res.sectors[i][j] = sel_goodsymsecs(res.ss, i, j, sign);
+                        res.sectors[i][j] = sel_goodsymsecs(res.ss, i, j, sign,
+                                                            kern);
                         total += res.sectors[i][j].L;
                 }
         }
@@ -312,8 +318,9 @@ static void tensprod_and_fill(struct symsecs * res, const struct symsecs * ss,
         /* for non-abelian symmetries, like SU(2), there are multiple irreps
          * that are valid as result of the tensorproduct of two irreps */
         struct iter_tprod iter = init_tprod(ss[0].irreps[ids[0]], 
-                                            ss[1].irreps[ids[1]],
-                                            sign, bookie.sgs, bookie.nrSyms);
+                                            ss[1].irreps[ids[1]], sign,
+                                            bookie.kernels,
+                                            bookie.sgs, bookie.nrSyms);
 
         while (iterate_tprod(&iter)) {
                 int ps = search_symsec(iter.cirr, res);
@@ -360,7 +367,7 @@ struct symsecs tensprod_symsecs(const struct symsecs * sectors1,
                 *sectors2
         };
 
-#pragma omp parallel default(none) shared(ss,res,sign,o,stderr)
+#pragma omp parallel default(none) shared(ss,res,sign,o,stderr) copyin(t3ns_ctx)
         {
                 double * safe_calloc(fcidims, res.nrSecs);
                 int * dims = NULL;
@@ -19,8 +19,73 @@
 #include <assert.h>
 #include <sys/time.h>
 #include <string.h>
+#include <omp.h>
 
 #include "timers.h"
+#include "trace.h"
+
+// Counters of every thread, padded to avoid false sharing.
+static struct {
+        struct perf_counters c;
+        char pad[64 - sizeof(struct perf_counters) % 64];
+} thread_counters[MAX_COUNTED_THREADS];
+static int nr_counted_threads = 0;
+static int my_id = -1;
+#pragma omp threadprivate(my_id)
+
+static FILE * output = NULL;
+static bool output_csv = false;
+
+int get_thread_id(void)
+{
+        if (my_id == -1) {
+#pragma omp atomic capture
+                my_id = nr_counted_threads++;
+        }
+        return my_id;
+}
+
+static struct perf_counters * my_counters(void)
+{
+        // Threads beyond the maximum share counters.
+        return &thread_counters[get_thread_id() % MAX_COUNTED_THREADS].c;
+}
+
+void count_gemm(int M, int N, int K, int L)
+{
+        struct perf_counters * c = my_counters();
+        const double flops = 2. * M * N * K * L;
+#pragma omp atomic
+        c->gemms += L;
+#pragma omp atomic
+        c->flops += flops;
+}
+
+void count_alloc(long long bytes)
+{
+        struct perf_counters * c = my_counters();
+#pragma omp atomic
+        c->bytes += bytes;
+}
+
+struct perf_counters get_perf_counters(void)
+{
+        struct perf_counters res = { 0 };
+        for (int i = 0; i < MAX_COUNTED_THREADS; ++i) {
+                res.gemms += thread_counters[i].c.gemms;
+                res.flops += thread_counters[i].c.flops;
+                res.bytes += thread_counters[i].c.bytes;
+        }
+        return res;
+}
+
+static void reset_counts(struct timer * timer)
+{
+        timer->calls = 0;
+        timer->count = (struct perf_counters) { 0 };
+        timer->maxthreadflops = 0;
+        timer->threads = 0;
+}
 
 struct timers init_timers(const char **names, const int * keys, int n)
 {
@@ -34,7 +99,10 @@ struct timers init_timers(const char **names, const int * keys, int n)
 
                 tim.timers[i].t = 0;
                 tim.timers[i].ticed = false;
+                tim.timers[i].traced = false;
                 tim.timers[i].touched = false;
+                tim.timers[i].parent = -1;
+                reset_counts(&tim.timers[i]);
         }
         return tim;
 }
@@ -44,7 +112,7 @@ void destroy_timers(struct timers * tim)
         safe_free(tim->timers);
 }
 
-static int search_key(struct timers * tim, int key)
+static int search_key(const struct timers * tim, int key)
 {
         for (int i = 0; i < tim->n; ++i) {
                 if (tim->timers[i].key == key) { return i; }
@@ -65,9 +133,16 @@ int tic(struct timers * tim, int key)
                 return 1;
         }
 
-        gettimeofday(&tim->timers[id].tictime, NULL);
-        tim->timers[id].ticed = true;
-        tim->timers[id].touched = true;
+        struct timer * timer = &tim->timers[id];
+        timer->ticcount = get_perf_counters();
+        for (int i = 0; i < MAX_COUNTED_THREADS; ++i) {
+                timer->ticflops[i] = thread_counters[i].c.flops;
+        }
+        gettimeofday(&timer->tictime, NULL);
+        timer->ticed = true;
+        timer->touched = true;
+        timer->traced = trace_enabled();
+        trace_begin(timer->name, "timer", NULL);
 
         return 0;
 }
@@ -87,25 +162,80 @@ int toc(struct timers * tim, int key)
 
         struct timeval tv;
         gettimeofday(&tv, NULL);
+        // The trace could have been started in between.
+        if (tim->timers[id].traced) { trace_end(tim->timers[id].name, "timer"); }
         tim->timers[id].ticed = false;
         long long t_el = (tv.tv_sec - tim->timers[id].tictime.tv_sec) * 
                 1000000LL + tv.tv_usec - tim->timers[id].tictime.tv_usec;
         tim->timers[id].t += t_el * 1e-6;
+
+        struct timer * timer = &tim->timers[id];
+        const struct perf_counters now = get_perf_counters();
+        timer->count.gemms += now.gemms - timer->ticcount.gemms;
+        timer->count.flops += now.flops - timer->ticcount.flops;
+        timer->count.bytes += now.bytes - timer->ticcount.bytes;
+        ++timer->calls;
+
+        double maxflops = 0;
+        int threads = 0;
+        for (int i = 0; i < MAX_COUNTED_THREADS; ++i) {
+                const double flops = thread_counters[i].c.flops - 
+                        timer->ticflops[i];
+                if (flops > 0) { ++threads; }
+                if (flops > maxflops) { maxflops = flops; }
+        }
+        timer->maxthreadflops += maxflops;
+        if (threads > timer->threads) { timer->threads = threads; }
         return 0;
 }
 
-void print_timers(struct timers * tim, const char * prefix, bool onlytouched)
+// The fraction of the FLOPs that would have been done with perfect balance.
+static double balance(const struct timer * timer)
+{
+        if (timer->maxthreadflops == 0 || timer->threads == 0) { return 1; }
+        return timer->count.flops / (timer->threads * timer->maxthreadflops);
+}
+
+static bool is_child_of(const struct timers * tim, int i, int parent)
+{
+        const int pkey = tim->timers[i].parent;
+        if (parent == -1) { 
+                return pkey == -1 || search_key(tim, pkey) == -1;
+        }
+        return pkey == tim->timers[parent].key;
+}
+
+static void print_children(struct timers * tim, int parent, 
+                           const char * prefix, int depth, bool onlytouched)
 {
         for (int i = 0; i < tim->n; ++i) {
+                if (!is_child_of(tim, i, parent)) { continue; }
                 struct timer TimTim = tim->timers[i];
                 if (TimTim.ticed) {
                         fprintf(stderr, "Timer %s was ticed but not toced.\n",
                                 TimTim.name);
                 }
-                if (!onlytouched || TimTim.touched)
-                        printf("%s%-35s :: %.2lf sec\n",
-                               prefix, TimTim.name, TimTim.t);
+                if (onlytouched && !TimTim.touched) { 
+                        // Its children take its place.
+                        print_children(tim, i, prefix, depth, onlytouched);
+                        continue; 
+                }
+
+                printf("%s%*s%-*s :: %.2lf sec", prefix, 2 * depth, "", 
+                       35 - 2 * depth, TimTim.name, TimTim.t);
+                if (TimTim.count.flops > 0 && TimTim.t > 0) {
+                        printf("  (%.2f GFLOP/s, %.0f%% balance)", 
+                               TimTim.count.flops * 1e-9 / TimTim.t,
+                               100 * balance(&TimTim));
+                }
+                printf("\n");
+                print_children(tim, i, prefix, depth + 1, onlytouched);
         }
+}
+
+void print_timers(struct timers * tim, const char * prefix, bool onlytouched)
+{
+        print_children(tim, -1, prefix, 0, onlytouched);
         struct timeval tv;
         gettimeofday(&tv, NULL);
         long long t_el = (tv.tv_sec - tim->inittime.tv_sec) * 
@@ -127,8 +257,16 @@ int add_timers(struct timers * result, const struct timers * toadd)
                         fprintf(stderr, "The inputted timers are not the same for adding them.\n");
                         return 1;
                 }
-                result->timers[id].t += toadd->timers[i].t;
-                result->timers[id].touched = true;
+                struct timer * res = &result->timers[id];
+                const struct timer * add = &toadd->timers[i];
+                res->t += add->t;
+                res->touched = true;
+                res->calls += add->calls;
+                res->count.gemms += add->count.gemms;
+                res->count.flops += add->count.flops;
+                res->count.bytes += add->count.bytes;
+                res->maxthreadflops += add->maxthreadflops;
+                if (add->threads > res->threads) { res->threads = add->threads; }
         }
         return 0;
 }
@@ -138,5 +276,107 @@ void reset_timers(struct timers * tim)
         for (int i = 0; i < tim->n; ++i) {
                 tim->timers[i].ticed = false;
                 tim->timers[i].t = 0;
+                reset_counts(&tim->timers[i]);
+        }
+}
+
+int set_timer_parent(struct timers * tim, int key, int parent)
+{
+        const int id = search_key(tim, key);
+        if (id == -1 || search_key(tim, parent) == -1) {
+                fprintf(stderr, "Key %d or %d not found in timer.", key, parent);
+                return 1;
+        }
+        tim->timers[id].parent = parent;
+        return 0;
+}
+
+int set_timers_output(const char * filename)
+{
+        if (output != NULL) { fclose(output); }
+        output = NULL;
+        if (filename == NULL) { return 0; }
+
+        output = fopen(filename, "w");
+        if (output == NULL) {
+                fprintf(stderr, "Error: could not open %s for the timers.\n", 
+                        filename);
+                return 1;
+        }
+        const size_t len = strlen(filename);
+        output_csv = len >= 4 && strcmp(filename + len - 4, ".csv") == 0;
+        return 0;
+}
+
+static void write_csv_header(const char ** labels, int n)
+{
+        for (int i = 0; i < n; ++i) { fprintf(output, "%s,", labels[i]); }
+        fprintf(output, "timer,parent,seconds,calls,gemms,gflop,bytes,balance\n");
+}
+
+static void write_csv_rows(const struct timers * tim, const int * values, 
+                           int n)
+{
+        for (int i = 0; i < tim->n; ++i) {
+                const struct timer * timer = &tim->timers[i];
+                if (!timer->touched) { continue; }
+                const int pid = is_child_of(tim, i, -1) ? -1 : 
+                        search_key(tim, timer->parent);
+
+                for (int j = 0; j < n; ++j) { fprintf(output, "%d,", values[j]); }
+                fprintf(output, "\"%s\",\"%s\",%.6f,%lld,%lld,%.6f,%lld,%.4f\n",
+                        timer->name, pid == -1 ? "" : tim->timers[pid].name,
+                        timer->t, timer->calls, timer->count.gemms, 
+                        timer->count.flops * 1e-9, timer->count.bytes,
+                        balance(timer));
+        }
+}
+
+static void write_json_children(const struct timers * tim, int parent, 
+                                bool * first)
+{
+        for (int i = 0; i < tim->n; ++i) {
+                const struct timer * timer = &tim->timers[i];
+                if (!is_child_of(tim, i, parent)) { continue; }
+                if (!timer->touched) { 
+                        // Its children take its place.
+                        write_json_children(tim, i, first);
+                        continue; 
+                }
+
+                fprintf(output, "%s{\"name\":\"%s\",\"seconds\":%.6f,"
+                        "\"calls\":%lld,\"gemms\":%lld,\"gflop\":%.6f,"
+                        "\"bytes\":%lld,\"balance\":%.4f,\"children\":",
+                        *first ? "" : ",", timer->name, timer->t, timer->calls,
+                        timer->count.gemms, timer->count.flops * 1e-9,
+                        timer->count.bytes, balance(timer));
+                *first = false;
+                bool cfirst = true;
+                fprintf(output, "[");
+                write_json_children(tim, i, &cfirst);
+                fprintf(output, "]}");
+        }
+}
+
+void write_timers_record(const struct timers * tim, const char ** labels, 
+                         const int * values, int n)
+{
+        if (output == NULL) { return; }
+#pragma omp critical (timers_output)
+        {
+                if (output_csv) {
+                        if (ftell(output) == 0) { write_csv_header(labels, n); }
+                        write_csv_rows(tim, values, n);
+                } else {
+                        fprintf(output, "{");
+                        for (int i = 0; i < n; ++i) {
+                                fprintf(output, "\"%s\":%d,", labels[i], values[i]);
+                        }
+                        bool first = true;
+                        fprintf(output, "\"timers\":[");
+                        write_json_children(tim, -1, &first);
+                        fprintf(output, "]}\n");
+                }
+                fflush(output);
         }
 }
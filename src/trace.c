@@ -0,0 +1,94 @@
+/*
+    T3NS: an implementation of the Three-Legged Tree Tensor Network algorithm
+    Copyright (C) 2018-2019 Klaas Gunst <Klaas.Gunst@UGent.be>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <time.h>
+
+#include "trace.h"
+#include "timers.h"
+#include "distributed.h"
+
+static FILE * trace = NULL;
+static bool first_event = true;
+static struct timespec trace_start;
+
+int set_trace_output(const char * filename)
+{
+        if (trace != NULL) {
+                fprintf(trace, "\n]\n");
+                fclose(trace);
+                trace = NULL;
+        }
+        if (filename == NULL || get_rank() != 0) { return 0; }
+
+        trace = fopen(filename, "w");
+        if (trace == NULL) {
+                fprintf(stderr, "Error: could not open %s for the trace.\n",
+                        filename);
+                return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &trace_start);
+        first_event = true;
+        fprintf(trace, "[\n");
+        return 0;
+}
+
+bool trace_enabled(void) { return trace != NULL; }
+
+double trace_now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (ts.tv_sec - trace_start.tv_sec) * 1e6 +
+                (ts.tv_nsec - trace_start.tv_nsec) * 1e-3;
+}
+
+static void write_event(const char * name, const char * cat, char ph,
+                        double ts, double dur, const char * args)
+{
+        const int tid = get_thread_id();
+#pragma omp critical (trace_output)
+        {
+                fprintf(trace, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+                        "\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                        first_event ? "" : ",\n", name, cat, ph, ts,
+                        get_rank(), tid);
+                if (ph == 'X') { fprintf(trace, ",\"dur\":%.3f", dur); }
+                if (args != NULL) { fprintf(trace, ",\"args\":%s", args); }
+                fprintf(trace, "}");
+                first_event = false;
+        }
+}
+
+void trace_begin(const char * name, const char * cat, const char * args)
+{
+        if (trace == NULL) { return; }
+        write_event(name, cat, 'B', trace_now(), 0, args);
+}
+
+void trace_end(const char * name, const char * cat)
+{
+        if (trace == NULL) { return; }
+        write_event(name, cat, 'E', trace_now(), 0, NULL);
+}
+
+void trace_span(const char * name, double start, int items)
+{
+        if (trace == NULL) { return; }
+        char args[64];
+        snprintf(args, sizeof args, "{\"items\":%d}", items);
+        write_event(name, "omp", 'X', start, trace_now() - start, args);
+}